@@ -0,0 +1,70 @@
+#ifndef COURSEWORK_BATCH_EVALUATOR_H
+#define COURSEWORK_BATCH_EVALUATOR_H
+
+#include <stdlib.h>
+
+#include "program.h"
+#include "fast_math.h"
+#include "thread_pool.h"
+
+#define BATCH_CHUNK_ROWS 1024 // number of rows evaluated by one task.
+
+// a batch of rows to evaluate, shared read-only by every task except for each task's own range of results.
+typedef struct batch
+{
+    const program* program;
+    accuracy accuracy; // accuracy of the transcendental functions.
+    const double* rows; // slot values of each row, one row after another.
+    double* results; // results of each row, one row after another.
+    int row_count;
+} batch;
+
+// evaluates one chunk of rows, each task has its own registers so no state is shared between rows.
+void batch_evaluate_chunk(void* context, int task)
+{
+    batch* batch = context;
+    const program* program = batch->program;
+
+    int first = task * BATCH_CHUNK_ROWS;
+    int last = first + BATCH_CHUNK_ROWS;
+    if (last > batch->row_count)
+    {
+        last = batch->row_count;
+    }
+
+    double* registers = (double*)malloc(sizeof(double) * (program->length + 1));
+    for (int row = first; row < last; ++row)
+    {
+        program_run_accuracy(program,
+                             batch->accuracy,
+                             batch->rows + (size_t)row * program->slot_count,
+                             registers,
+                             batch->results + (size_t)row * program->output_count);
+    }
+    free(registers);
+}
+
+// evaluates the program for each row of slot values like batch_evaluate, with transcendental functions at the given
+// accuracy.
+void batch_evaluate_accuracy(thread_pool* pool, const program* program, accuracy accuracy, const double* rows,
+                             int row_count, double* results)
+{
+    batch batch;
+    batch.program = program;
+    batch.accuracy = accuracy;
+    batch.rows = rows;
+    batch.results = results;
+    batch.row_count = row_count;
+
+    int chunk_count = (row_count + BATCH_CHUNK_ROWS - 1) / BATCH_CHUNK_ROWS;
+    thread_pool_run(pool, batch_evaluate_chunk, &batch, chunk_count);
+}
+
+// evaluates the program for each row of slot values, splitting the rows into chunks run by the thread pool.
+// rows holds program->slot_count values per row and results receives program->output_count values per row.
+void batch_evaluate(thread_pool* pool, const program* program, const double* rows, int row_count, double* results)
+{
+    batch_evaluate_accuracy(pool, program, accuracy_exact, rows, row_count, results);
+}
+
+#endif //COURSEWORK_BATCH_EVALUATOR_H
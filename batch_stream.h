@@ -0,0 +1,602 @@
+#ifndef COURSEWORK_BATCH_STREAM_H
+#define COURSEWORK_BATCH_STREAM_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "expression.h"
+#include "tree_hash.h"
+#include "thread_pool.h"
+
+#define STREAM_BLOCK_ROWS 1024 // rows of bindings passed from one stage to the next at once.
+#define STREAM_BLOCK_COUNT 8 // blocks shared by the stages, the reader waits when every block is in use.
+#define STREAM_ERROR_SIZE 128 // longest error message of a block.
+#define STREAM_NUMBER_SIZE 32 // longest number written by the format stage, including its separator.
+#define STREAM_FORMAT_ROWS 128 // rows formatted by one task of the format stage.
+#define STREAM_FORMAT_TASKS (STREAM_BLOCK_ROWS / STREAM_FORMAT_ROWS)
+
+// a run of binding rows for one expression, passed from stage to stage.
+typedef struct stream_block
+{
+    const compiled_expression* expression; // NULL when the rows follow a line that isn't a valid expression.
+    int row_count;
+    double* slots; // expression->variable_count values for each row.
+    double* results; // expression->variable_count + 1 values for each row, filled in by the evaluate stage.
+    int slot_capacity;
+    int result_capacity;
+    char error[STREAM_ERROR_SIZE]; // message written after the rows, or empty.
+    char* text; // the rows formatted by the format stage, each task writes to its own part of the text.
+    size_t text_lengths[STREAM_FORMAT_TASKS]; // length of the part written by each task.
+    size_t text_capacity;
+} stream_block;
+
+// queue of blocks between two stages. there are only STREAM_BLOCK_COUNT blocks, so a push never waits.
+typedef struct block_queue
+{
+    pthread_mutex_t lock;
+    pthread_cond_t ready; // signalled when a block is pushed or the queue is closed.
+    stream_block* blocks[STREAM_BLOCK_COUNT];
+    int first;
+    int count;
+    bool closed; // set when the stage before the queue has no more blocks.
+} block_queue;
+
+// initialise an empty queue.
+void block_queue_init(block_queue* queue)
+{
+    pthread_mutex_init(&queue->lock, NULL);
+    pthread_cond_init(&queue->ready, NULL);
+    queue->first = 0;
+    queue->count = 0;
+    queue->closed = false;
+}
+
+// free the resources of the queue, but not its blocks.
+void block_queue_free(block_queue* queue)
+{
+    pthread_mutex_destroy(&queue->lock);
+    pthread_cond_destroy(&queue->ready);
+}
+
+// add a block to the end of the queue.
+void block_queue_push(block_queue* queue, stream_block* block)
+{
+    pthread_mutex_lock(&queue->lock);
+    queue->blocks[(queue->first + queue->count++) % STREAM_BLOCK_COUNT] = block;
+    pthread_cond_signal(&queue->ready);
+    pthread_mutex_unlock(&queue->lock);
+}
+
+// remove and return the block at the front of the queue, waiting for one to be pushed.
+// returns NULL once the queue is closed and empty.
+stream_block* block_queue_pop(block_queue* queue)
+{
+    stream_block* block = NULL;
+    pthread_mutex_lock(&queue->lock);
+    while (queue->count == 0 && queue->closed == false)
+    {
+        pthread_cond_wait(&queue->ready, &queue->lock);
+    }
+    if (queue->count > 0)
+    {
+        block = queue->blocks[queue->first];
+        queue->first = (queue->first + 1) % STREAM_BLOCK_COUNT;
+        --queue->count;
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return block;
+}
+
+// mark that no more blocks will be pushed, which wakes the stage waiting on the queue.
+void block_queue_close(block_queue* queue)
+{
+    pthread_mutex_lock(&queue->lock);
+    queue->closed = true;
+    pthread_cond_broadcast(&queue->ready);
+    pthread_mutex_unlock(&queue->lock);
+}
+
+// empty the block and make room for a full block of rows of the expression.
+void stream_block_start(stream_block* block, const compiled_expression* expression)
+{
+    block->expression = expression;
+    block->row_count = 0;
+    block->error[0] = '\0';
+
+    int variable_count = (expression != NULL) ? expression->variable_count : 0;
+    if (block->slot_capacity < STREAM_BLOCK_ROWS * variable_count)
+    {
+        block->slot_capacity = STREAM_BLOCK_ROWS * variable_count;
+        block->slots = (double*)realloc(block->slots, sizeof(double) * block->slot_capacity);
+    }
+    if (block->result_capacity < STREAM_BLOCK_ROWS * (variable_count + 1))
+    {
+        block->result_capacity = STREAM_BLOCK_ROWS * (variable_count + 1);
+        block->results = (double*)realloc(block->results, sizeof(double) * block->result_capacity);
+    }
+}
+
+// counters of one run of the stream.
+typedef struct batch_stream_stats
+{
+    long long lines; // lines read, not counting blank lines and comments.
+    long long expressions; // distinct expression strings, each of which is parsed once.
+    long long rows; // rows evaluated, a line with an expression without variables is one row.
+    long long errors; // lines that couldn't be evaluated.
+    long long bytes_read;
+    long long bytes_written;
+} batch_stream_stats;
+
+// the stages of one run and the queues between them.
+typedef struct batch_stream
+{
+    FILE* in;
+    FILE* out;
+    thread_pool* pool; // workers of the format stage.
+    stream_block blocks[STREAM_BLOCK_COUNT];
+    block_queue empty; // blocks the read stage can fill.
+    block_queue parsed; // blocks waiting for the evaluate stage.
+    block_queue evaluated; // blocks waiting for the format stage.
+    batch_stream_stats stats;
+} batch_stream;
+
+// an expression string and its compiled expression, NULL if the string isn't a valid expression.
+typedef struct stream_entry
+{
+    char* text;
+    uint64_t hash;
+    compiled_expression* expression;
+} stream_entry;
+
+// table of every distinct expression string read, owned by the read stage.
+// the compiled expressions are only freed once the other stages have finished with them.
+typedef struct stream_table
+{
+    stream_entry* entries; // open addressing with linear probing, text is NULL for an empty entry.
+    int count;
+    int capacity; // always a power of two.
+} stream_table;
+
+// initialise an empty table.
+void stream_table_init(stream_table* table)
+{
+    table->count = 0;
+    table->capacity = 64;
+    table->entries = (stream_entry*)calloc(table->capacity, sizeof(stream_entry));
+}
+
+// free memory for the table, each string and each compiled expression.
+void stream_table_free(stream_table* table)
+{
+    for (int i = 0; i < table->capacity; ++i)
+    {
+        if (table->entries[i].text != NULL)
+        {
+            free(table->entries[i].text);
+            compiled_expression_free(table->entries[i].expression);
+        }
+    }
+    free(table->entries);
+}
+
+// returns the entry of the string, or the empty entry where it belongs.
+stream_entry* stream_table_find(stream_entry* entries, int capacity, const char* text, uint64_t hash)
+{
+    int index = (int)(hash & (uint64_t)(capacity - 1));
+    while (entries[index].text != NULL && (entries[index].hash != hash || strcmp(entries[index].text, text) != 0))
+    {
+        index = (index + 1) & (capacity - 1);
+    }
+    return &entries[index];
+}
+
+// returns the compiled expression of the string, compiling it the first time the string is seen.
+// sets found to false the first time.
+compiled_expression* stream_table_compile(stream_table* table, const char* text, bool* found)
+{
+    uint64_t hash = text_hash(text);
+    stream_entry* entry = stream_table_find(table->entries, table->capacity, text, hash);
+    *found = entry->text != NULL;
+    if (*found)
+    {
+        return entry->expression;
+    }
+
+    entry->text = strdup(text);
+    entry->hash = hash;
+    entry->expression = compiled_expression_create(text);
+    ++table->count;
+
+    // keep the table at most half full, so probes stay short.
+    if (table->count * 2 > table->capacity)
+    {
+        compiled_expression* expression = entry->expression;
+        int capacity = table->capacity * 2;
+        stream_entry* entries = (stream_entry*)calloc(capacity, sizeof(stream_entry));
+        for (int i = 0; i < table->capacity; ++i)
+        {
+            if (table->entries[i].text != NULL)
+            {
+                *stream_table_find(entries, capacity, table->entries[i].text, table->entries[i].hash) = table->entries[i];
+            }
+        }
+        free(table->entries);
+        table->entries = entries;
+        table->capacity = capacity;
+        return expression;
+    }
+
+    return entry->expression;
+}
+
+// reads a line of numbers separated by whitespace or commas, storing at most capacity of them.
+// returns the number of numbers on the line, or -1 if the line has anything other than numbers.
+int stream_read_row(const char* text, double* values, int capacity)
+{
+    int count = 0;
+    const char* c = text;
+    while (true)
+    {
+        while (*c == ' ' || *c == '\t' || *c == ',')
+        {
+            ++c;
+        }
+        if (*c == '\0')
+        {
+            return count;
+        }
+
+        char* end;
+        double value = strtod(c, &end);
+        if (end == c || (*end != '\0' && *end != ' ' && *end != '\t' && *end != ','))
+        {
+            return -1; // not a number, or a number followed by more of an expression, as in 2+3.
+        }
+        if (count < capacity)
+        {
+            values[count] = value;
+        }
+        ++count;
+        c = end;
+    }
+}
+
+// removes trailing whitespace, including the line break, and returns the string after any leading whitespace.
+char* stream_trim(char* line, size_t length)
+{
+    while (length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r' || is_whitespace(line[length - 1])))
+    {
+        line[--length] = '\0';
+    }
+    while (is_whitespace(*line))
+    {
+        ++line;
+    }
+    return line;
+}
+
+// sends a block to the evaluate stage and returns an empty block for the same expression.
+stream_block* stream_block_send(batch_stream* stream, stream_block* block)
+{
+    const compiled_expression* expression = block->expression;
+    block_queue_push(&stream->parsed, block);
+    block = block_queue_pop(&stream->empty);
+    stream_block_start(block, expression);
+    return block;
+}
+
+// the read stage, which reads each line, compiles each distinct expression and groups rows into blocks.
+// a line of numbers is a row of bindings for the last expression, when that expression has variables. any other
+// line is an expression, which is evaluated once right away if it has no variables. blank lines and lines starting
+// with '#' are skipped.
+void batch_stream_read(batch_stream* stream)
+{
+    stream_table table;
+    stream_table_init(&table);
+
+    stream_block* block = block_queue_pop(&stream->empty);
+    stream_block_start(block, NULL);
+    bool has_expression = false; // has a line been read as an expression yet? it may not be a valid one.
+
+    char* line = NULL;
+    size_t size = 0;
+    ssize_t length;
+    long long line_number = 0;
+    while ((length = getline(&line, &size, stream->in)) >= 0)
+    {
+        ++line_number;
+        stream->stats.bytes_read += length;
+        char* text = stream_trim(line, (size_t)length);
+        if (*text == '\0' || *text == '#')
+        {
+            continue;
+        }
+        ++stream->stats.lines;
+
+        // a line of numbers is a row while the last expression has variables or couldn't be parsed.
+        const compiled_expression* expression = block->expression;
+        if (has_expression && (expression == NULL || expression->variable_count > 0))
+        {
+            int variable_count = (expression != NULL) ? expression->variable_count : 0;
+            int count = stream_read_row(text, block->slots + (size_t)block->row_count * variable_count, variable_count);
+            if (count >= 0)
+            {
+                if (expression == NULL)
+                {
+                    snprintf(block->error, STREAM_ERROR_SIZE, "error: line %lld: no valid expression for this row", line_number);
+                }
+                else if (count != variable_count)
+                {
+                    snprintf(block->error, STREAM_ERROR_SIZE, "error: line %lld: expected %d values but found %d",
+                             line_number, variable_count, count);
+                }
+                else if (++block->row_count == STREAM_BLOCK_ROWS)
+                {
+                    block = stream_block_send(stream, block);
+                }
+
+                if (block->error[0] != '\0')
+                {
+                    ++stream->stats.errors;
+                    block = stream_block_send(stream, block);
+                }
+                continue;
+            }
+        }
+
+        bool found;
+        compiled_expression* compiled = stream_table_compile(&table, text, &found);
+        stream->stats.expressions += found ? 0 : 1;
+        if (compiled != expression)
+        {
+            if (block->row_count > 0)
+            {
+                block = stream_block_send(stream, block);
+            }
+            stream_block_start(block, compiled);
+        }
+        has_expression = true;
+
+        if (compiled == NULL)
+        {
+            ++stream->stats.errors;
+            snprintf(block->error, STREAM_ERROR_SIZE, "error: line %lld: not a valid expression", line_number);
+            block = stream_block_send(stream, block);
+        }
+        else if (compiled->variable_count == 0 && ++block->row_count == STREAM_BLOCK_ROWS)
+        {
+            block = stream_block_send(stream, block); // an expression without variables is a row by itself.
+        }
+    }
+
+    free(line);
+    block_queue_push(&stream->parsed, block); // the last block may be empty, which is written as nothing.
+    block_queue_close(&stream->parsed);
+
+    // wait for the blocks to come back from the other stages before freeing the expressions they point to.
+    for (int i = 0; i < STREAM_BLOCK_COUNT; ++i)
+    {
+        block_queue_pop(&stream->empty);
+    }
+    stream_table_free(&table);
+}
+
+// the evaluate stage, which computes the value and each partial derivative of every row.
+void* batch_stream_evaluate_main(void* argument)
+{
+    batch_stream* stream = argument;
+    double* registers = NULL;
+    int register_capacity = 0;
+
+    stream_block* block;
+    while ((block = block_queue_pop(&stream->parsed)) != NULL)
+    {
+        const compiled_expression* expression = block->expression;
+        if (expression != NULL && block->row_count > 0)
+        {
+            const program* program = expression->program;
+            if (register_capacity < program->length + 1)
+            {
+                register_capacity = program->length + 1;
+                registers = (double*)realloc(registers, sizeof(double) * register_capacity);
+            }
+
+            for (int row = 0; row < block->row_count; ++row)
+            {
+                program_run(program,
+                            block->slots + (size_t)row * program->slot_count,
+                            registers,
+                            block->results + (size_t)row * program->output_count);
+            }
+        }
+
+        block_queue_push(&stream->evaluated, block);
+    }
+
+    block_queue_close(&stream->evaluated);
+    free(registers);
+    return NULL;
+}
+
+// the number of characters a row of the block can take.
+size_t stream_block_row_size(const stream_block* block)
+{
+    int output_count = (block->expression != NULL) ? block->expression->program->output_count : 0;
+    return (size_t)output_count * STREAM_NUMBER_SIZE + 1;
+}
+
+// formats one task's rows of the block as the value followed by the partial derivatives.
+// numbers are written with 17 significant digits, so they read back as the same doubles.
+void stream_block_format(void* context, int task)
+{
+    stream_block* block = context;
+    int output_count = (block->expression != NULL) ? block->expression->program->output_count : 0;
+    int first = task * STREAM_FORMAT_ROWS;
+    int last = first + STREAM_FORMAT_ROWS;
+    if (last > block->row_count)
+    {
+        last = block->row_count;
+    }
+
+    char* start = block->text + (size_t)first * stream_block_row_size(block);
+    char* text = start;
+    const double* results = block->results + (size_t)first * output_count;
+    for (int row = first; row < last; ++row)
+    {
+        for (int output = 0; output < output_count; ++output)
+        {
+            text += sprintf(text, (output == 0) ? "%.17g" : " %.17g", *results++);
+        }
+        *text++ = '\n';
+    }
+    block->text_lengths[task] = text - start;
+}
+
+// the format stage, which writes each row of a block and then the block's error.
+// formatting a number costs more than reading and evaluating it, so the rows are split between the workers of a pool.
+void* batch_stream_write_main(void* argument)
+{
+    batch_stream* stream = argument;
+
+    stream_block* block;
+    while ((block = block_queue_pop(&stream->evaluated)) != NULL)
+    {
+        size_t row_size = stream_block_row_size(block);
+        size_t needed = (size_t)block->row_count * row_size;
+        if (block->text_capacity < needed)
+        {
+            block->text_capacity = needed;
+            block->text = (char*)realloc(block->text, block->text_capacity);
+        }
+
+        int task_count = (block->row_count + STREAM_FORMAT_ROWS - 1) / STREAM_FORMAT_ROWS;
+        if (task_count > 1)
+        {
+            thread_pool_run(stream->pool, stream_block_format, block, task_count);
+        }
+        else if (task_count == 1)
+        {
+            stream_block_format(block, 0);
+        }
+
+        for (int task = 0; task < task_count; ++task)
+        {
+            fwrite(block->text + (size_t)task * STREAM_FORMAT_ROWS * row_size, 1, block->text_lengths[task], stream->out);
+            stream->stats.bytes_written += block->text_lengths[task];
+        }
+        if (block->error[0] != '\0')
+        {
+            stream->stats.bytes_written += fprintf(stream->out, "%s\n", block->error);
+        }
+
+        stream->stats.rows += block->row_count;
+        block_queue_push(&stream->empty, block);
+    }
+
+    fflush(stream->out);
+    return NULL;
+}
+
+// the number of workers for the pool of the format stage, so they and the read and evaluate stages fill the processors.
+int batch_format_threads()
+{
+    int count = processor_count() - 2;
+    return (count > 0) ? count : 1;
+}
+
+// evaluates a stream of expressions and rows of bindings from in, and writes a line of results for each row to out.
+// reading and compiling, evaluating, and formatting run as a pipeline on three threads, so each stage works on the
+// next block while the later stages work on earlier blocks. the output is in the same order as the input.
+// the format stage also runs on the workers of the pool.
+batch_stream_stats batch_stream_run(thread_pool* pool, FILE* in, FILE* out)
+{
+    batch_stream stream;
+    stream.in = in;
+    stream.out = out;
+    stream.pool = pool;
+    memset(&stream.stats, 0, sizeof(stream.stats));
+    block_queue_init(&stream.empty);
+    block_queue_init(&stream.parsed);
+    block_queue_init(&stream.evaluated);
+    for (int i = 0; i < STREAM_BLOCK_COUNT; ++i)
+    {
+        memset(&stream.blocks[i], 0, sizeof(stream_block));
+        block_queue_push(&stream.empty, &stream.blocks[i]);
+    }
+
+    pthread_t evaluate_thread;
+    pthread_t write_thread;
+    pthread_create(&evaluate_thread, NULL, batch_stream_evaluate_main, &stream);
+    pthread_create(&write_thread, NULL, batch_stream_write_main, &stream);
+    batch_stream_read(&stream);
+    pthread_join(evaluate_thread, NULL);
+    pthread_join(write_thread, NULL);
+
+    for (int i = 0; i < STREAM_BLOCK_COUNT; ++i)
+    {
+        free(stream.blocks[i].slots);
+        free(stream.blocks[i].results);
+        free(stream.blocks[i].text);
+    }
+    block_queue_free(&stream.empty);
+    block_queue_free(&stream.parsed);
+    block_queue_free(&stream.evaluated);
+    return stream.stats;
+}
+
+// generates a stream with a few expressions and row_count rows of bindings, runs it to /dev/null and prints the
+// line rate and the input and output bandwidth.
+void batch_stream_benchmark(thread_pool* pool, long long row_count)
+{
+    static const char* expressions[] =
+    {
+        "x * y + sin(x)",
+        "sin(x * y) / (1 + x ^ 2) * cos(y / z) + tan(x * z) * ln(x + y + z)",
+        "(x * y * z + sin(x) * cos(y)) ^ 3 / sqrt(x ^ 2 + y ^ 2 + z ^ 2)",
+        "sqrt(a ^ 2 + b ^ 2)"
+    };
+    int expression_count = sizeof(expressions) / sizeof(expressions[0]);
+
+    char* input = NULL;
+    size_t input_size = 0;
+    FILE* generator = open_memstream(&input, &input_size);
+    unsigned int seed = 1;
+    for (int e = 0; e < expression_count; ++e)
+    {
+        fprintf(generator, "%s\n", expressions[e]);
+        int variable_count = strchr(expressions[e], 'z') != NULL ? 3 : 2;
+        for (long long row = 0; row < row_count / expression_count; ++row)
+        {
+            for (int v = 0; v < variable_count; ++v)
+            {
+                seed = seed * 1103515245u + 12345u;
+                fprintf(generator, v == 0 ? "%.6f" : " %.6f", 0.5 + (seed >> 8) % 100000 / 10000.0);
+            }
+            fputc('\n', generator);
+        }
+    }
+    fclose(generator);
+
+    FILE* in = fmemopen(input, input_size, "r");
+    FILE* out = fopen("/dev/null", "w");
+    struct timespec start, stop;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    batch_stream_stats stats = batch_stream_run(pool, in, out);
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+    fclose(in);
+    fclose(out);
+    free(input);
+
+    double seconds = (stop.tv_sec - start.tv_sec) + (stop.tv_nsec - start.tv_nsec) * 1e-9;
+    printf("%lld lines, %lld rows, %lld expressions, %lld errors in %.3f s\n",
+           stats.lines, stats.rows, stats.expressions, stats.errors, seconds);
+    printf("%.0f lines/s, %.1f MB/s in, %.1f MB/s out\n",
+           stats.lines / seconds, stats.bytes_read / seconds / 1e6, stats.bytes_written / seconds / 1e6);
+}
+
+#endif //COURSEWORK_BATCH_STREAM_H
@@ -0,0 +1,308 @@
+#ifndef COURSEWORK_C_WRITER_H
+#define COURSEWORK_C_WRITER_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "tree.h"
+#include "tree_hash.h"
+
+// a subexpression that has already been written to a temporary.
+typedef struct c_subexpression
+{
+    tree_node* node; // the first tree node written for this subexpression, or NULL for an empty table entry.
+    uint64_t hash; // structural hash of the subexpression.
+    int temporary; // index of the temporary holding its value.
+} c_subexpression;
+
+// an operand in the generated code, either a temporary, a variable or a constant.
+typedef struct c_operand
+{
+    uint64_t hash; // structural hash of the subtree the operand computes.
+    char text[48]; // c expression for the operand.
+} c_operand;
+
+// writes expression trees as c statements, hoisting every repeated subexpression into one temporary.
+typedef struct c_writer
+{
+    FILE* out;
+    const char* symbols; // variable symbol bound to each slot.
+    int symbol_count;
+    bool use_slots; // read variables from a slots array instead of from parameters named after each variable.
+    c_subexpression* table; // open-addressed hash table of the subexpressions written so far.
+    int table_capacity; // always a power of two.
+    int table_count;
+    int temporary_count;
+} c_writer;
+
+// initialise a writer with an empty subexpression table.
+void c_writer_init(c_writer* writer, FILE* out, const char* symbols, int symbol_count, bool use_slots)
+{
+    writer->out = out;
+    writer->symbols = symbols;
+    writer->symbol_count = symbol_count;
+    writer->use_slots = use_slots;
+    writer->table_capacity = 64;
+    writer->table_count = 0;
+    writer->table = (c_subexpression*)calloc(writer->table_capacity, sizeof(c_subexpression));
+    writer->temporary_count = 0;
+}
+
+// free memory for the subexpression table.
+void c_writer_free(c_writer* writer)
+{
+    free(writer->table);
+    writer->table = NULL;
+}
+
+// returns the table entry for the subtree, which is empty if the subtree hasn't been written yet.
+c_subexpression* c_writer_find(c_writer* writer, tree_node* node, uint64_t hash)
+{
+    int mask = writer->table_capacity - 1;
+    for (int index = (int)(hash & mask); ; index = (index + 1) & mask)
+    {
+        c_subexpression* entry = &writer->table[index];
+        if (entry->node == NULL || (entry->hash == hash && tree_equal(entry->node, node)))
+        {
+            return entry;
+        }
+    }
+}
+
+// doubles the size of the subexpression table.
+void c_writer_grow(c_writer* writer)
+{
+    c_subexpression* old_table = writer->table;
+    int old_capacity = writer->table_capacity;
+
+    writer->table_capacity *= 2;
+    writer->table = (c_subexpression*)calloc(writer->table_capacity, sizeof(c_subexpression));
+    for (int i = 0; i < old_capacity; ++i)
+    {
+        if (old_table[i].node != NULL)
+        {
+            *c_writer_find(writer, old_table[i].node, old_table[i].hash) = old_table[i];
+        }
+    }
+
+    free(old_table);
+}
+
+// writes a double as a c literal that reads back as the same value.
+void c_write_constant(char* text, double value)
+{
+    if (isnan(value))
+    {
+        strcpy(text, "(0.0 / 0.0)");
+    }
+    else if (isinf(value))
+    {
+        strcpy(text, (value > 0) ? "(1.0 / 0.0)" : "(-1.0 / 0.0)");
+    }
+    else
+    {
+        sprintf(text, "%.17g", value);
+        if (strpbrk(text, ".e") == NULL)
+        {
+            strcat(text, ".0"); // make sure the literal is a double, so division is never integer division.
+        }
+        if (value < 0 || (value == 0 && signbit(value)))
+        {
+            // parenthesise negative literals, so they can follow a unary minus.
+            memmove(text + 1, text, strlen(text) + 1);
+            text[0] = '(';
+            strcat(text, ")");
+        }
+    }
+}
+
+// writes the operand for a leaf node.
+void c_write_leaf(c_writer* writer, tree_node* node, c_operand* operand)
+{
+    if (node->token.type == variable)
+    {
+        for (int slot = 0; slot < writer->symbol_count; ++slot)
+        {
+            if (writer->symbols[slot] == node->token.symbol)
+            {
+                if (writer->use_slots)
+                {
+                    sprintf(operand->text, "slots[%d]", slot);
+                }
+                else
+                {
+                    sprintf(operand->text, "%c", node->token.symbol);
+                }
+                return;
+            }
+        }
+    }
+
+    // constants, and variables without a slot which keep the value stored in their token.
+    c_write_constant(operand->text, node->token.value);
+}
+
+// traverses the expression tree and writes a statement for each subexpression that hasn't been written before.
+void c_write_node(c_writer* writer, tree_node* node, c_operand* operand)
+{
+    // post-order traverse the tree, so operands are written before the operators that use them.
+    c_operand left, right;
+    left.hash = 0;
+    right.hash = 0;
+
+    if (node->left_child != NULL)
+    {
+        c_write_node(writer, node->left_child, &left);
+    }
+    if (node->right_child != NULL)
+    {
+        c_write_node(writer, node->right_child, &right);
+    }
+
+    // this is the same hash as tree_hash, computed from the hashes of the children.
+    operand->hash = hash_combine(hash_combine(token_hash(node->token), left.hash), right.hash);
+
+    if (is_operand(node->token))
+    {
+        c_write_leaf(writer, node, operand);
+        return;
+    }
+
+    c_subexpression* entry = c_writer_find(writer, node, operand->hash);
+    if (entry->node == NULL)
+    {
+        // first time we have seen this subexpression, so compute it into a new temporary.
+        entry->node = node;
+        entry->hash = operand->hash;
+        entry->temporary = writer->temporary_count++;
+
+        fprintf(writer->out, "    const double t%d = ", entry->temporary);
+        switch (node->token.type)
+        {
+            case addition: fprintf(writer->out, "%s + %s", left.text, right.text); break;
+            case subtraction: fprintf(writer->out, "%s - %s", left.text, right.text); break;
+            case multiplication: fprintf(writer->out, "%s * %s", left.text, right.text); break;
+            case division: fprintf(writer->out, "%s / %s", left.text, right.text); break;
+            case power: fprintf(writer->out, "pow(%s, %s)", left.text, right.text); break;
+            case negation: fprintf(writer->out, "-%s", right.text); break;
+            case squareroot: fprintf(writer->out, "sqrt(%s)", left.text); break;
+            case log_10: fprintf(writer->out, "log10(%s)", left.text); break;
+            case log_e: fprintf(writer->out, "log(%s)", left.text); break;
+            case sine: fprintf(writer->out, "sin(%s)", left.text); break;
+            case cosine: fprintf(writer->out, "cos(%s)", left.text); break;
+            case tangent: fprintf(writer->out, "tan(%s)", left.text); break;
+            default: fprintf(writer->out, "0.0"); break; // not a valid token type.
+        }
+        fprintf(writer->out, ";\n");
+
+        if (2 * ++writer->table_count > writer->table_capacity)
+        {
+            c_writer_grow(writer);
+        }
+    }
+
+    sprintf(operand->text, "t%d", entry->temporary);
+}
+
+// writes the parameter list naming each variable.
+void c_write_parameters(FILE* out, const char* symbols, int symbol_count)
+{
+    fprintf(out, "(");
+    for (int i = 0; i < symbol_count; ++i)
+    {
+        fprintf(out, "%sdouble %c", (i > 0) ? ", " : "", symbols[i]);
+    }
+    fprintf(out, (symbol_count == 0) ? "void)" : ")");
+}
+
+// writes a (void) statement for each parameter that none of the trees reads, so a function of a partial derivative
+// that doesn't depend on every variable compiles without an unused parameter warning.
+void c_write_unused(FILE* out, tree_node** roots, int root_count, const char* symbols, int symbol_count)
+{
+    bool used[256] = { false };
+    node_stack order;
+    node_stack_init(&order);
+    for (int i = 0; i < root_count; ++i)
+    {
+        tree_postorder(roots[i], &order);
+    }
+    for (int i = 0; i < order.count; ++i)
+    {
+        if (order.nodes[i]->token.type == variable)
+        {
+            used[(unsigned char)order.nodes[i]->token.symbol] = true;
+        }
+    }
+    node_stack_free(&order);
+
+    for (int i = 0; i < symbol_count; ++i)
+    {
+        if (used[(unsigned char)symbols[i]] == false)
+        {
+            fprintf(out, "    (void)%c;\n", symbols[i]);
+        }
+    }
+}
+
+// writes a function that takes each variable as a parameter and returns the value of the expression tree.
+void c_write_function(FILE* out, const char* qualifiers, const char* name, tree_node* root, const char* symbols, int symbol_count)
+{
+    fprintf(out, "%sdouble %s", qualifiers, name);
+    c_write_parameters(out, symbols, symbol_count);
+    fprintf(out, "\n{\n");
+    c_write_unused(out, &root, 1, symbols, symbol_count);
+
+    c_writer writer;
+    c_writer_init(&writer, out, symbols, symbol_count, false);
+    c_operand result;
+    c_write_node(&writer, root, &result);
+    c_writer_free(&writer);
+
+    fprintf(out, "    return %s;\n}\n", result.text);
+}
+
+// writes a statement for each tree that stores its value in the results array. subexpressions shared between the
+// trees are only computed once.
+void c_write_results(FILE* out, tree_node** roots, int root_count, const char* symbols, int symbol_count, bool use_slots)
+{
+    c_writer writer;
+    c_writer_init(&writer, out, symbols, symbol_count, use_slots);
+    for (int i = 0; i < root_count; ++i)
+    {
+        c_operand result;
+        c_write_node(&writer, roots[i], &result);
+        fprintf(out, "    results[%d] = %s;\n", i, result.text);
+    }
+    c_writer_free(&writer);
+}
+
+// writes a function that reads the variables from a slots array and writes the value of each tree to a results array.
+// subexpressions shared between the trees are only computed once.
+void c_write_program_function(FILE* out, const char* qualifiers, const char* name, tree_node** roots, int root_count,
+                              const char* symbols, int symbol_count)
+{
+    fprintf(out, "%svoid %s(const double* slots, double* results)\n{\n", qualifiers, name);
+    c_write_results(out, roots, root_count, symbols, symbol_count, true);
+    fprintf(out, "}\n");
+}
+
+// writes a function that takes each variable as a parameter, followed by a results array, and writes the value of
+// each tree to the results array. subexpressions shared between the trees are only computed once.
+void c_write_results_function(FILE* out, const char* qualifiers, const char* name, tree_node** roots, int root_count,
+                              const char* symbols, int symbol_count)
+{
+    fprintf(out, "%svoid %s(", qualifiers, name);
+    for (int i = 0; i < symbol_count; ++i)
+    {
+        fprintf(out, "double %c, ", symbols[i]);
+    }
+    fprintf(out, "double* results)\n{\n");
+    c_write_unused(out, roots, root_count, symbols, symbol_count);
+    c_write_results(out, roots, root_count, symbols, symbol_count, false);
+    fprintf(out, "}\n");
+}
+
+#endif //COURSEWORK_C_WRITER_H
@@ -0,0 +1,86 @@
+#ifndef COURSEWORK_CACHE_BENCHMARK_H
+#define COURSEWORK_CACHE_BENCHMARK_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "expression_cache.h"
+#include "image_benchmark.h"
+
+// looks up each string in the cache, releasing it straight away, and prints the time per lookup and what the lookups
+// of this phase added to the hit counters. stores the entry each string found in entries, or checks that it is the
+// entry already there when check is true. returns the number of strings that found a different entry.
+int cache_benchmark_phase(expression_cache* cache, const char* name, char** texts, int count, cache_entry** entries,
+                          bool check)
+{
+    expression_cache_stats before = expression_cache_get_stats(cache);
+    int failures = 0;
+    double start = parse_benchmark_seconds();
+    for (int i = 0; i < count; ++i)
+    {
+        cache_entry* entry = expression_cache_acquire(cache, texts[i]);
+        if (check)
+        {
+            failures += (entry == entries[i]) ? 0 : 1;
+        }
+        else
+        {
+            entries[i] = entry;
+        }
+        if (entry != NULL)
+        {
+            expression_cache_release(cache, entry);
+        }
+    }
+    double seconds = parse_benchmark_seconds() - start;
+
+    expression_cache_stats after = expression_cache_get_stats(cache);
+    printf("%-20s%12.2f%14lld%16lld%14lld\n", name, seconds * 1e6 / count, after.text_hits - before.text_hits,
+           after.structure_hits - before.structure_hits, after.compilations - before.compilations);
+    return failures;
+}
+
+// measures the two levels of the expression cache with the given number of generated formulas. each formula is
+// looked up first as it is written, which compiles it, then spelled differently inside parentheses with spaces, which
+// the string level misses and the structure level finds, then as it was first written again, which the string level
+// finds. the cache holds every string, so nothing is evicted.
+// returns the number of lookups that found a different entry from the first spelling of their formula.
+int cache_benchmark(int count)
+{
+    char** texts = (char**)malloc(sizeof(char*) * count);
+    char** spellings = (char**)malloc(sizeof(char*) * count);
+    cache_entry** entries = (cache_entry**)malloc(sizeof(cache_entry*) * count);
+    for (int i = 0; i < count; ++i)
+    {
+        char buffer[512];
+        image_benchmark_formula(buffer, sizeof(buffer), i);
+        texts[i] = strdup(buffer);
+        char spelling[1024];
+        snprintf(spelling, sizeof(spelling), "(  %s  )", buffer);
+        spellings[i] = strdup(spelling);
+    }
+
+    expression_cache cache;
+    expression_cache_init(&cache, 2 * count);
+    printf("%-20s%12s%14s%16s%14s\n", "lookup", "us/lookup", "string hits", "structure hits", "compilations");
+    int failures = cache_benchmark_phase(&cache, "first spelling", texts, count, entries, false);
+    failures += cache_benchmark_phase(&cache, "second spelling", spellings, count, entries, true);
+    failures += cache_benchmark_phase(&cache, "first again", texts, count, entries, true);
+
+    expression_cache_stats stats = expression_cache_get_stats(&cache);
+    expression_cache_print_stats(&stats, stdout);
+    expression_cache_free(&cache);
+
+    for (int i = 0; i < count; ++i)
+    {
+        free(texts[i]);
+        free(spellings[i]);
+    }
+    free(texts);
+    free(spellings);
+    free(entries);
+    return failures;
+}
+
+#endif //COURSEWORK_CACHE_BENCHMARK_H
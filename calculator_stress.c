@@ -0,0 +1,205 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "expression_calculator.h"
+
+// a stress test of the calculator library, built as its own program so it only sees the library interface.
+// reader threads evaluate named expressions while a writer keeps replacing them with new versions, once through a
+// registry that readers use without a lock and once through a table behind a read-write lock. version k of each
+// expression is x * k + k, so at x = 2 its value is three times its derivative, and a reader must never see a
+// version older than one it has already seen.
+
+#define STRESS_NAMES 16 // names the readers cycle through.
+#define STRESS_MAX_READERS 64
+
+// the state shared by the readers and the writer of one run.
+typedef struct stress_run
+{
+    bool locked; // read through the read-write lock rather than the registry.
+    calculator_registry* registry;
+    calculator_expression* table[STRESS_NAMES]; // the expressions of the locked run.
+    pthread_rwlock_t table_lock;
+    char names[STRESS_NAMES][16];
+    calculator_name* handles[STRESS_NAMES]; // the names in the registry.
+    int stop; // set atomically when the run is over.
+    long long versions[STRESS_NAMES]; // the newest version published under each name, updated atomically.
+    long long publications;
+    int most_retired; // the most replaced expressions waiting to be freed at once.
+    int pause_us; // time the writer waits between publications.
+} stress_run;
+
+// one reader thread and its counters.
+typedef struct stress_reader
+{
+    stress_run* run;
+    pthread_t thread;
+    long long evaluations;
+    long long failures; // evaluations with wrong results or a version older than one seen before.
+} stress_reader;
+
+// returns the time in seconds from a monotonic clock.
+double stress_seconds()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+// compiles version k of an expression.
+calculator_expression* stress_version(long long k)
+{
+    char text[64];
+    char error[CALCULATOR_ERROR_SIZE];
+    snprintf(text, sizeof(text), "x * %lld + %lld", k, k);
+    calculator_expression* expression = calculator_compile(text, error);
+    if (expression == NULL)
+    {
+        fprintf(stderr, "%s\n", error);
+        exit(1);
+    }
+    return expression;
+}
+
+void* stress_reader_main(void* argument)
+{
+    stress_reader* reader = argument;
+    stress_run* run = reader->run;
+    calculator_context* context = calculator_context_create(run->locked ? NULL : run->registry);
+    long long seen[STRESS_NAMES] = { 0 };
+    double x = 2;
+    double results[2];
+    for (int i = 0; __atomic_load_n(&run->stop, __ATOMIC_RELAXED) == 0; i = (i + 1) % STRESS_NAMES)
+    {
+        if (run->locked)
+        {
+            pthread_rwlock_rdlock(&run->table_lock);
+            calculator_evaluate(context, run->table[i], &x, results);
+            pthread_rwlock_unlock(&run->table_lock);
+        }
+        else
+        {
+            calculator_evaluate_named(context, run->handles[i], &x, results);
+        }
+
+        long long k = (long long)results[1];
+        if (results[0] != 3 * results[1] || k < seen[i] || k > __atomic_load_n(&run->versions[i], __ATOMIC_ACQUIRE))
+        {
+            ++reader->failures;
+        }
+        seen[i] = k;
+        ++reader->evaluations;
+    }
+    calculator_context_free(context);
+    return NULL;
+}
+
+// replaces the expressions one name at a time until the run is over.
+void* stress_writer_main(void* argument)
+{
+    stress_run* run = argument;
+    for (int i = 0; __atomic_load_n(&run->stop, __ATOMIC_RELAXED) == 0; i = (i + 1) % STRESS_NAMES)
+    {
+        long long k = run->versions[i] + 1;
+        calculator_expression* expression = stress_version(k);
+        __atomic_store_n(&run->versions[i], k, __ATOMIC_RELEASE); // no reader can see it before it is published.
+        if (run->locked)
+        {
+            pthread_rwlock_wrlock(&run->table_lock);
+            calculator_expression* old = run->table[i];
+            run->table[i] = expression;
+            pthread_rwlock_unlock(&run->table_lock);
+            calculator_expression_free(old);
+        }
+        else
+        {
+            calculator_registry_publish(run->registry, run->names[i], expression);
+            int retired = calculator_registry_retired(run->registry);
+            run->most_retired = (retired > run->most_retired) ? retired : run->most_retired;
+        }
+        ++run->publications;
+
+        if (run->pause_us > 0)
+        {
+            struct timespec pause = { 0, run->pause_us * 1000L };
+            nanosleep(&pause, NULL);
+        }
+    }
+    return NULL;
+}
+
+// runs reader_count readers and a writer for the given time, prints their rates and returns the failed evaluations.
+long long stress(bool locked, int reader_count, double seconds, int pause_us)
+{
+    stress_run run;
+    memset(&run, 0, sizeof(run));
+    run.locked = locked;
+    run.pause_us = pause_us;
+    run.registry = calculator_registry_create();
+    pthread_rwlock_init(&run.table_lock, NULL);
+    for (int i = 0; i < STRESS_NAMES; ++i)
+    {
+        snprintf(run.names[i], sizeof(run.names[i]), "price%d", i);
+        run.versions[i] = 1;
+        run.table[i] = stress_version(1);
+        calculator_registry_publish(run.registry, run.names[i], stress_version(1));
+        run.handles[i] = calculator_registry_name(run.registry, run.names[i]);
+    }
+
+    stress_reader readers[STRESS_MAX_READERS];
+    pthread_t writer;
+    double start = stress_seconds();
+    for (int i = 0; i < reader_count; ++i)
+    {
+        readers[i].run = &run;
+        readers[i].evaluations = 0;
+        readers[i].failures = 0;
+        pthread_create(&readers[i].thread, NULL, stress_reader_main, &readers[i]);
+    }
+    pthread_create(&writer, NULL, stress_writer_main, &run);
+
+    struct timespec length = { (time_t)seconds, (long)((seconds - (time_t)seconds) * 1e9) };
+    nanosleep(&length, NULL);
+    __atomic_store_n(&run.stop, 1, __ATOMIC_RELAXED);
+    long long evaluations = 0;
+    long long failures = 0;
+    for (int i = 0; i < reader_count; ++i)
+    {
+        pthread_join(readers[i].thread, NULL);
+        evaluations += readers[i].evaluations;
+        failures += readers[i].failures;
+    }
+    pthread_join(writer, NULL);
+    double elapsed = stress_seconds() - start;
+
+    printf("%-10s%9d%16.0f%16.0f%10d%10lld\n", locked ? "rwlock" : "epoch", reader_count, evaluations / elapsed,
+           run.publications / elapsed, run.most_retired, failures);
+
+    for (int i = 0; i < STRESS_NAMES; ++i)
+    {
+        calculator_expression_free(run.table[i]);
+    }
+    pthread_rwlock_destroy(&run.table_lock);
+    calculator_registry_free(run.registry);
+    return failures;
+}
+
+int main(int argc, char** argv)
+{
+    int most_readers = (argc > 1) ? atoi(argv[1]) : 8;
+    double seconds = (argc > 2) ? atof(argv[2]) : 1;
+    int pause_us = (argc > 3) ? atoi(argv[3]) : 100;
+    most_readers = (most_readers < STRESS_MAX_READERS) ? most_readers : STRESS_MAX_READERS;
+
+    printf("%-10s%9s%16s%16s%10s%10s\n", "registry", "readers", "evaluations/s", "publications/s", "retired", "failures");
+    long long failures = 0;
+    for (int readers = 1; readers <= most_readers; readers *= 2)
+    {
+        failures += stress(false, readers, seconds, pause_us);
+        failures += stress(true, readers, seconds, pause_us);
+    }
+    printf("%lld evaluations failed\n", failures);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,330 @@
+#ifndef COURSEWORK_CHEBYSHEV_H
+#define COURSEWORK_CHEBYSHEV_H
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <math.h>
+
+#include "program.h"
+
+// node of the tree of boxes a surrogate is split into.
+// a leaf holds a tensor-product chebyshev series over its box, any other node is split in half along one dimension.
+typedef struct chebyshev_piece
+{
+    double* lower; // lower corner of the box.
+    double* upper; // upper corner of the box.
+    double* coefficients; // (degree + 1) ^ dimension_count coefficients for a leaf, NULL otherwise.
+    int split_dimension; // dimension the box is split along, or -1 for a leaf.
+    int children[2]; // indices of the lower and upper halves.
+    double error; // largest error found when checking a leaf against the program.
+} chebyshev_piece;
+
+// a piecewise chebyshev approximation of one output of a program over a box of its slots.
+typedef struct chebyshev_surrogate
+{
+    int dimension_count; // number of slots of the program.
+    int degree; // degree of the series in each dimension.
+    chebyshev_piece* pieces; // the root piece is at index 0.
+    int piece_count;
+    int capacity;
+    int leaf_count;
+    double max_error; // largest error found over every leaf, an estimate from sampling rather than a proof.
+} chebyshev_surrogate;
+
+// returns the index of a new piece covering a box.
+int chebyshev_add_piece(chebyshev_surrogate* surrogate, const double* lower, const double* upper)
+{
+    if (surrogate->piece_count == surrogate->capacity)
+    {
+        surrogate->capacity = (surrogate->capacity == 0) ? 16 : surrogate->capacity * 2;
+        surrogate->pieces = (chebyshev_piece*)realloc(surrogate->pieces, sizeof(chebyshev_piece) * surrogate->capacity);
+    }
+
+    chebyshev_piece* piece = &surrogate->pieces[surrogate->piece_count];
+    piece->lower = (double*)malloc(sizeof(double) * (surrogate->dimension_count + 1));
+    piece->upper = (double*)malloc(sizeof(double) * (surrogate->dimension_count + 1));
+    for (int d = 0; d < surrogate->dimension_count; ++d)
+    {
+        piece->lower[d] = lower[d];
+        piece->upper[d] = upper[d];
+    }
+    piece->coefficients = NULL;
+    piece->split_dimension = -1;
+    piece->children[0] = -1;
+    piece->children[1] = -1;
+    piece->error = 0;
+
+    return surrogate->piece_count++;
+}
+
+// free memory for the surrogate and each of its pieces.
+void chebyshev_free(chebyshev_surrogate* surrogate)
+{
+    if (surrogate != NULL)
+    {
+        for (int i = 0; i < surrogate->piece_count; ++i)
+        {
+            free(surrogate->pieces[i].lower);
+            free(surrogate->pieces[i].upper);
+            free(surrogate->pieces[i].coefficients);
+        }
+
+        free(surrogate->pieces);
+        free(surrogate);
+    }
+}
+
+// returns the number of points or coefficients in a tensor grid of degree + 1 values per dimension.
+int chebyshev_grid_size(const chebyshev_surrogate* surrogate)
+{
+    int size = 1;
+    for (int d = 0; d < surrogate->dimension_count; ++d)
+    {
+        size *= surrogate->degree + 1;
+    }
+
+    return size;
+}
+
+// evaluates the chebyshev polynomials T_0 to T_degree at t.
+void chebyshev_polynomials(double t, int degree, double* values)
+{
+    values[0] = 1;
+    if (degree >= 1)
+    {
+        values[1] = t;
+    }
+    for (int k = 2; k <= degree; ++k)
+    {
+        values[k] = 2 * t * values[k - 1] - values[k - 2];
+    }
+}
+
+// evaluates the series of a leaf at a point, contracting one dimension at a time. the first contraction reads the
+// coefficients in place, so buffer only holds the partial sums, (degree + 1) ^ (dimension_count - 1) values.
+double chebyshev_evaluate_piece(const chebyshev_surrogate* surrogate, const chebyshev_piece* piece, const double* point,
+                                double* polynomials, double* buffer)
+{
+    int n = surrogate->degree + 1;
+    int size = chebyshev_grid_size(surrogate);
+    const double* source = piece->coefficients;
+    if (surrogate->dimension_count == 0)
+    {
+        return source[0];
+    }
+
+    // the last dimension varies fastest, so contract from the last dimension to the first.
+    for (int d = surrogate->dimension_count - 1; d >= 0; --d)
+    {
+        double width = piece->upper[d] - piece->lower[d];
+        double t = (width > 0) ? (2 * point[d] - piece->lower[d] - piece->upper[d]) / width : 0;
+        chebyshev_polynomials(t, surrogate->degree, polynomials);
+
+        size /= n;
+        for (int i = 0; i < size; ++i)
+        {
+            // sum the series in this dimension from the highest degree down, adding the small terms first.
+            double sum = 0;
+            for (int k = n - 1; k >= 0; --k)
+            {
+                sum += source[i * n + k] * polynomials[k];
+            }
+            buffer[i] = sum;
+        }
+        source = buffer;
+    }
+
+    return buffer[0];
+}
+
+// fits the series of a leaf by sampling the program at the chebyshev points of its box.
+void chebyshev_fit_piece(chebyshev_surrogate* surrogate, chebyshev_piece* piece, const program* program, int output,
+                         double* registers, double* results)
+{
+    int n = surrogate->degree + 1;
+    int dimensions = surrogate->dimension_count;
+    int size = chebyshev_grid_size(surrogate);
+    double* values = (double*)malloc(sizeof(double) * size);
+    double* next = (double*)malloc(sizeof(double) * size);
+    double* slots = (double*)malloc(sizeof(double) * (dimensions + 1));
+
+    // sample the program at each point of the tensor grid of chebyshev points.
+    for (int i = 0; i < size; ++i)
+    {
+        int index = i;
+        for (int d = dimensions - 1; d >= 0; --d)
+        {
+            double t = cos(M_PI * (index % n + 0.5) / n);
+            slots[d] = piece->lower[d] + (t + 1) * (piece->upper[d] - piece->lower[d]) / 2;
+            index /= n;
+        }
+
+        program_run(program, slots, registers, results);
+        values[i] = results[output];
+    }
+
+    // apply the discrete chebyshev transform along each dimension in turn.
+    int stride = 1;
+    for (int d = dimensions - 1; d >= 0; --d)
+    {
+        for (int i = 0; i < size; ++i)
+        {
+            int k = (i / stride) % n; // the degree this entry holds along dimension d.
+            int base = i - k * stride;
+            double sum = 0;
+            for (int j = 0; j < n; ++j)
+            {
+                sum += values[base + j * stride] * cos(M_PI * k * (j + 0.5) / n);
+            }
+            next[i] = sum * ((k == 0) ? 1.0 : 2.0) / n;
+        }
+
+        double* swap = values;
+        values = next;
+        next = swap;
+        stride *= n;
+    }
+
+    piece->coefficients = values;
+    free(next);
+    free(slots);
+}
+
+// checks a leaf against the program on a grid that includes the corners of its box and points between the chebyshev points.
+double chebyshev_check_piece(chebyshev_surrogate* surrogate, chebyshev_piece* piece, const program* program, int output,
+                             double* registers, double* results, double* polynomials, double* buffer)
+{
+    int m = surrogate->degree + 2;
+    int dimensions = surrogate->dimension_count;
+    int size = 1;
+    for (int d = 0; d < dimensions; ++d)
+    {
+        size *= m;
+    }
+
+    double* point = (double*)malloc(sizeof(double) * (dimensions + 1));
+    double error = 0;
+    for (int i = 0; i < size; ++i)
+    {
+        int index = i;
+        for (int d = dimensions - 1; d >= 0; --d)
+        {
+            point[d] = piece->lower[d] + (piece->upper[d] - piece->lower[d]) * (index % m) / (m - 1);
+            index /= m;
+        }
+
+        program_run(program, point, registers, results);
+        double difference = fabs(results[output] - chebyshev_evaluate_piece(surrogate, piece, point, polynomials, buffer));
+        if (isnan(difference) || difference > error)
+        {
+            error = isnan(difference) ? INFINITY : difference; // an undefined value can't be approximated.
+        }
+    }
+
+    free(point);
+    return error;
+}
+
+// fits a piece, splitting it in half along its widest dimension while its error is above the tolerance.
+void chebyshev_fit_recursive(chebyshev_surrogate* surrogate, int index, const program* program, int output, double tolerance,
+                             int depth, double* registers, double* results, double* polynomials, double* buffer)
+{
+    chebyshev_piece* piece = &surrogate->pieces[index];
+    chebyshev_fit_piece(surrogate, piece, program, output, registers, results);
+    double error = chebyshev_check_piece(surrogate, piece, program, output, registers, results, polynomials, buffer);
+
+    if (error <= tolerance || depth <= 0)
+    {
+        piece->error = error;
+        surrogate->leaf_count++;
+        if (error > surrogate->max_error)
+        {
+            surrogate->max_error = error;
+        }
+        return;
+    }
+
+    // split along the widest dimension and fit each half.
+    int widest = 0;
+    for (int d = 1; d < surrogate->dimension_count; ++d)
+    {
+        if (piece->upper[d] - piece->lower[d] > piece->upper[widest] - piece->lower[widest])
+        {
+            widest = d;
+        }
+    }
+
+    double* lower = (double*)malloc(sizeof(double) * (surrogate->dimension_count + 1));
+    double* upper = (double*)malloc(sizeof(double) * (surrogate->dimension_count + 1));
+    for (int d = 0; d < surrogate->dimension_count; ++d)
+    {
+        lower[d] = piece->lower[d];
+        upper[d] = piece->upper[d];
+    }
+    double middle = lower[widest] + (upper[widest] - lower[widest]) / 2;
+
+    free(piece->coefficients);
+    piece->coefficients = NULL;
+    piece->split_dimension = widest;
+
+    upper[widest] = middle;
+    int lower_half = chebyshev_add_piece(surrogate, lower, upper); // adding pieces may move the pieces array.
+    upper[widest] = surrogate->pieces[index].upper[widest];
+    lower[widest] = middle;
+    int upper_half = chebyshev_add_piece(surrogate, lower, upper);
+    surrogate->pieces[index].children[0] = lower_half;
+    surrogate->pieces[index].children[1] = upper_half;
+    free(lower);
+    free(upper);
+
+    chebyshev_fit_recursive(surrogate, lower_half, program, output, tolerance, depth - 1, registers, results, polynomials, buffer);
+    chebyshev_fit_recursive(surrogate, upper_half, program, output, tolerance, depth - 1, registers, results, polynomials, buffer);
+}
+
+// fits a piecewise chebyshev surrogate for one output of the program over a box of its slots.
+// boxes are halved until each piece is within the tolerance of the program, or max_depth halvings have been made.
+// max_error reports the largest error found, which may be above the tolerance if max_depth was reached.
+chebyshev_surrogate* chebyshev_fit(const program* program, int output, const double* lower, const double* upper,
+                                   int degree, double tolerance, int max_depth)
+{
+    chebyshev_surrogate* surrogate = (chebyshev_surrogate*)malloc(sizeof(chebyshev_surrogate));
+    surrogate->dimension_count = program->slot_count;
+    surrogate->degree = degree;
+    surrogate->pieces = NULL;
+    surrogate->piece_count = 0;
+    surrogate->capacity = 0;
+    surrogate->leaf_count = 0;
+    surrogate->max_error = 0;
+
+    int size = chebyshev_grid_size(surrogate);
+    double* registers = (double*)malloc(sizeof(double) * (program->length + 1));
+    double* results = (double*)malloc(sizeof(double) * (program->output_count + 1));
+    double* polynomials = (double*)malloc(sizeof(double) * (degree + 1));
+    double* buffer = (double*)malloc(sizeof(double) * size);
+
+    chebyshev_add_piece(surrogate, lower, upper);
+    chebyshev_fit_recursive(surrogate, 0, program, output, tolerance, max_depth, registers, results, polynomials, buffer);
+
+    free(registers);
+    free(results);
+    free(polynomials);
+    free(buffer);
+    return surrogate;
+}
+
+// evaluates the surrogate at a point, points outside the domain are extrapolated from the nearest piece.
+// polynomials must have room for degree + 1 values and buffer for (degree + 1) ^ (dimension_count - 1) values.
+double chebyshev_evaluate(const chebyshev_surrogate* surrogate, const double* point, double* polynomials, double* buffer)
+{
+    const chebyshev_piece* piece = &surrogate->pieces[0];
+    while (piece->split_dimension >= 0)
+    {
+        int d = piece->split_dimension;
+        const chebyshev_piece* lower_half = &surrogate->pieces[piece->children[0]];
+        piece = (point[d] < lower_half->upper[d]) ? lower_half : &surrogate->pieces[piece->children[1]];
+    }
+
+    return chebyshev_evaluate_piece(surrogate, piece, point, polynomials, buffer);
+}
+
+#endif //COURSEWORK_CHEBYSHEV_H
@@ -0,0 +1,200 @@
+#ifndef COURSEWORK_COLUMN_EVALUATOR_H
+#define COURSEWORK_COLUMN_EVALUATOR_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "expression.h"
+#include "column_file.h"
+#include "thread_pool.h"
+#include "float_evaluator.h"
+
+#define COLUMN_CHUNK_ROWS 4096 // number of rows evaluated by one task.
+#define COLUMN_FLOAT_BLOCK_ROWS (1 << 18) // rows converted to single precision at a time.
+#define COLUMN_FLOAT_TOLERANCE 1e-4 // largest estimated relative error of single precision evaluation that isn't warned.
+
+// the precision a column file is evaluated in. its columns hold doubles either way.
+typedef enum column_precision
+{
+    column_double,
+    column_float, // rows and results in single precision, evaluated by batch_evaluate_float.
+    column_mixed // like column_float, with additions and subtractions accumulated in double precision.
+} column_precision;
+
+// the columns of a column evaluation, shared read-only by every task except for each task's own range of rows.
+typedef struct column_batch
+{
+    const program* program;
+    const double** inputs; // the input column of each slot.
+    double** outputs; // the output column of each output of the program.
+    long long row_count;
+} column_batch;
+
+// evaluates one chunk of rows, gathering each row's slots from the input columns and scattering its results to the
+// output columns.
+void column_evaluate_chunk(void* context, int task)
+{
+    column_batch* batch = context;
+    const program* program = batch->program;
+
+    long long first = (long long)task * COLUMN_CHUNK_ROWS;
+    long long last = first + COLUMN_CHUNK_ROWS;
+    if (last > batch->row_count)
+    {
+        last = batch->row_count;
+    }
+
+    double* registers = (double*)malloc(sizeof(double) * (program->length + 1));
+    double* slots = (double*)malloc(sizeof(double) * (program->slot_count + 1));
+    double* results = (double*)malloc(sizeof(double) * program->output_count);
+    for (long long row = first; row < last; ++row)
+    {
+        for (int slot = 0; slot < program->slot_count; ++slot)
+        {
+            slots[slot] = batch->inputs[slot][row];
+        }
+        program_run(program, slots, registers, results);
+        for (int output = 0; output < program->output_count; ++output)
+        {
+            batch->outputs[output][row] = results[output];
+        }
+    }
+    free(registers);
+    free(slots);
+    free(results);
+}
+
+// evaluates the rows of the batch in single precision with batch_evaluate_float, a block at a time: each block of
+// rows is rounded to floats and laid out one row after another, evaluated on the pool and its results are widened
+// into the output columns. first the error of single precision is estimated over the range of the input columns,
+// and a warning is printed for each output whose estimate is above COLUMN_FLOAT_TOLERANCE.
+void column_evaluate_float(thread_pool* pool, const column_batch* batch, bool double_sums)
+{
+    const program* program = batch->program;
+    double* lower = (double*)malloc(sizeof(double) * (program->slot_count + 1));
+    double* upper = (double*)malloc(sizeof(double) * (program->slot_count + 1));
+    for (int slot = 0; slot < program->slot_count; ++slot)
+    {
+        lower[slot] = INFINITY;
+        upper[slot] = -INFINITY;
+        for (long long row = 0; row < batch->row_count; ++row)
+        {
+            lower[slot] = fmin(lower[slot], batch->inputs[slot][row]);
+            upper[slot] = fmax(upper[slot], batch->inputs[slot][row]);
+        }
+    }
+    float_analysis* analysis = float_analyse(program, lower, upper, double_sums);
+    float_analysis_warn(stderr, analysis, COLUMN_FLOAT_TOLERANCE);
+    float_analysis_free(analysis);
+    free(lower);
+    free(upper);
+
+    float* rows = (float*)malloc(sizeof(float) * (size_t)COLUMN_FLOAT_BLOCK_ROWS * (program->slot_count + 1));
+    float* results = (float*)malloc(sizeof(float) * (size_t)COLUMN_FLOAT_BLOCK_ROWS * program->output_count);
+    for (long long first = 0; first < batch->row_count; first += COLUMN_FLOAT_BLOCK_ROWS)
+    {
+        int count = (int)((batch->row_count - first < COLUMN_FLOAT_BLOCK_ROWS) ? batch->row_count - first : COLUMN_FLOAT_BLOCK_ROWS);
+        for (int slot = 0; slot < program->slot_count; ++slot)
+        {
+            const double* column = batch->inputs[slot] + first;
+            for (int row = 0; row < count; ++row)
+            {
+                rows[(size_t)row * program->slot_count + slot] = (float)column[row];
+            }
+        }
+        batch_evaluate_float(pool, program, rows, count, results, double_sums);
+        for (int output = 0; output < program->output_count; ++output)
+        {
+            double* column = batch->outputs[output] + first;
+            for (int row = 0; row < count; ++row)
+            {
+                column[row] = results[(size_t)row * program->output_count + output];
+            }
+        }
+    }
+    free(rows);
+    free(results);
+}
+
+// evaluates the expression and each of its partial derivatives for every row of a column file, and writes them to a
+// new column file with the columns F, dF/dx, dF/dy and so on. the input columns are found by the name of each
+// variable, and other columns are ignored. both files are mapped, so rows never pass through stdio or heap memory,
+// except in single precision, where each block of rows is rounded into a buffer first.
+// returns false and sets error if a file can't be mapped or a variable has no column.
+bool column_evaluate(thread_pool* pool, const compiled_expression* expression, const char* input_path,
+                     const char* output_path, column_precision precision, char* error)
+{
+    column_file input;
+    if (column_file_open(&input, input_path, error) == false)
+    {
+        return false;
+    }
+
+    const program* program = expression->program;
+    const double** inputs = (const double**)malloc(sizeof(double*) * (program->slot_count + 1));
+    for (int slot = 0; slot < program->slot_count; ++slot)
+    {
+        char name[2] = { program->symbols[slot], '\0' };
+        int column = column_file_find(&input, name);
+        if (column < 0)
+        {
+            snprintf(error, COLUMN_ERROR_SIZE, "%s has no column for the variable %s", input_path, name);
+            free(inputs);
+            column_file_close(&input);
+            return false;
+        }
+        inputs[slot] = column_file_column(&input, column);
+    }
+
+    // name the outputs after the value and the partial derivative with respect to each slot.
+    char* names = (char*)malloc(sizeof(char) * COLUMN_NAME_SIZE * program->output_count);
+    const char** name_pointers = (const char**)malloc(sizeof(char*) * program->output_count);
+    for (int output = 0; output < program->output_count; ++output)
+    {
+        name_pointers[output] = names + output * COLUMN_NAME_SIZE;
+        if (output == 0)
+        {
+            snprintf(names + output * COLUMN_NAME_SIZE, COLUMN_NAME_SIZE, "F");
+        }
+        else
+        {
+            snprintf(names + output * COLUMN_NAME_SIZE, COLUMN_NAME_SIZE, "dF/d%c", program->symbols[output - 1]);
+        }
+    }
+
+    column_file output;
+    bool evaluated = column_file_create(&output, output_path, name_pointers, program->output_count, input.row_count, error);
+    if (evaluated)
+    {
+        column_batch batch;
+        batch.program = program;
+        batch.inputs = inputs;
+        batch.outputs = (double**)malloc(sizeof(double*) * program->output_count);
+        batch.row_count = input.row_count;
+        for (int i = 0; i < program->output_count; ++i)
+        {
+            batch.outputs[i] = column_file_column(&output, i);
+        }
+
+        if (precision == column_double)
+        {
+            int chunk_count = (int)((input.row_count + COLUMN_CHUNK_ROWS - 1) / COLUMN_CHUNK_ROWS);
+            thread_pool_run(pool, column_evaluate_chunk, &batch, chunk_count);
+        }
+        else
+        {
+            column_evaluate_float(pool, &batch, precision == column_mixed);
+        }
+        free(batch.outputs);
+        column_file_close(&output);
+    }
+
+    free(names);
+    free(name_pointers);
+    free(inputs);
+    column_file_close(&input);
+    return evaluated;
+}
+
+#endif //COURSEWORK_COLUMN_EVALUATOR_H
@@ -0,0 +1,535 @@
+#ifndef COURSEWORK_COLUMN_FILE_H
+#define COURSEWORK_COLUMN_FILE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "thread_pool.h"
+
+#define COLUMN_FILE_MAGIC "EXPRCOL1" // the first 8 bytes of every column file.
+#define COLUMN_NAME_SIZE 16 // bytes for each column name, including the zero after it.
+#define COLUMN_DATA_ALIGNMENT 64 // the columns start at a multiple of this offset, so each starts on a cache line.
+#define COLUMN_ERROR_SIZE 128 // longest error message of a column file function.
+#define CSV_CHUNK_BYTES (1 << 20) // bytes of a csv file parsed by one task.
+#define CSV_MAX_COLUMNS 256 // most columns a csv file can have.
+
+// the start of a column file, followed by the name of each column, then each column of row_count doubles in turn.
+// every field is little-endian, so the columns are used where they are mapped rather than converted.
+typedef struct column_file_header
+{
+    char magic[8];
+    uint32_t column_count;
+    uint32_t name_size; // always COLUMN_NAME_SIZE.
+    uint64_t row_count;
+    uint64_t data_offset; // offset of the first column from the start of the file.
+} column_file_header;
+
+// a column file mapped into memory, read-only when it was opened and writable when it was created.
+typedef struct column_file
+{
+    void* mapped;
+    size_t mapped_size;
+    int column_count;
+    long long row_count;
+    const char* names; // column_count names of COLUMN_NAME_SIZE bytes each.
+    double* data; // column i starts at data + i * row_count.
+} column_file;
+
+// is the host little-endian, so the columns of a file can be used in place?
+bool host_is_little_endian()
+{
+    uint16_t value = 1;
+    return *(const uint8_t*)&value == 1;
+}
+
+// the offset of the first column of a file with the given number of columns.
+uint64_t column_file_data_offset(int column_count)
+{
+    uint64_t offset = sizeof(column_file_header) + (uint64_t)column_count * COLUMN_NAME_SIZE;
+    return (offset + COLUMN_DATA_ALIGNMENT - 1) / COLUMN_DATA_ALIGNMENT * COLUMN_DATA_ALIGNMENT;
+}
+
+// points the fields of the file at the header, names and columns of its mapping.
+void column_file_attach(column_file* file)
+{
+    const column_file_header* header = (const column_file_header*)file->mapped;
+    file->column_count = (int)header->column_count;
+    file->row_count = (long long)header->row_count;
+    file->names = (const char*)file->mapped + sizeof(column_file_header);
+    file->data = (double*)((char*)file->mapped + header->data_offset);
+}
+
+// maps a column file for reading, returns false and sets error if it can't be mapped or isn't a column file.
+bool column_file_open(column_file* file, const char* path, char* error)
+{
+    file->mapped = NULL;
+    if (host_is_little_endian() == false)
+    {
+        snprintf(error, COLUMN_ERROR_SIZE, "column files can only be mapped on little-endian hosts");
+        return false;
+    }
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        snprintf(error, COLUMN_ERROR_SIZE, "can't open %s", path);
+        return false;
+    }
+
+    struct stat status;
+    if (fstat(fd, &status) != 0 || (size_t)status.st_size < sizeof(column_file_header))
+    {
+        close(fd);
+        snprintf(error, COLUMN_ERROR_SIZE, "%s is not a column file", path);
+        return false;
+    }
+
+    void* mapped = mmap(NULL, status.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED)
+    {
+        snprintf(error, COLUMN_ERROR_SIZE, "can't map %s", path);
+        return false;
+    }
+
+    // check the header describes a file of exactly this size, so no name or column runs past the end of the mapping.
+    const column_file_header* header = (const column_file_header*)mapped;
+    uint64_t size = (uint64_t)status.st_size;
+    bool valid = memcmp(header->magic, COLUMN_FILE_MAGIC, 8) == 0 && header->name_size == COLUMN_NAME_SIZE &&
+                 header->data_offset == column_file_data_offset(header->column_count) && header->data_offset <= size &&
+                 (header->row_count == 0 || header->column_count <= (size - header->data_offset) / sizeof(double) / header->row_count) &&
+                 header->data_offset + header->column_count * header->row_count * sizeof(double) == size;
+    for (uint32_t i = 0; valid && i < header->column_count; ++i)
+    {
+        valid = memchr((const char*)mapped + sizeof(column_file_header) + (size_t)i * COLUMN_NAME_SIZE, '\0', COLUMN_NAME_SIZE) != NULL;
+    }
+    if (valid == false)
+    {
+        munmap(mapped, status.st_size);
+        snprintf(error, COLUMN_ERROR_SIZE, "%s is not a column file", path);
+        return false;
+    }
+
+    madvise(mapped, status.st_size, MADV_SEQUENTIAL);
+    file->mapped = mapped;
+    file->mapped_size = status.st_size;
+    column_file_attach(file);
+    return true;
+}
+
+// creates a column file with the given column names and number of rows and maps it for writing.
+// the columns start out as zero. returns false and sets error if the file can't be created.
+bool column_file_create(column_file* file, const char* path, const char** names, int column_count,
+                        long long row_count, char* error)
+{
+    file->mapped = NULL;
+    if (host_is_little_endian() == false)
+    {
+        snprintf(error, COLUMN_ERROR_SIZE, "column files can only be mapped on little-endian hosts");
+        return false;
+    }
+
+    for (int i = 0; i < column_count; ++i)
+    {
+        if (strlen(names[i]) >= COLUMN_NAME_SIZE)
+        {
+            snprintf(error, COLUMN_ERROR_SIZE, "column name %s is longer than %d characters", names[i], COLUMN_NAME_SIZE - 1);
+            return false;
+        }
+    }
+
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        snprintf(error, COLUMN_ERROR_SIZE, "can't create %s", path);
+        return false;
+    }
+
+    uint64_t data_offset = column_file_data_offset(column_count);
+    size_t size = data_offset + (uint64_t)column_count * row_count * sizeof(double);
+    void* mapped = MAP_FAILED;
+    if (ftruncate(fd, size) == 0)
+    {
+        mapped = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (mapped == MAP_FAILED)
+    {
+        unlink(path);
+        snprintf(error, COLUMN_ERROR_SIZE, "can't make %s %zu bytes long", path, size);
+        return false;
+    }
+
+    column_file_header* header = (column_file_header*)mapped;
+    memcpy(header->magic, COLUMN_FILE_MAGIC, 8);
+    header->column_count = column_count;
+    header->name_size = COLUMN_NAME_SIZE;
+    header->row_count = row_count;
+    header->data_offset = data_offset;
+    for (int i = 0; i < column_count; ++i)
+    {
+        strcpy((char*)mapped + sizeof(column_file_header) + (size_t)i * COLUMN_NAME_SIZE, names[i]);
+    }
+
+    madvise(mapped, size, MADV_SEQUENTIAL);
+    file->mapped = mapped;
+    file->mapped_size = size;
+    column_file_attach(file);
+    return true;
+}
+
+// unmaps the file, the changes to a created file are written back by the kernel.
+void column_file_close(column_file* file)
+{
+    if (file->mapped != NULL)
+    {
+        munmap(file->mapped, file->mapped_size);
+        file->mapped = NULL;
+    }
+}
+
+// returns the name of a column.
+const char* column_file_name(const column_file* file, int column)
+{
+    return file->names + (size_t)column * COLUMN_NAME_SIZE;
+}
+
+// returns the values of a column.
+double* column_file_column(const column_file* file, int column)
+{
+    return file->data + (size_t)column * file->row_count;
+}
+
+// returns the index of the column with the name, or -1 if there is no such column.
+int column_file_find(const column_file* file, const char* name)
+{
+    for (int i = 0; i < file->column_count; ++i)
+    {
+        if (strcmp(column_file_name(file, i), name) == 0)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// maps a text file for reading with a zero after its last character, so it can be read with the string functions.
+// when the file is a whole number of pages, the zero comes from an extra page reserved after the mapping.
+// returns NULL if the file can't be mapped, and the mapping must be unmapped with text_file_unmap.
+const char* text_file_map(const char* path, size_t* size)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        return NULL;
+    }
+
+    struct stat status;
+    if (fstat(fd, &status) != 0)
+    {
+        close(fd);
+        return NULL;
+    }
+
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    *size = status.st_size;
+    char* reserved = mmap(NULL, *size + page, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (reserved != MAP_FAILED && *size > 0 &&
+        mmap(reserved, *size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED)
+    {
+        munmap(reserved, *size + page);
+        reserved = MAP_FAILED;
+    }
+    close(fd);
+    if (reserved == MAP_FAILED)
+    {
+        return NULL;
+    }
+
+    madvise(reserved, *size, MADV_SEQUENTIAL);
+    return reserved;
+}
+
+// unmaps a text file mapped by text_file_map.
+void text_file_unmap(const char* text, size_t size)
+{
+    munmap((void*)text, size + (size_t)sysconf(_SC_PAGESIZE));
+}
+
+// is the line from start to end empty or only whitespace?
+bool csv_blank(const char* start, const char* end)
+{
+    for (const char* c = start; c < end; ++c)
+    {
+        if (*c != ' ' && *c != '\t' && *c != '\r')
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// a csv file being imported into a column file. the file is split into chunks of whole lines, which are counted by
+// one pass over the chunks and parsed straight into the columns by a second.
+typedef struct csv_import
+{
+    const char* text; // the mapped csv file.
+    size_t size;
+    int column_count;
+    int chunk_count;
+    size_t* starts; // the first character of each chunk, with the end of the text after the last chunk.
+    long long* rows; // rows in each chunk, then the row of the first line of each chunk in the second pass.
+    long long* error_rows; // row of the first line in each chunk that couldn't be parsed, or -1.
+    int* error_counts; // values found on that line, or -1 if it has something other than numbers.
+    column_file* output;
+} csv_import;
+
+// counts the rows of one chunk, a row is any line which isn't blank.
+void csv_count_chunk(void* context, int task)
+{
+    csv_import* import = context;
+    const char* line = import->text + import->starts[task];
+    const char* end = import->text + import->starts[task + 1];
+    long long rows = 0;
+    while (line < end)
+    {
+        const char* line_end = memchr(line, '\n', end - line);
+        line_end = (line_end != NULL) ? line_end : end;
+        rows += csv_blank(line, line_end) ? 0 : 1;
+        line = line_end + 1;
+    }
+    import->rows[task] = rows;
+}
+
+// parses the rows of one chunk into the columns, stopping at the first line that isn't a row of numbers.
+void csv_parse_chunk(void* context, int task)
+{
+    csv_import* import = context;
+    const char* line = import->text + import->starts[task];
+    const char* end = import->text + import->starts[task + 1];
+    long long row = import->rows[task];
+    long long row_count = import->output->row_count;
+    double* data = import->output->data;
+    import->error_rows[task] = -1;
+
+    while (line < end)
+    {
+        const char* line_end = memchr(line, '\n', end - line);
+        line_end = (line_end != NULL) ? line_end : end;
+        if (csv_blank(line, line_end))
+        {
+            line = line_end + 1;
+            continue;
+        }
+
+        // read the values separated by commas, strtod stops at the comma or line break after each value.
+        const char* c = line;
+        int count = 0;
+        while (true)
+        {
+            while (*c == ' ' || *c == '\t')
+            {
+                ++c;
+            }
+
+            char* number_end;
+            double value = (*c != '\n' && *c != '\r' && *c != ',') ? strtod(c, &number_end) : 0;
+            if (*c == '\n' || *c == '\r' || *c == ',' || number_end == c)
+            {
+                count = -1; // an empty value or not a number.
+                break;
+            }
+            if (count < import->column_count)
+            {
+                data[(size_t)count * row_count + row] = value;
+            }
+            ++count;
+
+            c = number_end;
+            while (*c == ' ' || *c == '\t' || *c == '\r')
+            {
+                ++c;
+            }
+            if (*c != ',')
+            {
+                count = (c == line_end) ? count : -1; // anything after the last value must be whitespace.
+                break;
+            }
+            ++c;
+        }
+
+        if (count != import->column_count)
+        {
+            import->error_rows[task] = row;
+            import->error_counts[task] = count;
+            return;
+        }
+
+        ++row;
+        line = line_end + 1;
+    }
+}
+
+// reads the names of the columns from the first line of a csv file, which are separated by commas and may be quoted.
+// returns the number of names, or -1 if a name is empty or too long for a column file.
+int csv_read_header(const char* line, const char* line_end, char names[][COLUMN_NAME_SIZE], int capacity)
+{
+    int count = 0;
+    const char* c = line;
+    while (c <= line_end)
+    {
+        const char* field_end = memchr(c, ',', line_end - c);
+        field_end = (field_end != NULL) ? field_end : line_end;
+
+        const char* first = c;
+        const char* last = field_end;
+        while (first < last && (*first == ' ' || *first == '\t' || *first == '"')) { ++first; }
+        while (last > first && (last[-1] == ' ' || last[-1] == '\t' || last[-1] == '\r' || last[-1] == '"')) { --last; }
+        if (last == first || last - first >= COLUMN_NAME_SIZE || count == capacity)
+        {
+            return -1;
+        }
+
+        memcpy(names[count], first, last - first);
+        names[count][last - first] = '\0';
+        ++count;
+        c = field_end + 1;
+    }
+    return count;
+}
+
+// imports a csv file with a header line of column names followed by a line of numbers for each row, into a new column
+// file. the csv file is mapped and its chunks are counted and parsed in parallel by the pool, and the columns are
+// written straight to the mapped column file, so neither file is held in heap memory.
+// returns false and sets error if the csv file can't be read or imported.
+bool csv_import_file(thread_pool* pool, const char* csv_path, const char* column_path, char* error)
+{
+    size_t size;
+    const char* text = text_file_map(csv_path, &size);
+    if (text == NULL)
+    {
+        snprintf(error, COLUMN_ERROR_SIZE, "can't map %s", csv_path);
+        return false;
+    }
+
+    // the header is the first line that isn't blank.
+    const char* header = text;
+    const char* header_end = memchr(header, '\n', size);
+    while (header_end != NULL && csv_blank(header, header_end))
+    {
+        header = header_end + 1;
+        header_end = memchr(header, '\n', text + size - header);
+    }
+    header_end = (header_end != NULL) ? header_end : text + size;
+
+    char names[CSV_MAX_COLUMNS][COLUMN_NAME_SIZE];
+    int column_count = csv_blank(header, header_end) ? -1 : csv_read_header(header, header_end, names, CSV_MAX_COLUMNS);
+    if (column_count < 0)
+    {
+        text_file_unmap(text, size);
+        snprintf(error, COLUMN_ERROR_SIZE, "%s needs a header of up to %d names of up to %d characters",
+                 csv_path, CSV_MAX_COLUMNS, COLUMN_NAME_SIZE - 1);
+        return false;
+    }
+
+    // split the rest of the text into chunks, moving the end of each chunk to the end of a line.
+    csv_import import;
+    import.text = text;
+    import.size = size;
+    import.column_count = column_count;
+    size_t first = (header_end < text + size) ? (size_t)(header_end - text + 1) : size;
+    import.chunk_count = (int)((size - first) / CSV_CHUNK_BYTES) + 1;
+    import.starts = (size_t*)malloc(sizeof(size_t) * (import.chunk_count + 1));
+    import.rows = (long long*)malloc(sizeof(long long) * import.chunk_count);
+    import.error_rows = (long long*)malloc(sizeof(long long) * import.chunk_count);
+    import.error_counts = (int*)malloc(sizeof(int) * import.chunk_count);
+    import.starts[0] = first;
+    for (int i = 1; i <= import.chunk_count; ++i)
+    {
+        size_t start = (i == import.chunk_count) ? size : first + (size - first) / import.chunk_count * i;
+        const char* line_end = (start < size) ? memchr(text + start, '\n', size - start) : NULL;
+        start = (line_end != NULL) ? (size_t)(line_end - text) + 1 : size;
+        import.starts[i] = (start > import.starts[i - 1]) ? start : import.starts[i - 1];
+    }
+
+    thread_pool_run(pool, csv_count_chunk, &import, import.chunk_count);
+    long long row_count = 0;
+    for (int i = 0; i < import.chunk_count; ++i)
+    {
+        long long rows = import.rows[i];
+        import.rows[i] = row_count;
+        row_count += rows;
+    }
+
+    const char* name_pointers[CSV_MAX_COLUMNS];
+    for (int i = 0; i < column_count; ++i)
+    {
+        name_pointers[i] = names[i];
+    }
+
+    column_file output;
+    bool imported = column_file_create(&output, column_path, name_pointers, column_count, row_count, error);
+    if (imported)
+    {
+        import.output = &output;
+        thread_pool_run(pool, csv_parse_chunk, &import, import.chunk_count);
+        for (int i = 0; i < import.chunk_count && imported; ++i)
+        {
+            if (import.error_rows[i] >= 0)
+            {
+                imported = false;
+                if (import.error_counts[i] < 0)
+                {
+                    snprintf(error, COLUMN_ERROR_SIZE, "%s: row %lld has something other than numbers",
+                             csv_path, import.error_rows[i] + 1);
+                }
+                else
+                {
+                    snprintf(error, COLUMN_ERROR_SIZE, "%s: row %lld has %d values instead of %d",
+                             csv_path, import.error_rows[i] + 1, import.error_counts[i], column_count);
+                }
+            }
+        }
+
+        column_file_close(&output);
+        if (imported == false)
+        {
+            unlink(column_path);
+        }
+    }
+
+    free(import.starts);
+    free(import.rows);
+    free(import.error_rows);
+    free(import.error_counts);
+    text_file_unmap(text, size);
+    return imported;
+}
+
+// writes a column file as csv, with a header line of the column names.
+void csv_export_file(const column_file* file, FILE* out)
+{
+    for (int column = 0; column < file->column_count; ++column)
+    {
+        fprintf(out, (column == 0) ? "%s" : ",%s", column_file_name(file, column));
+    }
+    fputc('\n', out);
+
+    for (long long row = 0; row < file->row_count; ++row)
+    {
+        for (int column = 0; column < file->column_count; ++column)
+        {
+            fprintf(out, (column == 0) ? "%.17g" : ",%.17g", column_file_column(file, column)[row]);
+        }
+        fputc('\n', out);
+    }
+}
+
+#endif //COURSEWORK_COLUMN_FILE_H
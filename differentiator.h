@@ -148,8 +148,9 @@ tree_node* tan_node(tree_node* operand)
     return node;
 }
 
-// build an expression tree that represents the derivative of another tree.
-tree_node* differentiate(tree_node* node, char symbol)
+// build the derivative of a node from the derivatives of its children.
+// each node's derivative only needs the derivatives of its children, so the children are always differentiated first.
+tree_node* differentiate_node(tree_node* node, char symbol, tree_node* left_derivative, tree_node* right_derivative)
 {
     token current_token = node->token;
 
@@ -157,51 +158,51 @@ tree_node* differentiate(tree_node* node, char symbol)
     {
         case addition:
             // d/dx[f(x) + g(x)] = f'(x) + g'(x)
-            return add_nodes(differentiate(node->left_child, symbol), differentiate(node->right_child, symbol));
+            return add_nodes(left_derivative, right_derivative);
         case subtraction:
             // d/dx[f(x) - g(x)] = f'(x) - g'(x)
-            return subtract_nodes(differentiate(node->left_child, symbol), differentiate(node->right_child, symbol));
+            return subtract_nodes(left_derivative, right_derivative);
         case multiplication:
             // d/dx[f(x) * g(x)] = f(x) * g'(x) + f'(x) * g(x)
-            return add_nodes(multiply_nodes(tree_node_copy(node->left_child), differentiate(node->right_child, symbol)),
-                             multiply_nodes(differentiate(node->left_child, symbol), tree_node_copy(node->right_child)));
+            return add_nodes(multiply_nodes(tree_node_copy(node->left_child), right_derivative),
+                             multiply_nodes(left_derivative, tree_node_copy(node->right_child)));
         case division:
             // d/dx[f(x) / g(x)] = (g(x) * f'(x) - f(x) * g'(x)) / (g(x) ^ 2)
-            return divide_nodes(subtract_nodes(multiply_nodes(tree_node_copy(node->right_child), differentiate(node->left_child, symbol)),
-                                               multiply_nodes(tree_node_copy(node->left_child), differentiate(node->right_child, symbol))),
+            return divide_nodes(subtract_nodes(multiply_nodes(tree_node_copy(node->right_child), left_derivative),
+                                               multiply_nodes(tree_node_copy(node->left_child), right_derivative)),
                                 power_nodes(tree_node_copy(node->right_child), constant_node(2)));
         case negation:
             // d/dx[-f(x)] = -f'(x)
-            return negate_node(differentiate(node->right_child, symbol));
+            return negate_node(right_derivative);
         case power:
             // d/dx[f(x) ^ g(x)] = f(x) ^ (g(x) - 1) * (g(x) * f'(x) + f(x) * ln(f(x)) * g'(x))
             return multiply_nodes(power_nodes(tree_node_copy(node->left_child), subtract_nodes(tree_node_copy(node->right_child), constant_node(1))),
-                                  add_nodes(multiply_nodes(tree_node_copy(node->right_child), differentiate(node->left_child, symbol)),
-                                            multiply_nodes(multiply_nodes(tree_node_copy(node->left_child), differentiate(node->right_child, symbol)),
+                                  add_nodes(multiply_nodes(tree_node_copy(node->right_child), left_derivative),
+                                            multiply_nodes(multiply_nodes(tree_node_copy(node->left_child), right_derivative),
                                                            ln_node(tree_node_copy(node->left_child)))));
         case squareroot:
             // d/dx[sqrt(f(x))] = f'(x) / (2 * sqrt(f(x)))
-            return divide_nodes(differentiate(node->left_child, symbol),
+            return divide_nodes(left_derivative,
                                 multiply_nodes(constant_node(2), sqrt_node(tree_node_copy(node->left_child))));
         case log_10:
             // d/dx[log_10(f(x))] = f'(x) / (ln(10) * f(x))
-            return divide_nodes(differentiate(node->left_child, symbol),
+            return divide_nodes(left_derivative,
                                 multiply_nodes(ln_node(constant_node(10)),
                                                tree_node_copy(node->left_child)));
         case log_e:
             // d/dx[ln(f(x))] = f'(x) / f(x)
-            return divide_nodes(differentiate(node->left_child, symbol), tree_node_copy(node->left_child));
+            return divide_nodes(left_derivative, tree_node_copy(node->left_child));
         case sine:
             // d/dx[sin(f(x))] = cos(f(x)) * f'(x)
             return multiply_nodes(cos_node(tree_node_copy(node->left_child)),
-                                  differentiate(node->left_child, symbol));
+                                  left_derivative);
         case cosine:
             // d/dx[cos(f(x))] = -sin(f(x)) * f'(x)
             return multiply_nodes(negate_node(sin_node(tree_node_copy(node->left_child))),
-                                  differentiate(node->left_child, symbol));
+                                  left_derivative);
         case tangent:
             // d/dx[tan(f(x))] = f'(x) / (cos(f(x))) ^ 2
-            return divide_nodes(differentiate(node->left_child, symbol),
+            return divide_nodes(left_derivative,
                                 power_nodes(cos_node(tree_node_copy(node->left_child)),
                                             constant_node(2)));
         case constant:
@@ -216,4 +217,47 @@ tree_node* differentiate(tree_node* node, char symbol)
     }
 }
 
+// build the derivative of a tree without recursion, so its depth is only limited by memory.
+tree_node* differentiate_iterative(tree_node* node, char symbol)
+{
+    node_stack order;
+    node_stack_init(&order);
+    tree_postorder(node, &order);
+
+    // the derivative of each child is on the stack when its parent is differentiated, the right child's on top.
+    node_stack derivatives;
+    node_stack_init(&derivatives);
+    for (int i = 0; i < order.count; ++i)
+    {
+        tree_node* current = order.nodes[i];
+        tree_node* right_derivative = (current->right_child != NULL) ? node_stack_pop(&derivatives) : NULL;
+        tree_node* left_derivative = (current->left_child != NULL) ? node_stack_pop(&derivatives) : NULL;
+        node_stack_push(&derivatives, differentiate_node(current, symbol, left_derivative, right_derivative));
+    }
+
+    tree_node* derivative = (derivatives.count > 0) ? derivatives.nodes[0] : NULL;
+    node_stack_free(&derivatives);
+    node_stack_free(&order);
+    return derivative;
+}
+
+// build the derivative of a tree recursively, switching to differentiate_iterative below the recursion limit.
+tree_node* differentiate_recursive(tree_node* node, char symbol, int depth)
+{
+    if (depth >= TREE_RECURSION_LIMIT)
+    {
+        return differentiate_iterative(node, symbol);
+    }
+
+    tree_node* left_derivative = (node->left_child != NULL) ? differentiate_recursive(node->left_child, symbol, depth + 1) : NULL;
+    tree_node* right_derivative = (node->right_child != NULL) ? differentiate_recursive(node->right_child, symbol, depth + 1) : NULL;
+    return differentiate_node(node, symbol, left_derivative, right_derivative);
+}
+
+// build an expression tree that represents the derivative of another tree.
+tree_node* differentiate(tree_node* node, char symbol)
+{
+    return differentiate_recursive(node, symbol, 0);
+}
+
 #endif //COURSEWORK_DIFFERENTIATOR_H
@@ -0,0 +1,169 @@
+#ifndef COURSEWORK_EVALUATE_BENCHMARK_H
+#define COURSEWORK_EVALUATE_BENCHMARK_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "parallel_evaluator.h"
+#include "parse_benchmark.h"
+
+#define EVALUATE_BENCHMARK_RUNS 5 // evaluations of each tree timed, the fastest is reported.
+#define EVALUATE_BENCHMARK_SMALL 1000 // about the number of nodes of the small tree.
+
+// builds a balanced tree with about the given number of nodes: products of a variable and a constant, summed and
+// subtracted in pairs, with a sine every third level to keep the values small.
+tree_node* evaluate_benchmark_balanced(int node_count)
+{
+    int leaf_count = 1;
+    while (leaf_count * 4 <= node_count)
+    {
+        leaf_count *= 2; // each leaf is a product of three nodes, with about one more node per leaf above the leaves.
+    }
+
+    tree_node** level = (tree_node**)malloc(sizeof(tree_node*) * leaf_count);
+    for (int i = 0; i < leaf_count; ++i)
+    {
+        token token;
+        token_init(&token, multiplication, '\0', 0);
+        level[i] = tree_node_create(token);
+        token_init_variable(&token, "xyz"[i % 3]);
+        level[i]->left_child = tree_node_create(token);
+        token_init_constant(&token, 1 + (i % 7) * 0.125);
+        level[i]->right_child = tree_node_create(token);
+    }
+
+    for (int depth = 0, count = leaf_count; count > 1; ++depth, count /= 2)
+    {
+        for (int i = 0; i < count / 2; ++i)
+        {
+            token token;
+            token_init(&token, (i % 2 == 0) ? addition : subtraction, '\0', 0);
+            tree_node* node = tree_node_create(token);
+            node->left_child = level[2 * i];
+            node->right_child = level[2 * i + 1];
+            if (depth % 3 == 2)
+            {
+                token_init(&token, sine, '\0', 0);
+                tree_node* wrapper = tree_node_create(token);
+                wrapper->left_child = node;
+                node = wrapper;
+            }
+            level[i] = node;
+        }
+    }
+
+    tree_node* root = level[0];
+    free(level);
+    return root;
+}
+
+// parses a generated sum of about the given number of nodes, whose additions and subtractions form one long left
+// spine with a small term hanging off each of them.
+tree_node* evaluate_benchmark_unbalanced(int node_count)
+{
+    char* text = NULL;
+    size_t size = 0;
+    FILE* file = open_memstream(&text, &size);
+    parse_benchmark_generate(file, (long long)node_count * 3); // about three characters of text per node.
+    fclose(file);
+    tree_node* root = parse_expression(text);
+    free(text);
+    return root;
+}
+
+// returns the fastest of EVALUATE_BENCHMARK_RUNS evaluations of the tree, in seconds, and its value in result. with
+// an evaluator the tree is evaluated by parallel_evaluate, otherwise by evaluate_bound.
+double evaluate_benchmark_latency(tree_node* root, thread_pool* pool, parallel_evaluator* evaluator,
+                                  const double* bindings, double* result)
+{
+    double fastest = 0;
+    for (int run = 0; run < EVALUATE_BENCHMARK_RUNS; ++run)
+    {
+        double start = parse_benchmark_seconds();
+        *result = (evaluator != NULL) ? parallel_evaluate(pool, evaluator, bindings) : evaluate_bound(root, bindings);
+        double seconds = parse_benchmark_seconds() - start;
+        fastest = (run == 0 || seconds < fastest) ? seconds : fastest;
+    }
+    return fastest;
+}
+
+// evaluates a tree sequentially and then in parallel with 1, 2, 4 and so on up to most_threads workers, and prints
+// the time to split the tree, the latency of one evaluation and its speedup. returns the number of parallel results
+// that differ from the sequential one.
+int evaluate_benchmark_tree(const char* name, tree_node* root, int most_threads, const double* bindings)
+{
+    double reference = 0;
+    evaluate_bound(root, bindings); // the first evaluation brings the tree into the cache.
+    double sequential_seconds = evaluate_benchmark_latency(root, NULL, NULL, bindings, &reference);
+    printf("%-12s%10lld%12s%10s%10s%12.3f%10.2f\n", name, parse_benchmark_count(root), "sequential", "", "",
+           sequential_seconds * 1e3, 1.0);
+
+    int failures = 0;
+    for (int threads = 1; threads <= most_threads; threads *= 2)
+    {
+        thread_pool* pool = thread_pool_create(threads);
+        double start = parse_benchmark_seconds();
+        parallel_evaluator* evaluator = parallel_evaluator_create(root, threads);
+        double split_seconds = parse_benchmark_seconds() - start;
+
+        double result = 0;
+        double seconds = evaluate_benchmark_latency(root, pool, evaluator, bindings, &result);
+        printf("%-12s%10d%12d%10d%10.1f%12.3f%10.2f\n", name, evaluator->node_count, threads, evaluator->task_count,
+               split_seconds * 1e3, seconds * 1e3, sequential_seconds / seconds);
+        failures += (memcmp(&result, &reference, sizeof(double)) == 0) ? 0 : 1;
+        parallel_evaluator_free(evaluator);
+        thread_pool_free(pool);
+    }
+    return failures;
+}
+
+// measures the latency of evaluating one balanced and one unbalanced tree of about the given number of nodes in
+// parallel, then checks that a small tree pays nothing for going through parallel_evaluate. returns the number of
+// parallel results that differ from evaluate_bound.
+int parallel_evaluate_benchmark(int node_count, int most_threads)
+{
+    double bindings[BINDING_TABLE_SIZE] = { 0 };
+    bindings['x'] = 0.75;
+    bindings['y'] = -1.5;
+    bindings['z'] = 2.25;
+
+    printf("%-12s%10s%12s%10s%10s%12s%10s\n", "tree", "nodes", "threads", "tasks", "split ms", "latency ms", "speedup");
+    tree_node* balanced = evaluate_benchmark_balanced(node_count);
+    int failures = evaluate_benchmark_tree("balanced", balanced, most_threads, bindings);
+    tree_free(balanced);
+    tree_node* unbalanced = evaluate_benchmark_unbalanced(node_count);
+    failures += evaluate_benchmark_tree("unbalanced", unbalanced, most_threads, bindings);
+    tree_free(unbalanced);
+
+    // a tree below PARALLEL_EVALUATE_MIN is evaluated by evaluate_bound on the calling thread.
+    tree_node* small = evaluate_benchmark_unbalanced(EVALUATE_BENCHMARK_SMALL);
+    thread_pool* pool = thread_pool_create(most_threads);
+    parallel_evaluator* evaluator = parallel_evaluator_create(small, most_threads);
+    int repeats = 100000;
+    double reference = 0;
+    double result = 0;
+    double start = parse_benchmark_seconds();
+    for (int i = 0; i < repeats; ++i)
+    {
+        reference += evaluate_bound(small, bindings);
+    }
+    double sequential_seconds = parse_benchmark_seconds() - start;
+    start = parse_benchmark_seconds();
+    for (int i = 0; i < repeats; ++i)
+    {
+        result += parallel_evaluate(pool, evaluator, bindings);
+    }
+    double seconds = parse_benchmark_seconds() - start;
+    printf("small tree of %d nodes: %.0f ns sequentially, %.0f ns through parallel_evaluate\n", evaluator->node_count,
+           sequential_seconds / repeats * 1e9, seconds / repeats * 1e9);
+    failures += (memcmp(&result, &reference, sizeof(double)) == 0) ? 0 : 1;
+    parallel_evaluator_free(evaluator);
+    thread_pool_free(pool);
+    tree_free(small);
+
+    printf("%d processors\n", processor_count());
+    return failures;
+}
+
+#endif //COURSEWORK_EVALUATE_BENCHMARK_H
@@ -6,57 +6,127 @@
 #include "tree.h"
 #include "variables.h"
 
-// evaluates the expression tree recursively.
-double evaluate(tree_node* node)
+#define BINDING_TABLE_SIZE 128 // one entry for each possible variable symbol.
+
+// computes the value of one node from the values of its subtrees, reading variables from the bindings table, or
+// from the value stored in each variable node when there are no bindings.
+double evaluate_node(token token, double left, double right, const double* bindings)
 {
+    switch (token.type)
+    {
+        case addition: return left + right; // add the left and right subtrees.
+        case subtraction: return left - right; // subtract the right subtree from the left subtree.
+        case multiplication: return left * right; // multiply the left and right subtrees.
+        case division: return left / right; // divide the left subtree by the right subtree.
+        case power: return pow(left, right); // left subtree raised to the power of the right subtree.
+        case negation: return -right; // negate the right subtree.
+        case squareroot: return sqrt(left); // square root of the left subtree.
+        case log_10: return log10(left); // log base 10 of the left subtree.
+        case log_e: return log(left); // natural log of the left subtree.
+        case sine: return sin(left); // sin of the left subtree.
+        case cosine: return cos(left); // cos of the left subtree.
+        case tangent: return tan(left); // tan of the left subtree.
+        case constant: return token.value; // value of a constant.
+        case variable: // value of a variable.
+            return (bindings != NULL) ? bindings[(unsigned char)token.symbol % BINDING_TABLE_SIZE] : token.value;
+        default: return 0; // not a valid token type.
+    }
+}
+
+// evaluates the expression tree without recursion, so its depth is only limited by memory.
+double evaluate_iterative(tree_node* node, const double* bindings)
+{
+    // list the nodes in post-order, then compute them with a stack of values, so operands are always on top.
+    node_stack order;
+    node_stack_init(&order);
+    tree_postorder(node, &order);
+
+    double buffer[NODE_STACK_BUFFER];
+    double* values = (order.count > NODE_STACK_BUFFER) ? (double*)malloc(sizeof(double) * order.count) : buffer;
+    int count = 0;
+
+    for (int i = 0; i < order.count; ++i)
+    {
+        tree_node* current = order.nodes[i];
+        double right = (current->right_child != NULL) ? values[--count] : 0; // the right subtree is on top.
+        double left = (current->left_child != NULL) ? values[--count] : 0;
+        values[count++] = evaluate_node(current->token, left, right, bindings);
+    }
+
+    double result = (count > 0) ? values[0] : 0;
+    if (values != buffer)
+    {
+        free(values);
+    }
+    node_stack_free(&order);
+    return result;
+}
+
+double evaluate_recursive(tree_node* node, const double* bindings, int depth);
+
+// evaluates a subtree, reading constants and variables without a call, since half the nodes of a tree are leaves.
+double evaluate_child(tree_node* node, const double* bindings, int depth)
+{
+    if (node->token.type == constant)
+    {
+        return node->token.value;
+    }
+    if (node->token.type == variable)
+    {
+        return (bindings != NULL) ? bindings[(unsigned char)node->token.symbol % BINDING_TABLE_SIZE] : node->token.value;
+    }
+    return evaluate_recursive(node, bindings, depth);
+}
+
+// evaluates the expression tree recursively, switching to evaluate_iterative for subtrees below the recursion limit.
+double evaluate_recursive(tree_node* node, const double* bindings, int depth)
+{
+    if (depth >= TREE_RECURSION_LIMIT)
+    {
+        return evaluate_iterative(node, bindings);
+    }
+
     token token = node->token;
+    ++depth;
     switch (token.type)
     {
-        case addition:
-            // add the left and right subtrees.
-            return evaluate(node->left_child) + evaluate(node->right_child);
-        case subtraction:
-            // subtract the right subtree from the left subtree.
-            return evaluate(node->left_child) - evaluate(node->right_child);
-        case multiplication:
-            // multiply the left and right subtrees.
-            return evaluate(node->left_child) * evaluate(node->right_child);
-        case division:
-            // divide the left subtree by the right subtree.
-            return evaluate(node->left_child) / evaluate(node->right_child);
-        case power:
-            // left subtree raised to the power of the right subtree.
-            return pow(evaluate(node->left_child), evaluate(node->right_child));
-        case negation:
-            // negate the right subtree.
-            return -evaluate(node->right_child);
-        case squareroot:
-            // square root of the left subtree.
-            return sqrt(evaluate(node->left_child));
-        case log_10:
-            // log base 10 of the left subtree.
-            return log10(evaluate(node->left_child));
-        case log_e:
-            // natural log of the left subtree.
-            return log(evaluate(node->left_child));
-        case sine:
-            // sin of the left subtree.
-            return sin(evaluate(node->left_child));
-        case cosine:
-            // cos of the left subtree.
-            return cos(evaluate(node->left_child));
-        case tangent:
-            // tan of the left subtree.
-            return tan(evaluate(node->left_child));
-        case constant:
-            // value of a constant.
-            return token.value;
-        case variable:
-            // value of a variable.
-            return token.value;
-        default:
-            // not a valid token type.
-            return 0;
+        case addition: return evaluate_child(node->left_child, bindings, depth) + evaluate_child(node->right_child, bindings, depth);
+        case subtraction: return evaluate_child(node->left_child, bindings, depth) - evaluate_child(node->right_child, bindings, depth);
+        case multiplication: return evaluate_child(node->left_child, bindings, depth) * evaluate_child(node->right_child, bindings, depth);
+        case division: return evaluate_child(node->left_child, bindings, depth) / evaluate_child(node->right_child, bindings, depth);
+        case power: return pow(evaluate_child(node->left_child, bindings, depth), evaluate_child(node->right_child, bindings, depth));
+        case negation: return -evaluate_child(node->right_child, bindings, depth);
+        case squareroot: return sqrt(evaluate_child(node->left_child, bindings, depth));
+        case log_10: return log10(evaluate_child(node->left_child, bindings, depth));
+        case log_e: return log(evaluate_child(node->left_child, bindings, depth));
+        case sine: return sin(evaluate_child(node->left_child, bindings, depth));
+        case cosine: return cos(evaluate_child(node->left_child, bindings, depth));
+        case tangent: return tan(evaluate_child(node->left_child, bindings, depth));
+        case constant: return token.value;
+        case variable: return (bindings != NULL) ? bindings[(unsigned char)token.symbol % BINDING_TABLE_SIZE] : token.value;
+        default: return 0; // not a valid token type.
+    }
+}
+
+// evaluates the expression tree.
+double evaluate(tree_node* node)
+{
+    return evaluate_recursive(node, NULL, 0);
+}
+
+// evaluates the expression tree, reading variable values from a table indexed by symbol.
+// unlike evaluate, the tree doesn't need its variables to be set, so it can be evaluated by many threads at once.
+double evaluate_bound(tree_node* node, const double* bindings)
+{
+    return evaluate_recursive(node, bindings, 0);
+}
+
+// fills a binding table from the value of each slot.
+void bind_slots(double* bindings, const char* symbols, int slot_count, const double* slots)
+{
+    for (int slot = 0; slot < slot_count; ++slot)
+    {
+        bindings[(unsigned char)symbols[slot] % BINDING_TABLE_SIZE] = slots[slot];
     }
 }
 
@@ -0,0 +1,485 @@
+#ifndef COURSEWORK_EXECUTION_MANAGER_H
+#define COURSEWORK_EXECUTION_MANAGER_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "expression.h"
+#include "evaluator.h"
+#include "infix_writer.h"
+#include "jit.h"
+#include "native_backend.h"
+
+// the engines an expression can run on, from cheapest to start to fastest to run.
+typedef enum execution_tier
+{
+    tier_interpreter, // walks the expression trees.
+    tier_jit, // machine code from the jit.
+    tier_native, // a shared object built by the c compiler.
+    tier_count
+} execution_tier;
+
+// an engine that runs one expression.
+typedef struct execution_engine
+{
+    execution_tier tier;
+    jit_code* jit; // machine code, for the jit tier.
+    native_code* native; // shared object, for the native tier.
+    double compile_seconds; // time taken to build the engine.
+} execution_engine;
+
+// counters for one expression, used to tune the promotion thresholds.
+typedef struct execution_stats
+{
+    long long calls; // number of evaluations.
+    long long tier_calls[tier_count]; // number of evaluations run on each tier.
+    execution_tier tier; // the tier evaluations currently run on.
+    double compile_seconds[tier_count]; // time taken to build the engine of each tier, zero if it was never built.
+} execution_stats;
+
+typedef struct execution_manager execution_manager;
+
+// an expression whose engine is promoted to a faster tier as it gets evaluated more often.
+typedef struct managed_expression
+{
+    compiled_expression* expression;
+    execution_manager* manager; // holds the promotion thresholds.
+    execution_engine* engines[tier_count]; // every engine built so far, kept until the expression is freed.
+    execution_engine* current; // the engine used by new evaluations, read and swapped atomically.
+    long long calls; // number of evaluations, updated atomically.
+    long long tier_calls[tier_count]; // number of evaluations run on each tier, updated atomically.
+    int requested; // the highest tier a promotion was requested to, updated atomically.
+    pthread_mutex_t promotion_lock; // held while an engine is added.
+} managed_expression;
+
+// a promotion waiting for the compiler thread.
+typedef struct promotion_request
+{
+    managed_expression* managed;
+    execution_tier tier;
+    struct promotion_request* next;
+} promotion_request;
+
+// owns a set of managed expressions and decides when they are promoted.
+struct execution_manager
+{
+    long long jit_threshold; // calls before an expression moves to the jit, or negative to never move.
+    long long native_threshold; // calls before an expression moves to a shared object, or negative to never move.
+    managed_expression** expressions;
+    int expression_count;
+    int capacity;
+    pthread_mutex_t lock; // protects the list of expressions.
+    pthread_t compiler; // builds the engines of promoted expressions, so evaluations never wait for a compiler.
+    promotion_request* first; // the promotions waiting to be built, oldest first.
+    promotion_request* last;
+    bool compiling; // is the compiler thread building an engine?
+    bool stopping; // set when the manager is being freed.
+    pthread_mutex_t queue_lock; // protects the promotions and the two flags above.
+    pthread_cond_t queue_changed; // signalled when a promotion is queued, built, or the manager is stopping.
+};
+
+// returns the time in seconds from a monotonic clock.
+double monotonic_seconds()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+execution_engine* execution_engine_create(compiled_expression* expression, execution_tier tier);
+
+// builds the engine of each queued promotion and publishes it, until the manager is stopping.
+void* execution_manager_compile(void* argument)
+{
+    execution_manager* manager = argument;
+    pthread_mutex_lock(&manager->queue_lock);
+    while (true)
+    {
+        while (manager->first == NULL && manager->stopping == false)
+        {
+            pthread_cond_wait(&manager->queue_changed, &manager->queue_lock);
+        }
+        if (manager->stopping)
+        {
+            break;
+        }
+
+        promotion_request* request = manager->first;
+        manager->first = request->next;
+        manager->last = (manager->first != NULL) ? manager->last : NULL;
+        manager->compiling = true;
+        pthread_mutex_unlock(&manager->queue_lock);
+
+        // a promotion to the jit that was overtaken by a promotion to a shared object has nothing left to do.
+        managed_expression* managed = request->managed;
+        execution_engine* current = __atomic_load_n(&managed->current, __ATOMIC_ACQUIRE);
+        if (current->tier < request->tier && managed->engines[request->tier] == NULL)
+        {
+            execution_engine* engine = execution_engine_create(managed->expression, request->tier);
+            pthread_mutex_lock(&managed->promotion_lock);
+            managed->engines[request->tier] = engine;
+            pthread_mutex_unlock(&managed->promotion_lock);
+            __atomic_store_n(&managed->current, engine, __ATOMIC_RELEASE); // evaluations already running keep the old engine.
+        }
+        free(request);
+
+        pthread_mutex_lock(&manager->queue_lock);
+        manager->compiling = false;
+        pthread_cond_broadcast(&manager->queue_changed);
+    }
+    pthread_mutex_unlock(&manager->queue_lock);
+    return NULL;
+}
+
+// create an execution manager with the given promotion thresholds, and start its compiler thread.
+execution_manager* execution_manager_create(long long jit_threshold, long long native_threshold)
+{
+    execution_manager* manager = (execution_manager*)malloc(sizeof(execution_manager));
+    manager->jit_threshold = jit_threshold;
+    manager->native_threshold = native_threshold;
+    manager->expressions = NULL;
+    manager->expression_count = 0;
+    manager->capacity = 0;
+    pthread_mutex_init(&manager->lock, NULL);
+    manager->first = NULL;
+    manager->last = NULL;
+    manager->compiling = false;
+    manager->stopping = false;
+    pthread_mutex_init(&manager->queue_lock, NULL);
+    pthread_cond_init(&manager->queue_changed, NULL);
+    pthread_create(&manager->compiler, NULL, execution_manager_compile, manager);
+    return manager;
+}
+
+// waits until every queued promotion has been built.
+void execution_manager_wait(execution_manager* manager)
+{
+    pthread_mutex_lock(&manager->queue_lock);
+    while (manager->first != NULL || manager->compiling)
+    {
+        pthread_cond_wait(&manager->queue_changed, &manager->queue_lock);
+    }
+    pthread_mutex_unlock(&manager->queue_lock);
+}
+
+// free memory for a managed expression and each engine built for it.
+void managed_expression_free(managed_expression* managed)
+{
+    if (managed != NULL)
+    {
+        for (int tier = 0; tier < tier_count; ++tier)
+        {
+            execution_engine* engine = managed->engines[tier];
+            if (engine != NULL)
+            {
+                jit_free(engine->jit);
+                native_free(engine->native);
+                free(engine);
+            }
+        }
+
+        pthread_mutex_destroy(&managed->promotion_lock);
+        compiled_expression_free(managed->expression);
+        free(managed);
+    }
+}
+
+// free memory for the manager and every expression it owns, after stopping its compiler thread.
+// promotions still queued are dropped, and one being built is finished first.
+void execution_manager_free(execution_manager* manager)
+{
+    if (manager != NULL)
+    {
+        pthread_mutex_lock(&manager->queue_lock);
+        manager->stopping = true;
+        pthread_cond_broadcast(&manager->queue_changed);
+        pthread_mutex_unlock(&manager->queue_lock);
+        pthread_join(manager->compiler, NULL);
+        while (manager->first != NULL)
+        {
+            promotion_request* next = manager->first->next;
+            free(manager->first);
+            manager->first = next;
+        }
+        pthread_mutex_destroy(&manager->queue_lock);
+        pthread_cond_destroy(&manager->queue_changed);
+
+        for (int i = 0; i < manager->expression_count; ++i)
+        {
+            managed_expression_free(manager->expressions[i]);
+        }
+
+        pthread_mutex_destroy(&manager->lock);
+        free(manager->expressions);
+        free(manager);
+    }
+}
+
+// create an engine for the tier and time how long it takes to build.
+execution_engine* execution_engine_create(compiled_expression* expression, execution_tier tier)
+{
+    execution_engine* engine = (execution_engine*)malloc(sizeof(execution_engine));
+    engine->tier = tier;
+    engine->jit = NULL;
+    engine->native = NULL;
+
+    double start = monotonic_seconds();
+    if (tier == tier_jit)
+    {
+        engine->jit = jit_compile(expression->program);
+    }
+    else if (tier == tier_native)
+    {
+        engine->native = native_compile(expression);
+    }
+    engine->compile_seconds = monotonic_seconds() - start;
+
+    return engine;
+}
+
+// compiles an expression string and adds it to the manager, it starts on the interpreter tier.
+// returns NULL if the string has no expression.
+managed_expression* execution_manager_add(execution_manager* manager, const char* text)
+{
+    compiled_expression* expression = compiled_expression_create(text);
+    if (expression == NULL)
+    {
+        return NULL;
+    }
+
+    managed_expression* managed = (managed_expression*)malloc(sizeof(managed_expression));
+    managed->expression = expression;
+    managed->manager = manager;
+    for (int tier = 0; tier < tier_count; ++tier)
+    {
+        managed->engines[tier] = NULL;
+    }
+    managed->engines[tier_interpreter] = execution_engine_create(expression, tier_interpreter);
+    managed->current = managed->engines[tier_interpreter];
+    managed->calls = 0;
+    for (int tier = 0; tier < tier_count; ++tier)
+    {
+        managed->tier_calls[tier] = 0;
+    }
+    managed->requested = tier_interpreter;
+    pthread_mutex_init(&managed->promotion_lock, NULL);
+
+    pthread_mutex_lock(&manager->lock);
+    if (manager->expression_count == manager->capacity)
+    {
+        manager->capacity = (manager->capacity == 0) ? 16 : manager->capacity * 2;
+        manager->expressions = (managed_expression**)realloc(manager->expressions, sizeof(managed_expression*) * manager->capacity);
+    }
+    manager->expressions[manager->expression_count++] = managed;
+    pthread_mutex_unlock(&manager->lock);
+
+    return managed;
+}
+
+// queues a promotion of the expression to a higher tier for the compiler thread, unless it was already requested.
+void managed_expression_promote(managed_expression* managed, execution_tier tier)
+{
+    int requested = __atomic_load_n(&managed->requested, __ATOMIC_RELAXED);
+    while (requested < (int)tier)
+    {
+        if (__atomic_compare_exchange_n(&managed->requested, &requested, (int)tier, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        {
+            promotion_request* request = (promotion_request*)malloc(sizeof(promotion_request));
+            request->managed = managed;
+            request->tier = tier;
+            request->next = NULL;
+
+            execution_manager* manager = managed->manager;
+            pthread_mutex_lock(&manager->queue_lock);
+            if (manager->last != NULL)
+            {
+                manager->last->next = request;
+            }
+            else
+            {
+                manager->first = request;
+            }
+            manager->last = request;
+            pthread_cond_signal(&manager->queue_changed);
+            pthread_mutex_unlock(&manager->queue_lock);
+            return;
+        }
+    }
+}
+
+// evaluates the expression and each of its partial derivatives, requesting a promotion when it crosses a threshold.
+// the evaluation runs on the current engine, and a new engine is used once the compiler thread has published it.
+// registers must have room for expression->program->length values, results receives variable_count + 1 values.
+void managed_evaluate(managed_expression* managed, const double* slots, double* registers, double* results)
+{
+    long long calls = __atomic_add_fetch(&managed->calls, 1, __ATOMIC_RELAXED);
+    execution_manager* manager = managed->manager;
+    execution_engine* engine = __atomic_load_n(&managed->current, __ATOMIC_ACQUIRE);
+
+    if (engine->tier < tier_native && manager->native_threshold >= 0 && calls >= manager->native_threshold)
+    {
+        managed_expression_promote(managed, tier_native);
+    }
+    else if (engine->tier < tier_jit && manager->jit_threshold >= 0 && calls >= manager->jit_threshold)
+    {
+        managed_expression_promote(managed, tier_jit);
+    }
+    __atomic_add_fetch(&managed->tier_calls[engine->tier], 1, __ATOMIC_RELAXED);
+
+    compiled_expression* expression = managed->expression;
+    switch (engine->tier)
+    {
+        case tier_jit:
+            jit_run(engine->jit, slots, registers, results);
+            break;
+        case tier_native:
+            native_run(engine->native, slots, registers, results);
+            break;
+        default:
+        {
+            // walk the expression tree and then each partial derivative tree.
+            double bindings[BINDING_TABLE_SIZE];
+            bind_slots(bindings, expression->program->symbols, expression->variable_count, slots);
+            results[0] = evaluate_bound(expression->root, bindings);
+            for (int i = 0; i < expression->variable_count; ++i)
+            {
+                results[i + 1] = evaluate_bound(expression->partials[i], bindings);
+            }
+            break;
+        }
+    }
+}
+
+// returns the counters of a managed expression.
+execution_stats managed_expression_stats(managed_expression* managed)
+{
+    execution_stats stats;
+    stats.calls = __atomic_load_n(&managed->calls, __ATOMIC_RELAXED);
+    stats.tier = __atomic_load_n(&managed->current, __ATOMIC_ACQUIRE)->tier;
+    for (int tier = 0; tier < tier_count; ++tier)
+    {
+        stats.tier_calls[tier] = __atomic_load_n(&managed->tier_calls[tier], __ATOMIC_RELAXED);
+    }
+
+    pthread_mutex_lock(&managed->promotion_lock);
+    for (int tier = 0; tier < tier_count; ++tier)
+    {
+        stats.compile_seconds[tier] = (managed->engines[tier] != NULL) ? managed->engines[tier]->compile_seconds : 0;
+    }
+    pthread_mutex_unlock(&managed->promotion_lock);
+
+    return stats;
+}
+
+// prints the counters of every expression in the manager.
+void execution_manager_print_stats(execution_manager* manager, FILE* out)
+{
+    static const char* tier_names[] = { "interpreter", "jit", "native" };
+
+    pthread_mutex_lock(&manager->lock);
+    for (int i = 0; i < manager->expression_count; ++i)
+    {
+        managed_expression* managed = manager->expressions[i];
+        execution_stats stats = managed_expression_stats(managed);
+        char* expression_string = infix(managed->expression->root);
+        fprintf(out, "%s: calls = %lld (interpreter %lld, jit %lld, native %lld), tier = %s, "
+                "jit compile = %.3f ms, native compile = %.3f ms\n",
+                expression_string, stats.calls, stats.tier_calls[tier_interpreter], stats.tier_calls[tier_jit],
+                stats.tier_calls[tier_native], tier_names[stats.tier],
+                stats.compile_seconds[tier_jit] * 1e3, stats.compile_seconds[tier_native] * 1e3);
+        free(expression_string);
+    }
+    pthread_mutex_unlock(&manager->lock);
+}
+
+#define TIERED_BENCHMARK_EXPRESSIONS 3
+
+// evaluates a few expressions the given number of times each, promoting them at the given thresholds, and prints for
+// each the time per call on each tier, the call that first ran on each promoted tier, and the slowest single call,
+// which shows whether an evaluation ever waited for a compiler. then prints the manager's counters.
+// returns the number of evaluations whose results differ from running the expression's program.
+long long tiered_benchmark(long long evaluations, long long jit_threshold, long long native_threshold)
+{
+    static const char* texts[TIERED_BENCHMARK_EXPRESSIONS] =
+    {
+        "sin(x * y) + x ^ 2 * cos(x * y)",
+        "ln(1 + x * x) / sqrt(y ^ 2 + 1) - x * y",
+        "(x - 1) * (y + 2) * tan(x / 8)"
+    };
+    execution_manager* manager = execution_manager_create(jit_threshold, native_threshold);
+    long long failures = 0;
+    printf("%-44s%14s%14s%14s%14s%14s%14s\n", "expression", "interp ns", "jit ns", "native ns", "jit from",
+           "native from", "slowest us");
+    for (int e = 0; e < TIERED_BENCHMARK_EXPRESSIONS; ++e)
+    {
+        managed_expression* managed = execution_manager_add(manager, texts[e]);
+        const program* program = managed->expression->program;
+        double* registers = (double*)malloc(sizeof(double) * (program->length + 1));
+        double* results = (double*)malloc(sizeof(double) * (program->output_count + 1));
+        double* expected = (double*)malloc(sizeof(double) * (program->output_count + 1));
+        double slots[2];
+
+        double seconds[tier_count] = { 0 };
+        long long calls[tier_count] = { 0 };
+        long long first_call[tier_count] = { 0 };
+        double slowest = 0;
+        for (long long i = 0; i < evaluations; ++i)
+        {
+            slots[0] = 0.5 + 0.001 * (i % 1000);
+            slots[1] = 1.5 - 0.002 * (i % 500);
+            execution_tier tier = __atomic_load_n(&managed->current, __ATOMIC_ACQUIRE)->tier;
+            double start = monotonic_seconds();
+            managed_evaluate(managed, slots, registers, results);
+            double elapsed = monotonic_seconds() - start;
+
+            seconds[tier] += elapsed;
+            first_call[tier] = (calls[tier]++ == 0) ? i + 1 : first_call[tier];
+            slowest = (elapsed > slowest) ? elapsed : slowest;
+            if (i % 97 == 0)
+            {
+                program_run(program, slots, registers, expected);
+                failures += (memcmp(results, expected, sizeof(double) * program->output_count) == 0) ? 0 : 1;
+            }
+        }
+
+        printf("%-44s", texts[e]);
+        for (int tier = 0; tier < tier_count; ++tier)
+        {
+            if (calls[tier] > 0)
+            {
+                printf("%14.1f", seconds[tier] / calls[tier] * 1e9);
+            }
+            else
+            {
+                printf("%14s", "-");
+            }
+        }
+        for (int tier = tier_jit; tier < tier_count; ++tier)
+        {
+            if (calls[tier] > 0)
+            {
+                printf("%14lld", first_call[tier]);
+            }
+            else
+            {
+                printf("%14s", "-");
+            }
+        }
+        printf("%14.1f\n", slowest * 1e6);
+
+        free(registers);
+        free(results);
+        free(expected);
+    }
+
+    execution_manager_wait(manager);
+    execution_manager_print_stats(manager, stdout);
+    printf("promoted to the jit after %lld calls and to a shared object after %lld calls\n", jit_threshold, native_threshold);
+    execution_manager_free(manager);
+    return failures;
+}
+
+#endif //COURSEWORK_EXECUTION_MANAGER_H
@@ -0,0 +1,252 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "expression.h"
+#include "infix_writer.h"
+#include "c_writer.h"
+
+// is the string a valid c identifier?
+bool is_identifier(const char* name)
+{
+    if (name[0] == '\0' || (isalpha((unsigned char)name[0]) == false && name[0] != '_'))
+    {
+        return false;
+    }
+
+    for (int i = 1; name[i] != '\0'; ++i)
+    {
+        if (isalnum((unsigned char)name[i]) == false && name[i] != '_')
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// would a function of the name clash with a c keyword, a name c reserves or a function or macro of math.h, which the
+// generated header includes? a function of math.h is also taken with an f or l suffix, like sinf and sinl.
+bool is_reserved(const char* name)
+{
+    static const char* keywords[] =
+    {
+        "auto", "break", "case", "char", "const", "continue", "default", "do", "double", "else", "enum", "extern",
+        "float", "for", "goto", "if", "inline", "int", "long", "register", "restrict", "return", "short", "signed",
+        "sizeof", "static", "struct", "switch", "typedef", "union", "unsigned", "void", "volatile", "while",
+        "float_t", "double_t", "signgam", "math_errhandling", "fpclassify", "isfinite", "isinf", "isnan", "isnormal",
+        "signbit", "isgreater", "isgreaterequal", "isless", "islessequal", "islessgreater", "isunordered"
+    };
+    static const char* functions[] =
+    {
+        "acos", "asin", "atan", "atan2", "cos", "sin", "tan", "acosh", "asinh", "atanh", "cosh", "sinh", "tanh",
+        "exp", "exp2", "exp10", "expm1", "frexp", "ilogb", "ldexp", "log", "log10", "log1p", "log2", "logb", "modf",
+        "scalb", "scalbn", "scalbln", "cbrt", "fabs", "hypot", "pow", "pow10", "sqrt", "erf", "erfc", "gamma",
+        "lgamma", "tgamma", "ceil", "floor", "nearbyint", "rint", "lrint", "llrint", "round", "lround", "llround",
+        "trunc", "fmod", "remainder", "remquo", "drem", "copysign", "nan", "nextafter", "nexttoward", "fdim", "fmax",
+        "fmin", "fma", "finite", "significand", "sincos", "j0", "j1", "jn", "y0", "y1", "yn"
+    };
+
+    // names starting with an underscore and a capital or with two underscores belong to the implementation.
+    if (name[0] == '_' && (isupper((unsigned char)name[1]) || name[1] == '_'))
+    {
+        return true;
+    }
+    for (size_t i = 0; i < sizeof(keywords) / sizeof(keywords[0]); ++i)
+    {
+        if (strcmp(name, keywords[i]) == 0)
+        {
+            return true;
+        }
+    }
+
+    size_t length = strlen(name);
+    bool suffixed = length > 1 && (name[length - 1] == 'f' || name[length - 1] == 'l');
+    for (size_t i = 0; i < sizeof(functions) / sizeof(functions[0]); ++i)
+    {
+        if (strcmp(name, functions[i]) == 0 ||
+            (suffixed && strlen(functions[i]) == length - 1 && strncmp(name, functions[i], length - 1) == 0))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+// removes leading and trailing whitespace from the string in place.
+char* trim(char* str)
+{
+    while (isspace((unsigned char)*str)) { ++str; }
+
+    int length = strlen(str);
+    while (length > 0 && isspace((unsigned char)str[length - 1])) { str[--length] = '\0'; }
+
+    return str;
+}
+
+// writes the functions for one expression and each of its partial derivatives.
+void write_expression(FILE* out, const char* name, compiled_expression* expression)
+{
+    char* symbols = (char*)malloc(sizeof(char) * (expression->variable_count + 1));
+    int slot = 0;
+    for (list_node* item = expression->variables.first; item != NULL; item = item->next)
+    {
+        variable_value* pair = item->payload;
+        symbols[slot++] = pair->symbol;
+    }
+
+    char* expression_string = infix(expression->root);
+    fprintf(out, "\n// %s = %s\n", name, expression_string);
+    free(expression_string);
+    c_write_function(out, "static inline ", name, expression->root, symbols, expression->variable_count);
+
+    char* function_name = (char*)malloc(sizeof(char) * (strlen(name) + 16));
+    for (int i = 0; i < expression->variable_count; ++i)
+    {
+        sprintf(function_name, "%s_d_%c", name, symbols[i]);
+        char* diff_expression_string = infix(expression->partials[i]);
+        fprintf(out, "\n// ∂%s/∂%c = %s\n", name, symbols[i], diff_expression_string);
+        free(diff_expression_string);
+        c_write_function(out, "static inline ", function_name, expression->partials[i], symbols, expression->variable_count);
+    }
+
+    // the expression and its partials together, so the subexpressions they share are computed once.
+    tree_node** roots = (tree_node**)malloc(sizeof(tree_node*) * (expression->variable_count + 1));
+    roots[0] = expression->root;
+    for (int i = 0; i < expression->variable_count; ++i)
+    {
+        roots[i + 1] = expression->partials[i];
+    }
+    sprintf(function_name, "%s_gradient", name);
+    fprintf(out, "\n// %s and each of its partial derivatives, in the order of the parameters.\n", name);
+    c_write_results_function(out, "static inline ", function_name, roots, expression->variable_count + 1, symbols,
+                             expression->variable_count);
+
+    free(roots);
+    free(function_name);
+    free(symbols);
+}
+
+// writes the include guard for a header named after the file, EXPRC_<NAME>_H with the name in capitals and every
+// character that can't be in an identifier replaced by an underscore, so two generated headers can be included together.
+void write_guard(char* guard, size_t size, const char* path)
+{
+    const char* name = (path != NULL) ? path : "generated";
+    const char* slash = strrchr(name, '/');
+    name = (slash != NULL) ? slash + 1 : name;
+    const char* dot = strrchr(name, '.');
+    int length = (dot != NULL && dot != name) ? (int)(dot - name) : (int)strlen(name);
+
+    int written = snprintf(guard, size, "EXPRC_");
+    for (int i = 0; i < length && written + 3 < (int)size; ++i)
+    {
+        guard[written++] = isalnum((unsigned char)name[i]) ? (char)toupper((unsigned char)name[i]) : '_';
+    }
+    snprintf(guard + written, size - written, "_H");
+}
+
+// reads one expression per line, optionally named as "name = expression", and writes a c header with a static inline
+// function for each expression and for each of its partial derivatives, and one that computes them all together.
+int main(int argc, char* argv[])
+{
+    const char* input_path = NULL;
+    const char* output_path = NULL;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+        {
+            output_path = argv[++i];
+        }
+        else if (input_path == NULL && argv[i][0] != '-')
+        {
+            input_path = argv[i];
+        }
+        else
+        {
+            fprintf(stderr, "usage: %s [input] [-o output.h]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    FILE* in = (input_path == NULL) ? stdin : fopen(input_path, "r");
+    if (in == NULL)
+    {
+        fprintf(stderr, "exprc: cannot open %s\n", input_path);
+        return 1;
+    }
+
+    FILE* out = (output_path == NULL) ? stdout : fopen(output_path, "w");
+    if (out == NULL)
+    {
+        fprintf(stderr, "exprc: cannot create %s\n", output_path);
+        return 1;
+    }
+
+    // the guard is named after the output file, or the input file when writing to stdout.
+    char guard[128];
+    write_guard(guard, sizeof(guard), (output_path != NULL) ? output_path : input_path);
+    fprintf(out, "// generated by exprc, do not edit.\n");
+    fprintf(out, "#ifndef %s\n#define %s\n\n#include <math.h>\n", guard, guard);
+
+    char* line = NULL;
+    size_t line_capacity = 0;
+    int line_number = 0;
+    int expression_count = 0;
+    int errors = 0;
+    while (getline(&line, &line_capacity, in) != -1)
+    {
+        ++line_number;
+        char* text = trim(line);
+        if (text[0] == '\0' || text[0] == '#')
+        {
+            continue; // skip blank lines and comments.
+        }
+
+        // split an optional function name from the expression.
+        char name[64];
+        char* equals = strchr(text, '=');
+        if (equals != NULL)
+        {
+            *equals = '\0';
+            char* given_name = trim(text);
+            if (is_identifier(given_name) == false || strlen(given_name) >= sizeof(name) - 8)
+            {
+                fprintf(stderr, "exprc: line %d: invalid function name \"%s\"\n", line_number, given_name);
+                ++errors;
+                continue;
+            }
+            if (is_reserved(given_name))
+            {
+                fprintf(stderr, "exprc: line %d: function name \"%s\" clashes with c or math.h\n", line_number, given_name);
+                ++errors;
+                continue;
+            }
+            strcpy(name, given_name);
+            text = equals + 1;
+        }
+        else
+        {
+            sprintf(name, "expression_%d", expression_count);
+        }
+
+        compiled_expression* expression = compiled_expression_create(text);
+        if (expression == NULL)
+        {
+            fprintf(stderr, "exprc: line %d: no expression\n", line_number);
+            ++errors;
+            continue;
+        }
+
+        write_expression(out, name, expression);
+        compiled_expression_free(expression);
+        ++expression_count;
+    }
+
+    fprintf(out, "\n#endif //%s\n", guard);
+
+    free(line);
+    if (in != stdin) { fclose(in); }
+    if (out != stdout) { fclose(out); }
+    return errors == 0 ? 0 : 1;
+}
@@ -0,0 +1,89 @@
+#ifndef COURSEWORK_EXPRESSION_H
+#define COURSEWORK_EXPRESSION_H
+
+#include <stdlib.h>
+
+#include "tree.h"
+#include "list.h"
+#include "parser.h"
+#include "variables.h"
+#include "simplifier.h"
+#include "differentiator.h"
+#include "program.h"
+#include "shared_transcendentals.h"
+
+// an expression together with its partial derivatives, ready to be evaluated many times.
+typedef struct compiled_expression
+{
+    tree_node* root; // the simplified expression tree.
+    list variables; // each variable in the expression, in binding slot order.
+    int variable_count; // number of variables, which is also the number of binding slots.
+    tree_node** partials; // the simplified partial derivative with respect to each variable, in binding slot order.
+    program* program; // outputs the value of the expression followed by each partial derivative.
+} compiled_expression;
+
+// differentiates a simplified expression tree and compiles it with its partial derivatives, taking ownership of it.
+compiled_expression* compiled_expression_create_tree(tree_node* root)
+{
+    compiled_expression* expression = (compiled_expression*)malloc(sizeof(compiled_expression));
+    expression->root = root;
+    list_init(&expression->variables);
+    find_variables(root, &expression->variables);
+    expression->variable_count = list_length(&expression->variables);
+
+    expression->partials = (tree_node**)malloc(sizeof(tree_node*) * (expression->variable_count + 1));
+    int slot = 0;
+    for (list_node* item = expression->variables.first; item != NULL; item = item->next)
+    {
+        variable_value* pair = item->payload;
+        tree_node* diff_root = differentiate(root, pair->symbol);
+        simplify(diff_root);
+        expression->partials[slot++] = diff_root;
+    }
+
+    // the program computes the expression and then each partial derivative.
+    tree_node** roots = (tree_node**)malloc(sizeof(tree_node*) * (expression->variable_count + 1));
+    roots[0] = root;
+    for (int i = 0; i < expression->variable_count; ++i)
+    {
+        roots[i + 1] = expression->partials[i];
+    }
+
+    expression->program = program_compile_many(roots, expression->variable_count + 1, &expression->variables);
+    program_share_transcendentals(expression->program); // the partials repeat the functions of the expression.
+    free(roots);
+    return expression;
+}
+
+// parses, simplifies and differentiates an expression string, returns NULL if the string has no valid expression.
+compiled_expression* compiled_expression_create(const char* text)
+{
+    tree_node* root = parse_expression(text);
+    if (root == NULL)
+    {
+        return NULL;
+    }
+
+    simplify(root);
+    return compiled_expression_create_tree(root);
+}
+
+// free memory for the expression, its partial derivatives and its program.
+void compiled_expression_free(compiled_expression* expression)
+{
+    if (expression != NULL)
+    {
+        for (int i = 0; i < expression->variable_count; ++i)
+        {
+            tree_free(expression->partials[i]);
+        }
+
+        free(expression->partials);
+        tree_free(expression->root);
+        free_variables(&expression->variables);
+        program_free(expression->program);
+        free(expression);
+    }
+}
+
+#endif //COURSEWORK_EXPRESSION_H
@@ -0,0 +1,459 @@
+#ifndef COURSEWORK_EXPRESSION_CACHE_H
+#define COURSEWORK_EXPRESSION_CACHE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "expression.h"
+#include "tree_hash.h"
+#include "result_cache.h"
+
+// a compiled expression in the cache, found by the structure of its simplified tree. it is shared by each string
+// that simplifies to the same tree and by each thread using it, and freed once the last of them releases it, so an
+// expression evicted while a thread evaluates it stays alive until the thread is done.
+typedef struct cache_entry
+{
+    uint64_t hash; // hash of the simplified tree.
+    compiled_expression* expression;
+    int references; // number of strings in the cache and threads using the entry.
+    struct cache_entry* next; // next entry in the same bucket.
+    result_cache* results; // the results of the binding vectors the expression was last evaluated with, or NULL.
+    pthread_mutex_t results_lock; // protects the results, which threads evaluating the expression share.
+} cache_entry;
+
+// a normalized expression string in the cache and the compiled expression it simplifies to.
+typedef struct cache_text
+{
+    char* text;
+    uint64_t hash; // hash of the string.
+    cache_entry* entry;
+    struct cache_text* next; // next string in the same bucket.
+    struct cache_text* newer; // neighbours in the order the strings were last used.
+    struct cache_text* older;
+} cache_text;
+
+// the counters of a cache.
+typedef struct expression_cache_stats
+{
+    long long lookups; // strings looked up.
+    long long text_hits; // lookups whose normalized string was cached.
+    long long structure_hits; // lookups whose string wasn't cached, but simplified to a cached tree.
+    long long compilations; // lookups that differentiated and compiled a new tree.
+    long long invalid; // lookups of strings with no valid expression.
+    long long evictions; // strings evicted to make room for another.
+    long long expressions_freed; // compiled expressions freed once no string or thread used them.
+    long long result_lookups; // binding vectors looked up in the result caches of the expressions.
+    long long result_hits; // binding vectors whose results were cached.
+    long long result_evictions; // results evicted to make room for others.
+    int texts; // strings in the cache.
+    int expressions; // compiled expressions in the cache.
+} expression_cache_stats;
+
+// thread-safe cache of compiled expressions with two levels. the first finds a compiled expression by its string
+// with the whitespace between tokens removed, and holds at most capacity strings, evicting the least recently used
+// one to make room for another. the second finds a compiled expression by the structure of its simplified tree, so
+// strings that are written differently but simplify to the same tree, like x*y and (x * y), share one expression
+// and only the first of them is differentiated and compiled. an expression stays in the second level while a string
+// of the first level or a thread uses it.
+typedef struct expression_cache
+{
+    pthread_mutex_t lock; // protects every field and the references, order and buckets of each entry and string.
+    cache_text** text_buckets; // chained hash table of the strings.
+    cache_entry** entry_buckets; // chained hash table of the compiled expressions.
+    int bucket_count; // buckets of each table, always a power of two, at least twice the capacity.
+    cache_text* newest; // the strings from the most to the least recently used.
+    cache_text* oldest;
+    int capacity;
+    int result_capacity; // binding vectors whose results each expression keeps, or 0 for none.
+    result_policy result_policy;
+    expression_cache_stats stats; // the result counters only count expressions that were freed.
+} expression_cache;
+
+// initialise an empty cache of at most capacity strings.
+void expression_cache_init(expression_cache* cache, int capacity)
+{
+    pthread_mutex_init(&cache->lock, NULL);
+    cache->capacity = (capacity > 0) ? capacity : 1;
+    cache->bucket_count = 16;
+    while (cache->bucket_count < cache->capacity * 2)
+    {
+        cache->bucket_count *= 2;
+    }
+    cache->text_buckets = (cache_text**)calloc(cache->bucket_count, sizeof(cache_text*));
+    cache->entry_buckets = (cache_entry**)calloc(cache->bucket_count, sizeof(cache_entry*));
+    cache->newest = NULL;
+    cache->oldest = NULL;
+    cache->result_capacity = 0;
+    cache->result_policy = result_lru;
+    memset(&cache->stats, 0, sizeof(cache->stats));
+}
+
+// makes each expression compiled from now on keep the results of the last capacity binding vectors it was evaluated
+// with, evicted by the policy. for services that evaluate the same expression with the same values again and again.
+void expression_cache_memoize(expression_cache* cache, int capacity, result_policy policy)
+{
+    pthread_mutex_lock(&cache->lock);
+    cache->result_capacity = capacity;
+    cache->result_policy = policy;
+    pthread_mutex_unlock(&cache->lock);
+}
+
+// free memory for an entry, its compiled expression and its results.
+void cache_entry_free(cache_entry* entry)
+{
+    compiled_expression_free(entry->expression);
+    result_cache_free(entry->results);
+    pthread_mutex_destroy(&entry->results_lock);
+    free(entry);
+}
+
+// free memory for the cache, each string and each compiled expression, which no thread may still be using.
+void expression_cache_free(expression_cache* cache)
+{
+    for (cache_text* text = cache->newest; text != NULL;)
+    {
+        cache_text* older = text->older;
+        free(text->text);
+        free(text);
+        text = older;
+    }
+    for (int i = 0; i < cache->bucket_count; ++i)
+    {
+        for (cache_entry* entry = cache->entry_buckets[i]; entry != NULL;)
+        {
+            cache_entry* next = entry->next;
+            cache_entry_free(entry);
+            entry = next;
+        }
+    }
+    free(cache->text_buckets);
+    free(cache->entry_buckets);
+    pthread_mutex_destroy(&cache->lock);
+}
+
+// returns the string with the whitespace between tokens removed, except for one space between two characters that
+// would otherwise join into one token, like the digits of 1 2. the string is allocated on the heap.
+char* expression_cache_normalize(const char* text)
+{
+    char* normal = (char*)malloc(strlen(text) + 1);
+    int length = 0;
+    bool space = false; // whitespace was skipped since the last character copied.
+    for (const char* c = text; *c != '\0'; ++c)
+    {
+        if (is_whitespace(*c))
+        {
+            space = true;
+            continue;
+        }
+
+        bool word = is_letter(*c) || is_digit(*c) || is_decimal_point(*c);
+        if (space && length > 0 && word &&
+            (is_letter(normal[length - 1]) || is_digit(normal[length - 1]) || is_decimal_point(normal[length - 1])))
+        {
+            normal[length++] = ' ';
+        }
+        normal[length++] = *c;
+        space = false;
+    }
+    normal[length] = '\0';
+    return normal;
+}
+
+// returns the cached string, or NULL if it isn't cached. the lock must be held.
+cache_text* expression_cache_find_text(expression_cache* cache, const char* text, uint64_t hash)
+{
+    cache_text* item = cache->text_buckets[hash & (uint64_t)(cache->bucket_count - 1)];
+    while (item != NULL && (item->hash != hash || strcmp(item->text, text) != 0))
+    {
+        item = item->next;
+    }
+    return item;
+}
+
+// returns the compiled expression of a simplified tree, or NULL if it isn't cached. the lock must be held.
+cache_entry* expression_cache_find_tree(expression_cache* cache, tree_node* root, uint64_t hash)
+{
+    cache_entry* entry = cache->entry_buckets[hash & (uint64_t)(cache->bucket_count - 1)];
+    while (entry != NULL && (entry->hash != hash || tree_equal(entry->expression->root, root) == false))
+    {
+        entry = entry->next;
+    }
+    return entry;
+}
+
+// removes a string from the order of use. the lock must be held.
+void expression_cache_unlink(expression_cache* cache, cache_text* text)
+{
+    if (text->newer != NULL)
+    {
+        text->newer->older = text->older;
+    }
+    else
+    {
+        cache->newest = text->older;
+    }
+
+    if (text->older != NULL)
+    {
+        text->older->newer = text->newer;
+    }
+    else
+    {
+        cache->oldest = text->newer;
+    }
+}
+
+// makes a string the most recently used. the lock must be held.
+void expression_cache_touch(expression_cache* cache, cache_text* text)
+{
+    text->newer = NULL;
+    text->older = cache->newest;
+    if (cache->newest != NULL)
+    {
+        cache->newest->newer = text;
+    }
+    else
+    {
+        cache->oldest = text;
+    }
+    cache->newest = text;
+}
+
+// drops a reference to an entry, removing it from the cache if nothing else uses it and returning it to be freed
+// once the lock is released, otherwise returns NULL. the lock must be held.
+cache_entry* expression_cache_unreference(expression_cache* cache, cache_entry* entry)
+{
+    if (--entry->references > 0)
+    {
+        return NULL;
+    }
+
+    cache_entry** link = &cache->entry_buckets[entry->hash & (uint64_t)(cache->bucket_count - 1)];
+    while (*link != entry)
+    {
+        link = &(*link)->next;
+    }
+    *link = entry->next;
+    --cache->stats.expressions;
+    ++cache->stats.expressions_freed;
+    if (entry->results != NULL)
+    {
+        cache->stats.result_lookups += entry->results->lookups;
+        cache->stats.result_hits += entry->results->hits;
+        cache->stats.result_evictions += entry->results->evictions;
+    }
+    return entry;
+}
+
+// adds a string for an entry to the cache, evicting the least recently used string if the cache is full.
+// returns the entry of the evicted string if it is no longer used, to be freed once the lock is released.
+// the lock must be held.
+cache_entry* expression_cache_insert_text(expression_cache* cache, const char* text, uint64_t hash, cache_entry* entry)
+{
+    cache_entry* unused = NULL;
+    if (cache->stats.texts == cache->capacity)
+    {
+        cache_text* oldest = cache->oldest;
+        expression_cache_unlink(cache, oldest);
+        cache_text** link = &cache->text_buckets[oldest->hash & (uint64_t)(cache->bucket_count - 1)];
+        while (*link != oldest)
+        {
+            link = &(*link)->next;
+        }
+        *link = oldest->next;
+        unused = expression_cache_unreference(cache, oldest->entry);
+        free(oldest->text);
+        free(oldest);
+        --cache->stats.texts;
+        ++cache->stats.evictions;
+    }
+
+    cache_text* item = (cache_text*)malloc(sizeof(cache_text));
+    item->text = strdup(text);
+    item->hash = hash;
+    item->entry = entry;
+    ++entry->references;
+    cache_text** bucket = &cache->text_buckets[hash & (uint64_t)(cache->bucket_count - 1)];
+    item->next = *bucket;
+    *bucket = item;
+    expression_cache_touch(cache, item);
+    ++cache->stats.texts;
+    return unused;
+}
+
+// returns the entry of the string for the calling thread to use until it releases it, compiling the string if
+// neither it nor a string with the same simplified tree is cached. the string is parsed and compiled without holding
+// the lock, so other threads carry on meanwhile. returns NULL if the string isn't a valid expression.
+cache_entry* expression_cache_acquire(expression_cache* cache, const char* text)
+{
+    char* normal = expression_cache_normalize(text);
+    uint64_t text_key = text_hash(normal);
+    pthread_mutex_lock(&cache->lock);
+    ++cache->stats.lookups;
+    cache_text* item = expression_cache_find_text(cache, normal, text_key);
+    if (item != NULL)
+    {
+        ++cache->stats.text_hits;
+        ++item->entry->references;
+        expression_cache_unlink(cache, item);
+        expression_cache_touch(cache, item);
+        pthread_mutex_unlock(&cache->lock);
+        free(normal);
+        return item->entry;
+    }
+    pthread_mutex_unlock(&cache->lock);
+
+    tree_node* root = parse_expression(normal);
+    if (root == NULL)
+    {
+        pthread_mutex_lock(&cache->lock);
+        ++cache->stats.invalid;
+        pthread_mutex_unlock(&cache->lock);
+        free(normal);
+        return NULL;
+    }
+    simplify(root);
+    uint64_t tree_key = tree_hash(root);
+
+    // differentiate and compile the tree unless another string simplified to it, looking again afterwards in case
+    // another thread compiled the same tree meanwhile.
+    compiled_expression* expression = NULL;
+    cache_entry* entry = NULL;
+    while (true)
+    {
+        pthread_mutex_lock(&cache->lock);
+        entry = expression_cache_find_tree(cache, (expression != NULL) ? expression->root : root, tree_key);
+        if (entry != NULL || expression != NULL)
+        {
+            break;
+        }
+        pthread_mutex_unlock(&cache->lock);
+        expression = compiled_expression_create_tree(root);
+        root = NULL;
+    }
+
+    if (entry != NULL)
+    {
+        ++cache->stats.structure_hits;
+    }
+    else
+    {
+        ++cache->stats.compilations;
+        ++cache->stats.expressions;
+        entry = (cache_entry*)malloc(sizeof(cache_entry));
+        entry->hash = tree_key;
+        entry->expression = expression;
+        entry->references = 0;
+        entry->results = (cache->result_capacity > 0) ?
+                         result_cache_create(expression->program, cache->result_capacity, cache->result_policy) : NULL;
+        pthread_mutex_init(&entry->results_lock, NULL);
+        cache_entry** bucket = &cache->entry_buckets[tree_key & (uint64_t)(cache->bucket_count - 1)];
+        entry->next = *bucket;
+        *bucket = entry;
+        expression = NULL;
+    }
+
+    // the string may also have been cached by another thread meanwhile.
+    ++entry->references;
+    cache_entry* unused = NULL;
+    if (expression_cache_find_text(cache, normal, text_key) == NULL)
+    {
+        unused = expression_cache_insert_text(cache, normal, text_key, entry);
+    }
+    pthread_mutex_unlock(&cache->lock);
+
+    if (unused != NULL)
+    {
+        cache_entry_free(unused);
+    }
+    compiled_expression_free(expression);
+    tree_free(root);
+    free(normal);
+    return entry;
+}
+
+// releases an entry the calling thread acquired, freeing it if no string or other thread uses it.
+void expression_cache_release(expression_cache* cache, cache_entry* entry)
+{
+    pthread_mutex_lock(&cache->lock);
+    cache_entry* unused = expression_cache_unreference(cache, entry);
+    pthread_mutex_unlock(&cache->lock);
+    if (unused != NULL)
+    {
+        cache_entry_free(unused);
+    }
+}
+
+// evaluates the expression of an entry the calling thread acquired, copying its results from the entry's result
+// cache if the binding vector is in it. the program runs without holding the lock of the result cache.
+void expression_cache_evaluate(cache_entry* entry, const double* slots, double* registers, double* results)
+{
+    const program* program = entry->expression->program;
+    if (entry->results == NULL)
+    {
+        program_run(program, slots, registers, results);
+        return;
+    }
+
+    result_cache* memo = entry->results;
+    uint64_t hash = result_cache_hash(memo, slots);
+    pthread_mutex_lock(&entry->results_lock);
+    bool found = result_cache_find_hashed(memo, slots, hash, results);
+    pthread_mutex_unlock(&entry->results_lock);
+    if (found)
+    {
+        return;
+    }
+
+    program_run(program, slots, registers, results);
+    pthread_mutex_lock(&entry->results_lock);
+    if (result_cache_index(memo, slots, hash) < 0) // another thread may have stored the same binding vector meanwhile.
+    {
+        result_cache_store_hashed(memo, slots, hash, results);
+    }
+    pthread_mutex_unlock(&entry->results_lock);
+}
+
+// returns a copy of the counters of the cache, adding up the result counters of every expression in it.
+expression_cache_stats expression_cache_get_stats(expression_cache* cache)
+{
+    pthread_mutex_lock(&cache->lock);
+    expression_cache_stats stats = cache->stats;
+    for (int i = 0; i < cache->bucket_count; ++i)
+    {
+        for (cache_entry* entry = cache->entry_buckets[i]; entry != NULL; entry = entry->next)
+        {
+            if (entry->results != NULL)
+            {
+                pthread_mutex_lock(&entry->results_lock);
+                stats.result_lookups += entry->results->lookups;
+                stats.result_hits += entry->results->hits;
+                stats.result_evictions += entry->results->evictions;
+                pthread_mutex_unlock(&entry->results_lock);
+            }
+        }
+    }
+    pthread_mutex_unlock(&cache->lock);
+    return stats;
+}
+
+// prints the counters of the cache and its hit rate.
+void expression_cache_print_stats(const expression_cache_stats* stats, FILE* out)
+{
+    long long hits = stats->text_hits + stats->structure_hits;
+    fprintf(out, "cache: %lld lookups, %lld string hits, %lld structure hits, %lld compilations, %lld invalid\n",
+            stats->lookups, stats->text_hits, stats->structure_hits, stats->compilations, stats->invalid);
+    fprintf(out, "cache: %.1f%% hit rate, %lld evictions, %lld expressions freed, %d strings, %d expressions\n",
+            (stats->lookups > 0) ? 100.0 * hits / stats->lookups : 0.0, stats->evictions, stats->expressions_freed,
+            stats->texts, stats->expressions);
+    if (stats->result_lookups > 0)
+    {
+        fprintf(out, "results: %lld lookups, %lld hits, %.1f%% hit ratio, %lld evictions\n", stats->result_lookups,
+                stats->result_hits, 100.0 * stats->result_hits / stats->result_lookups, stats->result_evictions);
+    }
+}
+
+#endif //COURSEWORK_EXPRESSION_CACHE_H
@@ -0,0 +1,351 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "expression_calculator.h"
+#include "expression.h"
+#include "tree_hash.h"
+
+// the library is this one translation unit, which includes the headers that define the calculator, so their
+// functions are defined once and stay hidden behind the functions declared in expression_calculator.h.
+// evaluation never binds values into the trees with set_variables, it runs the compiled program with the values as
+// its slots and the context's registers as scratch, so nothing shared is written while evaluating.
+
+#define CALCULATOR_BUCKETS 1024 // buckets of a registry's name table, which never grows so readers need no lock.
+#define CALCULATOR_LINE 64 // size of a cache line.
+
+struct calculator_expression
+{
+    compiled_expression* compiled;
+    char* text;
+    char* symbols; // the variable of each slot.
+};
+
+struct calculator_context
+{
+    uint64_t epoch; // the registry epoch the thread entered in, or 0 outside the registry. updated atomically.
+    char padding[CALCULATOR_LINE - sizeof(uint64_t)]; // the epoch has a cache line to itself.
+    calculator_registry* registry;
+    double* registers;
+    int register_capacity;
+    calculator_context* next; // the next context reading the same registry.
+};
+
+// a name with the expression currently published under it. a name is never removed until the registry is freed.
+struct calculator_name
+{
+    char* name;
+    uint64_t hash;
+    calculator_expression* expression; // read and swapped atomically, NULL until one is published.
+    calculator_name* next; // the next name in the same bucket, set before the name is added.
+};
+
+// an expression replaced in the given epoch, which readers that entered in that epoch or before may still use.
+typedef struct calculator_retired
+{
+    calculator_expression* expression;
+    uint64_t epoch;
+    struct calculator_retired* next;
+} calculator_retired;
+
+struct calculator_registry
+{
+    calculator_name* buckets[CALCULATOR_BUCKETS]; // each bucket is read and set atomically.
+    uint64_t epoch; // advanced atomically each time an expression is replaced. starts at 1.
+    calculator_context* contexts;
+    calculator_retired* retired; // newest first.
+    int retired_count;
+    pthread_mutex_t lock; // held by writers, and to add or remove a context.
+};
+
+CALCULATOR_API calculator_expression* calculator_compile(const char* text, char* error)
+{
+    compiled_expression* compiled = compiled_expression_create(text);
+    if (compiled == NULL)
+    {
+        snprintf(error, CALCULATOR_ERROR_SIZE, "no valid expression in \"%.64s\"", text);
+        return NULL;
+    }
+
+    calculator_expression* expression = (calculator_expression*)malloc(sizeof(calculator_expression));
+    expression->compiled = compiled;
+    expression->text = strdup(text);
+    expression->symbols = (char*)malloc(sizeof(char) * (compiled->variable_count + 1));
+    int slot = 0;
+    for (list_node* item = compiled->variables.first; item != NULL; item = item->next)
+    {
+        variable_value* pair = item->payload;
+        expression->symbols[slot++] = pair->symbol;
+    }
+    expression->symbols[slot] = '\0';
+    return expression;
+}
+
+CALCULATOR_API void calculator_expression_free(calculator_expression* expression)
+{
+    if (expression != NULL)
+    {
+        compiled_expression_free(expression->compiled);
+        free(expression->text);
+        free(expression->symbols);
+        free(expression);
+    }
+}
+
+CALCULATOR_API const char* calculator_text(const calculator_expression* expression)
+{
+    return expression->text;
+}
+
+CALCULATOR_API int calculator_variable_count(const calculator_expression* expression)
+{
+    return expression->compiled->variable_count;
+}
+
+CALCULATOR_API char calculator_variable(const calculator_expression* expression, int slot)
+{
+    return expression->symbols[slot];
+}
+
+CALCULATOR_API calculator_context* calculator_context_create(calculator_registry* registry)
+{
+    void* memory = NULL;
+    if (posix_memalign(&memory, CALCULATOR_LINE, sizeof(calculator_context)) != 0)
+    {
+        return NULL;
+    }
+
+    calculator_context* context = (calculator_context*)memory;
+    context->epoch = 0;
+    context->registry = registry;
+    context->register_capacity = 64;
+    context->registers = (double*)malloc(sizeof(double) * context->register_capacity);
+    context->next = NULL;
+    if (registry != NULL)
+    {
+        pthread_mutex_lock(&registry->lock);
+        context->next = registry->contexts;
+        registry->contexts = context;
+        pthread_mutex_unlock(&registry->lock);
+    }
+    return context;
+}
+
+CALCULATOR_API void calculator_context_free(calculator_context* context)
+{
+    if (context == NULL)
+    {
+        return;
+    }
+
+    calculator_registry* registry = context->registry;
+    if (registry != NULL)
+    {
+        pthread_mutex_lock(&registry->lock);
+        calculator_context** link = &registry->contexts;
+        while (*link != context)
+        {
+            link = &(*link)->next;
+        }
+        *link = context->next;
+        pthread_mutex_unlock(&registry->lock);
+    }
+    free(context->registers);
+    free(context);
+}
+
+CALCULATOR_API void calculator_evaluate(calculator_context* context, const calculator_expression* expression,
+                                        const double* values, double* results)
+{
+    const program* program = expression->compiled->program;
+    if (program->length > context->register_capacity)
+    {
+        while (context->register_capacity < program->length)
+        {
+            context->register_capacity *= 2;
+        }
+        free(context->registers);
+        context->registers = (double*)malloc(sizeof(double) * context->register_capacity);
+    }
+    program_run(program, values, context->registers, results);
+}
+
+CALCULATOR_API calculator_registry* calculator_registry_create()
+{
+    calculator_registry* registry = (calculator_registry*)malloc(sizeof(calculator_registry));
+    for (int i = 0; i < CALCULATOR_BUCKETS; ++i)
+    {
+        registry->buckets[i] = NULL;
+    }
+    registry->epoch = 1;
+    registry->contexts = NULL;
+    registry->retired = NULL;
+    registry->retired_count = 0;
+    pthread_mutex_init(&registry->lock, NULL);
+    return registry;
+}
+
+CALCULATOR_API void calculator_registry_free(calculator_registry* registry)
+{
+    if (registry == NULL)
+    {
+        return;
+    }
+
+    for (int i = 0; i < CALCULATOR_BUCKETS; ++i)
+    {
+        calculator_name* name = registry->buckets[i];
+        while (name != NULL)
+        {
+            calculator_name* next = name->next;
+            calculator_expression_free(name->expression);
+            free(name->name);
+            free(name);
+            name = next;
+        }
+    }
+
+    while (registry->retired != NULL)
+    {
+        calculator_retired* next = registry->retired->next;
+        calculator_expression_free(registry->retired->expression);
+        free(registry->retired);
+        registry->retired = next;
+    }
+    pthread_mutex_destroy(&registry->lock);
+    free(registry);
+}
+
+// frees the replaced expressions no reader can still be using. the registry's lock must be held.
+void calculator_registry_reclaim(calculator_registry* registry)
+{
+    // a reader that entered in a later epoch than an expression was replaced in can only have found its replacement.
+    uint64_t oldest = UINT64_MAX;
+    for (calculator_context* context = registry->contexts; context != NULL; context = context->next)
+    {
+        uint64_t epoch = __atomic_load_n(&context->epoch, __ATOMIC_SEQ_CST);
+        oldest = (epoch != 0 && epoch < oldest) ? epoch : oldest;
+    }
+
+    calculator_retired** link = &registry->retired;
+    while (*link != NULL)
+    {
+        calculator_retired* retired = *link;
+        if (retired->epoch < oldest)
+        {
+            *link = retired->next;
+            calculator_expression_free(retired->expression);
+            free(retired);
+            --registry->retired_count;
+        }
+        else
+        {
+            link = &retired->next;
+        }
+    }
+}
+
+// returns the name in the registry, adding it without an expression if it isn't there. the registry's lock must be
+// held.
+calculator_name* calculator_registry_add(calculator_registry* registry, const char* name)
+{
+    uint64_t hash = text_hash(name);
+    calculator_name** bucket = &registry->buckets[hash % CALCULATOR_BUCKETS];
+    calculator_name* found = *bucket;
+    while (found != NULL && (found->hash != hash || strcmp(found->name, name) != 0))
+    {
+        found = found->next;
+    }
+
+    if (found == NULL)
+    {
+        found = (calculator_name*)malloc(sizeof(calculator_name));
+        found->name = strdup(name);
+        found->hash = hash;
+        found->expression = NULL;
+        found->next = *bucket;
+        __atomic_store_n(bucket, found, __ATOMIC_RELEASE);
+    }
+    return found;
+}
+
+CALCULATOR_API calculator_name* calculator_registry_name(calculator_registry* registry, const char* name)
+{
+    pthread_mutex_lock(&registry->lock);
+    calculator_name* found = calculator_registry_add(registry, name);
+    pthread_mutex_unlock(&registry->lock);
+    return found;
+}
+
+CALCULATOR_API void calculator_registry_publish(calculator_registry* registry, const char* name,
+                                                calculator_expression* expression)
+{
+    pthread_mutex_lock(&registry->lock);
+    calculator_name* found = calculator_registry_add(registry, name);
+    calculator_expression* replaced = __atomic_exchange_n(&found->expression, expression, __ATOMIC_SEQ_CST);
+    if (replaced != NULL)
+    {
+        // readers that enter after the epoch advances find the new expression, so the old one is retired in the
+        // epoch before that.
+        calculator_retired* retired = (calculator_retired*)malloc(sizeof(calculator_retired));
+        retired->expression = replaced;
+        retired->epoch = __atomic_fetch_add(&registry->epoch, 1, __ATOMIC_SEQ_CST);
+        retired->next = registry->retired;
+        registry->retired = retired;
+        ++registry->retired_count;
+        calculator_registry_reclaim(registry);
+    }
+    pthread_mutex_unlock(&registry->lock);
+}
+
+CALCULATOR_API int calculator_registry_retired(calculator_registry* registry)
+{
+    pthread_mutex_lock(&registry->lock);
+    calculator_registry_reclaim(registry);
+    int count = registry->retired_count;
+    pthread_mutex_unlock(&registry->lock);
+    return count;
+}
+
+CALCULATOR_API void calculator_enter(calculator_context* context)
+{
+    // the store must be ordered before the reads of the registry, which a release store alone wouldn't be.
+    uint64_t epoch = __atomic_load_n(&context->registry->epoch, __ATOMIC_ACQUIRE);
+    __atomic_store_n(&context->epoch, epoch, __ATOMIC_SEQ_CST);
+}
+
+CALCULATOR_API void calculator_leave(calculator_context* context)
+{
+    __atomic_store_n(&context->epoch, 0, __ATOMIC_RELEASE);
+}
+
+CALCULATOR_API const calculator_expression* calculator_find(calculator_context* context, const char* name)
+{
+    uint64_t hash = text_hash(name);
+    calculator_name* found = __atomic_load_n(&context->registry->buckets[hash % CALCULATOR_BUCKETS], __ATOMIC_ACQUIRE);
+    while (found != NULL && (found->hash != hash || strcmp(found->name, name) != 0))
+    {
+        found = found->next;
+    }
+    return (found != NULL) ? calculator_current(found) : NULL;
+}
+
+CALCULATOR_API const calculator_expression* calculator_current(const calculator_name* name)
+{
+    return __atomic_load_n(&name->expression, __ATOMIC_SEQ_CST);
+}
+
+CALCULATOR_API bool calculator_evaluate_named(calculator_context* context, const calculator_name* name,
+                                              const double* values, double* results)
+{
+    calculator_enter(context);
+    const calculator_expression* expression = calculator_current(name);
+    if (expression != NULL)
+    {
+        calculator_evaluate(context, expression, values, results);
+    }
+    calculator_leave(context);
+    return expression != NULL;
+}
@@ -0,0 +1,90 @@
+#ifndef COURSEWORK_EXPRESSION_CALCULATOR_H
+#define COURSEWORK_EXPRESSION_CALCULATOR_H
+
+#include <stdbool.h>
+
+// the library interface of the calculator. unlike the other headers, this one only declares its functions, which are
+// defined once in expression_calculator.c, so any number of translation units can include it and link the library.
+// every other symbol of the library is hidden.
+
+#define CALCULATOR_API __attribute__((visibility("default")))
+#define CALCULATOR_ERROR_SIZE 128 // size of the error buffers passed to the library.
+
+// a compiled expression with its partial derivatives. it never changes once compiled, so any number of threads can
+// evaluate it at the same time.
+typedef struct calculator_expression calculator_expression;
+
+// what one thread needs to evaluate expressions: scratch registers and its place in a registry's read epochs.
+// a context must only be used by one thread at a time.
+typedef struct calculator_context calculator_context;
+
+// named expressions that writers replace atomically while readers keep evaluating them without taking a lock.
+typedef struct calculator_registry calculator_registry;
+
+// a name in a registry, which readers can find its current expression by without looking the name up again.
+typedef struct calculator_name calculator_name;
+
+// compiles an expression string, returns NULL and sets error if the string has no valid expression.
+CALCULATOR_API calculator_expression* calculator_compile(const char* text, char* error);
+
+// free memory for an expression that was never published to a registry.
+CALCULATOR_API void calculator_expression_free(calculator_expression* expression);
+
+// returns the string the expression was compiled from.
+CALCULATOR_API const char* calculator_text(const calculator_expression* expression);
+
+// returns the number of variables of the expression, which is also the number of values an evaluation takes.
+CALCULATOR_API int calculator_variable_count(const calculator_expression* expression);
+
+// returns the variable bound to a slot of the expression.
+CALCULATOR_API char calculator_variable(const calculator_expression* expression, int slot);
+
+// create a context for one thread, taking part in the read epochs of the registry if it isn't NULL.
+CALCULATOR_API calculator_context* calculator_context_create(calculator_registry* registry);
+
+// free memory for the context. the thread must not be reading the registry.
+CALCULATOR_API void calculator_context_free(calculator_context* context);
+
+// evaluates the expression with a value for each of its variables in slot order, and writes its value followed by
+// each partial derivative to results, which must have room for one more value than there are variables.
+CALCULATOR_API void calculator_evaluate(calculator_context* context, const calculator_expression* expression,
+                                        const double* values, double* results);
+
+// create an empty registry.
+CALCULATOR_API calculator_registry* calculator_registry_create();
+
+// free memory for the registry and every expression published to it. each of its contexts must be freed first.
+CALCULATOR_API void calculator_registry_free(calculator_registry* registry);
+
+// publishes the expression under the name, taking ownership of it. readers that already found the expression it
+// replaces keep using that one until they leave the registry, and it is freed after the last of them has.
+CALCULATOR_API void calculator_registry_publish(calculator_registry* registry, const char* name,
+                                                calculator_expression* expression);
+
+// returns the name in the registry, adding it without an expression if it isn't there. a name stays valid until the
+// registry is freed.
+CALCULATOR_API calculator_name* calculator_registry_name(calculator_registry* registry, const char* name);
+
+// returns the number of replaced expressions some reader may still be using.
+CALCULATOR_API int calculator_registry_retired(calculator_registry* registry);
+
+// starts reading the registry of the context. expressions found before leaving stay valid until then, so a reader
+// should leave soon: nothing replaced after it entered is freed while it stays.
+CALCULATOR_API void calculator_enter(calculator_context* context);
+
+// stops reading the registry of the context.
+CALCULATOR_API void calculator_leave(calculator_context* context);
+
+// returns the expression published under the name, or NULL if there is none. must be called between enter and leave.
+CALCULATOR_API const calculator_expression* calculator_find(calculator_context* context, const char* name);
+
+// returns the expression currently published under a name of a registry, or NULL if there is none.
+// must be called between enter and leave.
+CALCULATOR_API const calculator_expression* calculator_current(const calculator_name* name);
+
+// evaluates the expression currently published under the name like calculator_evaluate, entering and leaving the
+// registry around it, so it must not be called between enter and leave. returns false if the name has no expression.
+CALCULATOR_API bool calculator_evaluate_named(calculator_context* context, const calculator_name* name,
+                                              const double* values, double* results);
+
+#endif //COURSEWORK_EXPRESSION_CALCULATOR_H
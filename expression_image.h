@@ -0,0 +1,703 @@
+#ifndef COURSEWORK_EXPRESSION_IMAGE_H
+#define COURSEWORK_EXPRESSION_IMAGE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdbool.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "expression.h"
+
+#define EXPRESSION_IMAGE_MAGIC "EXPRIMG1" // the first 8 bytes of every expression image.
+#define EXPRESSION_IMAGE_VERSION 1 // changed whenever the format of an image changes.
+#define EXPRESSION_IMAGE_ERROR_SIZE 128 // longest error message of an expression image function.
+#define EXPRESSION_IMAGE_BASE 0x100000000000ULL // lowest address an image asks to be mapped at, far above the heap.
+#define EXPRESSION_IMAGE_SPACING (1ULL << 34) // distance between the addresses images ask for.
+#define EXPRESSION_IMAGE_SPACES 1024 // number of addresses images ask for, so images rarely ask for the same one.
+
+#ifndef MAP_FIXED_NOREPLACE
+#define MAP_FIXED_NOREPLACE 0x100000 // older headers lack the flag, and older kernels take the address as a hint.
+#endif
+
+// an expression image holds compiled expressions exactly as they are laid out in memory, with each pointer already
+// pointing where it would if the image were mapped at its base address. a loader that gets the base address uses the
+// expressions where they lie, with no pointer to move, and its pages are shared by every process that maps the image.
+// otherwise the image ends with a table of the pointers, and the loader moves each one to where the image was mapped
+// in one pass. either way each pointer and index is checked before the image is used, so a damaged image is rejected.
+// the layout of the structs is part of the format, so an image is only loaded by a build with the same layout.
+typedef struct expression_image_header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t expression_count;
+    uint64_t layout; // fingerprint of the size, field offsets and byte order of each struct in the image.
+    uint64_t base; // the address the pointers of the image point into.
+    uint64_t size; // size of the image in bytes, including the pointer table.
+    uint64_t expressions_offset; // offset of the array of expression_count compiled expressions.
+    uint64_t texts_offset; // offset of the array of the text each expression was compiled from.
+    uint64_t pointers_offset; // offset of the pointer table, each entry is the offset of a pointer divided by 8.
+    uint64_t pointer_count;
+} expression_image_header;
+
+// an expression image mapped into memory. the expressions are read-only and owned by the mapping, so they are never
+// passed to compiled_expression_free.
+typedef struct expression_image
+{
+    void* mapped;
+    size_t mapped_size;
+    int expression_count;
+    compiled_expression* expressions;
+    const char* const* texts;
+} expression_image;
+
+// returns a fingerprint of the layout of the structs stored in an image.
+uint64_t expression_image_layout()
+{
+    uint32_t byte_order = 0x01020304;
+    uint64_t fields[] =
+    {
+        sizeof(void*), *(const uint8_t*)&byte_order, sizeof(expression_image_header),
+        sizeof(token), offsetof(token, symbol), offsetof(token, value),
+        sizeof(tree_node), offsetof(tree_node, left_child), offsetof(tree_node, right_child),
+        sizeof(list_node), offsetof(list_node, next), offsetof(list_node, prev),
+        sizeof(variable_value), offsetof(variable_value, value),
+        sizeof(instruction), offsetof(instruction, partner), offsetof(instruction, value),
+        sizeof(program), offsetof(program, symbols), offsetof(program, outputs), offsetof(program, lookup),
+        sizeof(compiled_expression), offsetof(compiled_expression, variables), offsetof(compiled_expression, partials),
+        offsetof(compiled_expression, program)
+    };
+
+    uint64_t layout = 0;
+    for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); ++i)
+    {
+        layout = hash_combine(layout, fields[i]);
+    }
+    return layout;
+}
+
+// an image being written, the buffer holds the image and the pointers array holds the pointer table.
+typedef struct image_writer
+{
+    char* data;
+    size_t size;
+    size_t capacity;
+    uint32_t* pointers;
+    size_t pointer_count;
+    size_t pointer_capacity;
+} image_writer;
+
+// initialise an empty image.
+void image_writer_init(image_writer* writer)
+{
+    writer->data = NULL;
+    writer->size = 0;
+    writer->capacity = 0;
+    writer->pointers = NULL;
+    writer->pointer_count = 0;
+    writer->pointer_capacity = 0;
+}
+
+// free memory for the image.
+void image_writer_free(image_writer* writer)
+{
+    free(writer->data);
+    free(writer->pointers);
+    image_writer_init(writer);
+}
+
+// reserves zeroed space for size bytes at the end of the image, aligned for any struct, and returns its offset.
+// the buffer may move, so the image is addressed by offsets until it is written.
+uint64_t image_writer_reserve(image_writer* writer, size_t size)
+{
+    size_t offset = (writer->size + 7) / 8 * 8;
+    if (offset + size > writer->capacity)
+    {
+        writer->capacity = (writer->capacity > 0) ? writer->capacity : 4096;
+        while (offset + size > writer->capacity)
+        {
+            writer->capacity *= 2;
+        }
+        writer->data = (char*)realloc(writer->data, writer->capacity);
+    }
+
+    memset(writer->data + writer->size, 0, offset + size - writer->size);
+    writer->size = offset + size;
+    return offset;
+}
+
+// returns the address in the buffer of an offset of the image.
+void* image_writer_at(image_writer* writer, uint64_t offset)
+{
+    return writer->data + offset;
+}
+
+// stores a pointer to the target offset in the pointer field at the given offset and adds it to the pointer table.
+// the pointer is stored as an offset until the image is written. an offset of 0 is the header, which is never a
+// target, so it stands for NULL and needs no entry in the table.
+void image_writer_pointer(image_writer* writer, uint64_t field, uint64_t target)
+{
+    uintptr_t value = (uintptr_t)target;
+    memcpy(writer->data + field, &value, sizeof(value));
+    if (target == 0)
+    {
+        return;
+    }
+
+    if (writer->pointer_count == writer->pointer_capacity)
+    {
+        writer->pointer_capacity = (writer->pointer_capacity > 0) ? writer->pointer_capacity * 2 : 1024;
+        writer->pointers = (uint32_t*)realloc(writer->pointers, sizeof(uint32_t) * writer->pointer_capacity);
+    }
+    writer->pointers[writer->pointer_count++] = (uint32_t)(field / 8);
+}
+
+// copies a string to the image, returns its offset.
+uint64_t image_writer_string(image_writer* writer, const char* text)
+{
+    text = (text != NULL) ? text : "";
+    size_t length = strlen(text);
+    uint64_t offset = image_writer_reserve(writer, length + 1);
+    memcpy(image_writer_at(writer, offset), text, length);
+    return offset;
+}
+
+// copies a tree to the image as one array of nodes in post-order, returns the offset of its root or 0 for no tree.
+// in post-order the right child of a node comes just before it, and the left child comes before the whole right
+// subtree, so the size of each subtree is enough to find the children without a map from nodes to offsets.
+uint64_t image_writer_tree(image_writer* writer, tree_node* root)
+{
+    if (root == NULL)
+    {
+        return 0;
+    }
+
+    node_stack order;
+    node_stack_init(&order);
+    tree_postorder(root, &order);
+
+    uint64_t first = image_writer_reserve(writer, sizeof(tree_node) * order.count);
+    int* sizes = (int*)malloc(sizeof(int) * order.count);
+    for (int i = 0; i < order.count; ++i)
+    {
+        tree_node* node = order.nodes[i];
+        int right = (node->right_child != NULL) ? i - 1 : -1;
+        int left = (node->left_child == NULL) ? -1 : (right >= 0) ? right - sizes[right] : i - 1;
+        sizes[i] = 1 + ((left >= 0) ? sizes[left] : 0) + ((right >= 0) ? sizes[right] : 0);
+
+        uint64_t offset = first + sizeof(tree_node) * i;
+        tree_node* copy = image_writer_at(writer, offset);
+        copy->token.type = node->token.type;
+        copy->token.symbol = node->token.symbol;
+        copy->token.value = node->token.value;
+        image_writer_pointer(writer, offset + offsetof(tree_node, left_child),
+                             (left >= 0) ? first + sizeof(tree_node) * left : 0);
+        image_writer_pointer(writer, offset + offsetof(tree_node, right_child),
+                             (right >= 0) ? first + sizeof(tree_node) * right : 0);
+    }
+
+    uint64_t root_offset = first + sizeof(tree_node) * (order.count - 1);
+    free(sizes);
+    node_stack_free(&order);
+    return root_offset;
+}
+
+// copies a program to the image without its hash table, which is only needed while compiling, returns its offset.
+uint64_t image_writer_program(image_writer* writer, const program* source)
+{
+    uint64_t offset = image_writer_reserve(writer, sizeof(program));
+    program* copy = image_writer_at(writer, offset);
+    program_init(copy);
+    copy->length = source->length;
+    copy->capacity = source->length;
+    copy->slot_count = source->slot_count;
+    copy->output_count = source->output_count;
+    copy->eliminated = source->eliminated;
+
+    uint64_t code = image_writer_reserve(writer, sizeof(instruction) * source->length);
+    memcpy(image_writer_at(writer, code), source->code, sizeof(instruction) * source->length);
+    image_writer_pointer(writer, offset + offsetof(program, code), code);
+
+    uint64_t symbols = image_writer_reserve(writer, sizeof(char) * (source->slot_count + 1));
+    memcpy(image_writer_at(writer, symbols), source->symbols, sizeof(char) * source->slot_count);
+    image_writer_pointer(writer, offset + offsetof(program, symbols), symbols);
+
+    uint64_t outputs = image_writer_reserve(writer, sizeof(int) * (source->output_count + 1));
+    memcpy(image_writer_at(writer, outputs), source->outputs, sizeof(int) * source->output_count);
+    image_writer_pointer(writer, offset + offsetof(program, outputs), outputs);
+    return offset;
+}
+
+// copies a compiled expression to the reserved space for it at the given offset.
+void image_writer_expression(image_writer* writer, uint64_t offset, const compiled_expression* source)
+{
+    ((compiled_expression*)image_writer_at(writer, offset))->variable_count = source->variable_count;
+    image_writer_pointer(writer, offset + offsetof(compiled_expression, root), image_writer_tree(writer, source->root));
+
+    // the variables list, with each node next to its variable.
+    uint64_t previous = 0;
+    for (list_node* item = source->variables.first; item != NULL; item = item->next)
+    {
+        uint64_t node = image_writer_reserve(writer, sizeof(list_node) + sizeof(variable_value));
+        uint64_t pair = node + sizeof(list_node);
+        *(variable_value*)image_writer_at(writer, pair) = *(variable_value*)item->payload;
+        image_writer_pointer(writer, node + offsetof(list_node, payload), pair);
+        image_writer_pointer(writer, node + offsetof(list_node, prev), previous);
+        if (previous == 0)
+        {
+            image_writer_pointer(writer, offset + offsetof(compiled_expression, variables) + offsetof(list, first), node);
+        }
+        else
+        {
+            image_writer_pointer(writer, previous + offsetof(list_node, next), node);
+        }
+        previous = node;
+    }
+    image_writer_pointer(writer, offset + offsetof(compiled_expression, variables) + offsetof(list, last), previous);
+
+    uint64_t partials = image_writer_reserve(writer, sizeof(tree_node*) * (source->variable_count + 1));
+    for (int i = 0; i < source->variable_count; ++i)
+    {
+        image_writer_pointer(writer, partials + sizeof(tree_node*) * i, image_writer_tree(writer, source->partials[i]));
+    }
+    image_writer_pointer(writer, offset + offsetof(compiled_expression, partials), partials);
+    image_writer_pointer(writer, offset + offsetof(compiled_expression, program), image_writer_program(writer, source->program));
+}
+
+// returns the base address for an image of the expressions with the given texts.
+uint64_t expression_image_base(const char* const* texts, int count)
+{
+    uint64_t hash = 0;
+    for (int i = 0; i < count; ++i)
+    {
+        for (const char* c = texts[i]; c != NULL && *c != '\0'; ++c)
+        {
+            hash = hash_combine(hash, (uint64_t)*c);
+        }
+    }
+    return EXPRESSION_IMAGE_BASE + hash % EXPRESSION_IMAGE_SPACES * EXPRESSION_IMAGE_SPACING;
+}
+
+// writes compiled expressions and the text each was compiled from to an image file.
+// returns false and sets error if the file can't be written.
+bool expression_image_write(const char* path, compiled_expression* const* expressions, const char* const* texts,
+                            int count, char* error)
+{
+    image_writer writer;
+    image_writer_init(&writer);
+    uint64_t header = image_writer_reserve(&writer, sizeof(expression_image_header));
+    uint64_t array = image_writer_reserve(&writer, sizeof(compiled_expression) * count);
+    uint64_t text_array = image_writer_reserve(&writer, sizeof(char*) * count);
+    for (int i = 0; i < count; ++i)
+    {
+        image_writer_expression(&writer, array + sizeof(compiled_expression) * i, expressions[i]);
+        image_writer_pointer(&writer, text_array + sizeof(char*) * i, image_writer_string(&writer, texts[i]));
+    }
+
+    uint64_t pointers = image_writer_reserve(&writer, sizeof(uint32_t) * writer.pointer_count);
+    memcpy(image_writer_at(&writer, pointers), writer.pointers, sizeof(uint32_t) * writer.pointer_count);
+    if (pointers / 8 > UINT32_MAX)
+    {
+        image_writer_free(&writer);
+        snprintf(error, EXPRESSION_IMAGE_ERROR_SIZE, "the expressions are too large for one image");
+        return false;
+    }
+
+    // point each pointer into the image mapped at its base address.
+    uint64_t base = expression_image_base(texts, count);
+    for (size_t i = 0; i < writer.pointer_count; ++i)
+    {
+        *(uintptr_t*)image_writer_at(&writer, (uint64_t)writer.pointers[i] * 8) += (uintptr_t)base;
+    }
+
+    expression_image_header* fields = image_writer_at(&writer, header);
+    memcpy(fields->magic, EXPRESSION_IMAGE_MAGIC, 8);
+    fields->version = EXPRESSION_IMAGE_VERSION;
+    fields->expression_count = count;
+    fields->layout = expression_image_layout();
+    fields->base = base;
+    fields->size = writer.size;
+    fields->expressions_offset = array;
+    fields->texts_offset = text_array;
+    fields->pointers_offset = pointers;
+    fields->pointer_count = writer.pointer_count;
+
+    FILE* file = fopen(path, "wb");
+    bool written = file != NULL && fwrite(writer.data, 1, writer.size, file) == writer.size;
+    written = (file != NULL && fclose(file) == 0) && written;
+    if (written == false)
+    {
+        snprintf(error, EXPRESSION_IMAGE_ERROR_SIZE, "can't write %s", path);
+    }
+    image_writer_free(&writer);
+    return written;
+}
+
+// the part of a mapped image that holds the expressions, which every pointer of an expression must point into.
+typedef struct image_bounds
+{
+    const char* mapped;
+    uint64_t limit; // offset of the pointer table, which ends the expressions.
+    long long nodes_left; // tree nodes that may still be visited, so subtrees shared by a damaged image end quickly.
+} image_bounds;
+
+// does the pointer point into the expressions of the image, aligned like every object the writer reserves, with room
+// for count objects of the given size?
+bool image_span_valid(const image_bounds* bounds, const void* pointer, size_t size, uint64_t count)
+{
+    uint64_t offset = (uint64_t)((uintptr_t)pointer - (uintptr_t)bounds->mapped);
+    return pointer != NULL && offset % 8 == 0 && offset <= bounds->limit && count <= (bounds->limit - offset) / size;
+}
+
+// is the tree laid out as image_writer_tree writes it, with every node inside the image, each child before its parent
+// and the children each type of token has? no tree is valid too.
+bool image_tree_valid(image_bounds* bounds, const tree_node* root)
+{
+    if (root == NULL)
+    {
+        return true;
+    }
+
+    int count = 0;
+    int capacity = 64;
+    const tree_node** pending = (const tree_node**)malloc(sizeof(tree_node*) * capacity);
+    bool valid = image_span_valid(bounds, root, sizeof(tree_node), 1);
+    pending[count++] = root;
+    while (valid && count > 0)
+    {
+        const tree_node* node = pending[--count];
+        token_type type = node->token.type;
+        bool binary = type >= addition && type <= power;
+        bool has_left = binary || (type >= squareroot && type <= tangent); // a function's argument is on the left.
+        bool has_right = binary || type == negation; // a negation's operand is on the right.
+        valid = --bounds->nodes_left >= 0 && type >= addition && type <= variable &&
+                (node->left_child != NULL) == has_left && (node->right_child != NULL) == has_right;
+
+        const tree_node* children[2] = { node->left_child, node->right_child };
+        for (int i = 0; valid && i < 2; ++i)
+        {
+            if (children[i] == NULL)
+            {
+                continue;
+            }
+            valid = children[i] < node && image_span_valid(bounds, children[i], sizeof(tree_node), 1);
+            if (count == capacity)
+            {
+                capacity *= 2;
+                pending = (const tree_node**)realloc(pending, sizeof(tree_node*) * capacity);
+            }
+            pending[count++] = children[i];
+        }
+    }
+
+    free(pending);
+    return valid;
+}
+
+// is the program inside the image, with the slots and outputs of an expression of the given number of variables, and
+// does each instruction only read registers computed before it, slots the program has and a partner that pairs back?
+bool image_program_valid(const image_bounds* bounds, const program* program, int variable_count)
+{
+    if (image_span_valid(bounds, program, sizeof(struct program), 1) == false || program->length < 0 ||
+        program->slot_count != variable_count || program->output_count != variable_count + 1 || program->lookup != NULL ||
+        image_span_valid(bounds, program->code, sizeof(instruction), (uint64_t)program->length) == false ||
+        image_span_valid(bounds, program->symbols, sizeof(char), (uint64_t)program->slot_count) == false ||
+        image_span_valid(bounds, program->outputs, sizeof(int), (uint64_t)program->output_count) == false)
+    {
+        return false;
+    }
+
+    for (int i = 0; i < program->length; ++i)
+    {
+        const instruction* instruction = &program->code[i];
+        token_type type = instruction->type;
+        bool binary = type >= addition && type <= power;
+        bool operand = type == constant || type == variable;
+        bool valid = type >= addition && type <= variable &&
+                     (operand ? instruction->left == -1 : instruction->left >= 0 && instruction->left < i) &&
+                     (binary ? instruction->right >= 0 && instruction->right < i : instruction->right == -1) &&
+                     (type == variable ? instruction->slot >= 0 && instruction->slot < program->slot_count : true);
+
+        // a sine and its cosine name each other and read the same argument.
+        int partner = instruction->partner;
+        if (valid && partner != -1)
+        {
+            valid = (type == sine || type == cosine) && partner >= 0 && partner < program->length && partner != i &&
+                    program->code[partner].partner == i && program->code[partner].left == instruction->left &&
+                    program->code[partner].type == ((type == sine) ? cosine : sine);
+        }
+        if (valid == false)
+        {
+            return false;
+        }
+    }
+
+    for (int i = 0; i < program->output_count; ++i)
+    {
+        if (program->outputs[i] < 0 || program->outputs[i] >= program->length)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// is the compiled expression laid out as image_writer_expression writes it, with its trees, its list of variables,
+// its partials and its program all inside the image?
+bool image_expression_valid(image_bounds* bounds, const compiled_expression* expression)
+{
+    int count = expression->variable_count;
+    if (count < 0 || image_tree_valid(bounds, expression->root) == false)
+    {
+        return false;
+    }
+
+    // the list must hold exactly variable_count nodes linked both ways, which also rules out a cycle.
+    const list_node* previous = NULL;
+    const list_node* item = expression->variables.first;
+    for (int i = 0; i < count; ++i)
+    {
+        if (image_span_valid(bounds, item, sizeof(list_node), 1) == false || item->prev != previous ||
+            image_span_valid(bounds, item->payload, sizeof(variable_value), 1) == false)
+        {
+            return false;
+        }
+        previous = item;
+        item = item->next;
+    }
+    if (item != NULL || expression->variables.last != previous)
+    {
+        return false;
+    }
+
+    if (image_span_valid(bounds, expression->partials, sizeof(tree_node*), (uint64_t)count) == false)
+    {
+        return false;
+    }
+    for (int i = 0; i < count; ++i)
+    {
+        if (image_tree_valid(bounds, expression->partials[i]) == false)
+        {
+            return false;
+        }
+    }
+
+    return image_program_valid(bounds, expression->program, count);
+}
+
+// checks every expression and text of a mapped image before it is used, so a damaged image is rejected rather than
+// followed out of the mapping. this reads every page of the expressions.
+bool expression_image_valid(const char* mapped, const expression_image_header* header)
+{
+    image_bounds bounds;
+    bounds.mapped = mapped;
+    bounds.limit = header->pointers_offset;
+    bounds.nodes_left = (long long)(header->pointers_offset / sizeof(tree_node));
+
+    const compiled_expression* expressions = (const compiled_expression*)(mapped + header->expressions_offset);
+    const char* const* texts = (const char* const*)(mapped + header->texts_offset);
+    for (uint32_t i = 0; i < header->expression_count; ++i)
+    {
+        if (image_expression_valid(&bounds, &expressions[i]) == false ||
+            image_span_valid(&bounds, texts[i], sizeof(char), 1) == false ||
+            memchr(texts[i], '\0', bounds.limit - (uint64_t)(texts[i] - mapped)) == NULL)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// maps an expression image at its base address, or anywhere else and moves its pointers to where it was mapped.
+// the mapping is private and read-only once it is loaded, so the file itself is never changed.
+// the pointers of an image mapped at its base address are used as they are, like those of a shared library, so it
+// needs no relocation, but its expressions are still read once to check them before they are used.
+// returns false and sets error if the file can't be mapped, isn't a valid image or was written by a different layout.
+bool expression_image_open(expression_image* image, const char* path, char* error)
+{
+    image->mapped = NULL;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        snprintf(error, EXPRESSION_IMAGE_ERROR_SIZE, "can't open %s", path);
+        return false;
+    }
+
+    // check the header describes an image of exactly this size, with aligned arrays that end before the pointer table,
+    // so no array runs past the mapping. the comparisons are arranged so that no sum can overflow.
+    expression_image_header header;
+    struct stat status;
+    bool valid = fstat(fd, &status) == 0 && pread(fd, &header, sizeof(header), 0) == (ssize_t)sizeof(header) &&
+                 memcmp(header.magic, EXPRESSION_IMAGE_MAGIC, 8) == 0 && header.size == (uint64_t)status.st_size &&
+                 header.pointers_offset <= header.size && header.pointers_offset % 8 == 0 &&
+                 header.expressions_offset % 8 == 0 && header.expressions_offset <= header.pointers_offset &&
+                 header.expression_count <= (header.pointers_offset - header.expressions_offset) / sizeof(compiled_expression) &&
+                 header.texts_offset % 8 == 0 && header.texts_offset <= header.pointers_offset &&
+                 header.expression_count <= (header.pointers_offset - header.texts_offset) / sizeof(char*) &&
+                 header.pointer_count <= (header.size - header.pointers_offset) / sizeof(uint32_t);
+    if (valid == false)
+    {
+        close(fd);
+        snprintf(error, EXPRESSION_IMAGE_ERROR_SIZE, "%s is not an expression image", path);
+        return false;
+    }
+    if (header.version != EXPRESSION_IMAGE_VERSION || header.layout != expression_image_layout())
+    {
+        close(fd);
+        snprintf(error, EXPRESSION_IMAGE_ERROR_SIZE, "%s was written by an incompatible build", path);
+        return false;
+    }
+
+    size_t size = header.size;
+    char* mapped = mmap((void*)(uintptr_t)header.base, size, PROT_READ, MAP_PRIVATE | MAP_FIXED_NOREPLACE, fd, 0);
+    if (mapped != MAP_FAILED && mapped != (char*)(uintptr_t)header.base)
+    {
+        munmap(mapped, size); // an older kernel took the base address as a hint and mapped the image elsewhere.
+        mapped = MAP_FAILED;
+    }
+
+    if (mapped == MAP_FAILED)
+    {
+        // the base address is taken, so map the image anywhere and move each pointer by the same distance.
+        // each pointer must lie before the pointer table and point before it too, and nothing is moved once one
+        // doesn't, so a damaged table can't write outside the mapping.
+        mapped = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+        const uint32_t* pointers = (const uint32_t*)(mapped + header.pointers_offset);
+        uintptr_t distance = (uintptr_t)mapped - (uintptr_t)header.base;
+        for (uint64_t i = 0; mapped != MAP_FAILED && valid && i < header.pointer_count; ++i)
+        {
+            uint64_t field = (uint64_t)pointers[i] * 8;
+            uintptr_t* pointer = (uintptr_t*)(mapped + field);
+            valid = field < header.pointers_offset && *pointer - (uintptr_t)header.base < header.pointers_offset;
+            if (valid)
+            {
+                *pointer += distance;
+            }
+        }
+        if (mapped != MAP_FAILED)
+        {
+            mprotect(mapped, size, PROT_READ);
+        }
+    }
+    close(fd);
+
+    // a pointer the table missed, or a damaged field of an expression, is found here rather than when it is used.
+    valid = valid && mapped != MAP_FAILED && expression_image_valid(mapped, &header);
+    if (mapped == MAP_FAILED || valid == false)
+    {
+        if (mapped != MAP_FAILED)
+        {
+            munmap(mapped, size);
+        }
+        snprintf(error, EXPRESSION_IMAGE_ERROR_SIZE, (mapped == MAP_FAILED) ? "can't map %s" : "%s is not an expression image", path);
+        return false;
+    }
+
+    image->mapped = mapped;
+    image->mapped_size = size;
+    image->expression_count = (int)header.expression_count;
+    image->expressions = (compiled_expression*)(mapped + header.expressions_offset);
+    image->texts = (const char* const*)(mapped + header.texts_offset);
+    return true;
+}
+
+// unmaps the image, along with every expression in it.
+void expression_image_close(expression_image* image)
+{
+    if (image->mapped != NULL)
+    {
+        munmap(image->mapped, image->mapped_size);
+        image->mapped = NULL;
+    }
+}
+
+// returns the index of the expression compiled from the text, or -1 if the image has no such expression.
+int expression_image_find(const expression_image* image, const char* text)
+{
+    for (int i = 0; i < image->expression_count; ++i)
+    {
+        if (strcmp(image->texts[i], text) == 0)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// compiles each line of a text file that isn't blank and writes the expressions to an image file.
+// returns false and sets error if a file can't be read or written or a line has no valid expression.
+bool expression_image_compile(const char* text_path, const char* image_path, char* error)
+{
+    FILE* file = fopen(text_path, "r");
+    if (file == NULL)
+    {
+        snprintf(error, EXPRESSION_IMAGE_ERROR_SIZE, "can't open %s", text_path);
+        return false;
+    }
+
+    compiled_expression** expressions = NULL;
+    char** texts = NULL;
+    int count = 0;
+    int capacity = 0;
+    bool compiled = true;
+
+    char* line = NULL;
+    size_t line_size = 0;
+    ssize_t length;
+    for (int number = 1; compiled && (length = getline(&line, &line_size, file)) >= 0; ++number)
+    {
+        while (length > 0 && is_whitespace(line[length - 1]))
+        {
+            line[--length] = '\0';
+        }
+        int start = 0;
+        while (is_whitespace(line[start]))
+        {
+            ++start;
+        }
+        if (line[start] == '\0')
+        {
+            continue;
+        }
+
+        compiled_expression* expression = compiled_expression_create(line + start);
+        if (expression == NULL)
+        {
+            snprintf(error, EXPRESSION_IMAGE_ERROR_SIZE, "line %d of %s is not a valid expression", number, text_path);
+            compiled = false;
+            break;
+        }
+
+        if (count == capacity)
+        {
+            capacity = (capacity > 0) ? capacity * 2 : 64;
+            expressions = (compiled_expression**)realloc(expressions, sizeof(compiled_expression*) * capacity);
+            texts = (char**)realloc(texts, sizeof(char*) * capacity);
+        }
+        expressions[count] = expression;
+        texts[count++] = strdup(line + start);
+    }
+    free(line);
+    fclose(file);
+
+    if (compiled)
+    {
+        compiled = expression_image_write(image_path, expressions, (const char* const*)texts, count, error);
+    }
+
+    for (int i = 0; i < count; ++i)
+    {
+        compiled_expression_free(expressions[i]);
+        free(texts[i]);
+    }
+    free(expressions);
+    free(texts);
+    return compiled;
+}
+
+#endif //COURSEWORK_EXPRESSION_IMAGE_H
@@ -0,0 +1,1003 @@
+#ifndef COURSEWORK_EXPRESSION_SERVER_H
+#define COURSEWORK_EXPRESSION_SERVER_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#include "expression_cache.h"
+#include "parse_benchmark.h"
+#include "image_benchmark.h"
+
+#define SERVER_MAX_MESSAGE (1 << 20) // longest message in bytes, longer ones close the connection.
+#define SERVER_ERROR_SIZE 128 // longest error message of a server function or response.
+#define SERVER_CACHE_CAPACITY 4096 // compiled expressions the server keeps by default.
+#define SERVER_MAX_REGISTERED (1 << 24) // bytes of expression strings one connection may register, more are refused.
+
+// the protocol is a stream of messages, each a 32-bit length in host byte order followed by that many bytes.
+// the first byte of a request is its kind, and the first byte of a response is its status.
+// a register request is followed by the expression string, and its response by the 32-bit id of the expression on
+// this connection, the 32-bit number of variables and the symbol of each variable in binding slot order.
+// an evaluate request is followed by the 32-bit id of an expression and the double value of each variable, and its
+// response by the value of the expression and its partial derivative with respect to each variable.
+// a statistics request is followed by nothing, and its response by the counters of the cache as an
+// expression_cache_stats struct, since the client is on the same host.
+// an error response is followed by a message.
+typedef enum server_request
+{
+    server_register = 1,
+    server_evaluate = 2,
+    server_statistics = 3
+} server_request;
+
+typedef enum server_status
+{
+    server_ok = 0,
+    server_error = 1
+} server_status;
+
+typedef struct server_connection server_connection;
+
+// a server listening on a Unix domain socket, whose workers share one cache of compiled expressions.
+// each worker waits on the same epoll instance for a request on any connection, and a connection is only given to
+// one worker at a time, so any number of clients are served by a fixed number of threads.
+typedef struct expression_server
+{
+    int listen_fd;
+    int epoll_fd;
+    int wake_fds[2]; // a pipe that becomes readable when the server stops.
+    pthread_t* threads;
+    int thread_count;
+    expression_cache cache;
+    pthread_mutex_t lock; // protects the list of connections.
+    server_connection* connections;
+    char path[sizeof(((struct sockaddr_un*)0)->sun_path)];
+} expression_server;
+
+// reads exactly size bytes, returns false at the end of the stream or on an error.
+bool server_read(int fd, void* buffer, size_t size)
+{
+    char* bytes = buffer;
+    while (size > 0)
+    {
+        ssize_t count = read(fd, bytes, size);
+        if (count < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (count <= 0)
+        {
+            return false;
+        }
+        bytes += count;
+        size -= count;
+    }
+    return true;
+}
+
+// writes exactly size bytes, returns false on an error.
+bool server_write(int fd, const void* buffer, size_t size)
+{
+    const char* bytes = buffer;
+    while (size > 0)
+    {
+        ssize_t count = send(fd, bytes, size, MSG_NOSIGNAL);
+        if (count < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (count <= 0)
+        {
+            return false;
+        }
+        bytes += count;
+        size -= count;
+    }
+    return true;
+}
+
+// a message being built or read, with room for its length in front of it so it is sent with one write.
+typedef struct server_message
+{
+    char* data; // the length, followed by the message.
+    uint32_t length; // length of the message, not counting the length itself.
+    uint32_t capacity;
+} server_message;
+
+// initialise an empty message.
+void server_message_init(server_message* message)
+{
+    message->capacity = 256;
+    message->data = (char*)malloc(message->capacity);
+    message->length = 0;
+}
+
+// free memory for the message.
+void server_message_free(server_message* message)
+{
+    free(message->data);
+}
+
+// returns the bytes of the message after its length.
+char* server_message_bytes(server_message* message)
+{
+    return message->data + sizeof(uint32_t);
+}
+
+// makes room for a message of the given length.
+void server_message_reserve(server_message* message, uint32_t length)
+{
+    if (sizeof(uint32_t) + length > message->capacity)
+    {
+        while (sizeof(uint32_t) + length > message->capacity)
+        {
+            message->capacity *= 2;
+        }
+        message->data = (char*)realloc(message->data, message->capacity);
+    }
+}
+
+// appends bytes to the message.
+void server_message_append(server_message* message, const void* bytes, uint32_t size)
+{
+    server_message_reserve(message, message->length + size);
+    memcpy(server_message_bytes(message) + message->length, bytes, size);
+    message->length += size;
+}
+
+// starts a message with its first byte.
+void server_message_start(server_message* message, uint8_t first)
+{
+    message->length = 0;
+    server_message_append(message, &first, 1);
+}
+
+// sends the message, returns false on an error.
+bool server_message_send(server_message* message, int fd)
+{
+    memcpy(message->data, &message->length, sizeof(uint32_t));
+    return server_write(fd, message->data, sizeof(uint32_t) + message->length);
+}
+
+// receives a message on a blocking socket, as a client does, returns false at the end of the stream, on an error or if
+// the message is too long. the server reads with server_connection_receive instead, which never blocks.
+bool server_message_receive(server_message* message, int fd)
+{
+    uint32_t length;
+    if (server_read(fd, &length, sizeof(length)) == false || length == 0 || length > SERVER_MAX_MESSAGE)
+    {
+        return false;
+    }
+    server_message_reserve(message, length);
+    message->length = length;
+    return server_read(fd, server_message_bytes(message), length);
+}
+
+// a client connection, only served by one worker at a time. its socket never blocks, so a client that sends part of
+// a request or doesn't read its response holds no worker: what has been read or sent so far is kept here, and the
+// worker that is next given the connection carries on from there.
+struct server_connection
+{
+    int fd;
+    char** texts; // the string of each expression registered on the connection, indexed by its id.
+    int text_count;
+    int text_capacity;
+    size_t text_bytes; // memory held by texts, at most SERVER_MAX_REGISTERED.
+    server_message request; // the request being read.
+    uint32_t received; // bytes of the request read so far, counting its length.
+    server_message response; // the response being sent.
+    uint32_t sent; // bytes of the response sent so far, counting its length.
+    bool sending; // is the response still being sent?
+    struct server_connection* next; // neighbours in the list of open connections.
+    struct server_connection* prev;
+};
+
+// how far a read or a write on a connection got.
+typedef enum server_progress
+{
+    server_done, // the whole message was read or sent.
+    server_pending, // the socket would block, so the rest waits for the next epoll event.
+    server_closed // the stream ended, failed or sent a message that is too long.
+} server_progress;
+
+// reads as much of the connection's request as has arrived, without blocking. returns server_done once the whole
+// request is read, after which the next call starts reading a new one.
+server_progress server_connection_receive(server_connection* connection)
+{
+    server_message* request = &connection->request;
+    while (true)
+    {
+        // the length is read first, then the message it announces.
+        uint32_t total = sizeof(uint32_t) + ((connection->received < sizeof(uint32_t)) ? 0 : request->length);
+        if (connection->received == total)
+        {
+            connection->received = 0;
+            return server_done;
+        }
+
+        ssize_t count = read(connection->fd, request->data + connection->received, total - connection->received);
+        if (count < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            return server_pending;
+        }
+        if (count <= 0)
+        {
+            return server_closed;
+        }
+
+        connection->received += count;
+        if (connection->received == sizeof(uint32_t))
+        {
+            uint32_t length;
+            memcpy(&length, request->data, sizeof(length));
+            if (length == 0 || length > SERVER_MAX_MESSAGE)
+            {
+                return server_closed;
+            }
+            server_message_reserve(request, length);
+            request->length = length;
+        }
+    }
+}
+
+// sends as much of the connection's response as the client takes, without blocking. returns server_done once the
+// whole response is sent.
+server_progress server_connection_send(server_connection* connection)
+{
+    server_message* response = &connection->response;
+    uint32_t total = sizeof(uint32_t) + response->length;
+    while (connection->sent < total)
+    {
+        ssize_t count = send(connection->fd, response->data + connection->sent, total - connection->sent, MSG_NOSIGNAL);
+        if (count < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            return server_pending;
+        }
+        if (count <= 0)
+        {
+            return server_closed;
+        }
+        connection->sent += count;
+    }
+    connection->sending = false;
+    return server_done;
+}
+
+// starts sending the response built on the connection.
+server_progress server_connection_respond(server_connection* connection)
+{
+    memcpy(connection->response.data, &connection->response.length, sizeof(uint32_t));
+    connection->sent = 0;
+    connection->sending = true;
+    return server_connection_send(connection);
+}
+
+// makes the response an error with a message.
+void server_message_error(server_message* response, const char* text)
+{
+    server_message_start(response, server_error);
+    server_message_append(response, text, strlen(text));
+}
+
+// the buffers a worker evaluates requests with, grown to the largest program seen.
+typedef struct server_worker
+{
+    expression_server* server;
+    double* slots;
+    double* results;
+    double* registers;
+    int slot_capacity; // room for the slots and for the results, which are one more than the slots.
+    int register_capacity;
+} server_worker;
+
+// registers the expression of a request on the connection, compiling it if it isn't cached.
+// a connection can only hold SERVER_MAX_REGISTERED bytes of expressions, so a client can't use up the server's memory.
+void server_handle_register(server_worker* worker, server_connection* connection)
+{
+    server_message* request = &connection->request;
+    server_message* response = &connection->response;
+    size_t size = request->length + sizeof(char*);
+    if (connection->text_bytes + size > SERVER_MAX_REGISTERED)
+    {
+        server_message_error(response, "too many expressions registered on this connection");
+        return;
+    }
+
+    char* text = (char*)malloc(request->length);
+    memcpy(text, server_message_bytes(request) + 1, request->length - 1);
+    text[request->length - 1] = '\0';
+
+    cache_entry* entry = expression_cache_acquire(&worker->server->cache, text);
+    if (entry == NULL)
+    {
+        server_message_error(response, "invalid expression");
+        free(text);
+        return;
+    }
+
+    if (connection->text_count == connection->text_capacity)
+    {
+        connection->text_capacity = (connection->text_capacity > 0) ? connection->text_capacity * 2 : 8;
+        connection->texts = (char**)realloc(connection->texts, sizeof(char*) * connection->text_capacity);
+    }
+    uint32_t id = connection->text_count;
+    connection->texts[connection->text_count++] = text;
+    connection->text_bytes += size;
+
+    const program* program = entry->expression->program;
+    uint32_t slot_count = program->slot_count;
+    server_message_start(response, server_ok);
+    server_message_append(response, &id, sizeof(id));
+    server_message_append(response, &slot_count, sizeof(slot_count));
+    server_message_append(response, program->symbols, slot_count);
+    expression_cache_release(&worker->server->cache, entry);
+}
+
+// evaluates an expression registered on the connection with the values of a request.
+// the expression is found in the cache by its string, so it is compiled again if it was evicted meanwhile.
+void server_handle_evaluate(server_worker* worker, server_connection* connection)
+{
+    server_message* request = &connection->request;
+    server_message* response = &connection->response;
+    uint32_t id;
+    if (request->length < 1 + sizeof(id) || (request->length - 1 - sizeof(id)) % sizeof(double) != 0)
+    {
+        server_message_error(response, "malformed evaluate request");
+        return;
+    }
+    memcpy(&id, server_message_bytes(request) + 1, sizeof(id));
+    if (id >= (uint32_t)connection->text_count)
+    {
+        server_message_error(response, "unknown expression id");
+        return;
+    }
+
+    cache_entry* entry = expression_cache_acquire(&worker->server->cache, connection->texts[id]);
+    if (entry == NULL)
+    {
+        server_message_error(response, "invalid expression");
+        return;
+    }
+    const program* program = entry->expression->program;
+    int value_count = (int)((request->length - 1 - sizeof(id)) / sizeof(double));
+    if (value_count != program->slot_count)
+    {
+        char error[SERVER_ERROR_SIZE];
+        snprintf(error, sizeof(error), "expected %d values, got %d", program->slot_count, value_count);
+        server_message_error(response, error);
+        expression_cache_release(&worker->server->cache, entry);
+        return;
+    }
+
+    if (program->slot_count + 1 > worker->slot_capacity)
+    {
+        worker->slot_capacity = program->slot_count + 1;
+        worker->slots = (double*)realloc(worker->slots, sizeof(double) * worker->slot_capacity);
+        worker->results = (double*)realloc(worker->results, sizeof(double) * worker->slot_capacity);
+    }
+    if (program->length + 1 > worker->register_capacity)
+    {
+        worker->register_capacity = program->length + 1;
+        worker->registers = (double*)realloc(worker->registers, sizeof(double) * worker->register_capacity);
+    }
+    memcpy(worker->slots, server_message_bytes(request) + 1 + sizeof(id), sizeof(double) * value_count);
+
+    expression_cache_evaluate(entry, worker->slots, worker->registers, worker->results);
+    server_message_start(response, server_ok);
+    server_message_append(response, worker->results, sizeof(double) * program->output_count);
+    expression_cache_release(&worker->server->cache, entry);
+}
+
+// closes a connection and frees memory for it.
+void server_connection_close(expression_server* server, server_connection* connection)
+{
+    pthread_mutex_lock(&server->lock);
+    if (connection->prev != NULL)
+    {
+        connection->prev->next = connection->next;
+    }
+    else
+    {
+        server->connections = connection->next;
+    }
+    if (connection->next != NULL)
+    {
+        connection->next->prev = connection->prev;
+    }
+    pthread_mutex_unlock(&server->lock);
+
+    close(connection->fd);
+    for (int i = 0; i < connection->text_count; ++i)
+    {
+        free(connection->texts[i]);
+    }
+    free(connection->texts);
+    server_message_free(&connection->request);
+    server_message_free(&connection->response);
+    free(connection);
+}
+
+// answers the request read on the connection with a response built on it.
+void server_handle_request(server_worker* worker, server_connection* connection)
+{
+    uint8_t kind = (uint8_t)server_message_bytes(&connection->request)[0];
+    if (kind == server_register)
+    {
+        server_handle_register(worker, connection);
+    }
+    else if (kind == server_evaluate)
+    {
+        server_handle_evaluate(worker, connection);
+    }
+    else if (kind == server_statistics)
+    {
+        expression_cache_stats stats = expression_cache_get_stats(&worker->server->cache);
+        server_message_start(&connection->response, server_ok);
+        server_message_append(&connection->response, &stats, sizeof(stats));
+    }
+    else
+    {
+        server_message_error(&connection->response, "unknown request");
+    }
+}
+
+// accepts each waiting client and adds its connection to the epoll instance.
+void server_accept(expression_server* server)
+{
+    while (true)
+    {
+        int fd = accept(server->listen_fd, NULL, NULL);
+        if (fd < 0)
+        {
+            return; // no more clients are waiting.
+        }
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+        server_connection* connection = (server_connection*)malloc(sizeof(server_connection));
+        connection->fd = fd;
+        connection->texts = NULL;
+        connection->text_count = 0;
+        connection->text_capacity = 0;
+        connection->text_bytes = 0;
+        server_message_init(&connection->request);
+        connection->received = 0;
+        server_message_init(&connection->response);
+        connection->sent = 0;
+        connection->sending = false;
+        connection->prev = NULL;
+        pthread_mutex_lock(&server->lock);
+        connection->next = server->connections;
+        if (server->connections != NULL)
+        {
+            server->connections->prev = connection;
+        }
+        server->connections = connection;
+        pthread_mutex_unlock(&server->lock);
+
+        struct epoll_event event;
+        event.events = EPOLLIN | EPOLLONESHOT;
+        event.data.ptr = connection;
+        epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, fd, &event);
+    }
+}
+
+// serves one request of each connection that has one, until the server stops.
+// a connection is added to the epoll instance with EPOLLONESHOT and rearmed after each event, so no two workers ever
+// use it at once, and a connection that sent several requests is served again straight away. it is rearmed for
+// writing while a response the client hasn't taken is pending, and for reading otherwise, so a request that arrives
+// in pieces is read a piece at a time.
+void* server_worker_main(void* argument)
+{
+    server_worker worker;
+    worker.server = argument;
+    worker.slots = NULL;
+    worker.results = NULL;
+    worker.registers = NULL;
+    worker.slot_capacity = 0;
+    worker.register_capacity = 0;
+
+    expression_server* server = worker.server;
+    while (true)
+    {
+        struct epoll_event event;
+        int count = epoll_wait(server->epoll_fd, &event, 1, -1);
+        if (count <= 0)
+        {
+            continue;
+        }
+        if (event.data.ptr == &server->wake_fds)
+        {
+            break;
+        }
+
+        struct epoll_event rearm;
+        rearm.events = EPOLLIN | EPOLLONESHOT;
+        rearm.data.ptr = event.data.ptr;
+        if (event.data.ptr == server)
+        {
+            server_accept(server);
+            epoll_ctl(server->epoll_fd, EPOLL_CTL_MOD, server->listen_fd, &rearm);
+            continue;
+        }
+
+        server_connection* connection = event.data.ptr;
+        server_progress progress;
+        if (connection->sending)
+        {
+            progress = server_connection_send(connection);
+        }
+        else
+        {
+            progress = server_connection_receive(connection);
+            if (progress == server_done)
+            {
+                server_handle_request(&worker, connection);
+                progress = server_connection_respond(connection);
+            }
+        }
+
+        if (progress == server_closed)
+        {
+            server_connection_close(server, connection);
+        }
+        else
+        {
+            rearm.events = (connection->sending ? EPOLLOUT : EPOLLIN) | EPOLLONESHOT;
+            epoll_ctl(server->epoll_fd, EPOLL_CTL_MOD, connection->fd, &rearm);
+        }
+    }
+
+    free(worker.slots);
+    free(worker.results);
+    free(worker.registers);
+    return NULL;
+}
+
+// starts a server listening on the socket path with the given number of workers, 0 for one per processor, and a
+// cache of at most cache_capacity expressions. a file already at the path is replaced.
+// returns false and sets error if the socket can't be created.
+bool expression_server_start(expression_server* server, const char* path, int thread_count, int cache_capacity,
+                             char* error)
+{
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address.sun_path))
+    {
+        snprintf(error, SERVER_ERROR_SIZE, "socket path %.64s is too long", path);
+        return false;
+    }
+    strcpy(address.sun_path, path);
+    strcpy(server->path, path);
+
+    server->listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    unlink(path);
+    if (server->listen_fd < 0 || bind(server->listen_fd, (struct sockaddr*)&address, sizeof(address)) != 0 ||
+        listen(server->listen_fd, SOMAXCONN) != 0)
+    {
+        if (server->listen_fd >= 0)
+        {
+            close(server->listen_fd);
+        }
+        snprintf(error, SERVER_ERROR_SIZE, "can't listen on %s", path);
+        return false;
+    }
+
+    server->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (pipe(server->wake_fds) != 0)
+    {
+        close(server->listen_fd);
+        close(server->epoll_fd);
+        unlink(path);
+        snprintf(error, SERVER_ERROR_SIZE, "can't create a pipe");
+        return false;
+    }
+
+    fcntl(server->wake_fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(server->wake_fds[1], F_SETFD, FD_CLOEXEC);
+
+    // the pipe is level-triggered and never read, so once it is written every worker sees it and stops.
+    struct epoll_event event;
+    event.events = EPOLLIN | EPOLLONESHOT;
+    event.data.ptr = server;
+    epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, server->listen_fd, &event);
+    event.events = EPOLLIN;
+    event.data.ptr = &server->wake_fds;
+    epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, server->wake_fds[0], &event);
+
+    expression_cache_init(&server->cache, cache_capacity);
+    pthread_mutex_init(&server->lock, NULL);
+    server->connections = NULL;
+    server->thread_count = (thread_count > 0) ? thread_count : processor_count();
+    server->threads = (pthread_t*)malloc(sizeof(pthread_t) * server->thread_count);
+    for (int i = 0; i < server->thread_count; ++i)
+    {
+        pthread_create(&server->threads[i], NULL, server_worker_main, server);
+    }
+    return true;
+}
+
+// stops the workers, closes each connection and the socket and frees memory for the server.
+void expression_server_stop(expression_server* server)
+{
+    char wake = 0;
+    if (write(server->wake_fds[1], &wake, 1) != 1)
+    {
+        perror("write");
+    }
+    for (int i = 0; i < server->thread_count; ++i)
+    {
+        pthread_join(server->threads[i], NULL);
+    }
+
+    while (server->connections != NULL)
+    {
+        server_connection_close(server, server->connections);
+    }
+    close(server->listen_fd);
+    close(server->epoll_fd);
+    close(server->wake_fds[0]);
+    close(server->wake_fds[1]);
+    unlink(server->path);
+    expression_cache_free(&server->cache);
+    pthread_mutex_destroy(&server->lock);
+    free(server->threads);
+}
+
+// connects to a server, returns the socket or -1 if it can't connect.
+int server_client_connect(const char* path)
+{
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address.sun_path))
+    {
+        return -1;
+    }
+    strcpy(address.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd >= 0 && connect(fd, (struct sockaddr*)&address, sizeof(address)) != 0)
+    {
+        close(fd);
+        fd = -1;
+    }
+    return fd;
+}
+
+// sends the request and receives its response, returns false and sets error if the server can't be reached or
+// answers with an error.
+bool server_client_call(int fd, server_message* request, server_message* response, char* error)
+{
+    if (server_message_send(request, fd) == false || server_message_receive(response, fd) == false)
+    {
+        snprintf(error, SERVER_ERROR_SIZE, "the server closed the connection");
+        return false;
+    }
+    if (server_message_bytes(response)[0] != server_ok)
+    {
+        snprintf(error, SERVER_ERROR_SIZE, "%.*s", (int)response->length - 1, server_message_bytes(response) + 1);
+        return false;
+    }
+    return true;
+}
+
+// registers an expression, returns its id and sets the symbol of each variable in binding slot order, or returns -1
+// and sets error. a variable is one character, so symbols needs room for 256 of them followed by a zero.
+int server_client_register(int fd, const char* text, char* symbols, int* slot_count, char* error)
+{
+    server_message request;
+    server_message response;
+    server_message_init(&request);
+    server_message_init(&response);
+    server_message_start(&request, server_register);
+    server_message_append(&request, text, strlen(text));
+
+    int id = -1;
+    if (server_client_call(fd, &request, &response, error))
+    {
+        uint32_t fields[2];
+        memcpy(fields, server_message_bytes(&response) + 1, sizeof(fields));
+        id = (int)fields[0];
+        *slot_count = (int)fields[1];
+        memcpy(symbols, server_message_bytes(&response) + 1 + sizeof(fields), fields[1]);
+        symbols[fields[1]] = '\0';
+    }
+    server_message_free(&request);
+    server_message_free(&response);
+    return id;
+}
+
+// evaluates a registered expression with the value of each variable, stores the value and each partial derivative
+// in results and returns their number, or returns -1 and sets error. the messages are reused between calls.
+int server_client_evaluate(int fd, int id, const double* values, int value_count, double* results,
+                           server_message* request, server_message* response, char* error)
+{
+    uint32_t field = id;
+    server_message_start(request, server_evaluate);
+    server_message_append(request, &field, sizeof(field));
+    server_message_append(request, values, sizeof(double) * value_count);
+    if (server_client_call(fd, request, response, error) == false)
+    {
+        return -1;
+    }
+
+    int count = (int)((response->length - 1) / sizeof(double));
+    memcpy(results, server_message_bytes(response) + 1, sizeof(double) * count);
+    return count;
+}
+
+// gets the counters of the server's cache, returns false and sets error if the server can't be reached.
+bool server_client_stats(int fd, expression_cache_stats* stats, char* error)
+{
+    server_message request;
+    server_message response;
+    server_message_init(&request);
+    server_message_init(&response);
+    server_message_start(&request, server_statistics);
+    bool received = server_client_call(fd, &request, &response, error);
+    if (received && response.length != 1 + sizeof(*stats))
+    {
+        snprintf(error, SERVER_ERROR_SIZE, "malformed statistics response");
+        received = false;
+    }
+    if (received)
+    {
+        memcpy(stats, server_message_bytes(&response) + 1, sizeof(*stats));
+    }
+    server_message_free(&request);
+    server_message_free(&response);
+    return received;
+}
+
+// the load of one client of the benchmark, and the latency of each of its requests.
+typedef struct server_load
+{
+    const char* path;
+    int client;
+    int expression_count; // distinct expressions registered by the client.
+    int request_count; // evaluate requests sent by the client.
+    double* register_seconds;
+    double* evaluate_seconds;
+    int failures;
+} server_load;
+
+// connects to the server, registers the client's expressions and then evaluates them in turn.
+// half of the expressions are shared by every client, so their registration is answered from the cache.
+void* server_load_main(void* argument)
+{
+    server_load* load = argument;
+    int fd = server_client_connect(load->path);
+    if (fd < 0)
+    {
+        load->failures = load->request_count;
+        return NULL;
+    }
+
+    char error[SERVER_ERROR_SIZE];
+    char symbols[257];
+    int* ids = (int*)malloc(sizeof(int) * load->expression_count);
+    int* slot_counts = (int*)malloc(sizeof(int) * load->expression_count);
+    for (int i = 0; i < load->expression_count; ++i)
+    {
+        char text[512];
+        image_benchmark_formula(text, sizeof(text), (i % 2 == 0) ? i : 1000 * (load->client + 1) + i);
+        double start = parse_benchmark_seconds();
+        ids[i] = server_client_register(fd, text, symbols, &slot_counts[i], error);
+        load->register_seconds[i] = parse_benchmark_seconds() - start;
+        load->failures += (ids[i] < 0) ? 1 : 0;
+    }
+
+    server_message request;
+    server_message response;
+    server_message_init(&request);
+    server_message_init(&response);
+    double values[256];
+    double results[257];
+    for (int i = 0; i < load->request_count; ++i)
+    {
+        int expression = i % load->expression_count;
+        for (int slot = 0; slot < slot_counts[expression]; ++slot)
+        {
+            values[slot] = 0.5 + 0.001 * i + slot;
+        }
+        double start = parse_benchmark_seconds();
+        int count = (ids[expression] < 0) ? -1 :
+                    server_client_evaluate(fd, ids[expression], values, slot_counts[expression], results, &request, &response, error);
+        load->evaluate_seconds[i] = parse_benchmark_seconds() - start;
+        load->failures += (count != slot_counts[expression] + 1) ? 1 : 0;
+    }
+
+    server_message_free(&request);
+    server_message_free(&response);
+    free(ids);
+    free(slot_counts);
+    close(fd);
+    return NULL;
+}
+
+// compares two latencies for sorting.
+int server_compare_seconds(const void* a, const void* b)
+{
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+// sorts the latencies and prints their percentiles in microseconds.
+void server_print_latency(const char* name, double* seconds, int count)
+{
+    qsort(seconds, count, sizeof(double), server_compare_seconds);
+    printf("%-24s%10d%10.1f%10.1f%10.1f%10.1f\n", name, count, seconds[count / 2] * 1e6, seconds[count * 9 / 10] * 1e6,
+           seconds[count * 99 / 100] * 1e6, seconds[count - 1] * 1e6);
+}
+
+// connects a client that stalls and leaves it connected, returns its socket or -1. one that stops in the middle of
+// its request sends a length and only half of the request, and one that doesn't read sends statistics requests
+// without reading any response until its socket is full.
+int server_stalled_client(const char* path, bool reading)
+{
+    int fd = server_client_connect(path);
+    if (fd < 0)
+    {
+        return -1;
+    }
+
+    server_message request;
+    server_message_init(&request);
+    server_message_start(&request, server_statistics);
+    memcpy(request.data, &request.length, sizeof(uint32_t));
+    if (reading)
+    {
+        uint32_t length = 64;
+        char half[32] = { server_statistics };
+        server_write(fd, &length, sizeof(length));
+        server_write(fd, half, sizeof(half));
+    }
+    else
+    {
+        while (send(fd, request.data, sizeof(uint32_t) + request.length, MSG_DONTWAIT | MSG_NOSIGNAL) > 0)
+        {
+        }
+    }
+    server_message_free(&request);
+    return fd;
+}
+
+extern char** environ;
+
+// runs the coursework executable once in batch mode on the input file, as a client would without a server.
+// returns false if it can't be run.
+bool server_spawn_batch(const char* input_path)
+{
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, 0, input_path, O_RDONLY, 0);
+    posix_spawn_file_actions_addopen(&actions, 1, "/dev/null", O_WRONLY, 0);
+    char* arguments[] = { "coursework", "--batch", NULL };
+    pid_t pid;
+    bool spawned = posix_spawn(&pid, "/proc/self/exe", &actions, NULL, arguments, environ) == 0;
+    posix_spawn_file_actions_destroy(&actions);
+
+    int status = 1;
+    return spawned && waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+// starts a server on a temporary socket and measures the latency of register and evaluate requests from the given
+// number of concurrent clients, then the latency of running the executable once per request for comparison.
+// meanwhile two clients per worker stall, half in the middle of a request and half by not reading, which must not
+// hold up the others. returns the number of requests that failed.
+int expression_server_benchmark(int client_count, int request_count)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/coursework-server-%d.sock", (int)getpid());
+    char error[SERVER_ERROR_SIZE];
+    expression_server server;
+    if (expression_server_start(&server, path, 0, SERVER_CACHE_CAPACITY, error) == false)
+    {
+        printf("%s\n", error);
+        return 1;
+    }
+
+    int stalled_count = 2 * server.thread_count;
+    int* stalled = (int*)malloc(sizeof(int) * stalled_count);
+    for (int i = 0; i < stalled_count; ++i)
+    {
+        stalled[i] = server_stalled_client(path, i % 2 == 0);
+    }
+
+    int expression_count = 16;
+    server_load* loads = (server_load*)malloc(sizeof(server_load) * client_count);
+    pthread_t* threads = (pthread_t*)malloc(sizeof(pthread_t) * client_count);
+    double* register_seconds = (double*)malloc(sizeof(double) * client_count * expression_count);
+    double* evaluate_seconds = (double*)malloc(sizeof(double) * client_count * request_count);
+    double start = parse_benchmark_seconds();
+    for (int i = 0; i < client_count; ++i)
+    {
+        loads[i].path = path;
+        loads[i].client = i;
+        loads[i].expression_count = expression_count;
+        loads[i].request_count = request_count;
+        loads[i].register_seconds = register_seconds + i * expression_count;
+        loads[i].evaluate_seconds = evaluate_seconds + (long long)i * request_count;
+        loads[i].failures = 0;
+        pthread_create(&threads[i], NULL, server_load_main, &loads[i]);
+    }
+
+    int failures = 0;
+    for (int i = 0; i < client_count; ++i)
+    {
+        pthread_join(threads[i], NULL);
+        failures += loads[i].failures;
+    }
+    double seconds = parse_benchmark_seconds() - start;
+    expression_cache_stats stats = expression_cache_get_stats(&server.cache);
+    for (int i = 0; i < stalled_count; ++i)
+    {
+        failures += (stalled[i] < 0) ? 1 : 0;
+        if (stalled[i] >= 0)
+        {
+            close(stalled[i]);
+        }
+    }
+    free(stalled);
+    expression_server_stop(&server);
+
+    printf("%d clients, %d workers, %d evaluate requests each, %d stalled clients\n", client_count, server.thread_count,
+           request_count, stalled_count);
+    printf("%-24s%10s%10s%10s%10s%10s\n", "latency (us)", "requests", "p50", "p90", "p99", "max");
+    server_print_latency("register", register_seconds, client_count * expression_count);
+    server_print_latency("evaluate", evaluate_seconds, client_count * request_count);
+
+    // a process per request pays for starting up and compiling the expression every time.
+    char input_path[] = "/tmp/coursework-request-XXXXXX";
+    int fd = mkstemp(input_path);
+    int spawn_count = 50;
+    double* spawn_seconds = (double*)malloc(sizeof(double) * spawn_count);
+    if (fd >= 0)
+    {
+        char text[512];
+        image_benchmark_formula(text, sizeof(text), 3);
+        dprintf(fd, "%s\n0.5 1.5 2.5\n", text);
+        close(fd);
+        for (int i = 0; i < spawn_count; ++i)
+        {
+            double spawn_start = parse_benchmark_seconds();
+            failures += server_spawn_batch(input_path) ? 0 : 1;
+            spawn_seconds[i] = parse_benchmark_seconds() - spawn_start;
+        }
+        unlink(input_path);
+        server_print_latency("process per request", spawn_seconds, spawn_count);
+    }
+    printf("%.0f evaluate requests per second\n", client_count * (double)request_count / seconds);
+    expression_cache_print_stats(&stats, stdout);
+
+    free(spawn_seconds);
+    free(loads);
+    free(threads);
+    free(register_seconds);
+    free(evaluate_seconds);
+    return failures;
+}
+
+#endif //COURSEWORK_EXPRESSION_SERVER_H
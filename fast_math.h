@@ -0,0 +1,234 @@
+#ifndef COURSEWORK_FAST_MATH_H
+#define COURSEWORK_FAST_MATH_H
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "program.h"
+
+// how accurately transcendental functions are computed during evaluation. the fast tier only replaces the functions
+// it computes faster than libm, the others are the libm functions in both tiers.
+typedef enum accuracy
+{
+    accuracy_exact, // the libm functions, the same results as evaluate.
+    accuracy_fast // sin and cos within a relative error of about 1e-7, log10 within a few ulps of libm, pow correctly
+                  // rounded for small whole exponents.
+} accuracy;
+
+// split constants for range reduction, the leading part has trailing zero bits so multiples of it are exact.
+#define FAST_PIO2_1 1.57079632673412561417e+00 // first 33 bits of pi / 2.
+#define FAST_PIO2_1T 6.07710050650619224932e-11 // pi / 2 - FAST_PIO2_1.
+#define FAST_INVPIO2 6.36619772367581382433e-01 // 2 / pi.
+#define FAST_INVLN10 4.34294481903251816668e-01 // 1 / ln(10).
+#define FAST_REDUCTION_LIMIT 1.6e6 // larger arguments need more bits of pi / 2 than we keep, so they use libm.
+
+// reduces x to r in [-pi / 4, pi / 4] and returns the quadrant, so x = quadrant * pi / 2 + r.
+int fast_reduce(double x, double* r)
+{
+    double k = nearbyint(x * FAST_INVPIO2);
+    *r = (x - k * FAST_PIO2_1) - k * FAST_PIO2_1T; // the first product is exact, because k is small.
+    return (int)((long long)k & 3);
+}
+
+// sine of r for |r| <= pi / 4, using the leading minimax coefficients of fdlibm's __kernel_sin.
+double fast_sin_kernel(double r)
+{
+    const double s1 = -1.66666666666666324348e-01;
+    const double s2 = 8.33333333332248946124e-03;
+    const double s3 = -1.98412698298579493134e-04;
+    const double s4 = 2.75573137070700676789e-06;
+
+    double z = r * r;
+    return r + z * r * (s1 + z * (s2 + z * (s3 + z * s4)));
+}
+
+// cosine of r for |r| <= pi / 4, using the leading minimax coefficients of fdlibm's __kernel_cos.
+double fast_cos_kernel(double r)
+{
+    const double c1 = 4.16666666666666019037e-02;
+    const double c2 = -1.38888888888741095749e-03;
+    const double c3 = 2.48015872894767294178e-05;
+
+    double z = r * r;
+    return 1.0 - 0.5 * z + z * z * (c1 + z * (c2 + z * c3));
+}
+
+double fast_sin(double x, accuracy accuracy)
+{
+    if (accuracy == accuracy_exact || !(fabs(x) < FAST_REDUCTION_LIMIT))
+    {
+        return sin(x); // also handles infinities and nans.
+    }
+
+    double r;
+    switch (fast_reduce(x, &r))
+    {
+        case 0: return fast_sin_kernel(r);
+        case 1: return fast_cos_kernel(r);
+        case 2: return -fast_sin_kernel(r);
+        default: return -fast_cos_kernel(r);
+    }
+}
+
+double fast_cos(double x, accuracy accuracy)
+{
+    if (accuracy == accuracy_exact || !(fabs(x) < FAST_REDUCTION_LIMIT))
+    {
+        return cos(x);
+    }
+
+    double r;
+    switch (fast_reduce(x, &r))
+    {
+        case 0: return fast_cos_kernel(r);
+        case 1: return -fast_sin_kernel(r);
+        case 2: return -fast_cos_kernel(r);
+        default: return fast_sin_kernel(r);
+    }
+}
+
+// the sine and cosine of x from one range reduction, for a sine and cosine of the same argument.
+void fast_sincos(double x, accuracy accuracy, double* sine_value, double* cosine_value)
+{
+    if (accuracy == accuracy_exact || !(fabs(x) < FAST_REDUCTION_LIMIT))
+    {
+        *sine_value = sin(x);
+        *cosine_value = cos(x);
+        return;
+    }
+
+    double r;
+    int quadrant = fast_reduce(x, &r);
+    double s = fast_sin_kernel(r);
+    double c = fast_cos_kernel(r);
+    *sine_value = (quadrant == 0) ? s : (quadrant == 1) ? c : (quadrant == 2) ? -s : -c;
+    *cosine_value = (quadrant == 0) ? c : (quadrant == 1) ? -s : (quadrant == 2) ? -c : s;
+}
+
+// libm's log is much faster than its log10, and scaling it loses only a few ulps.
+double fast_log10(double x, accuracy accuracy)
+{
+    if (accuracy == accuracy_exact)
+    {
+        return log10(x);
+    }
+
+    return log(x) * FAST_INVLN10;
+}
+
+double fast_pow(double x, double y, accuracy accuracy)
+{
+    if (accuracy == accuracy_fast)
+    {
+        // small whole exponents are common in derivatives, e.g. g(x) ^ 2 from the quotient rule. each of these is
+        // correctly rounded, so at least as accurate as libm's pow.
+        if (y == 2) { return x * x; }
+        if (y == 1) { return x; }
+        if (y == 0) { return 1; }
+        if (y == -1) { return 1 / x; }
+    }
+
+    return pow(x, y);
+}
+
+// runs the program like program_run, with transcendental functions at the given accuracy.
+void program_run_accuracy(const program* program, accuracy accuracy, const double* slots, double* registers, double* results)
+{
+    if (accuracy == accuracy_exact)
+    {
+        program_run(program, slots, registers, results);
+        return;
+    }
+
+    for (int i = 0; i < program->length; ++i)
+    {
+        const instruction* instruction = &program->code[i];
+        switch (instruction->type)
+        {
+            case addition: registers[i] = registers[instruction->left] + registers[instruction->right]; break;
+            case subtraction: registers[i] = registers[instruction->left] - registers[instruction->right]; break;
+            case multiplication: registers[i] = registers[instruction->left] * registers[instruction->right]; break;
+            case division: registers[i] = registers[instruction->left] / registers[instruction->right]; break;
+            case power: registers[i] = fast_pow(registers[instruction->left], registers[instruction->right], accuracy); break;
+            case negation: registers[i] = -registers[instruction->left]; break;
+            case squareroot: registers[i] = sqrt(registers[instruction->left]); break;
+            case log_10: registers[i] = fast_log10(registers[instruction->left], accuracy); break;
+            case log_e: registers[i] = log(registers[instruction->left]); break;
+            case sine:
+            case cosine:
+                if (instruction->partner < 0)
+                {
+                    registers[i] = (instruction->type == sine) ? fast_sin(registers[instruction->left], accuracy)
+                                                               : fast_cos(registers[instruction->left], accuracy);
+                }
+                else if (instruction->partner > i)
+                {
+                    // the first of a sine and cosine of the same argument computes both from one reduction.
+                    double sine_value, cosine_value;
+                    fast_sincos(registers[instruction->left], accuracy, &sine_value, &cosine_value);
+                    registers[(instruction->type == sine) ? i : instruction->partner] = sine_value;
+                    registers[(instruction->type == sine) ? instruction->partner : i] = cosine_value;
+                }
+                break;
+            case tangent: registers[i] = tan(registers[instruction->left]); break;
+            case constant: registers[i] = instruction->value; break;
+            case variable: registers[i] = slots[instruction->slot]; break;
+            default: registers[i] = 0; break; // not a valid token type.
+        }
+    }
+
+    for (int i = 0; i < program->output_count; ++i)
+    {
+        results[i] = registers[program->outputs[i]];
+    }
+}
+
+// largest errors of a fast math function against libm over a range of inputs.
+typedef struct fast_math_error
+{
+    double max_ulps; // largest distance in units in the last place.
+    double max_relative; // largest relative error.
+} fast_math_error;
+
+// returns the distance between two doubles in units in the last place.
+double ulp_distance(double a, double b)
+{
+    if (a == b || (isnan(a) && isnan(b)))
+    {
+        return 0;
+    }
+    else if (isnan(a) || isnan(b))
+    {
+        return INFINITY;
+    }
+
+    // map the bits of each double onto a line where adjacent doubles are adjacent integers.
+    uint64_t a_bits, b_bits;
+    memcpy(&a_bits, &a, sizeof(a_bits));
+    memcpy(&b_bits, &b, sizeof(b_bits));
+    a_bits = (a_bits >> 63) ? ~a_bits : (a_bits | 0x8000000000000000ULL);
+    b_bits = (b_bits >> 63) ? ~b_bits : (b_bits | 0x8000000000000000ULL);
+    return (double)((a_bits > b_bits) ? a_bits - b_bits : b_bits - a_bits);
+}
+
+// sweeps a one argument function over a range of inputs and measures its error against the exact tier.
+fast_math_error fast_math_measure(double (*function)(double, accuracy), accuracy accuracy, double lower, double upper, int samples)
+{
+    fast_math_error error = { 0, 0 };
+    for (int i = 0; i < samples; ++i)
+    {
+        double x = lower + (upper - lower) * (i + 0.5) / samples;
+        double expected = function(x, accuracy_exact);
+        double actual = function(x, accuracy);
+
+        double ulps = ulp_distance(expected, actual);
+        double relative = (expected != 0) ? fabs((actual - expected) / expected) : fabs(actual);
+        if (ulps > error.max_ulps) { error.max_ulps = ulps; }
+        if (relative > error.max_relative) { error.max_relative = relative; }
+    }
+
+    return error;
+}
+
+#endif //COURSEWORK_FAST_MATH_H
@@ -0,0 +1,371 @@
+#ifndef COURSEWORK_FLOAT_EVALUATOR_H
+#define COURSEWORK_FLOAT_EVALUATOR_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <float.h>
+#include <math.h>
+
+#include "program.h"
+#include "thread_pool.h"
+#include "tree_hash.h"
+#include "batch_evaluator.h"
+
+// computes a single instruction in single precision from its operands.
+float float_compute(const instruction* instruction, float left, float right, const float* slots)
+{
+    switch (instruction->type)
+    {
+        case addition: return left + right;
+        case subtraction: return left - right;
+        case multiplication: return left * right;
+        case division: return left / right;
+        case power: return powf(left, right);
+        case negation: return -left;
+        case squareroot: return sqrtf(left);
+        case log_10: return log10f(left);
+        case log_e: return logf(left);
+        case sine: return sinf(left);
+        case cosine: return cosf(left);
+        case tangent: return tanf(left);
+        case constant: return (float)instruction->value;
+        case variable: return slots[instruction->slot];
+        default: return 0; // not a valid token type.
+    }
+}
+
+// runs the program on one set of single precision slot values, with every instruction in single precision.
+// registers must have room for program->length values.
+void program_run_float(const program* program, const float* slots, float* registers, float* results)
+{
+    for (int i = 0; i < program->length; ++i)
+    {
+        // arithmetic is computed here, since most instructions are arithmetic, and everything else by float_compute.
+        const instruction* instruction = &program->code[i];
+        switch (instruction->type)
+        {
+            case addition: registers[i] = registers[instruction->left] + registers[instruction->right]; break;
+            case subtraction: registers[i] = registers[instruction->left] - registers[instruction->right]; break;
+            case multiplication: registers[i] = registers[instruction->left] * registers[instruction->right]; break;
+            case division: registers[i] = registers[instruction->left] / registers[instruction->right]; break;
+            case sine:
+            case cosine:
+                if (instruction->partner < 0)
+                {
+                    registers[i] = float_compute(instruction, registers[instruction->left], 0, slots);
+                }
+                else if (instruction->partner > i)
+                {
+                    // the first of a sine and cosine of the same argument computes both, as program_run does.
+                    float argument = registers[instruction->left];
+                    float sine_value = sinf(argument);
+                    float cosine_value = cosf(argument);
+                    registers[(instruction->type == sine) ? i : instruction->partner] = sine_value;
+                    registers[(instruction->type == sine) ? instruction->partner : i] = cosine_value;
+                }
+                break;
+            default:
+                registers[i] = float_compute(instruction, (instruction->left >= 0) ? registers[instruction->left] : 0,
+                                             (instruction->right >= 0) ? registers[instruction->right] : 0, slots);
+                break;
+        }
+    }
+
+    for (int i = 0; i < program->output_count; ++i)
+    {
+        results[i] = registers[program->outputs[i]];
+    }
+}
+
+// runs the program on one set of single precision slot values, accumulating additions and subtractions in double
+// precision, so a sum only rounds to single precision when a function or product reads it.
+// registers must have room for program->length values.
+void program_run_mixed(const program* program, const float* slots, double* registers, float* results)
+{
+    for (int i = 0; i < program->length; ++i)
+    {
+        const instruction* instruction = &program->code[i];
+        double left = (instruction->left >= 0) ? registers[instruction->left] : 0;
+        double right = (instruction->right >= 0) ? registers[instruction->right] : 0;
+
+        switch (instruction->type)
+        {
+            case addition: registers[i] = left + right; break;
+            case subtraction: registers[i] = left - right; break;
+            case negation: registers[i] = -left; break;
+            default: registers[i] = float_compute(instruction, (float)left, (float)right, slots); break;
+        }
+    }
+
+    for (int i = 0; i < program->output_count; ++i)
+    {
+        results[i] = (float)registers[program->outputs[i]];
+    }
+}
+
+// a batch of single precision rows to evaluate, shared like a double precision batch.
+typedef struct float_batch
+{
+    const program* program;
+    const float* rows; // slot values of each row, one row after another.
+    float* results; // results of each row, one row after another.
+    int row_count;
+    bool double_sums; // accumulate additions and subtractions in double precision.
+} float_batch;
+
+// evaluates one chunk of single precision rows.
+void batch_evaluate_float_chunk(void* context, int task)
+{
+    float_batch* batch = context;
+    const program* program = batch->program;
+
+    int first = task * BATCH_CHUNK_ROWS;
+    int last = first + BATCH_CHUNK_ROWS;
+    if (last > batch->row_count)
+    {
+        last = batch->row_count;
+    }
+
+    if (batch->double_sums)
+    {
+        double* registers = (double*)malloc(sizeof(double) * (program->length + 1));
+        for (int row = first; row < last; ++row)
+        {
+            program_run_mixed(program,
+                              batch->rows + (size_t)row * program->slot_count,
+                              registers,
+                              batch->results + (size_t)row * program->output_count);
+        }
+        free(registers);
+    }
+    else
+    {
+        float* registers = (float*)malloc(sizeof(float) * (program->length + 1));
+        for (int row = first; row < last; ++row)
+        {
+            program_run_float(program,
+                              batch->rows + (size_t)row * program->slot_count,
+                              registers,
+                              batch->results + (size_t)row * program->output_count);
+        }
+        free(registers);
+    }
+}
+
+// evaluates the program for each row of single precision slot values, like batch_evaluate.
+// with double_sums, additions and subtractions are accumulated in double precision.
+void batch_evaluate_float(thread_pool* pool, const program* program, const float* rows, int row_count, float* results,
+                          bool double_sums)
+{
+    float_batch batch;
+    batch.program = program;
+    batch.rows = rows;
+    batch.results = results;
+    batch.row_count = row_count;
+    batch.double_sums = double_sums;
+
+    int chunk_count = (row_count + BATCH_CHUNK_ROWS - 1) / BATCH_CHUNK_ROWS;
+    thread_pool_run(pool, batch_evaluate_float_chunk, &batch, chunk_count);
+}
+
+#define FLOAT_ANALYSIS_POINTS 4096 // largest number of points of the domain the analysis samples.
+
+// estimated error of evaluating each output of a program in single precision over a box of slot values.
+typedef struct float_analysis
+{
+    int output_count;
+    double* relative_error; // largest error of each output divided by the largest magnitude of the output.
+    int* cancellation; // the addition or subtraction with the largest cancellation feeding each output, or -1.
+    double* cancellation_factor; // (|left| + |right|) / |result| of that instruction, so 1 means no cancellation.
+} float_analysis;
+
+// free memory for the analysis.
+void float_analysis_free(float_analysis* analysis)
+{
+    if (analysis != NULL)
+    {
+        free(analysis->relative_error);
+        free(analysis->cancellation);
+        free(analysis->cancellation_factor);
+        free(analysis);
+    }
+}
+
+// returns the rounding error of storing a value in single precision, which is zero for values a float holds exactly.
+double float_rounding_error(double value, double unit_roundoff)
+{
+    return ((double)(float)value == value) ? 0 : unit_roundoff * fabs(value);
+}
+
+// returns the magnitude of the derivative of a function of one argument, used to carry its argument's error through it.
+double float_derivative(token_type type, double argument, double result)
+{
+    switch (type)
+    {
+        case squareroot: return 0.5 / result;
+        case log_10: return 1 / (argument * M_LN10);
+        case log_e: return 1 / argument;
+        case sine: return cos(argument);
+        case cosine: return sin(argument);
+        case tangent: return 1 + result * result;
+        default: return 0;
+    }
+}
+
+// estimates the error of running the program in single precision over a box of slot values, before running it.
+// the program is run in double precision on a grid of points of the box, and a first-order bound on the absolute
+// error of each register is carried through each instruction. a subtraction of nearly equal values keeps the absolute
+// error of its operands while its result shrinks, which is where the relative error grows.
+// with double_sums, additions and subtractions round like program_run_mixed does.
+// like a chebyshev surrogate's max_error, this is an estimate from sampling rather than a proof.
+float_analysis* float_analyse(const program* program, const double* lower, const double* upper, bool double_sums)
+{
+    const double float_roundoff = FLT_EPSILON / 2;
+    const double sum_roundoff = double_sums ? DBL_EPSILON / 2 : float_roundoff;
+
+    float_analysis* analysis = (float_analysis*)malloc(sizeof(float_analysis));
+    analysis->output_count = program->output_count;
+    analysis->relative_error = (double*)malloc(sizeof(double) * (program->output_count + 1));
+    analysis->cancellation = (int*)malloc(sizeof(int) * (program->output_count + 1));
+    analysis->cancellation_factor = (double*)malloc(sizeof(double) * (program->output_count + 1));
+
+    // the same number of points along each dimension, with both ends of each range included.
+    // with too many dimensions to visit every corner, a varied subset of the corners is visited instead.
+    int per_dimension = 2;
+    while (program->slot_count > 0 && pow(per_dimension + 1, program->slot_count) <= FLOAT_ANALYSIS_POINTS)
+    {
+        ++per_dimension;
+    }
+    bool corners_only = pow(per_dimension, program->slot_count) > FLOAT_ANALYSIS_POINTS;
+    int point_count = corners_only ? FLOAT_ANALYSIS_POINTS : (int)pow(per_dimension, program->slot_count);
+
+    double* slots = (double*)malloc(sizeof(double) * (program->slot_count + 1));
+    double* registers = (double*)malloc(sizeof(double) * (program->length + 1));
+    double* errors = (double*)malloc(sizeof(double) * (program->length + 1));
+    double* largest_error = (double*)calloc(program->length + 1, sizeof(double));
+    double* largest_value = (double*)calloc(program->length + 1, sizeof(double));
+    double* factors = (double*)malloc(sizeof(double) * (program->length + 1));
+    int* worst = (int*)malloc(sizeof(int) * (program->length + 1));
+    for (int i = 0; i < program->length; ++i)
+    {
+        factors[i] = 1;
+    }
+
+    for (int point = 0; point < point_count; ++point)
+    {
+        int index = point;
+        for (int slot = program->slot_count - 1; slot >= 0; --slot)
+        {
+            int step = corners_only ? (int)(hash_combine(point, slot) & 1) : index % per_dimension;
+            slots[slot] = lower[slot] + (upper[slot] - lower[slot]) * step / (per_dimension - 1);
+            index /= per_dimension;
+        }
+
+        for (int i = 0; i < program->length; ++i)
+        {
+            const instruction* instruction = &program->code[i];
+            registers[i] = instruction_compute(instruction, registers, slots);
+
+            double result = registers[i];
+            double left = (instruction->left >= 0) ? registers[instruction->left] : 0;
+            double right = (instruction->right >= 0) ? registers[instruction->right] : 0;
+            double left_error = (instruction->left >= 0) ? errors[instruction->left] : 0;
+            double right_error = (instruction->right >= 0) ? errors[instruction->right] : 0;
+
+            switch (instruction->type)
+            {
+                case addition:
+                case subtraction:
+                    errors[i] = left_error + right_error + sum_roundoff * fabs(result);
+                    if (result != 0 && (fabs(left) + fabs(right)) / fabs(result) > factors[i])
+                    {
+                        factors[i] = (fabs(left) + fabs(right)) / fabs(result);
+                    }
+                    break;
+                case multiplication:
+                    errors[i] = fabs(right) * left_error + fabs(left) * right_error + float_roundoff * fabs(result);
+                    break;
+                case division:
+                    errors[i] = left_error / fabs(right) + fabs(left) * right_error / (right * right) + float_roundoff * fabs(result);
+                    break;
+                case power:
+                    errors[i] = fabs(result) * (fabs(right / left) * left_error + fabs(log(fabs(left))) * right_error)
+                                + float_roundoff * fabs(result);
+                    break;
+                case negation:
+                    errors[i] = left_error; // exact.
+                    break;
+                case constant:
+                    errors[i] = float_rounding_error(result, float_roundoff);
+                    break;
+                case variable:
+                    errors[i] = 0; // the input columns already hold floats.
+                    break;
+                default:
+                    errors[i] = fabs(float_derivative(instruction->type, left, result)) * left_error + float_roundoff * fabs(result);
+                    break;
+            }
+
+            // undefined values are undefined in either precision, so they don't count as errors.
+            if (isfinite(errors[i]) && errors[i] > largest_error[i]) { largest_error[i] = errors[i]; }
+            if (isfinite(result) && fabs(result) > largest_value[i]) { largest_value[i] = fabs(result); }
+        }
+    }
+
+    // find the worst cancellation below each register, so it can be reported against each output.
+    for (int i = 0; i < program->length; ++i)
+    {
+        const instruction* instruction = &program->code[i];
+        worst[i] = (instruction->type == addition || instruction->type == subtraction) ? i : -1;
+        for (int operand = 0; operand < 2; ++operand)
+        {
+            int below = (operand == 0) ? instruction->left : instruction->right;
+            if (below >= 0 && worst[below] >= 0 && (worst[i] < 0 || factors[worst[below]] > factors[worst[i]]))
+            {
+                worst[i] = worst[below];
+            }
+        }
+    }
+
+    for (int i = 0; i < program->output_count; ++i)
+    {
+        int output = program->outputs[i];
+        analysis->relative_error[i] = (largest_value[output] > 0) ? largest_error[output] / largest_value[output] : 0;
+        analysis->cancellation[i] = worst[output];
+        analysis->cancellation_factor[i] = (worst[output] >= 0) ? factors[worst[output]] : 1;
+    }
+
+    free(slots);
+    free(registers);
+    free(errors);
+    free(largest_error);
+    free(largest_value);
+    free(factors);
+    free(worst);
+    return analysis;
+}
+
+// prints a warning for each output whose estimated relative error in single precision is above the tolerance.
+// returns the number of outputs that are unsafe to evaluate in single precision.
+int float_analysis_warn(FILE* stream, const float_analysis* analysis, double tolerance)
+{
+    int unsafe = 0;
+    for (int i = 0; i < analysis->output_count; ++i)
+    {
+        if (analysis->relative_error[i] > tolerance)
+        {
+            fprintf(stream, "warning: output %d may have a relative error of %.3g in single precision", i, analysis->relative_error[i]);
+            if (analysis->cancellation[i] >= 0 && analysis->cancellation_factor[i] > 1 / tolerance)
+            {
+                fprintf(stream, ", instruction %d cancels by a factor of %.3g", analysis->cancellation[i], analysis->cancellation_factor[i]);
+            }
+            fprintf(stream, "\n");
+            ++unsafe;
+        }
+    }
+
+    return unsafe;
+}
+
+#endif //COURSEWORK_FLOAT_EVALUATOR_H
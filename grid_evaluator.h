@@ -0,0 +1,195 @@
+#ifndef COURSEWORK_GRID_EVALUATOR_H
+#define COURSEWORK_GRID_EVALUATOR_H
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include "program.h"
+
+// range of values swept by one variable of a grid.
+typedef struct grid_axis
+{
+    char symbol; // the variable swept by this axis.
+    double start; // first value of the variable.
+    double stop; // last value of the variable.
+    int count; // number of evenly spaced values from start to stop.
+} grid_axis;
+
+// a program split into loop levels, where level L holds the instructions that only change when axis L changes.
+typedef struct grid_plan
+{
+    const program* program;
+    const grid_axis* axes; // axes in loop order, the outermost loop first.
+    int axis_count;
+    int* axis_slots; // binding slot of each axis.
+    int** levels; // instructions to compute at each loop level, in post-order.
+    int* level_counts;
+    int* invariant; // instructions that don't depend on any axis.
+    int invariant_count;
+} grid_plan;
+
+// returns the value of an axis at a point along it.
+double grid_axis_value(const grid_axis* axis, int index)
+{
+    if (axis->count <= 1)
+    {
+        return axis->start;
+    }
+
+    return axis->start + (axis->stop - axis->start) * index / (axis->count - 1);
+}
+
+// computes the instructions of one loop level, then runs the next level for each of its values.
+void grid_run_level(grid_plan* plan, int level, double* slots, double* registers, double** results)
+{
+    const grid_axis* axis = &plan->axes[level];
+    const program* program = plan->program;
+
+    for (int index = 0; index < axis->count; ++index)
+    {
+        slots[plan->axis_slots[level]] = grid_axis_value(axis, index);
+
+        // only the instructions that depend on this axis, and on no inner axis, change here.
+        for (int i = 0; i < plan->level_counts[level]; ++i)
+        {
+            int instruction = plan->levels[level][i];
+            registers[instruction] = instruction_compute(&program->code[instruction], registers, slots);
+        }
+
+        if (level + 1 < plan->axis_count)
+        {
+            grid_run_level(plan, level + 1, slots, registers, results);
+        }
+        else
+        {
+            // innermost loop, so write the outputs for this point of the grid.
+            for (int i = 0; i < program->output_count; ++i)
+            {
+                (*results)[i] = registers[program->outputs[i]];
+            }
+            *results += program->output_count;
+        }
+    }
+}
+
+// evaluates the program at every point of a grid, with the axes looped over in the given order, the outermost first.
+// each subexpression is computed in the outermost loop where it is invariant, e.g. sin(2 * x) is only computed
+// once per value of x when x is the outer loop.
+// results receives program->output_count values per point, with the last axis varying fastest.
+// returns false if a variable of the program has no axis.
+bool grid_evaluate(const program* program, const grid_axis* axes, int axis_count, double* results)
+{
+    grid_plan plan;
+    plan.program = program;
+    plan.axes = axes;
+    plan.axis_count = axis_count;
+    plan.axis_slots = (int*)malloc(sizeof(int) * (axis_count + 1));
+
+    // find the axis of each binding slot, an axis for a variable the program doesn't use gets a spare slot.
+    int* slot_levels = (int*)malloc(sizeof(int) * (program->slot_count + 1));
+    for (int level = 0; level < axis_count; ++level)
+    {
+        plan.axis_slots[level] = program->slot_count + level;
+    }
+    for (int slot = 0; slot < program->slot_count; ++slot)
+    {
+        slot_levels[slot] = -1;
+        for (int level = 0; level < axis_count; ++level)
+        {
+            if (axes[level].symbol == program->symbols[slot])
+            {
+                slot_levels[slot] = level;
+                plan.axis_slots[level] = slot;
+            }
+        }
+    }
+    double* slots = (double*)malloc(sizeof(double) * (program->slot_count + axis_count + 1));
+
+    // the level of an instruction is the innermost axis of any variable it depends on, or -1 for none.
+    int* instruction_levels = (int*)malloc(sizeof(int) * (program->length + 1));
+    plan.level_counts = (int*)calloc(axis_count + 1, sizeof(int));
+    plan.invariant_count = 0;
+    bool complete = true;
+    for (int i = 0; i < program->length; ++i)
+    {
+        const instruction* instruction = &program->code[i];
+        int level = -1;
+        if (instruction->type == variable)
+        {
+            level = slot_levels[instruction->slot];
+            complete = complete && (level >= 0);
+        }
+        if (instruction->left >= 0 && instruction_levels[instruction->left] > level)
+        {
+            level = instruction_levels[instruction->left];
+        }
+        if (instruction->right >= 0 && instruction_levels[instruction->right] > level)
+        {
+            level = instruction_levels[instruction->right];
+        }
+
+        instruction_levels[i] = level;
+        if (level >= 0) { ++plan.level_counts[level]; } else { ++plan.invariant_count; }
+    }
+
+    if (complete)
+    {
+        // bucket the instructions by level, keeping them in post-order.
+        plan.levels = (int**)malloc(sizeof(int*) * (axis_count + 1));
+        for (int level = 0; level < axis_count; ++level)
+        {
+            plan.levels[level] = (int*)malloc(sizeof(int) * (plan.level_counts[level] + 1));
+            plan.level_counts[level] = 0;
+        }
+        plan.invariant = (int*)malloc(sizeof(int) * (plan.invariant_count + 1));
+        plan.invariant_count = 0;
+
+        for (int i = 0; i < program->length; ++i)
+        {
+            int level = instruction_levels[i];
+            if (level >= 0)
+            {
+                plan.levels[level][plan.level_counts[level]++] = i;
+            }
+            else
+            {
+                plan.invariant[plan.invariant_count++] = i;
+            }
+        }
+
+        double* registers = (double*)malloc(sizeof(double) * (program->length + 1));
+        for (int i = 0; i < plan.invariant_count; ++i)
+        {
+            registers[plan.invariant[i]] = instruction_compute(&program->code[plan.invariant[i]], registers, slots);
+        }
+
+        if (axis_count > 0)
+        {
+            grid_run_level(&plan, 0, slots, registers, &results);
+        }
+        else
+        {
+            for (int i = 0; i < program->output_count; ++i)
+            {
+                results[i] = registers[program->outputs[i]];
+            }
+        }
+
+        free(registers);
+        for (int level = 0; level < axis_count; ++level)
+        {
+            free(plan.levels[level]);
+        }
+        free(plan.levels);
+        free(plan.invariant);
+    }
+
+    free(instruction_levels);
+    free(plan.level_counts);
+    free(slots);
+    free(slot_levels);
+    free(plan.axis_slots);
+    return complete;
+}
+
+#endif //COURSEWORK_GRID_EVALUATOR_H
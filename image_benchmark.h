@@ -0,0 +1,356 @@
+#ifndef COURSEWORK_IMAGE_BENCHMARK_H
+#define COURSEWORK_IMAGE_BENCHMARK_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "expression_image.h"
+#include "infix_writer.h"
+#include "parse_benchmark.h"
+
+// writes the i-th generated formula to the buffer, a sum of a few terms like those a service is configured with.
+void image_benchmark_formula(char* buffer, size_t size, int i)
+{
+    static const char* terms[] =
+    {
+        "sin(x * %g + y)",
+        "(z / %g) ^ 2",
+        "cos(%g * x) / (1 + y ^ 2)",
+        "sqrt(x ^ 2 + y ^ 2 + %g)",
+        "ln(%g + x * x) * tan(y)",
+        "log(%g + z) * x",
+        "x ^ 3 * %g - y * z"
+    };
+    int term_count = sizeof(terms) / sizeof(terms[0]);
+
+    int length = 0;
+    for (int k = 0; k < 3 + i % 5; ++k)
+    {
+        if (k > 0)
+        {
+            length += snprintf(buffer + length, size - length, (k % 3 == 2) ? " - " : " + ");
+        }
+        length += snprintf(buffer + length, size - length, terms[(i * 7 + k * 3) % term_count], 0.25 * (i + k + 1));
+    }
+}
+
+// parses, simplifies and differentiates the text without compiling a program, as each run did before images.
+// returns the number of tree nodes built.
+long long image_benchmark_derive(const char* text)
+{
+    tree_node* root = parse_expression(text);
+    simplify(root);
+    long long nodes = parse_benchmark_count(root);
+
+    list variables;
+    list_init(&variables);
+    find_variables(root, &variables);
+    for (list_node* item = variables.first; item != NULL; item = item->next)
+    {
+        variable_value* pair = item->payload;
+        tree_node* diff_root = differentiate(root, pair->symbol);
+        simplify(diff_root);
+        nodes += parse_benchmark_count(diff_root);
+        tree_free(diff_root);
+    }
+
+    free_variables(&variables);
+    tree_free(root);
+    return nodes;
+}
+
+// is the loaded expression the same as the compiled one, with equal trees and a program giving the same results?
+bool image_benchmark_equal(const compiled_expression* loaded, const compiled_expression* compiled)
+{
+    bool equal = loaded->variable_count == compiled->variable_count && tree_equal(loaded->root, compiled->root);
+    for (int i = 0; equal && i < compiled->variable_count; ++i)
+    {
+        equal = tree_equal(loaded->partials[i], compiled->partials[i]);
+    }
+
+    const program* program = compiled->program;
+    if (equal == false || loaded->program->length != program->length || loaded->program->output_count != program->output_count)
+    {
+        return false;
+    }
+
+    double* slots = (double*)malloc(sizeof(double) * (program->slot_count + 1));
+    double* registers = (double*)malloc(sizeof(double) * (program->length + 1));
+    double* expected = (double*)malloc(sizeof(double) * program->output_count);
+    double* results = (double*)malloc(sizeof(double) * program->output_count);
+    for (int slot = 0; slot < program->slot_count; ++slot)
+    {
+        slots[slot] = 0.5 + 0.25 * slot;
+    }
+    program_run(program, slots, registers, expected);
+    program_run(loaded->program, slots, registers, results);
+    equal = memcmp(expected, results, sizeof(double) * program->output_count) == 0;
+
+    free(slots);
+    free(registers);
+    free(expected);
+    free(results);
+    return equal;
+}
+
+// runs the program of each expression once, returns the sum of their values.
+double image_benchmark_run(const compiled_expression* expressions, int count)
+{
+    int length = 0;
+    int slot_count = 0;
+    int output_count = 0;
+    for (int i = 0; i < count; ++i)
+    {
+        const program* program = expressions[i].program;
+        length = (program->length > length) ? program->length : length;
+        slot_count = (program->slot_count > slot_count) ? program->slot_count : slot_count;
+        output_count = (program->output_count > output_count) ? program->output_count : output_count;
+    }
+
+    double* slots = (double*)malloc(sizeof(double) * (slot_count + 1));
+    double* registers = (double*)malloc(sizeof(double) * (length + 1));
+    double* results = (double*)malloc(sizeof(double) * (output_count + 1));
+    for (int slot = 0; slot < slot_count; ++slot)
+    {
+        slots[slot] = 0.5 + 0.25 * slot;
+    }
+
+    double sum = 0;
+    for (int i = 0; i < count; ++i)
+    {
+        program_run(expressions[i].program, slots, registers, results);
+        sum += results[0];
+    }
+
+    free(slots);
+    free(registers);
+    free(results);
+    return sum;
+}
+
+// times starting up with the given number of generated formulas, first by parsing, simplifying and differentiating
+// each one, then by compiling each one to a program as well, then by loading them from an image whose pages were
+// dropped from the page cache, both at its base address and elsewhere, and then by running each loaded program once.
+// returns the number of loaded expressions that differ from the compiled ones.
+int image_benchmark(int count)
+{
+    char** texts = (char**)malloc(sizeof(char*) * count);
+    for (int i = 0; i < count; ++i)
+    {
+        char buffer[512];
+        image_benchmark_formula(buffer, sizeof(buffer), i);
+        texts[i] = strdup(buffer);
+    }
+
+    double start = parse_benchmark_seconds();
+    long long nodes = 0;
+    for (int i = 0; i < count; ++i)
+    {
+        nodes += image_benchmark_derive(texts[i]);
+    }
+    double derive_seconds = parse_benchmark_seconds() - start;
+
+    start = parse_benchmark_seconds();
+    compiled_expression** expressions = (compiled_expression**)malloc(sizeof(compiled_expression*) * count);
+    for (int i = 0; i < count; ++i)
+    {
+        expressions[i] = compiled_expression_create(texts[i]);
+    }
+    double compile_seconds = parse_benchmark_seconds() - start;
+
+    char path[] = "/tmp/coursework-image-XXXXXX";
+    int fd = mkstemp(path);
+    char error[EXPRESSION_IMAGE_ERROR_SIZE];
+    bool written = fd >= 0 && expression_image_write(path, expressions, (const char* const*)texts, count, error);
+    if (fd >= 0)
+    {
+        fsync(fd);
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED); // the next open reads the image from the disk.
+    }
+
+    expression_image image;
+    start = parse_benchmark_seconds();
+    bool loaded = written && expression_image_open(&image, path, error);
+    double load_seconds = parse_benchmark_seconds() - start;
+
+    start = parse_benchmark_seconds();
+    double sum = loaded ? image_benchmark_run(image.expressions, count) : 0;
+    double run_seconds = parse_benchmark_seconds() - start;
+
+    // the first image holds the base address, so a second one is mapped elsewhere and its pointers are moved.
+    expression_image moved;
+    if (fd >= 0)
+    {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        close(fd);
+    }
+    start = parse_benchmark_seconds();
+    bool loaded_moved = loaded && expression_image_open(&moved, path, error);
+    double move_seconds = parse_benchmark_seconds() - start;
+    unlink(path);
+
+    int failures = count;
+    if (loaded && loaded_moved)
+    {
+        printf("%-24s%12s%16s\n", "startup", "ms", "us/formula");
+        printf("%-24s%12.2f%16.2f\n", "parse+simplify+diff", derive_seconds * 1e3, derive_seconds * 1e6 / count);
+        printf("%-24s%12.2f%16.2f\n", "compile", compile_seconds * 1e3, compile_seconds * 1e6 / count);
+        printf("%-24s%12.2f%16.2f\n", "load image", load_seconds * 1e3, load_seconds * 1e6 / count);
+        printf("%-24s%12.2f%16.2f\n", "first run of each", run_seconds * 1e3, run_seconds * 1e6 / count);
+        printf("%-24s%12.2f%16.2f\n", "load moved image", move_seconds * 1e3, move_seconds * 1e6 / count);
+        printf("%d formulas, %lld tree nodes, %.1f MB image, sum of values %g\n", count, nodes, image.mapped_size / 1e6, sum);
+        printf("first image %s at its base address\n",
+               ((uint64_t)(uintptr_t)image.mapped == expression_image_base((const char* const*)texts, count)) ? "mapped" : "not mapped");
+
+        failures = 0;
+        for (int i = 0; i < count; ++i)
+        {
+            failures += (image_benchmark_equal(&image.expressions[i], expressions[i]) &&
+                         image_benchmark_equal(&moved.expressions[i], expressions[i]) &&
+                         strcmp(image.texts[i], texts[i]) == 0 && strcmp(moved.texts[i], texts[i]) == 0) ? 0 : 1;
+        }
+        expression_image_close(&image);
+        expression_image_close(&moved);
+    }
+    else
+    {
+        printf("%s\n", written ? error : "can't write a temporary image");
+        if (loaded)
+        {
+            expression_image_close(&image);
+        }
+    }
+
+    for (int i = 0; i < count; ++i)
+    {
+        compiled_expression_free(expressions[i]);
+        free(texts[i]);
+    }
+    free(expressions);
+    free(texts);
+    return failures;
+}
+
+// writes an image of the given number of generated formulas, then opens copies of it with one byte changed at a
+// different place each try, half of them while the undamaged image holds the base address so that they are moved. a
+// copy that opens is used as --show-image would use it: each tree is printed, each program is run and each text is
+// looked up. a damaged image must either be rejected or be safe to use, so a run that ends has passed.
+// returns the number of tries in which the undamaged image could not be opened.
+int image_corruption_test(int tries)
+{
+    int count = 20;
+    char** texts = (char**)malloc(sizeof(char*) * count);
+    compiled_expression** expressions = (compiled_expression**)malloc(sizeof(compiled_expression*) * count);
+    for (int i = 0; i < count; ++i)
+    {
+        char buffer[512];
+        image_benchmark_formula(buffer, sizeof(buffer), i);
+        texts[i] = strdup(buffer);
+        expressions[i] = compiled_expression_create(texts[i]);
+    }
+
+    char path[] = "/tmp/coursework-image-XXXXXX";
+    char damaged_path[] = "/tmp/coursework-damaged-XXXXXX";
+    int fd = mkstemp(path);
+    int damaged_fd = mkstemp(damaged_path);
+    char error[EXPRESSION_IMAGE_ERROR_SIZE];
+    bool written = fd >= 0 && damaged_fd >= 0 &&
+                   expression_image_write(path, expressions, (const char* const*)texts, count, error);
+
+    // the bytes of the undamaged image.
+    char* bytes = NULL;
+    off_t size = written ? lseek(fd, 0, SEEK_END) : 0;
+    if (size > 0)
+    {
+        bytes = (char*)malloc(size);
+        written = pread(fd, bytes, size, 0) == (ssize_t)size;
+    }
+
+    int failures = 0;
+    int rejected = 0;
+    int moved = 0;
+    long long characters = 0;
+    expression_image original;
+    bool holding = false;
+    for (int try = 0; written && try < tries; ++try)
+    {
+        if (try == tries / 2)
+        {
+            holding = expression_image_open(&original, path, error);
+            failures += holding ? 0 : 1;
+        }
+
+        // a different byte each try, spread over the whole image, changed by a different pattern.
+        off_t offset = (off_t)(((uint64_t)try * 2654435761u) % (uint64_t)size);
+        char saved = bytes[offset];
+        bytes[offset] ^= (char)(1 + try % 255);
+        bool copied = pwrite(damaged_fd, bytes, size, 0) == (ssize_t)size;
+        bytes[offset] = saved;
+
+        expression_image image;
+        if (copied == false || expression_image_open(&image, damaged_path, error) == false)
+        {
+            ++rejected;
+            continue;
+        }
+
+        moved += holding ? 1 : 0;
+        for (int i = 0; i < image.expression_count; ++i)
+        {
+            const compiled_expression* expression = &image.expressions[i];
+            char* text = infix(expression->root);
+            characters += strlen(text);
+            free(text);
+            for (int slot = 0; slot < expression->variable_count; ++slot)
+            {
+                text = infix(expression->partials[slot]);
+                characters += strlen(text);
+                free(text);
+            }
+            expression_image_find(&image, texts[i]);
+        }
+        image_benchmark_run(image.expressions, image.expression_count);
+        expression_image_close(&image);
+    }
+
+    if (written)
+    {
+        printf("%d tries on a %lld byte image: %d damaged images rejected, %d accepted and used, %d of them moved\n",
+               tries, (long long)size, rejected, tries - rejected, moved);
+        printf("%lld characters of trees printed from the accepted images\n", characters);
+    }
+    else
+    {
+        printf("%s\n", (fd >= 0 && damaged_fd >= 0) ? error : "can't write a temporary image");
+        failures = 1;
+    }
+
+    if (holding)
+    {
+        expression_image_close(&original);
+    }
+    for (int i = 0; i < count; ++i)
+    {
+        compiled_expression_free(expressions[i]);
+        free(texts[i]);
+    }
+    free(bytes);
+    free(expressions);
+    free(texts);
+    if (fd >= 0)
+    {
+        close(fd);
+        unlink(path);
+    }
+    if (damaged_fd >= 0)
+    {
+        close(damaged_fd);
+        unlink(damaged_path);
+    }
+    return failures;
+}
+
+#endif //COURSEWORK_IMAGE_BENCHMARK_H
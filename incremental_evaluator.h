@@ -0,0 +1,260 @@
+#ifndef COURSEWORK_INCREMENTAL_EVALUATOR_H
+#define COURSEWORK_INCREMENTAL_EVALUATOR_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "program.h"
+
+// evaluates a program once, then recomputes only the instructions that depend on variables which changed since.
+typedef struct incremental_evaluator
+{
+    const program* program;
+    double* registers; // the last value of each instruction.
+    double* slots; // the current value of each binding slot.
+    int* parents; // instructions that read each instruction, stored contiguously per instruction.
+    int* parent_offsets; // index of each instruction's first parent, with one extra entry marking the end.
+    int** slot_readers; // the instructions reading each binding slot.
+    int* slot_reader_counts;
+    bool* dirty; // instructions waiting to be recomputed.
+    int* dirty_list; // indices of dirty instructions.
+    int dirty_count;
+    int* cones; // the instructions that depend on each binding slot, in index order, stored contiguously per slot.
+    int* cone_offsets; // index of each slot's first dependent instruction, with one extra entry marking the end.
+    bool* changed_slots; // slots changed since the last update.
+    int* changed_list;
+    int changed_count;
+    int last_update_count; // number of instructions recomputed by the last update.
+} incremental_evaluator;
+
+// compares two instruction indices, used to sort dirty instructions into post-order.
+int compare_indices(const void* a, const void* b)
+{
+    return *(const int*)a - *(const int*)b;
+}
+
+// marks an instruction and every instruction on the paths from it to the outputs as dirty.
+void incremental_evaluator_mark(incremental_evaluator* evaluator, int index)
+{
+    // the dirty list doubles as the work list, so each instruction is visited at most once.
+    if (evaluator->dirty[index])
+    {
+        return;
+    }
+
+    int first = evaluator->dirty_count;
+    evaluator->dirty[index] = true;
+    evaluator->dirty_list[evaluator->dirty_count++] = index;
+
+    for (int next = first; next < evaluator->dirty_count; ++next)
+    {
+        int current = evaluator->dirty_list[next];
+        for (int p = evaluator->parent_offsets[current]; p < evaluator->parent_offsets[current + 1]; ++p)
+        {
+            int parent = evaluator->parents[p];
+            if (evaluator->dirty[parent] == false)
+            {
+                evaluator->dirty[parent] = true;
+                evaluator->dirty_list[evaluator->dirty_count++] = parent;
+            }
+        }
+    }
+}
+
+// create an incremental evaluator for a program and compute every instruction with the given slot values.
+incremental_evaluator* incremental_evaluator_create(const program* program, const double* slots)
+{
+    incremental_evaluator* evaluator = (incremental_evaluator*)malloc(sizeof(incremental_evaluator));
+    int length = program->length;
+    evaluator->program = program;
+    evaluator->registers = (double*)malloc(sizeof(double) * (length + 1));
+    evaluator->slots = (double*)malloc(sizeof(double) * (program->slot_count + 1));
+    evaluator->dirty = (bool*)calloc(length + 1, sizeof(bool));
+    evaluator->dirty_list = (int*)malloc(sizeof(int) * (length + 1));
+    evaluator->dirty_count = 0;
+    evaluator->changed_slots = (bool*)calloc(program->slot_count + 1, sizeof(bool));
+    evaluator->changed_list = (int*)malloc(sizeof(int) * (program->slot_count + 1));
+    evaluator->changed_count = 0;
+    evaluator->last_update_count = length;
+
+    // count the parents of each instruction, and the readers of each slot.
+    evaluator->parent_offsets = (int*)calloc(length + 1, sizeof(int));
+    evaluator->slot_reader_counts = (int*)calloc(program->slot_count + 1, sizeof(int));
+    for (int i = 0; i < length; ++i)
+    {
+        const instruction* instruction = &program->code[i];
+        if (instruction->left >= 0) { ++evaluator->parent_offsets[instruction->left + 1]; }
+        if (instruction->right >= 0) { ++evaluator->parent_offsets[instruction->right + 1]; }
+        if (instruction->type == variable) { ++evaluator->slot_reader_counts[instruction->slot]; }
+    }
+
+    // turn the counts into offsets, then fill in the parents.
+    for (int i = 0; i < length; ++i)
+    {
+        evaluator->parent_offsets[i + 1] += evaluator->parent_offsets[i];
+    }
+
+    evaluator->parents = (int*)malloc(sizeof(int) * (evaluator->parent_offsets[length] + 1));
+    int* next_parent = (int*)malloc(sizeof(int) * (length + 1));
+    for (int i = 0; i < length; ++i)
+    {
+        next_parent[i] = evaluator->parent_offsets[i];
+    }
+
+    evaluator->slot_readers = (int**)malloc(sizeof(int*) * (program->slot_count + 1));
+    for (int slot = 0; slot < program->slot_count; ++slot)
+    {
+        evaluator->slot_readers[slot] = (int*)malloc(sizeof(int) * (evaluator->slot_reader_counts[slot] + 1));
+        evaluator->slot_reader_counts[slot] = 0;
+    }
+
+    for (int i = 0; i < length; ++i)
+    {
+        const instruction* instruction = &program->code[i];
+        if (instruction->left >= 0) { evaluator->parents[next_parent[instruction->left]++] = i; }
+        if (instruction->right >= 0) { evaluator->parents[next_parent[instruction->right]++] = i; }
+        if (instruction->type == variable)
+        {
+            evaluator->slot_readers[instruction->slot][evaluator->slot_reader_counts[instruction->slot]++] = i;
+        }
+    }
+    free(next_parent);
+
+    // the instructions that depend on each slot, found once here so an update doesn't search or sort.
+    evaluator->cone_offsets = (int*)malloc(sizeof(int) * (program->slot_count + 1));
+    evaluator->cones = NULL;
+    int cone_total = 0;
+    for (int slot = 0; slot < program->slot_count; ++slot)
+    {
+        for (int r = 0; r < evaluator->slot_reader_counts[slot]; ++r)
+        {
+            incremental_evaluator_mark(evaluator, evaluator->slot_readers[slot][r]);
+        }
+        qsort(evaluator->dirty_list, evaluator->dirty_count, sizeof(int), compare_indices);
+
+        evaluator->cones = (int*)realloc(evaluator->cones, sizeof(int) * (cone_total + evaluator->dirty_count + 1));
+        evaluator->cone_offsets[slot] = cone_total;
+        for (int i = 0; i < evaluator->dirty_count; ++i)
+        {
+            evaluator->cones[cone_total++] = evaluator->dirty_list[i];
+            evaluator->dirty[evaluator->dirty_list[i]] = false;
+        }
+        evaluator->dirty_count = 0;
+    }
+    evaluator->cone_offsets[program->slot_count] = cone_total;
+
+    // compute every instruction once.
+    for (int slot = 0; slot < program->slot_count; ++slot)
+    {
+        evaluator->slots[slot] = slots[slot];
+    }
+    double* results = (double*)malloc(sizeof(double) * (program->output_count + 1));
+    program_run(program, evaluator->slots, evaluator->registers, results);
+    free(results);
+
+    return evaluator;
+}
+
+// free memory for the incremental evaluator, but not its program.
+void incremental_evaluator_free(incremental_evaluator* evaluator)
+{
+    if (evaluator != NULL)
+    {
+        for (int slot = 0; slot < evaluator->program->slot_count; ++slot)
+        {
+            free(evaluator->slot_readers[slot]);
+        }
+
+        free(evaluator->slot_readers);
+        free(evaluator->slot_reader_counts);
+        free(evaluator->cones);
+        free(evaluator->cone_offsets);
+        free(evaluator->parents);
+        free(evaluator->parent_offsets);
+        free(evaluator->registers);
+        free(evaluator->slots);
+        free(evaluator->dirty);
+        free(evaluator->dirty_list);
+        free(evaluator->changed_slots);
+        free(evaluator->changed_list);
+        free(evaluator);
+    }
+}
+
+// sets a new value for a binding slot, which is not used until the next update.
+void incremental_evaluator_set(incremental_evaluator* evaluator, int slot, double value)
+{
+    if (memcmp(&evaluator->slots[slot], &value, sizeof(value)) == 0)
+    {
+        return; // the value hasn't changed, so nothing depends on it.
+    }
+
+    evaluator->slots[slot] = value;
+    if (evaluator->changed_slots[slot] == false)
+    {
+        evaluator->changed_slots[slot] = true;
+        evaluator->changed_list[evaluator->changed_count++] = slot;
+    }
+}
+
+// recomputes only the instructions that depend on the slots changed since the last update,
+// then writes the result of each compiled tree to results.
+void incremental_evaluator_update(incremental_evaluator* evaluator, double* results)
+{
+    const program* program = evaluator->program;
+    int count = 0;
+    if (evaluator->changed_count == 1)
+    {
+        // the usual case: the cone of the one changed slot is already in index order.
+        int slot = evaluator->changed_list[0];
+        for (int c = evaluator->cone_offsets[slot]; c < evaluator->cone_offsets[slot + 1]; ++c)
+        {
+            int index = evaluator->cones[c];
+            evaluator->registers[index] = instruction_compute(&program->code[index], evaluator->registers, evaluator->slots);
+        }
+        count = evaluator->cone_offsets[slot + 1] - evaluator->cone_offsets[slot];
+    }
+    else if (evaluator->changed_count > 1)
+    {
+        // mark the union of the cones, then recompute the marked instructions in index order, since operands come
+        // before the instructions that read them.
+        int first = program->length;
+        for (int i = 0; i < evaluator->changed_count; ++i)
+        {
+            int slot = evaluator->changed_list[i];
+            for (int c = evaluator->cone_offsets[slot]; c < evaluator->cone_offsets[slot + 1]; ++c)
+            {
+                evaluator->dirty[evaluator->cones[c]] = true;
+            }
+            if (evaluator->cone_offsets[slot] < evaluator->cone_offsets[slot + 1])
+            {
+                first = (evaluator->cones[evaluator->cone_offsets[slot]] < first) ? evaluator->cones[evaluator->cone_offsets[slot]] : first;
+            }
+        }
+        for (int index = first; index < program->length; ++index)
+        {
+            if (evaluator->dirty[index])
+            {
+                evaluator->registers[index] = instruction_compute(&program->code[index], evaluator->registers, evaluator->slots);
+                evaluator->dirty[index] = false;
+                ++count;
+            }
+        }
+    }
+
+    for (int i = 0; i < evaluator->changed_count; ++i)
+    {
+        evaluator->changed_slots[evaluator->changed_list[i]] = false;
+    }
+    evaluator->changed_count = 0;
+    evaluator->last_update_count = count;
+
+    for (int i = 0; i < program->output_count; ++i)
+    {
+        results[i] = evaluator->registers[program->outputs[i]];
+    }
+}
+
+#endif //COURSEWORK_INCREMENTAL_EVALUATOR_H
@@ -6,113 +6,125 @@
 
 #include "tree.h"
 
-// concatenates five strings in ascending order.
-char* concat(const char* str1, const char* str2, const char* str3, const char* str4, const char* str5)
+// returns the text written before the left subtree of a node, which opens a function or a binary operator.
+const char* infix_prefix(token token)
 {
-    // determine the length of each string.
-    int len1 = (str1 == NULL) ? 0 : strlen(str1);
-    int len2 = (str2 == NULL) ? 0 : strlen(str2);
-    int len3 = (str3 == NULL) ? 0 : strlen(str3);
-    int len4 = (str4 == NULL) ? 0 : strlen(str4);
-    int len5 = (str5 == NULL) ? 0 : strlen(str5);
-
-    // allocate memory for the concatenated string on the heap.
-    char* str = (char*)malloc(sizeof(char) * (len1 + len2 + len3 + len4 + len5 + 1));
-
-    // concatenate the strings.
-    int n = 0;
-    for (int i = 0; i < len1; ++i) { str[n++] = str1[i]; }
-    for (int i = 0; i < len2; ++i) { str[n++] = str2[i]; }
-    for (int i = 0; i < len3; ++i) { str[n++] = str3[i]; }
-    for (int i = 0; i < len4; ++i) { str[n++] = str4[i]; }
-    for (int i = 0; i < len5; ++i) { str[n++] = str5[i]; }
+    switch (token.type)
+    {
+        case squareroot: return "sqrt(";
+        case log_10: return "log(";
+        case log_e: return "ln(";
+        case sine: return "sin(";
+        case cosine: return "cos(";
+        case tangent: return "tan(";
+        case addition:
+        case subtraction:
+        case multiplication:
+        case division:
+        case power: return "("; // don't put a left parenthesis around the unary negation.
+        default: return "";
+    }
+}
 
-    str[len1 + len2 + len3 + len4 + len5] = '\0'; // null terminator.
+// writes the text between the subtrees of a node, which is the node itself for operators and operands.
+void infix_middle(token token, char* middle_string)
+{
+    middle_string[0] = '\0';
+    switch (token.type)
+    {
+        case addition: strcpy(middle_string, " + "); break;
+        case subtraction: strcpy(middle_string, " - "); break;
+        case multiplication: strcpy(middle_string, " * "); break;
+        case division: strcpy(middle_string, " / "); break;
+        case negation: strcpy(middle_string, "-"); break;
+        case power: strcpy(middle_string, ")^("); break;
+        case variable: middle_string[0] = token.symbol; middle_string[1] = '\0'; break;
+        case constant: sprintf(middle_string, "%g", token.value); break;
+        default: break;
+    }
+}
 
-    return str;
+// returns the text written after the right subtree of a node, which closes a function or a binary operator.
+const char* infix_suffix(token token)
+{
+    return (is_function(token) || (is_operator(token) && is_binary(token))) ? ")" : "";
 }
 
+// a node being written by infix, and how much of it has been written.
+typedef struct infix_frame
+{
+    tree_node* node;
+    int stage; // 0 before the left subtree, 1 between the subtrees, 2 after the right subtree.
+} infix_frame;
+
 // produces a string in infix notation from the expression tree.
 char* infix(tree_node* node)
 {
-    // inorder traverse the tree.
-    if (node != NULL)
+    if (node == NULL)
+    {
+        return NULL; // expression tree is null.
+    }
+
+    // inorder traverse the tree with a stack of frames, appending to one growing string.
+    int length = 0;
+    int capacity = 64;
+    char* expression_string = (char*)malloc(sizeof(char) * capacity);
+    int frame_count = 0;
+    int frame_capacity = 16;
+    infix_frame* frames = (infix_frame*)malloc(sizeof(infix_frame) * frame_capacity);
+    frames[frame_count].node = node;
+    frames[frame_count++].stage = 0;
+
+    while (frame_count > 0)
     {
-        token current_token = node->token;
-        bool function = is_function(current_token);
+        infix_frame* frame = &frames[frame_count - 1];
+        token current_token = frame->node->token;
+        tree_node* child = NULL;
 
-        // Set the prefix string if it is a function.
-        char* prefix_string = (char*)malloc(sizeof(char) * 6);
-        prefix_string[0] = '\0';
-        if (function)
+        char middle_string[64];
+        const char* text;
+        if (frame->stage == 0)
         {
-            switch (current_token.type)
-            {
-                case squareroot: strcpy(prefix_string, "sqrt("); break;
-                case log_10: strcpy(prefix_string, "log("); break;
-                case log_e: strcpy(prefix_string, "ln("); break;
-                case sine: strcpy(prefix_string, "sin("); break;
-                case cosine: strcpy(prefix_string, "cos("); break;
-                case tangent: strcpy(prefix_string, "tan("); break;
-                default: break;
-            }
+            text = infix_prefix(current_token);
+            child = frame->node->left_child; // traverse the left subtree.
         }
-        else if (is_operator(current_token) && is_binary(current_token))
+        else if (frame->stage == 1)
         {
-            strcpy(prefix_string, "("); // don't put a left parenthesis around the unary negation.
+            infix_middle(current_token, middle_string); // visit the root node.
+            text = middle_string;
+            child = frame->node->right_child; // traverse the right subtree.
         }
-
-        // traverse the left subtree.
-        char* left_string = infix(node->left_child);
-
-        // visit the root node.
-        char* middle_string = (char*)malloc(sizeof(char) * 64);
-        middle_string[0] = '\0';
-        if (function == false)
+        else
         {
-            switch (current_token.type)
-            {
-                case addition: strcpy(middle_string, " + "); break;
-                case subtraction: strcpy(middle_string, " - "); break;
-                case multiplication: strcpy(middle_string, " * "); break;
-                case division: strcpy(middle_string, " / "); break;
-                case negation: strcpy(middle_string, "-"); break;
-                case power: strcpy(middle_string, ")^("); break;
-                case variable: middle_string[0] = current_token.symbol; middle_string[1] = '\0'; break;
-                case constant: sprintf(middle_string, "%g", current_token.value); break;
-                default: break;
-            }
+            text = infix_suffix(current_token);
+            --frame_count;
         }
+        ++frame->stage;
 
-        // traverse the right subtree.
-        char* right_string = infix(node->right_child);
-
-        // set the suffix string if it is a function.
-        char* suffix_string = malloc(sizeof(char) * 2);
-        suffix_string[0] = '\0';
-        if (function)
+        int text_length = strlen(text);
+        if (length + text_length + 1 > capacity)
         {
-            strcpy(suffix_string, ")");
+            while (length + text_length + 1 > capacity) { capacity *= 2; }
+            expression_string = (char*)realloc(expression_string, sizeof(char) * capacity);
         }
-        else if (is_operator(current_token) && is_binary(current_token))
+        memcpy(expression_string + length, text, text_length);
+        length += text_length;
+
+        if (child != NULL)
         {
-            strcpy(suffix_string, ")"); // don't put a right parenthesis around the unary negation.
+            if (frame_count == frame_capacity)
+            {
+                frame_capacity *= 2;
+                frames = (infix_frame*)realloc(frames, sizeof(infix_frame) * frame_capacity);
+            }
+            frames[frame_count].node = child;
+            frames[frame_count++].stage = 0;
         }
-
-        // allocate a string, which is set to contain the concatenation of the five strings.
-        char* expression_string = concat(prefix_string, left_string, middle_string, right_string, suffix_string);
-
-        // free the memory for these five strings.
-        free(prefix_string);
-        free(left_string);
-        free(middle_string);
-        free(right_string);
-        free(suffix_string);
-
-        return expression_string;
     }
 
-    return NULL; // expression tree is null.
+    expression_string[length] = '\0'; // null terminator.
+    free(frames);
+    return expression_string;
 }
 
 #endif //COURSEWORK_INFIX_WRITER_H
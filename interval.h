@@ -0,0 +1,383 @@
+#ifndef COURSEWORK_INTERVAL_H
+#define COURSEWORK_INTERVAL_H
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <math.h>
+
+#include "program.h"
+
+// a closed range of real numbers, an empty interval has nan bounds.
+typedef struct interval
+{
+    double lower;
+    double upper;
+} interval;
+
+// create an interval from its bounds.
+interval interval_create(double lower, double upper)
+{
+    interval result;
+    result.lower = lower;
+    result.upper = upper;
+    return result;
+}
+
+// the interval containing every real number.
+interval interval_entire()
+{
+    return interval_create(-INFINITY, INFINITY);
+}
+
+// the interval containing no numbers, e.g. the square root of a negative interval.
+interval interval_empty()
+{
+    return interval_create(NAN, NAN);
+}
+
+bool interval_is_empty(interval a)
+{
+    return isnan(a.lower) || isnan(a.upper);
+}
+
+bool interval_contains(interval a, double value)
+{
+    return interval_is_empty(a) == false && a.lower <= value && value <= a.upper;
+}
+
+// widens the interval outwards by a number of units in the last place on each side.
+// a rounded result is within half an ulp, and libm functions are within a few ulps, so this keeps the bounds correct.
+interval interval_widen(interval a, int ulps)
+{
+    if (isnan(a.lower) || isnan(a.upper))
+    {
+        return interval_entire(); // an operation on a non-empty interval gave nan, e.g. infinity minus infinity.
+    }
+
+    for (int i = 0; i < ulps; ++i)
+    {
+        a.lower = nextafter(a.lower, -INFINITY);
+        a.upper = nextafter(a.upper, INFINITY);
+    }
+
+    return a;
+}
+
+// the smallest interval containing four values, used for products and quotients of the bounds.
+interval interval_hull4(double a, double b, double c, double d)
+{
+    if (isnan(a) || isnan(b) || isnan(c) || isnan(d))
+    {
+        return interval_entire(); // e.g. zero times infinity, which can be any value in the limit.
+    }
+
+    return interval_create(fmin(fmin(a, b), fmin(c, d)), fmax(fmax(a, b), fmax(c, d)));
+}
+
+interval interval_add(interval a, interval b)
+{
+    return interval_widen(interval_create(a.lower + b.lower, a.upper + b.upper), 1);
+}
+
+interval interval_subtract(interval a, interval b)
+{
+    return interval_widen(interval_create(a.lower - b.upper, a.upper - b.lower), 1);
+}
+
+interval interval_multiply(interval a, interval b)
+{
+    return interval_widen(interval_hull4(a.lower * b.lower, a.lower * b.upper, a.upper * b.lower, a.upper * b.upper), 1);
+}
+
+interval interval_divide(interval a, interval b)
+{
+    if (b.lower == 0 && b.upper == 0)
+    {
+        return interval_empty(); // division by exactly zero.
+    }
+    else if (b.lower <= 0 && b.upper >= 0)
+    {
+        return interval_entire(); // the divisor may be arbitrarily close to zero.
+    }
+
+    return interval_widen(interval_hull4(a.lower / b.lower, a.lower / b.upper, a.upper / b.lower, a.upper / b.upper), 1);
+}
+
+interval interval_negate(interval a)
+{
+    return interval_create(-a.upper, -a.lower);
+}
+
+interval interval_sqrt(interval a)
+{
+    if (a.upper < 0)
+    {
+        return interval_empty();
+    }
+
+    return interval_widen(interval_create(sqrt(fmax(a.lower, 0)), sqrt(a.upper)), 1);
+}
+
+// logarithms are increasing, so the bounds are the logarithms of the bounds.
+interval interval_log(interval a, double (*function)(double))
+{
+    if (a.upper < 0)
+    {
+        return interval_empty();
+    }
+
+    return interval_widen(interval_create(function(fmax(a.lower, 0)), function(a.upper)), 2);
+}
+
+// does the interval contain offset + k * period for some integer k?
+bool interval_contains_periodic(interval a, double offset, double period)
+{
+    // widen the test slightly so rounding in the division never misses a point, including an extra point is still correct.
+    double slack = 1e-12 * fmax(1, fmax(fabs(a.lower), fabs(a.upper)));
+    double k = ceil((a.lower - slack - offset) / period);
+    return offset + k * period <= a.upper + slack;
+}
+
+// sine and cosine are bounded by their values at the ends and at any maximum or minimum inside the interval.
+// phase is where the function has a maximum, that is pi / 2 for sine and 0 for cosine.
+interval interval_sinusoid(interval a, double (*function)(double), double phase)
+{
+    if (a.upper - a.lower >= 2 * M_PI || fabs(a.lower) > 1e15 || fabs(a.upper) > 1e15)
+    {
+        return interval_create(-1, 1); // a whole period, or so large that the argument has lost its precision.
+    }
+
+    double at_lower = function(a.lower);
+    double at_upper = function(a.upper);
+    interval result = interval_widen(interval_create(fmin(at_lower, at_upper), fmax(at_lower, at_upper)), 2);
+    if (interval_contains_periodic(a, phase, 2 * M_PI))
+    {
+        result.upper = 1;
+    }
+    if (interval_contains_periodic(a, phase + M_PI, 2 * M_PI))
+    {
+        result.lower = -1;
+    }
+
+    return interval_create(fmax(result.lower, -1), fmin(result.upper, 1));
+}
+
+interval interval_tan(interval a)
+{
+    if (a.upper - a.lower >= M_PI || fabs(a.lower) > 1e15 || fabs(a.upper) > 1e15 || interval_contains_periodic(a, M_PI / 2, M_PI))
+    {
+        return interval_entire(); // the interval contains a pole.
+    }
+
+    return interval_widen(interval_create(tan(a.lower), tan(a.upper)), 2); // tan is increasing between poles.
+}
+
+// raises an interval to a whole number power.
+interval interval_integer_power(interval a, double exponent)
+{
+    if (exponent == 0)
+    {
+        return interval_create(1, 1);
+    }
+    else if (exponent < 0)
+    {
+        return interval_divide(interval_create(1, 1), interval_integer_power(a, -exponent));
+    }
+
+    interval result;
+    if (fmod(exponent, 2) != 0 || a.lower >= 0)
+    {
+        result = interval_create(pow(a.lower, exponent), pow(a.upper, exponent)); // increasing for odd powers and positive bases.
+    }
+    else if (a.upper <= 0)
+    {
+        result = interval_create(pow(a.upper, exponent), pow(a.lower, exponent)); // decreasing for even powers of negative bases.
+    }
+    else
+    {
+        result = interval_create(0, pow(fmax(-a.lower, a.upper), exponent)); // even power of an interval containing zero.
+    }
+
+    return interval_widen(result, 2);
+}
+
+interval interval_power(interval a, interval b)
+{
+    if (b.lower == b.upper && b.lower == floor(b.lower))
+    {
+        return interval_integer_power(a, b.lower);
+    }
+    else if (b.lower == b.upper || a.lower >= 0)
+    {
+        // a fractional power is only real for a base that isn't negative.
+        if (a.upper < 0)
+        {
+            return interval_empty();
+        }
+
+        // for a positive base pow is monotonic in each argument, so the bounds are at the corners.
+        double lower = fmax(a.lower, 0);
+        return interval_widen(interval_hull4(pow(lower, b.lower), pow(lower, b.upper), pow(a.upper, b.lower), pow(a.upper, b.upper)), 2);
+    }
+
+    return interval_entire(); // a negative base with a range of exponents, which includes both integers and fractions.
+}
+
+// computes a single instruction over intervals from the registers of its operands.
+interval interval_compute(const instruction* instruction, const interval* registers, const interval* slots)
+{
+    interval left = (instruction->left >= 0) ? registers[instruction->left] : interval_empty();
+    interval right = (instruction->right >= 0) ? registers[instruction->right] : interval_empty();
+
+    if (instruction->type != constant && instruction->type != variable &&
+        (interval_is_empty(left) || (instruction->right >= 0 && interval_is_empty(right))))
+    {
+        return interval_empty(); // the operand is undefined everywhere, so this instruction is too.
+    }
+
+    switch (instruction->type)
+    {
+        case addition: return interval_add(left, right);
+        case subtraction: return interval_subtract(left, right);
+        case multiplication: return interval_multiply(left, right);
+        case division: return interval_divide(left, right);
+        case power: return interval_power(left, right);
+        case negation: return interval_negate(left);
+        case squareroot: return interval_sqrt(left);
+        case log_10: return interval_log(left, log10);
+        case log_e: return interval_log(left, log);
+        case sine: return interval_sinusoid(left, sin, M_PI / 2);
+        case cosine: return interval_sinusoid(left, cos, 0);
+        case tangent: return interval_tan(left);
+        case constant: return interval_create(instruction->value, instruction->value);
+        case variable: return slots[instruction->slot];
+        default: return interval_create(0, 0); // not a valid token type.
+    }
+}
+
+// runs the program over a box of slot intervals, and writes bounds for the result of each compiled tree to results.
+// the bounds contain every value the program gives for slot values inside the box.
+void interval_run(const program* program, const interval* slots, interval* registers, interval* results)
+{
+    for (int i = 0; i < program->length; ++i)
+    {
+        registers[i] = interval_compute(&program->code[i], registers, slots);
+    }
+
+    for (int i = 0; i < program->output_count; ++i)
+    {
+        results[i] = registers[program->outputs[i]];
+    }
+}
+
+// the boxes found by a subdivision, together with counters comparing it with sampling every point.
+typedef struct subdivision
+{
+    interval* boxes; // slot_count intervals per box where the output may be zero.
+    int box_count;
+    int capacity;
+    long long evaluations; // number of interval evaluations of the program.
+    double sampled_points; // number of points sampling the whole domain at the finest resolution would evaluate.
+} subdivision;
+
+// free memory for the boxes of a subdivision.
+void subdivision_free(subdivision* subdivision)
+{
+    free(subdivision->boxes);
+    subdivision->boxes = NULL;
+    subdivision->box_count = 0;
+    subdivision->capacity = 0;
+}
+
+// subdivides the domain into boxes no wider than min_width, discarding every box where the output can't be zero.
+// the output is the index of the compiled tree to find zeros of.
+subdivision interval_find_zeros(const program* program, int output, const interval* domain, double min_width)
+{
+    int slot_count = program->slot_count;
+    subdivision result;
+    result.boxes = NULL;
+    result.box_count = 0;
+    result.capacity = 0;
+    result.evaluations = 0;
+    result.sampled_points = 1;
+    for (int slot = 0; slot < slot_count; ++slot)
+    {
+        result.sampled_points *= fmax(1, ceil((domain[slot].upper - domain[slot].lower) / min_width));
+    }
+
+    interval* registers = (interval*)malloc(sizeof(interval) * (program->length + 1));
+    interval* outputs = (interval*)malloc(sizeof(interval) * (program->output_count + 1));
+
+    // depth-first search with an explicit stack of boxes.
+    int stack_capacity = 64;
+    int stack_count = 1;
+    interval* stack = (interval*)malloc(sizeof(interval) * stack_capacity * (slot_count + 1));
+    for (int slot = 0; slot < slot_count; ++slot)
+    {
+        stack[slot] = domain[slot];
+    }
+
+    while (stack_count > 0)
+    {
+        interval* box = &stack[--stack_count * slot_count];
+        interval_run(program, box, registers, outputs);
+        ++result.evaluations;
+
+        if (interval_contains(outputs[output], 0) == false)
+        {
+            continue; // the output can't be zero anywhere in this box.
+        }
+
+        // find the widest side of the box.
+        int widest = -1;
+        for (int slot = 0; slot < slot_count; ++slot)
+        {
+            double width = box[slot].upper - box[slot].lower;
+            if (width > min_width && (widest < 0 || width > box[widest].upper - box[widest].lower))
+            {
+                widest = slot;
+            }
+        }
+
+        if (widest < 0)
+        {
+            // the box is small enough, so keep it.
+            if (result.box_count == result.capacity)
+            {
+                result.capacity = (result.capacity == 0) ? 64 : result.capacity * 2;
+                result.boxes = (interval*)realloc(result.boxes, sizeof(interval) * result.capacity * (slot_count + 1));
+            }
+            for (int slot = 0; slot < slot_count; ++slot)
+            {
+                result.boxes[result.box_count * slot_count + slot] = box[slot];
+            }
+            ++result.box_count;
+            continue;
+        }
+
+        // split the box in half along its widest side and push both halves.
+        if (stack_count + 2 > stack_capacity)
+        {
+            stack_capacity *= 2;
+            stack = (interval*)realloc(stack, sizeof(interval) * stack_capacity * (slot_count + 1));
+            box = &stack[stack_count * slot_count];
+        }
+
+        double middle = box[widest].lower + (box[widest].upper - box[widest].lower) / 2;
+        interval* upper_half = &stack[(stack_count + 1) * slot_count];
+        for (int slot = 0; slot < slot_count; ++slot)
+        {
+            upper_half[slot] = box[slot];
+        }
+        box[widest].upper = middle; // the lower half stays where the box was.
+        upper_half[widest].lower = middle;
+        stack_count += 2;
+    }
+
+    free(stack);
+    free(outputs);
+    free(registers);
+    return result;
+}
+
+#endif //COURSEWORK_INTERVAL_H
@@ -0,0 +1,259 @@
+#ifndef COURSEWORK_JIT_H
+#define COURSEWORK_JIT_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "program.h"
+
+#if defined(__x86_64__) && defined(__unix__)
+#define JIT_AVAILABLE 1
+#include <sys/mman.h>
+#else
+#define JIT_AVAILABLE 0
+#endif
+
+// native code for a program, takes the slot values and the register file and writes the result of each compiled tree.
+typedef void (*jit_function)(const double* slots, double* registers, double* results);
+
+// a program together with the machine code generated for it.
+typedef struct jit_code
+{
+    const program* program; // the program is interpreted when no machine code could be generated.
+    jit_function function; // the generated machine code, or NULL.
+    void* memory; // executable memory holding the machine code.
+    size_t size; // size of the executable memory in bytes.
+} jit_code;
+
+// growable buffer of machine code bytes.
+typedef struct code_buffer
+{
+    unsigned char* bytes;
+    size_t length;
+    size_t capacity;
+} code_buffer;
+
+// append bytes to the code buffer.
+void code_buffer_write(code_buffer* buffer, const void* bytes, size_t length)
+{
+    if (buffer->length + length > buffer->capacity)
+    {
+        while (buffer->length + length > buffer->capacity)
+        {
+            buffer->capacity = (buffer->capacity == 0) ? 256 : buffer->capacity * 2;
+        }
+        buffer->bytes = (unsigned char*)realloc(buffer->bytes, buffer->capacity);
+    }
+
+    memcpy(buffer->bytes + buffer->length, bytes, length);
+    buffer->length += length;
+}
+
+// append an opcode followed by a 32-bit little-endian displacement or immediate.
+void code_buffer_write_op32(code_buffer* buffer, const unsigned char* opcode, size_t length, int32_t value)
+{
+    code_buffer_write(buffer, opcode, length);
+    code_buffer_write(buffer, &value, sizeof(value));
+}
+
+// append an opcode followed by a 64-bit little-endian immediate.
+void code_buffer_write_op64(code_buffer* buffer, const unsigned char* opcode, size_t length, uint64_t value)
+{
+    code_buffer_write(buffer, opcode, length);
+    code_buffer_write(buffer, &value, sizeof(value));
+}
+
+// returns the libm function called for a token, or NULL if the token doesn't need a call.
+void* jit_math_function(token_type type)
+{
+    switch (type)
+    {
+        case power: return (void*)&pow;
+        case log_10: return (void*)&log10;
+        case log_e: return (void*)&log;
+        case sine: return (void*)&sin;
+        case cosine: return (void*)&cos;
+        case tangent: return (void*)&tan;
+        default: return NULL;
+    }
+}
+
+// lowers the program to scalar sse2 machine code.
+// rbx holds the slots pointer, r12 holds the results pointer and r13 holds the registers pointer, so register i lives
+// at [r13 + 8 * i]. the registers are the caller's array rather than a stack frame, so a program of any length runs
+// within the stack of the calling thread.
+void jit_emit_program(code_buffer* buffer, const program* program)
+{
+    // the three pushes leave the stack 16-byte aligned for the calls to libm.
+    static const unsigned char push_rbx_r12_r13[] = { 0x53, 0x41, 0x54, 0x41, 0x55 };
+    static const unsigned char mov_rbx_rdi_r13_rsi_r12_rdx[] = { 0x48, 0x89, 0xFB, 0x49, 0x89, 0xF5, 0x49, 0x89, 0xD4 };
+    static const unsigned char pop_r13_r12_rbx_ret[] = { 0x41, 0x5D, 0x41, 0x5C, 0x5B, 0xC3 };
+    static const unsigned char mov_rax_imm[] = { 0x48, 0xB8 };
+    static const unsigned char mov_rax_rbx[] = { 0x48, 0x8B, 0x83 }; // mov rax, [rbx + disp32]
+    static const unsigned char mov_rax_r13[] = { 0x49, 0x8B, 0x85 }; // mov rax, [r13 + disp32]
+    static const unsigned char mov_r13_rax[] = { 0x49, 0x89, 0x85 }; // mov [r13 + disp32], rax
+    static const unsigned char mov_r12_rax[] = { 0x49, 0x89, 0x84, 0x24 }; // mov [r12 + disp32], rax
+    static const unsigned char movsd_xmm0_r13[] = { 0xF2, 0x41, 0x0F, 0x10, 0x85 }; // movsd xmm0, [r13 + disp32]
+    static const unsigned char movsd_xmm1_r13[] = { 0xF2, 0x41, 0x0F, 0x10, 0x8D }; // movsd xmm1, [r13 + disp32]
+    static const unsigned char movsd_r13_xmm0[] = { 0xF2, 0x41, 0x0F, 0x11, 0x85 }; // movsd [r13 + disp32], xmm0
+    static const unsigned char addsd_xmm0_r13[] = { 0xF2, 0x41, 0x0F, 0x58, 0x85 }; // addsd xmm0, [r13 + disp32]
+    static const unsigned char subsd_xmm0_r13[] = { 0xF2, 0x41, 0x0F, 0x5C, 0x85 }; // subsd xmm0, [r13 + disp32]
+    static const unsigned char mulsd_xmm0_r13[] = { 0xF2, 0x41, 0x0F, 0x59, 0x85 }; // mulsd xmm0, [r13 + disp32]
+    static const unsigned char divsd_xmm0_r13[] = { 0xF2, 0x41, 0x0F, 0x5E, 0x85 }; // divsd xmm0, [r13 + disp32]
+    static const unsigned char sqrtsd_xmm0_r13[] = { 0xF2, 0x41, 0x0F, 0x51, 0x85 }; // sqrtsd xmm0, [r13 + disp32]
+    static const unsigned char btc_rax_63[] = { 0x48, 0x0F, 0xBA, 0xF8, 0x3F }; // flip the sign bit of rax.
+    static const unsigned char call_rax[] = { 0xFF, 0xD0 };
+
+    code_buffer_write(buffer, push_rbx_r12_r13, sizeof(push_rbx_r12_r13));
+    code_buffer_write(buffer, mov_rbx_rdi_r13_rsi_r12_rdx, sizeof(mov_rbx_rdi_r13_rsi_r12_rdx));
+
+    for (int i = 0; i < program->length; ++i)
+    {
+        const instruction* instruction = &program->code[i];
+        int32_t target = 8 * i;
+        int32_t left = 8 * instruction->left;
+        int32_t right = 8 * instruction->right;
+        uint64_t bits;
+
+        switch (instruction->type)
+        {
+            case addition:
+                code_buffer_write_op32(buffer, movsd_xmm0_r13, sizeof(movsd_xmm0_r13), left);
+                code_buffer_write_op32(buffer, addsd_xmm0_r13, sizeof(addsd_xmm0_r13), right);
+                code_buffer_write_op32(buffer, movsd_r13_xmm0, sizeof(movsd_r13_xmm0), target);
+                break;
+            case subtraction:
+                code_buffer_write_op32(buffer, movsd_xmm0_r13, sizeof(movsd_xmm0_r13), left);
+                code_buffer_write_op32(buffer, subsd_xmm0_r13, sizeof(subsd_xmm0_r13), right);
+                code_buffer_write_op32(buffer, movsd_r13_xmm0, sizeof(movsd_r13_xmm0), target);
+                break;
+            case multiplication:
+                code_buffer_write_op32(buffer, movsd_xmm0_r13, sizeof(movsd_xmm0_r13), left);
+                code_buffer_write_op32(buffer, mulsd_xmm0_r13, sizeof(mulsd_xmm0_r13), right);
+                code_buffer_write_op32(buffer, movsd_r13_xmm0, sizeof(movsd_r13_xmm0), target);
+                break;
+            case division:
+                code_buffer_write_op32(buffer, movsd_xmm0_r13, sizeof(movsd_xmm0_r13), left);
+                code_buffer_write_op32(buffer, divsd_xmm0_r13, sizeof(divsd_xmm0_r13), right);
+                code_buffer_write_op32(buffer, movsd_r13_xmm0, sizeof(movsd_r13_xmm0), target);
+                break;
+            case squareroot:
+                code_buffer_write_op32(buffer, sqrtsd_xmm0_r13, sizeof(sqrtsd_xmm0_r13), left);
+                code_buffer_write_op32(buffer, movsd_r13_xmm0, sizeof(movsd_r13_xmm0), target);
+                break;
+            case negation:
+                code_buffer_write_op32(buffer, mov_rax_r13, sizeof(mov_rax_r13), left);
+                code_buffer_write(buffer, btc_rax_63, sizeof(btc_rax_63));
+                code_buffer_write_op32(buffer, mov_r13_rax, sizeof(mov_r13_rax), target);
+                break;
+            case power:
+            case log_10:
+            case log_e:
+            case sine:
+            case cosine:
+            case tangent:
+                // call the libm function with its arguments in xmm0 and xmm1.
+                code_buffer_write_op32(buffer, movsd_xmm0_r13, sizeof(movsd_xmm0_r13), left);
+                if (instruction->type == power)
+                {
+                    code_buffer_write_op32(buffer, movsd_xmm1_r13, sizeof(movsd_xmm1_r13), right);
+                }
+                code_buffer_write_op64(buffer, mov_rax_imm, sizeof(mov_rax_imm), (uint64_t)(uintptr_t)jit_math_function(instruction->type));
+                code_buffer_write(buffer, call_rax, sizeof(call_rax));
+                code_buffer_write_op32(buffer, movsd_r13_xmm0, sizeof(movsd_r13_xmm0), target);
+                break;
+            case variable:
+                code_buffer_write_op32(buffer, mov_rax_rbx, sizeof(mov_rax_rbx), 8 * instruction->slot);
+                code_buffer_write_op32(buffer, mov_r13_rax, sizeof(mov_r13_rax), target);
+                break;
+            case constant:
+            default:
+                bits = 0; // not a valid token type evaluates to zero, just like program_run.
+                if (instruction->type == constant)
+                {
+                    memcpy(&bits, &instruction->value, sizeof(bits));
+                }
+                code_buffer_write_op64(buffer, mov_rax_imm, sizeof(mov_rax_imm), bits);
+                code_buffer_write_op32(buffer, mov_r13_rax, sizeof(mov_r13_rax), target);
+                break;
+        }
+    }
+
+    // copy each output register to the results array.
+    for (int i = 0; i < program->output_count; ++i)
+    {
+        code_buffer_write_op32(buffer, mov_rax_r13, sizeof(mov_rax_r13), 8 * program->outputs[i]);
+        code_buffer_write_op32(buffer, mov_r12_rax, sizeof(mov_r12_rax), 8 * i);
+    }
+
+    code_buffer_write(buffer, pop_r13_r12_rbx_ret, sizeof(pop_r13_r12_rbx_ret));
+}
+
+// compiles the program to machine code, or keeps the interpreter if this architecture isn't supported.
+// the program must outlive the jit code.
+jit_code* jit_compile(const program* program)
+{
+    jit_code* code = (jit_code*)malloc(sizeof(jit_code));
+    code->program = program;
+    code->function = NULL;
+    code->memory = NULL;
+    code->size = 0;
+
+#if JIT_AVAILABLE
+    code_buffer buffer = { NULL, 0, 0 };
+    jit_emit_program(&buffer, program);
+
+    // write the code into fresh pages, then make them executable but no longer writable.
+    void* memory = mmap(NULL, buffer.length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory != MAP_FAILED)
+    {
+        memcpy(memory, buffer.bytes, buffer.length);
+        if (mprotect(memory, buffer.length, PROT_READ | PROT_EXEC) == 0)
+        {
+            code->function = (jit_function)memory;
+            code->memory = memory;
+            code->size = buffer.length;
+        }
+        else
+        {
+            munmap(memory, buffer.length);
+        }
+    }
+    free(buffer.bytes);
+#endif
+
+    return code;
+}
+
+// free memory for the jit code, but not its program.
+void jit_free(jit_code* code)
+{
+    if (code != NULL)
+    {
+#if JIT_AVAILABLE
+        if (code->memory != NULL)
+        {
+            munmap(code->memory, code->size);
+        }
+#endif
+        free(code);
+    }
+}
+
+// runs the machine code, or interprets the program when there is no machine code.
+// registers must have room for program->length values.
+void jit_run(const jit_code* code, const double* slots, double* registers, double* results)
+{
+    if (code->function != NULL)
+    {
+        code->function(slots, registers, results);
+    }
+    else
+    {
+        program_run(code->program, slots, registers, results);
+    }
+}
+
+#endif //COURSEWORK_JIT_H
@@ -0,0 +1,135 @@
+#ifndef COURSEWORK_JIT_SELF_TEST_H
+#define COURSEWORK_JIT_SELF_TEST_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "parser.h"
+#include "evaluator.h"
+#include "variables.h"
+#include "program.h"
+#include "jit.h"
+
+// are two results identical bit-for-bit? any two nans are treated as identical.
+bool jit_same_result(double a, double b)
+{
+    if (isnan(a) && isnan(b))
+    {
+        return true;
+    }
+
+    uint64_t a_bits, b_bits;
+    memcpy(&a_bits, &a, sizeof(a_bits));
+    memcpy(&b_bits, &b, sizeof(b_bits));
+    return a_bits == b_bits;
+}
+
+#define JIT_SELF_TEST_LONG_TERMS 400000 // terms of the long sum, whose program has more registers than the stack holds.
+
+// compiles a long sum with the jit and checks it agrees bit-for-bit with program_run, since its registers would
+// overflow the stack if they were kept there. returns 1 if they disagree.
+int jit_self_test_long()
+{
+    char* text = (char*)malloc((size_t)JIT_SELF_TEST_LONG_TERMS * 24);
+    int length = 0;
+    for (int k = 1; k <= JIT_SELF_TEST_LONG_TERMS; ++k)
+    {
+        length += sprintf(text + length, (k > 1) ? " + x * %d" : "x * %d", k);
+    }
+    tree_node* root = parse_expression(text);
+    free(text);
+
+    list variables;
+    list_init(&variables);
+    find_variables(root, &variables);
+    program* program = program_compile(root, &variables);
+    jit_code* code = jit_compile(program);
+    double* registers = (double*)malloc(sizeof(double) * (program->length + 1));
+    double slots[1] = { 0.75 };
+
+    double expected;
+    double actual;
+    program_run(program, slots, registers, &expected);
+    jit_run(code, slots, registers, &actual);
+    int failures = jit_same_result(expected, actual) ? 0 : 1;
+    if (failures > 0)
+    {
+        printf("jit mismatch: sum of %d terms: program_run = %.17g, jit = %.17g\n", JIT_SELF_TEST_LONG_TERMS, expected, actual);
+    }
+
+    free(registers);
+    jit_free(code);
+    program_free(program);
+    free_variables(&variables);
+    tree_free(root);
+    return failures;
+}
+
+// compiles each simple operation with the jit and checks it agrees bit-for-bit with evaluate over a range of values,
+// then checks a long sum. prints each disagreement and returns the number of disagreements.
+int jit_self_test()
+{
+    static const char* expressions[] =
+    {
+        "x + y", "x - y", "x * y", "x / y", "x ^ y", "-x", "sqrt(x)", "log(x)", "ln(x)", "sin(x)", "cos(x)", "tan(x)",
+        "2.5", "pi * x", "e ^ -y", "x * (y - 3) / (x + 1)", "sin(2 * x) ^ 2 + cos(y) * tan(x - y)", "-(x + -y)"
+    };
+    static const double values[] = { 0.0, -0.0, 1.0, -1.0, 0.5, -2.75, 3.0, 1e-300, 1e300, 123.456, INFINITY, -INFINITY, NAN };
+
+    int expression_count = sizeof(expressions) / sizeof(expressions[0]);
+    int value_count = sizeof(values) / sizeof(values[0]);
+    int failures = 0;
+
+    for (int i = 0; i < expression_count; ++i)
+    {
+        tree_node* root = parse_expression(expressions[i]);
+
+        list variables;
+        list_init(&variables);
+        find_variables(root, &variables);
+
+        program* program = program_compile(root, &variables);
+        jit_code* code = jit_compile(program);
+        double* registers = (double*)malloc(sizeof(double) * (program->length + 1));
+        double slots[2];
+
+        for (int x = 0; x < value_count; ++x)
+        {
+            for (int y = 0; y < value_count; ++y)
+            {
+                // bind the same values to the tree and to the slots.
+                int slot = 0;
+                for (list_node* item = variables.first; item != NULL; item = item->next)
+                {
+                    variable_value* pair = item->payload;
+                    pair->value = (pair->symbol == 'x') ? values[x] : values[y];
+                    slots[slot++] = pair->value;
+                }
+                set_variables(root, &variables);
+
+                double expected = evaluate(root);
+                double actual;
+                jit_run(code, slots, registers, &actual);
+
+                if (jit_same_result(expected, actual) == false)
+                {
+                    printf("jit mismatch: %s at x = %g, y = %g: evaluate = %.17g, jit = %.17g\n",
+                           expressions[i], values[x], values[y], expected, actual);
+                    ++failures;
+                }
+            }
+        }
+
+        free(registers);
+        jit_free(code);
+        program_free(program);
+        free_variables(&variables);
+        tree_free(root);
+    }
+
+    return failures + jit_self_test_long();
+}
+
+#endif //COURSEWORK_JIT_SELF_TEST_H
@@ -1,4 +1,6 @@
 #include <stdio.h>
+#include <string.h>
+#include <signal.h>
 
 #include "parser.h"
 #include "evaluator.h"
@@ -6,42 +8,475 @@
 #include "differentiator.h"
 #include "simplifier.h"
 #include "infix_writer.h"
+#include "program.h"
+#include "jit_self_test.h"
+#include "math_report.h"
+#include "batch_stream.h"
+#include "parse_benchmark.h"
+#include "column_evaluator.h"
+#include "image_benchmark.h"
+#include "expression_server.h"
+#include "result_benchmark.h"
+#include "cache_benchmark.h"
+#include "evaluate_benchmark.h"
+#include "program_benchmark.h"
+#include "execution_manager.h"
 
-int main()
+int main(int argc, char* argv[])
 {
-    // get the user input.
-    char input[256];
+    if (argc > 1 && strcmp(argv[1], "--jit-self-test") == 0)
+    {
+        // check the jit agrees with the interpreter, or that we fall back to the interpreter on this architecture.
+        int failures = jit_self_test();
+        printf("jit %s: %d mismatches\n", JIT_AVAILABLE ? "enabled" : "unavailable", failures);
+        return failures == 0 ? 0 : 1;
+    }
+    else if (argc > 1 && strcmp(argv[1], "--math-report") == 0)
+    {
+        // measure each accuracy of the transcendental functions against libm.
+        int failures = math_report();
+        printf("%d functions outside their documented bounds\n", failures);
+        return failures == 0 ? 0 : 1;
+    }
+    else if (argc > 1 && strcmp(argv[1], "--batch") == 0)
+    {
+        // evaluate expressions and rows of bindings from a file or stdin, without prompting.
+        FILE* in = (argc > 2) ? fopen(argv[2], "r") : stdin;
+        if (in == NULL)
+        {
+            fprintf(stderr, "can't open %s\n", argv[2]);
+            return 1;
+        }
+        thread_pool* pool = thread_pool_create(batch_format_threads());
+        batch_stream_stats stats = batch_stream_run(pool, in, stdout);
+        thread_pool_free(pool);
+        if (in != stdin)
+        {
+            fclose(in);
+        }
+        return stats.errors == 0 ? 0 : 1;
+    }
+    else if (argc > 3 && strcmp(argv[1], "--import-csv") == 0)
+    {
+        // convert a csv file of variable values into a column file.
+        char error[COLUMN_ERROR_SIZE];
+        thread_pool* pool = thread_pool_create(0);
+        bool imported = csv_import_file(pool, argv[2], argv[3], error);
+        thread_pool_free(pool);
+        if (imported == false)
+        {
+            fprintf(stderr, "%s\n", error);
+        }
+        return imported ? 0 : 1;
+    }
+    else if (argc > 2 && strcmp(argv[1], "--export-csv") == 0)
+    {
+        // write a column file as csv.
+        char error[COLUMN_ERROR_SIZE];
+        column_file file;
+        if (column_file_open(&file, argv[2], error) == false)
+        {
+            fprintf(stderr, "%s\n", error);
+            return 1;
+        }
+        csv_export_file(&file, stdout);
+        column_file_close(&file);
+        return 0;
+    }
+    else if (argc > 4 && strcmp(argv[1], "--evaluate-columns") == 0)
+    {
+        // evaluate an expression and its partial derivatives for each row of a column file, in double precision
+        // unless float or mixed precision is asked for.
+        column_precision precision = column_double;
+        if (argc > 5)
+        {
+            if (strcmp(argv[5], "float") == 0)
+            {
+                precision = column_float;
+            }
+            else if (strcmp(argv[5], "mixed") == 0)
+            {
+                precision = column_mixed;
+            }
+            else if (strcmp(argv[5], "double") != 0)
+            {
+                fprintf(stderr, "Unknown precision %s, expected double, float or mixed\n", argv[5]);
+                return 1;
+            }
+        }
+
+        compiled_expression* expression = compiled_expression_create(argv[2]);
+        if (expression == NULL)
+        {
+            fprintf(stderr, "Invalid expression\n");
+            return 1;
+        }
+
+        char error[COLUMN_ERROR_SIZE];
+        thread_pool* pool = thread_pool_create(0);
+        bool evaluated = column_evaluate(pool, expression, argv[3], argv[4], precision, error);
+        thread_pool_free(pool);
+        compiled_expression_free(expression);
+        if (evaluated == false)
+        {
+            fprintf(stderr, "%s\n", error);
+        }
+        return evaluated ? 0 : 1;
+    }
+    else if (argc > 3 && strcmp(argv[1], "--compile-image") == 0)
+    {
+        // compile each line of a text file and save the expressions to an image that loads without compiling.
+        char error[EXPRESSION_IMAGE_ERROR_SIZE];
+        bool compiled = expression_image_compile(argv[2], argv[3], error);
+        if (compiled == false)
+        {
+            fprintf(stderr, "%s\n", error);
+        }
+        return compiled ? 0 : 1;
+    }
+    else if (argc > 2 && strcmp(argv[1], "--show-image") == 0)
+    {
+        // print each expression of an image and its partial derivatives, straight from the mapped trees.
+        char error[EXPRESSION_IMAGE_ERROR_SIZE];
+        expression_image image;
+        if (expression_image_open(&image, argv[2], error) == false)
+        {
+            fprintf(stderr, "%s\n", error);
+            return 1;
+        }
+        for (int i = 0; i < image.expression_count; ++i)
+        {
+            const compiled_expression* expression = &image.expressions[i];
+            char* expression_string = infix(expression->root);
+            printf("%s\nF() = %s\n", image.texts[i], expression_string);
+            free(expression_string);
+
+            int slot = 0;
+            for (list_node* item = expression->variables.first; item != NULL; item = item->next)
+            {
+                variable_value* pair = item->payload;
+                char* diff_expression_string = infix(expression->partials[slot++]);
+                printf("∂F/∂%c = %s\n", pair->symbol, diff_expression_string);
+                free(diff_expression_string);
+            }
+        }
+        expression_image_close(&image);
+        return 0;
+    }
+    else if (argc > 1 && strcmp(argv[1], "--image-benchmark") == 0)
+    {
+        // measure startup with generated formulas compiled from text against loading them from an image.
+        int failures = image_benchmark((argc > 2) ? atoi(argv[2]) : 5000);
+        printf("%d loaded expressions differ from the compiled ones\n", failures);
+        return failures == 0 ? 0 : 1;
+    }
+    else if (argc > 1 && strcmp(argv[1], "--image-corruption-test") == 0)
+    {
+        // open copies of an image with one byte changed, each must be rejected or be safe to use.
+        int failures = image_corruption_test((argc > 2) ? atoi(argv[2]) : 4000);
+        return failures == 0 ? 0 : 1;
+    }
+    else if (argc > 2 && strcmp(argv[1], "--serve") == 0)
+    {
+        // serve register and evaluate requests on a Unix domain socket until interrupted.
+        sigset_t signals;
+        sigemptyset(&signals);
+        sigaddset(&signals, SIGINT);
+        sigaddset(&signals, SIGTERM);
+        pthread_sigmask(SIG_BLOCK, &signals, NULL); // the workers inherit the mask, so only sigwait sees the signals.
+
+        char error[SERVER_ERROR_SIZE];
+        expression_server server;
+        if (expression_server_start(&server, argv[2], (argc > 3) ? atoi(argv[3]) : 0,
+                                    (argc > 4) ? atoi(argv[4]) : SERVER_CACHE_CAPACITY, error) == false)
+        {
+            fprintf(stderr, "%s\n", error);
+            return 1;
+        }
+        if (argc > 5 && atoi(argv[5]) > 0)
+        {
+            // remember the results of each expression for its most recent binding vectors.
+            expression_cache_memoize(&server.cache, atoi(argv[5]),
+                                     (argc > 6 && strcmp(argv[6], "clock") == 0) ? result_clock : result_lru);
+        }
+        int signal;
+        sigwait(&signals, &signal);
+        expression_server_stop(&server);
+        return 0;
+    }
+    else if (argc > 3 && strcmp(argv[1], "--query") == 0)
+    {
+        // register an expression with a server and evaluate it with the values that follow it.
+        char error[SERVER_ERROR_SIZE];
+        char symbols[257];
+        int slot_count = 0;
+        int fd = server_client_connect(argv[2]);
+        int id = (fd >= 0) ? server_client_register(fd, argv[3], symbols, &slot_count, error) : -1;
+        if (id < 0)
+        {
+            fprintf(stderr, "%s\n", (fd >= 0) ? error : "can't connect to the server");
+            return 1;
+        }
+
+        double values[256];
+        double results[257];
+        for (int slot = 0; slot < slot_count; ++slot)
+        {
+            values[slot] = (4 + slot < argc) ? atof(argv[4 + slot]) : 0;
+        }
+        server_message request;
+        server_message response;
+        server_message_init(&request);
+        server_message_init(&response);
+        int count = server_client_evaluate(fd, id, values, slot_count, results, &request, &response, error);
+        server_message_free(&request);
+        server_message_free(&response);
+        close(fd);
+        if (count < 0)
+        {
+            fprintf(stderr, "%s\n", error);
+            return 1;
+        }
+
+        printf("F() = %.17g\n", results[0]);
+        for (int slot = 0; slot < slot_count; ++slot)
+        {
+            printf("∂F/∂%c = %.17g\n", symbols[slot], results[slot + 1]);
+        }
+        return 0;
+    }
+    else if (argc > 2 && strcmp(argv[1], "--server-stats") == 0)
+    {
+        // print the hit rate and eviction counters of a server's cache.
+        char error[SERVER_ERROR_SIZE];
+        expression_cache_stats stats;
+        int fd = server_client_connect(argv[2]);
+        bool received = fd >= 0 && server_client_stats(fd, &stats, error);
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        if (received == false)
+        {
+            fprintf(stderr, "%s\n", (fd >= 0) ? error : "can't connect to the server");
+            return 1;
+        }
+        expression_cache_print_stats(&stats, stdout);
+        return 0;
+    }
+    else if (argc > 1 && strcmp(argv[1], "--server-benchmark") == 0)
+    {
+        // measure the latency of requests from concurrent clients of a server started for the benchmark.
+        int failures = expression_server_benchmark((argc > 2) ? atoi(argv[2]) : 4, (argc > 3) ? atoi(argv[3]) : 20000);
+        printf("%d requests failed\n", failures);
+        return failures == 0 ? 0 : 1;
+    }
+    else if (argc > 1 && strcmp(argv[1], "--cache-benchmark") == 0)
+    {
+        // measure lookups of the expression cache that compile, hit the structure level and hit the string level.
+        int failures = cache_benchmark((argc > 2) ? atoi(argv[2]) : 2000);
+        printf("%d second spellings found a different expression\n", failures);
+        return failures == 0 ? 0 : 1;
+    }
+    else if (argc > 1 && strcmp(argv[1], "--result-benchmark") == 0)
+    {
+        // measure the hit ratio and time per request of result caches on a generated trace of evaluate requests.
+        int failures = result_benchmark((argc > 2) ? atoi(argv[2]) : 2000000);
+        printf("%d replays differ from the one without a cache\n", failures);
+        return failures == 0 ? 0 : 1;
+    }
+    else if (argc > 1 && strcmp(argv[1], "--parse-benchmark") == 0)
+    {
+        // measure the parse throughput of a generated expression read from each kind of source.
+        int failures = parse_benchmark((argc > 2) ? atoi(argv[2]) : 64);
+        printf("%d sources parsed a different tree\n", failures);
+        return failures == 0 ? 0 : 1;
+    }
+    else if (argc > 1 && strcmp(argv[1], "--parallel-parse-benchmark") == 0)
+    {
+        // measure how parsing one generated expression in parallel scales with the number of workers.
+        int failures = parallel_parse_benchmark((argc > 2) ? atoi(argv[2]) : 64, (argc > 3) ? atoi(argv[3]) : 8);
+        printf("%d parallel parses differ from the sequential one\n", failures);
+        return failures == 0 ? 0 : 1;
+    }
+    else if (argc > 1 && strcmp(argv[1], "--parallel-evaluate-benchmark") == 0)
+    {
+        // measure the latency of evaluating one large tree in parallel as the number of workers grows.
+        int failures = parallel_evaluate_benchmark((argc > 2) ? atoi(argv[2]) : 2000000, (argc > 3) ? atoi(argv[3]) : 8);
+        printf("%d parallel evaluations differ from the sequential one\n", failures);
+        return failures == 0 ? 0 : 1;
+    }
+    else if (argc > 1 && strcmp(argv[1], "--tiered-benchmark") == 0)
+    {
+        // measure each tier of tiered execution, with promotions built on the manager's compiler thread.
+        long long failures = tiered_benchmark((argc > 2) ? atoll(argv[2]) : 2000000, (argc > 3) ? atoll(argv[3]) : 1000,
+                                              (argc > 4) ? atoll(argv[4]) : 100000);
+        printf("%lld evaluations differ from the program\n", failures);
+        return failures == 0 ? 0 : 1;
+    }
+    else if (argc > 1 && strcmp(argv[1], "--batch-scaling-benchmark") == 0)
+    {
+        // measure how evaluating rows of bindings with batch_evaluate scales with the number of workers.
+        int failures = batch_scaling_benchmark((argc > 2) ? atoi(argv[2]) : 1000000, (argc > 3) ? atoi(argv[3]) : 8);
+        printf("%d batch evaluations differ from the serial loop\n", failures);
+        return failures == 0 ? 0 : 1;
+    }
+    else if (argc > 1 && strcmp(argv[1], "--incremental-benchmark") == 0)
+    {
+        // measure recomputing only what depends on a changed variable against running the whole program.
+        int failures = incremental_benchmark((argc > 2) ? atoi(argv[2]) : 200000, (argc > 3) ? atoi(argv[3]) : 8);
+        printf("%d incremental updates differ from the program\n", failures);
+        return failures == 0 ? 0 : 1;
+    }
+    else if (argc > 1 && strcmp(argv[1], "--grid-benchmark") == 0)
+    {
+        // measure evaluating grids with each subexpression hoisted to the outermost loop where it is invariant.
+        int failures = grid_benchmark((argc > 2) ? atoi(argv[2]) : 1000000);
+        printf("%d grids differ from the program\n", failures);
+        return failures == 0 ? 0 : 1;
+    }
+    else if (argc > 1 && strcmp(argv[1], "--find-zeros") == 0)
+    {
+        // find the regions of a box of variable values where an expression may be zero, by interval subdivision.
+        find_zeros_report((argc > 2) ? argv[2] : "x ^ 2 + y ^ 2 - 1", (argc > 3) ? atof(argv[3]) : -2,
+                          (argc > 4) ? atof(argv[4]) : 2, (argc > 5) ? atof(argv[5]) : 0.001);
+        return 0;
+    }
+    else if (argc > 1 && strcmp(argv[1], "--chebyshev-benchmark") == 0)
+    {
+        // measure the error and speed of a chebyshev surrogate against the program it approximates.
+        int failures = chebyshev_benchmark((argc > 2) ? atoi(argv[2]) : 8, (argc > 3) ? atof(argv[3]) : 1e-6,
+                                           (argc > 4) ? atoi(argv[4]) : 1000000);
+        printf("%d surrogates outside twice their estimated error\n", failures);
+        return failures == 0 ? 0 : 1;
+    }
+    else if (argc > 1 && strcmp(argv[1], "--accuracy-benchmark") == 0)
+    {
+        // measure the throughput and error of evaluating programs at each accuracy.
+        int failures = accuracy_benchmark((argc > 2) ? atoi(argv[2]) : 1000000);
+        printf("%d exact evaluations differ from the program\n", failures);
+        return failures == 0 ? 0 : 1;
+    }
+    else if (argc > 1 && strcmp(argv[1], "--float-benchmark") == 0)
+    {
+        // measure the throughput and error of single precision evaluation against double precision.
+        int failures = float_benchmark((argc > 2) ? atoi(argv[2]) : 1000000);
+        printf("%d batch rows differ from evaluating the row alone\n", failures);
+        return failures == 0 ? 0 : 1;
+    }
+    else if (argc > 1 && strcmp(argv[1], "--sincos-benchmark") == 0)
+    {
+        // measure computing a sine and cosine of the same argument with one call against two calls.
+        int failures = sincos_benchmark((argc > 2) ? atoi(argv[2]) : 1000000);
+        printf("%d paired programs differ from the split ones\n", failures);
+        return failures == 0 ? 0 : 1;
+    }
+    else if (argc > 1 && strcmp(argv[1], "--cse-benchmark") == 0)
+    {
+        // measure evaluating the value and gradient as trees against the program with common subexpressions shared.
+        int failures = cse_benchmark((argc > 2) ? atoi(argv[2]) : 200000);
+        printf("%d rows differ between the trees and the program\n", failures);
+        return failures == 0 ? 0 : 1;
+    }
+    else if (argc > 1 && strcmp(argv[1], "--rebalance-benchmark") == 0)
+    {
+        // measure the depth and evaluation time of a long sum before and after rebalancing it.
+        rebalance_benchmark((argc > 2) ? atoi(argv[2]) : 100000);
+        return 0;
+    }
+    else if (argc > 1 && strcmp(argv[1], "--batch-benchmark") == 0)
+    {
+        // measure the line rate of batch mode on a generated stream.
+        thread_pool* pool = thread_pool_create(batch_format_threads());
+        batch_stream_benchmark(pool, (argc > 2) ? atoll(argv[2]) : 4000000);
+        thread_pool_free(pool);
+        return 0;
+    }
+
+    // options of the interactive calculator: --accuracy fast evaluates with the fast transcendental functions, and
+    // --rebalance regroups long sums and products into balanced trees.
+    accuracy accuracy = accuracy_exact;
+    bool balanced = false;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--accuracy") == 0 && i + 1 < argc)
+        {
+            accuracy = (strcmp(argv[++i], "fast") == 0) ? accuracy_fast : accuracy_exact;
+        }
+        else if (strcmp(argv[i], "--rebalance") == 0)
+        {
+            balanced = true;
+        }
+    }
+
+    // get the user input, a line of any length.
+    char* input = NULL;
+    size_t input_size = 0;
     printf("Enter an expression: ");
-    fgets(input, 256, stdin);
+    if (getline(&input, &input_size, stdin) < 0)
+    {
+        input_size = 0;
+    }
 
-    tree_node* root = parse_expression(input); // parse input string to an expression tree.
+    tree_node* root = (input_size > 0) ? parse_expression(input) : NULL; // parse input string to an expression tree.
+    free(input);
+    if (root == NULL)
+    {
+        printf("Invalid expression\n");
+        return 1;
+    }
 
     simplify(root); // simplify the expression tree.
+    if (balanced)
+    {
+        rebalance(root);
+    }
 
     list variables;
+    list_init(&variables);
     find_variables(root, &variables); // add each variable in the expression tree to the variables list.
     query_variables(&variables); // ask the user to assign a value for each variable in the list.
-    set_variables(root, &variables); // set these values for each variable node in the expression tree.
 
-    double value = evaluate(root); // evaluate the expression tree.
+    // construct the partial derivative expression tree with respect to each variable, then simplify it.
+    int variable_count = list_length(&variables);
+    tree_node** roots = (tree_node**)malloc(sizeof(tree_node*) * (variable_count + 1));
+    double* slots = (double*)malloc(sizeof(double) * (variable_count + 1));
+    roots[0] = root;
+    int slot = 0;
+    for (list_node* item = variables.first; item != NULL; item = item->next)
+    {
+        variable_value* pair = item->payload;
+        roots[slot + 1] = differentiate(root, pair->symbol);
+        simplify(roots[slot + 1]);
+        slots[slot++] = pair->value;
+    }
+
+    // compile the expression and its derivatives together, so subexpressions they share are only computed once.
+    program* program = program_compile_many(roots, variable_count + 1, &variables);
+    double* registers = (double*)malloc(sizeof(double) * (program->length + 1));
+    double* values = (double*)malloc(sizeof(double) * (variable_count + 1));
+    program_run_accuracy(program, accuracy, slots, registers, values);
+
     char* expression_string = infix(root); // produce a string in infix notation for the simplified expression tree.
-    printf("F() = %s = %g\n", expression_string, value);
+    printf("F() = %s = %g\n", expression_string, values[0]);
     free(expression_string);
 
+    slot = 0;
     for (list_node* item = variables.first; item != NULL; item = item->next)
     {
-        // calculate the partial derivative of the expression with respect to each variable.
         variable_value* pair = item->payload;
-        tree_node* diff_root = differentiate(root, pair->symbol); // construct the derivative expression tree.
-        simplify(diff_root); // simplify the derivative expression tree.
-        double diff_value = evaluate(diff_root); // evaluate the derivative expression tree.
-
-        char* diff_expression_string = infix(diff_root); // produce a string in infix notation for the derivative.
-        printf("∂F/∂%c = %s = %g\n", pair->symbol, diff_expression_string, diff_value);
+        char* diff_expression_string = infix(roots[slot + 1]); // produce a string in infix notation for the derivative.
+        printf("∂F/∂%c = %s = %g\n", pair->symbol, diff_expression_string, values[slot + 1]);
         free(diff_expression_string);
-        tree_free(diff_root);
+        tree_free(roots[slot + 1]);
+        ++slot;
     }
 
+    program_free(program);
+    free(registers);
+    free(values);
+    free(slots);
+    free(roots);
     free_variables(&variables);
     tree_free(root);
     return 0;
@@ -0,0 +1,78 @@
+#ifndef COURSEWORK_MATH_REPORT_H
+#define COURSEWORK_MATH_REPORT_H
+
+#include <stdio.h>
+#include <time.h>
+
+#include "fast_math.h"
+
+// pow with a whole exponent, which the fast tier computes without libm. the exponent is read at run time, as it is
+// from the registers of a program, so the compiler can't turn the libm call into a multiplication.
+double math_report_square(double x, accuracy accuracy)
+{
+    static volatile double exponent = 2;
+    return fast_pow(x, exponent, accuracy);
+}
+
+// a function of the report, with the range of inputs it is swept over.
+typedef struct math_report_function
+{
+    const char* name;
+    double (*function)(double, accuracy);
+    double lower;
+    double upper;
+} math_report_function;
+
+// returns the average time of one call in nanoseconds over a sweep of the range.
+double math_report_time(const math_report_function* function, accuracy accuracy, int samples, volatile double* checksum)
+{
+    struct timespec start, stop;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    double sum = 0;
+    for (int i = 0; i < samples; ++i)
+    {
+        sum += function->function(function->lower + (function->upper - function->lower) * (i + 0.5) / samples, accuracy);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+
+    *checksum += sum;
+    return ((stop.tv_sec - start.tv_sec) * 1e9 + (stop.tv_nsec - start.tv_nsec)) / samples;
+}
+
+// measures the error against libm and the time per call of each function at each accuracy, and prints a table.
+// returns the number of functions outside the documented bounds of their accuracy.
+int math_report()
+{
+    static const math_report_function functions[] =
+    {
+        { "sin", fast_sin, -10, 10 },
+        { "cos", fast_cos, -10, 10 },
+        { "log", fast_log10, 1e-3, 1e3 },
+        { "x ^ 2", math_report_square, 1e-3, 1e3 }
+    };
+    static const char* names[] = { "exact", "fast" };
+    const int samples = 1000000;
+
+    int function_count = sizeof(functions) / sizeof(functions[0]);
+    int failures = 0;
+    volatile double checksum = 0; // keeps the timed calls from being optimised away.
+    printf("%-8s%-8s%12s%16s%12s\n", "name", "tier", "max ulps", "max relative", "ns/call");
+    for (int i = 0; i < function_count; ++i)
+    {
+        for (int tier = accuracy_exact; tier <= accuracy_fast; ++tier)
+        {
+            const math_report_function* function = &functions[i];
+            fast_math_error error = fast_math_measure(function->function, (accuracy)tier, function->lower, function->upper, samples);
+            double time = math_report_time(function, (accuracy)tier, samples, &checksum);
+            printf("%-8s%-8s%12.0f%16.3g%12.1f\n", function->name, names[tier], error.max_ulps, error.max_relative, time);
+
+            // the bounds documented for each accuracy.
+            bool within = (tier == accuracy_exact) ? error.max_ulps == 0 : error.max_relative <= 1e-7;
+            failures += within ? 0 : 1;
+        }
+    }
+
+    return failures;
+}
+
+#endif //COURSEWORK_MATH_REPORT_H
@@ -0,0 +1,306 @@
+#ifndef COURSEWORK_NATIVE_BACKEND_H
+#define COURSEWORK_NATIVE_BACKEND_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dlfcn.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "expression.h"
+#include "program.h"
+#include "tree_hash.h"
+#include "c_writer.h"
+
+#define NATIVE_FUNCTION_NAME "expression_program"
+#define NATIVE_PATH_SIZE 4096 // size of the buffer holding the path of the cache directory.
+#define NATIVE_FORMAT_VERSION 1 // change this whenever the generated code changes, so old cache entries are not used.
+
+// native code for an expression, takes the slot values and writes the value followed by each partial derivative.
+typedef void (*native_function)(const double* slots, double* results);
+
+// an expression's program together with a shared object compiled from it.
+typedef struct native_code
+{
+    const program* program; // the program is interpreted when the shared object could not be built or loaded.
+    native_function function; // function loaded from the shared object, or NULL.
+    void* library; // handle returned by dlopen, or NULL.
+    uint64_t hash; // structural hash of the expression, its partial derivatives and its binding slots.
+    bool cached; // was the shared object already in the cache?
+} native_code;
+
+// is the path a directory only we can use, owned by us with mode 0700 and not a symbolic link? nothing else may be
+// able to plant a shared object where we load them from.
+bool native_private_directory(const char* path)
+{
+    struct stat status;
+    return lstat(path, &status) == 0 && S_ISDIR(status.st_mode) && status.st_uid == getuid() &&
+           (status.st_mode & 0777) == 0700;
+}
+
+// finds the directory used to cache shared objects, creating it if it doesn't exist, and returns false if there is
+// none we can trust. the directory is EXPRESSION_CACHE_DIR if it is set, otherwise expression-calculator under
+// XDG_CACHE_HOME or ~/.cache.
+bool native_cache_directory(char* directory, size_t size)
+{
+    const char* given = getenv("EXPRESSION_CACHE_DIR");
+    const char* cache_home = getenv("XDG_CACHE_HOME");
+    const char* home = getenv("HOME");
+    int length;
+    if (given != NULL && given[0] != '\0')
+    {
+        length = snprintf(directory, size, "%s", given);
+    }
+    else if (cache_home != NULL && cache_home[0] == '/')
+    {
+        length = snprintf(directory, size, "%s/expression-calculator", cache_home);
+    }
+    else if (home != NULL && home[0] == '/')
+    {
+        // ~/.cache is shared with other programs, so it only has to exist. the directory in it is checked below.
+        length = snprintf(directory, size, "%s/.cache", home);
+        if (length < 0 || (size_t)length >= size || (mkdir(directory, 0700) != 0 && errno != EEXIST))
+        {
+            return false;
+        }
+        length = snprintf(directory, size, "%s/.cache/expression-calculator", home);
+    }
+    else
+    {
+        return false;
+    }
+
+    if (length < 0 || (size_t)length >= size || (mkdir(directory, 0700) != 0 && errno != EEXIST))
+    {
+        return false;
+    }
+    return native_private_directory(directory);
+}
+
+// hashes the structure of each tree and the binding slot order, which together decide the generated code.
+uint64_t native_hash(compiled_expression* expression)
+{
+    uint64_t hash = hash_combine(0, NATIVE_FORMAT_VERSION);
+    hash = hash_combine(hash, tree_hash(expression->root));
+    for (int i = 0; i < expression->variable_count; ++i)
+    {
+        hash = hash_combine(hash, (uint64_t)(unsigned char)expression->program->symbols[i]);
+        hash = hash_combine(hash, tree_hash(expression->partials[i]));
+    }
+
+    return hash;
+}
+
+// compiles the c source into a shared object with the c compiler named by CC, or cc if CC is not set.
+// the compiler is run directly rather than through a shell, so no path is ever interpreted as a command.
+bool native_compile_source(const char* source_path, const char* object_path)
+{
+    const char* compiler = getenv("CC");
+    if (compiler == NULL || compiler[0] == '\0')
+    {
+        compiler = "cc";
+    }
+
+    pid_t child = fork();
+    if (child == 0)
+    {
+        int null = open("/dev/null", O_WRONLY);
+        if (null >= 0)
+        {
+            dup2(null, STDOUT_FILENO);
+            dup2(null, STDERR_FILENO);
+        }
+        char* const arguments[] =
+        {
+            (char*)compiler, "-O2", "-shared", "-fPIC", "-o", (char*)object_path, (char*)source_path, "-lm", NULL
+        };
+        execvp(compiler, arguments);
+        _exit(127);
+    }
+
+    int status = 0;
+    while (child > 0 && waitpid(child, &status, 0) < 0 && errno == EINTR)
+    {
+    }
+    return child > 0 && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+// returns the c source for the expression and its partial derivatives, which the caller must free.
+char* native_source(compiled_expression* expression)
+{
+    char* source = NULL;
+    size_t size = 0;
+    FILE* out = open_memstream(&source, &size);
+    tree_node** roots = (tree_node**)malloc(sizeof(tree_node*) * (expression->variable_count + 1));
+    roots[0] = expression->root;
+    for (int i = 0; i < expression->variable_count; ++i)
+    {
+        roots[i + 1] = expression->partials[i];
+    }
+
+    fprintf(out, "#include <math.h>\n\n");
+    c_write_program_function(out, "", NATIVE_FUNCTION_NAME, roots, expression->variable_count + 1,
+                             expression->program->symbols, expression->variable_count);
+    free(roots);
+    fclose(out);
+    return source;
+}
+
+// is the file at the path ours, a regular file holding exactly the given text? a shared object in the cache is only
+// reused if the source saved next to it is the one we would compile, since its name is only a 64-bit hash.
+bool native_file_matches(const char* path, const char* text)
+{
+    struct stat status;
+    size_t length = strlen(text);
+    if (lstat(path, &status) != 0 || S_ISREG(status.st_mode) == false || status.st_uid != getuid() ||
+        (size_t)status.st_size != length)
+    {
+        return false;
+    }
+
+    FILE* in = fopen(path, "r");
+    if (in == NULL)
+    {
+        return false;
+    }
+    char* contents = (char*)malloc(length + 1);
+    bool matches = fread(contents, 1, length, in) == length && memcmp(contents, text, length) == 0;
+    free(contents);
+    fclose(in);
+    return matches;
+}
+
+// writes the text to a new file, returns false if it can't be written in full.
+bool native_write_file(const char* path, const char* text)
+{
+    int fd = open(path, O_WRONLY | O_CREAT | O_EXCL, 0600);
+    if (fd < 0)
+    {
+        return false;
+    }
+    FILE* out = fdopen(fd, "w");
+    if (out == NULL)
+    {
+        close(fd);
+        return false;
+    }
+    bool written = fputs(text, out) >= 0;
+    return fclose(out) == 0 && written;
+}
+
+// loads the expression's function from a shared object.
+bool native_load(native_code* code, const char* object_path)
+{
+    void* library = dlopen(object_path, RTLD_NOW | RTLD_LOCAL);
+    if (library == NULL)
+    {
+        return false;
+    }
+
+    void* function = dlsym(library, NATIVE_FUNCTION_NAME);
+    if (function == NULL)
+    {
+        dlclose(library);
+        return false;
+    }
+
+    code->library = library;
+    *(void**)&code->function = function; // dlsym returns an object pointer, so convert it through memory.
+    return true;
+}
+
+// compiles the expression to a shared object and loads it, reusing a cached shared object if there is one.
+// if no c compiler is available, or there is no private cache directory, the code falls back to interpreting the
+// expression's program.
+native_code* native_compile(compiled_expression* expression)
+{
+    native_code* code = (native_code*)malloc(sizeof(native_code));
+    code->program = expression->program;
+    code->function = NULL;
+    code->library = NULL;
+    code->hash = native_hash(expression);
+    code->cached = false;
+
+    char directory[NATIVE_PATH_SIZE];
+    if (native_cache_directory(directory, sizeof(directory)) == false)
+    {
+        return code;
+    }
+
+    // each path has room for the directory and a file name.
+    char object_path[NATIVE_PATH_SIZE + 64];
+    char saved_source_path[NATIVE_PATH_SIZE + 64];
+    char temporary_object_path[NATIVE_PATH_SIZE + 64];
+    char source_path[NATIVE_PATH_SIZE + 64];
+    unsigned long long hash = (unsigned long long)code->hash;
+    snprintf(object_path, sizeof(object_path), "%s/%016llx.so", directory, hash);
+    snprintf(saved_source_path, sizeof(saved_source_path), "%s/%016llx.c", directory, hash);
+    char* source = native_source(expression);
+
+    struct stat status;
+    if (native_file_matches(saved_source_path, source) && lstat(object_path, &status) == 0 &&
+        S_ISREG(status.st_mode) && status.st_uid == getuid() && native_load(code, object_path))
+    {
+        code->cached = true; // compiled by an earlier submission or an earlier process.
+    }
+    else
+    {
+        // build under names unique to this process, then rename into place so other processes never load a partial
+        // file. the shared object is loaded before the renames, so this process always runs what it just compiled.
+        snprintf(source_path, sizeof(source_path), "%s/%016llx.%ld.c", directory, hash, (long)getpid());
+        snprintf(temporary_object_path, sizeof(temporary_object_path), "%s/%016llx.%ld.so", directory, hash, (long)getpid());
+        remove(source_path);
+        remove(temporary_object_path);
+
+        if (native_write_file(source_path, source) &&
+            native_compile_source(source_path, temporary_object_path) &&
+            native_load(code, temporary_object_path))
+        {
+            // the loaded library stays valid after its file is renamed over the cached one.
+            if (rename(source_path, saved_source_path) != 0 || rename(temporary_object_path, object_path) != 0)
+            {
+                remove(saved_source_path);
+            }
+        }
+
+        remove(source_path);
+        remove(temporary_object_path);
+    }
+
+    free(source);
+    return code;
+}
+
+// unload the shared object and free memory for the native code, but not its program.
+void native_free(native_code* code)
+{
+    if (code != NULL)
+    {
+        if (code->library != NULL)
+        {
+            dlclose(code->library);
+        }
+        free(code);
+    }
+}
+
+// runs the native function, or interprets the program when there is no native function.
+// registers are only used by the interpreter and must have room for program->length values.
+void native_run(const native_code* code, const double* slots, double* registers, double* results)
+{
+    if (code->function != NULL)
+    {
+        code->function(slots, results);
+    }
+    else
+    {
+        program_run(code->program, slots, registers, results);
+    }
+}
+
+#endif //COURSEWORK_NATIVE_BACKEND_H
@@ -0,0 +1,225 @@
+#ifndef COURSEWORK_PARALLEL_EVALUATOR_H
+#define COURSEWORK_PARALLEL_EVALUATOR_H
+
+#include <stdlib.h>
+
+#include "evaluator.h"
+#include "thread_pool.h"
+
+#define PARALLEL_EVALUATE_MIN 32768 // trees with fewer nodes are evaluated on the calling thread alone.
+#define PARALLEL_EVALUATE_GRAIN 4096 // least nodes of a subtree evaluated by one task.
+#define PARALLEL_EVALUATE_TASKS 8 // tasks for each worker, so a slow task can be balanced.
+
+// a tree split for evaluation on a thread pool. the subtrees at or below the grain size whose parents are above it
+// are the units, which tasks evaluate on their own. the nodes above the units are the skeleton, which is evaluated
+// on the calling thread from the values of the units once every task has finished. each node is evaluated by the
+// same operation on the same operands as in evaluate_bound, so the result is exactly the same.
+typedef struct parallel_evaluator
+{
+    tree_node* root;
+    int node_count;
+    tree_node** units; // the root of each unit, in post-order.
+    int unit_count;
+    int* task_units; // the first unit of each task, followed by unit_count.
+    int task_count;
+    tree_node** skeleton; // the nodes above the units, in post-order.
+    int* steps; // the skeleton in post-order: the index of a unit, or -1 minus the index of a skeleton node.
+    int step_count;
+    double* values; // the value of each unit in the evaluation in progress.
+    double* stack; // the values of the skeleton in the evaluation in progress.
+} parallel_evaluator;
+
+// the evaluation shared by the tasks.
+typedef struct parallel_evaluation
+{
+    parallel_evaluator* evaluator;
+    const double* bindings;
+} parallel_evaluation;
+
+// create an evaluator for the tree on a pool of the given number of workers. the tree must not change while the
+// evaluator is used. a tree smaller than PARALLEL_EVALUATE_MIN has no units and is evaluated sequentially.
+parallel_evaluator* parallel_evaluator_create(tree_node* root, int thread_count)
+{
+    parallel_evaluator* evaluator = (parallel_evaluator*)calloc(1, sizeof(parallel_evaluator));
+    evaluator->root = root;
+
+    node_stack order;
+    node_stack_init(&order);
+    tree_postorder(root, &order);
+    int count = order.count;
+    evaluator->node_count = count;
+    if (count < PARALLEL_EVALUATE_MIN)
+    {
+        node_stack_free(&order);
+        return evaluator;
+    }
+
+    // the size of each subtree, by the index of its root in post-order. a node's right child comes just before it,
+    // and its left child just before the right child's subtree.
+    int* sizes = (int*)malloc(sizeof(int) * count);
+    for (int i = 0; i < count; ++i)
+    {
+        tree_node* node = order.nodes[i];
+        int size = 1;
+        int child = i - 1;
+        if (node->right_child != NULL)
+        {
+            size += sizes[child];
+            child -= sizes[child];
+        }
+        if (node->left_child != NULL)
+        {
+            size += sizes[child];
+        }
+        sizes[i] = size;
+    }
+
+    // the grain grows with the tree, so the number of tasks stays close to PARALLEL_EVALUATE_TASKS per worker.
+    int grain = count / ((thread_count > 0 ? thread_count : 1) * PARALLEL_EVALUATE_TASKS);
+    grain = (grain > PARALLEL_EVALUATE_GRAIN) ? grain : PARALLEL_EVALUATE_GRAIN;
+
+    // walk down from the root until the subtrees are no bigger than the grain, marking the last index of each unit
+    // at its first index.
+    int* unit_ends = (int*)malloc(sizeof(int) * count);
+    for (int i = 0; i < count; ++i)
+    {
+        unit_ends[i] = -1;
+    }
+    int* pending = (int*)malloc(sizeof(int) * count);
+    int pending_count = 0;
+    pending[pending_count++] = count - 1;
+    while (pending_count > 0)
+    {
+        int index = pending[--pending_count];
+        if (sizes[index] <= grain)
+        {
+            unit_ends[index - sizes[index] + 1] = index;
+            ++evaluator->unit_count;
+            continue;
+        }
+
+        ++evaluator->step_count;
+        tree_node* node = order.nodes[index];
+        int child = index - 1;
+        if (node->right_child != NULL)
+        {
+            pending[pending_count++] = child;
+            child -= sizes[child];
+        }
+        if (node->left_child != NULL)
+        {
+            pending[pending_count++] = child;
+        }
+    }
+    free(pending);
+
+    // the skeleton nodes and the units in post-order, with each unit in place of its subtree.
+    int skeleton_count = evaluator->step_count;
+    evaluator->step_count += evaluator->unit_count;
+    evaluator->units = (tree_node**)malloc(sizeof(tree_node*) * evaluator->unit_count);
+    evaluator->skeleton = (tree_node**)malloc(sizeof(tree_node*) * skeleton_count);
+    evaluator->steps = (int*)malloc(sizeof(int) * evaluator->step_count);
+    int* unit_sizes = (int*)malloc(sizeof(int) * evaluator->unit_count);
+    int unit = 0;
+    int skeleton = 0;
+    int step = 0;
+    for (int i = 0; i < count; ++i)
+    {
+        if (unit_ends[i] >= 0)
+        {
+            unit_sizes[unit] = sizes[unit_ends[i]];
+            evaluator->units[unit] = order.nodes[unit_ends[i]];
+            evaluator->steps[step++] = unit++;
+            i = unit_ends[i];
+        }
+        else
+        {
+            evaluator->skeleton[skeleton] = order.nodes[i];
+            evaluator->steps[step++] = -1 - skeleton++;
+        }
+    }
+    free(unit_ends);
+    free(sizes);
+    node_stack_free(&order);
+
+    // each task evaluates consecutive units until it has about a grain of nodes, so small units share a task.
+    evaluator->task_units = (int*)malloc(sizeof(int) * (evaluator->unit_count + 1));
+    int nodes = 0;
+    for (unit = 0; unit < evaluator->unit_count; ++unit)
+    {
+        if (unit == 0 || nodes >= grain)
+        {
+            evaluator->task_units[evaluator->task_count++] = unit;
+            nodes = 0;
+        }
+        nodes += unit_sizes[unit];
+    }
+    evaluator->task_units[evaluator->task_count] = evaluator->unit_count;
+    free(unit_sizes);
+
+    evaluator->values = (double*)malloc(sizeof(double) * evaluator->unit_count);
+    evaluator->stack = (double*)malloc(sizeof(double) * evaluator->step_count);
+    return evaluator;
+}
+
+// free memory for the evaluator, but not for its tree.
+void parallel_evaluator_free(parallel_evaluator* evaluator)
+{
+    if (evaluator != NULL)
+    {
+        free(evaluator->units);
+        free(evaluator->task_units);
+        free(evaluator->skeleton);
+        free(evaluator->steps);
+        free(evaluator->values);
+        free(evaluator->stack);
+        free(evaluator);
+    }
+}
+
+// evaluates the units of one task.
+void parallel_evaluate_task(void* context, int task)
+{
+    parallel_evaluation* evaluation = context;
+    parallel_evaluator* evaluator = evaluation->evaluator;
+    for (int unit = evaluator->task_units[task]; unit < evaluator->task_units[task + 1]; ++unit)
+    {
+        evaluator->values[unit] = evaluate_bound(evaluator->units[unit], evaluation->bindings);
+    }
+}
+
+// evaluates the tree like evaluate_bound, with the units evaluated by the workers of the pool. an evaluator holds
+// the values of the evaluation in progress, so it must only be used by one evaluation at a time.
+double parallel_evaluate(thread_pool* pool, parallel_evaluator* evaluator, const double* bindings)
+{
+    if (evaluator->unit_count == 0)
+    {
+        return (evaluator->root != NULL) ? evaluate_bound(evaluator->root, bindings) : 0;
+    }
+
+    parallel_evaluation evaluation;
+    evaluation.evaluator = evaluator;
+    evaluation.bindings = bindings;
+    thread_pool_run(pool, parallel_evaluate_task, &evaluation, evaluator->task_count);
+
+    // the skeleton is evaluated as evaluate_iterative does, with the value of each unit in place of its subtree.
+    double* values = evaluator->stack;
+    int count = 0;
+    for (int step = 0; step < evaluator->step_count; ++step)
+    {
+        int index = evaluator->steps[step];
+        if (index >= 0)
+        {
+            values[count++] = evaluator->values[index];
+            continue;
+        }
+
+        tree_node* current = evaluator->skeleton[-1 - index];
+        double right = (current->right_child != NULL) ? values[--count] : 0; // the right subtree is on top.
+        double left = (current->left_child != NULL) ? values[--count] : 0;
+        values[count++] = evaluate_node(current->token, left, right, bindings);
+    }
+    return values[0];
+}
+
+#endif //COURSEWORK_PARALLEL_EVALUATOR_H
@@ -0,0 +1,332 @@
+#ifndef COURSEWORK_PARALLEL_PARSER_H
+#define COURSEWORK_PARALLEL_PARSER_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "parser.h"
+#include "thread_pool.h"
+
+#define PARALLEL_PARSE_CHUNK 65536 // smallest piece of text scanned by one task.
+#define PARALLEL_PARSE_GROUPS 4 // pieces of the expression parsed by each worker, so a slow piece can be balanced.
+
+// a piece of the text scanned by one task. the scan finds the nesting depth of each character with a prefix sum: each
+// chunk finds the change in depth over it, and then the depth at the start of each chunk is the sum of the changes
+// before it. a chunk finds the additions and subtractions at the least depth it reaches before it knows that depth, so
+// they are outside any parentheses if the depth at its start is just enough to bring that least depth to zero.
+typedef struct parse_chunk
+{
+    int first; // index in the text of the first character of the chunk.
+    int last; // index of the character after the chunk.
+    int depth; // the change in depth over the chunk, up to its stop.
+    int lowest; // the least change in depth at any character of the chunk.
+    int stop; // index of the first character of the chunk that ends the expression, or -1.
+    int* splits; // indices of the binary additions and subtractions of the chunk at its least depth.
+    int split_count;
+    int split_capacity;
+} parse_chunk;
+
+// a run of terms of the expression parsed by one task. after the first, each group is parsed as if the operator
+// before its first term followed a placeholder, which is replaced with the tree of the groups before it.
+typedef struct parse_group
+{
+    int first;
+    int last;
+    token_type operator; // the addition or subtraction before the group.
+    tree_node* placeholder;
+    tree_node* joint; // the node of the operator before the group, whose left child is the placeholder.
+    tree_node* root;
+} parse_group;
+
+// the state of a parallel parse shared by its tasks.
+typedef struct parallel_parse
+{
+    const char* text;
+    int length; // characters up to the end of the expression.
+    parse_chunk* chunks;
+    int chunk_count;
+    parse_group* groups;
+    int group_count;
+} parallel_parse;
+
+// does a run of letters end the expression? it does unless it is one letter, pi, or the start of a function name,
+// which are the runs the tokenizer reads as a constant, variable or function.
+bool parse_ends_at_letters(const char* text, int index)
+{
+    static const char* names[] = { "pi", "sqrt", "log", "ln", "sin", "cos", "tan" };
+    int length = 1;
+    while (is_letter(text[index + length]))
+    {
+        ++length;
+    }
+    if (length == 1)
+    {
+        return false;
+    }
+
+    for (int name = 0; name < (int)(sizeof(names) / sizeof(names[0])); ++name)
+    {
+        int matched = 0;
+        while (matched < length && names[name][matched] != '\0' && (text[index + matched] | 0x20) == names[name][matched])
+        {
+            ++matched;
+        }
+        if (matched == length && (name > 0 || length == 2))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// scans a chunk for its change in depth, where in it the expression ends, and the additions and subtractions at the
+// least depth it reaches.
+void parse_scan_chunk(void* context, int task)
+{
+    parallel_parse* parse = context;
+    parse_chunk* chunk = &parse->chunks[task];
+    const char* text = parse->text;
+    int index = chunk->first;
+    while (index > 0 && index < chunk->last && is_letter(text[index]) && is_letter(text[index - 1]))
+    {
+        ++index; // the run of letters belongs to the chunk it started in.
+    }
+
+    // the last character of the previous token decides whether a minus sign is unary, as in parse_reader_after.
+    int before = chunk->first - 1;
+    while (before >= 0 && is_whitespace(text[before]))
+    {
+        --before;
+    }
+    char previous = (before >= 0) ? text[before] : '\0';
+
+    // the class of each character, every character that can't start a token is 0.
+    enum { ends, space, plain, left, right, sign, letter };
+    static const unsigned char classes[256] =
+    {
+        [' '] = space, ['\t'] = space, ['\n'] = space, ['\r'] = space,
+        ['0' ... '9'] = plain, ['.'] = plain, ['*'] = plain, ['/'] = plain, ['~'] = plain, ['^'] = plain,
+        ['('] = left, [')'] = right, ['+'] = sign, ['-'] = sign,
+        ['a' ... 'z'] = letter, ['A' ... 'Z'] = letter
+    };
+
+    int depth = 0;
+    int lowest = 0;
+    chunk->stop = -1;
+    for (; index < chunk->last && chunk->stop < 0; ++index)
+    {
+        char c = text[index];
+        switch (classes[(unsigned char)c])
+        {
+            case space:
+                continue; // the previous character stays the last one of a token.
+            case left:
+                ++depth;
+                break;
+            case right:
+                if (--depth < lowest)
+                {
+                    lowest = depth;
+                    chunk->split_count = 0; // the splits found so far are inside parentheses.
+                }
+                break;
+            case sign:
+                if (depth == lowest &&
+                    (c == '+' || (previous != '\0' && previous != '(' && is_operator_symbol(previous) == false)))
+                {
+                    if (chunk->split_count == chunk->split_capacity)
+                    {
+                        chunk->split_capacity = (chunk->split_capacity > 0) ? chunk->split_capacity * 2 : 64;
+                        chunk->splits = (int*)realloc(chunk->splits, sizeof(int) * chunk->split_capacity);
+                    }
+                    chunk->splits[chunk->split_count++] = index;
+                }
+                break;
+            case letter:
+                if (parse_ends_at_letters(text, index))
+                {
+                    chunk->stop = index;
+                }
+                while (is_letter(text[index + 1]))
+                {
+                    ++index; // the rest of a run of letters is one token.
+                }
+                break;
+            case ends:
+                chunk->stop = index;
+                break;
+        }
+        previous = text[index];
+    }
+    chunk->depth = depth;
+    chunk->lowest = lowest;
+}
+
+// parses one group of terms.
+void parse_group_task(void* context, int task)
+{
+    parallel_parse* parse = context;
+    parse_group* group = &parse->groups[task];
+    // the group is copied so it ends with a zero, which is where the tokenizer stops.
+    int length = group->last - group->first;
+    char* text = (char*)malloc(length + 1);
+    memcpy(text, parse->text + group->first, length);
+    text[length] = '\0';
+
+    text_reader reader;
+    text_reader_init_string(&reader, text);
+    if (group->placeholder != NULL)
+    {
+        group->root = parse_reader_after(&reader, group->placeholder, group->operator, &group->joint);
+    }
+    else
+    {
+        group->root = parse_reader(&reader);
+    }
+    free(text);
+}
+
+// replaces the placeholder of a group with the tree of the groups before it, returns false if the group's tree
+// doesn't have the placeholder where the operator before the group put it.
+bool parse_graft(parse_group* group, tree_node* left)
+{
+    if (group->joint == NULL || group->joint->left_child != group->placeholder)
+    {
+        return false;
+    }
+
+    tree_node_free(group->placeholder);
+    group->joint->left_child = left;
+    return true;
+}
+
+// parses the expression string on the workers of the pool and produces the same tree as parse_expression.
+// the text is split into groups of terms at additions and subtractions outside any parentheses, each group is
+// parsed by a worker, and the trees of the groups are joined left to right as the parser joins terms. text the
+// groups can't be parsed from on their own, such as unbalanced parentheses, is parsed by parse_expression instead.
+tree_node* parse_expression_parallel(thread_pool* pool, const char* text)
+{
+    parallel_parse parse;
+    parse.text = text;
+    parse.length = (int)strlen(text);
+    parse.chunk_count = pool->thread_count * 8;
+    if (parse.chunk_count > parse.length / PARALLEL_PARSE_CHUNK)
+    {
+        parse.chunk_count = (parse.length / PARALLEL_PARSE_CHUNK > 0) ? parse.length / PARALLEL_PARSE_CHUNK : 1;
+    }
+    parse.chunks = (parse_chunk*)calloc(parse.chunk_count, sizeof(parse_chunk));
+    for (int i = 0; i < parse.chunk_count; ++i)
+    {
+        parse.chunks[i].first = (int)((long long)parse.length * i / parse.chunk_count);
+        parse.chunks[i].last = (int)((long long)parse.length * (i + 1) / parse.chunk_count);
+    }
+
+    // the depth at the start of each chunk is the sum of the changes over the chunks before it, up to the first stop.
+    // the expression can only be split if the depth never goes below zero.
+    thread_pool_run(pool, parse_scan_chunk, &parse, parse.chunk_count);
+    int used = parse.chunk_count;
+    for (int i = 0; i < parse.chunk_count && used == parse.chunk_count; ++i)
+    {
+        if (parse.chunks[i].stop >= 0)
+        {
+            parse.length = parse.chunks[i].stop;
+            used = i + 1;
+        }
+    }
+
+    int split_count = 0;
+    for (int i = 0; i < used; ++i)
+    {
+        split_count += parse.chunks[i].split_count;
+    }
+    int* splits = (int*)malloc(sizeof(int) * (split_count + 1));
+    split_count = 0;
+    int depth = 0;
+    bool negative = false;
+    for (int i = 0; i < used; ++i)
+    {
+        parse_chunk* chunk = &parse.chunks[i];
+        negative = negative || depth + chunk->lowest < 0;
+        if (depth + chunk->lowest == 0 && chunk->split_count > 0)
+        {
+            memcpy(splits + split_count, chunk->splits, sizeof(int) * chunk->split_count);
+            split_count += chunk->split_count;
+        }
+        depth += chunk->depth;
+    }
+    for (int i = 0; i < parse.chunk_count; ++i)
+    {
+        free(parse.chunks[i].splits);
+    }
+    free(parse.chunks);
+
+    // each group starts at the first split at or after an even share of the text, so groups hold about as much text.
+    bool valid = negative == false && depth == 0;
+    int group_limit = (split_count > 0 && valid) ? pool->thread_count * PARALLEL_PARSE_GROUPS : 1;
+    int* starts = (int*)malloc(sizeof(int) * (group_limit + 1)); // the split before each group, -1 for the first.
+    parse.group_count = 1;
+    starts[0] = -1;
+    int split = 0;
+    for (int share = 1; share < group_limit; ++share)
+    {
+        long long target = (long long)parse.length * share / group_limit;
+        while (split < split_count && splits[split] < target)
+        {
+            ++split;
+        }
+        if (split < split_count)
+        {
+            starts[parse.group_count++] = split++;
+        }
+    }
+
+    parse.groups = (parse_group*)malloc(sizeof(parse_group) * parse.group_count);
+    for (int i = 0; i < parse.group_count; ++i)
+    {
+        parse_group* group = &parse.groups[i];
+        group->first = (i > 0) ? splits[starts[i]] + 1 : 0;
+        group->last = (i + 1 < parse.group_count) ? splits[starts[i + 1]] : parse.length;
+        group->operator = (i > 0 && text[splits[starts[i]]] == '-') ? subtraction : addition;
+        group->placeholder = NULL;
+        group->joint = NULL;
+        group->root = NULL;
+        if (i > 0)
+        {
+            token placeholder;
+            token_init(&placeholder, end, '\0', 0);
+            group->placeholder = tree_node_create(placeholder);
+        }
+    }
+    free(starts);
+    free(splits);
+
+    tree_node* root = NULL;
+    if (valid)
+    {
+        thread_pool_run(pool, parse_group_task, &parse, parse.group_count);
+        root = parse.groups[0].root;
+        int joined = 1;
+        while (joined < parse.group_count && root != NULL && parse.groups[joined].root != NULL &&
+               parse_graft(&parse.groups[joined], root))
+        {
+            root = parse.groups[joined++].root;
+        }
+
+        valid = root != NULL && joined == parse.group_count;
+        if (valid == false)
+        {
+            // the groups that weren't joined still hold their own trees, with their placeholders.
+            tree_free(root);
+            for (int i = joined; i < parse.group_count; ++i)
+            {
+                tree_free(parse.groups[i].root);
+            }
+        }
+    }
+
+    free(parse.groups);
+    return valid ? root : parse_expression(text);
+}
+
+#endif //COURSEWORK_PARALLEL_PARSER_H
@@ -0,0 +1,160 @@
+#ifndef COURSEWORK_PARSE_BENCHMARK_H
+#define COURSEWORK_PARSE_BENCHMARK_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "parser.h"
+#include "parallel_parser.h"
+#include "tree_hash.h"
+
+// writes a generated expression of about the given number of bytes to the file, like those of a code generator.
+// the terms vary in length, so tokens fall across the chunk boundaries of the reader.
+void parse_benchmark_generate(FILE* file, long long size)
+{
+    static const char* terms[] =
+    {
+        "sin(x * 1.25 + y) * 2.5",
+        "(z / 3.75) ^ 2",
+        "cos(0.5 * x) / (1 + y ^ 2)",
+        "-sqrt(x ^ 2 + y ^ 2 + z ^ 2)",
+        "ln(1.000001 + x * x) * tan(y / 1024)",
+        "log(12345.678 + z)"
+    };
+    int term_count = sizeof(terms) / sizeof(terms[0]);
+
+    long long written = 0;
+    for (int i = 0; written < size; ++i)
+    {
+        written += fprintf(file, "%s %c\n", terms[i % term_count], (i % 3 == 2) ? '-' : '+');
+    }
+    fprintf(file, "0\n");
+    fflush(file);
+}
+
+// returns the number of nodes in the tree.
+long long parse_benchmark_count(tree_node* root)
+{
+    node_stack order;
+    node_stack_init(&order);
+    tree_postorder(root, &order);
+    long long count = order.count;
+    node_stack_free(&order);
+    return count;
+}
+
+// returns the time in seconds from a monotonic clock.
+double parse_benchmark_seconds()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+// parses a generated expression of about the given number of megabytes from a string, a FILE*, a file descriptor and
+// a mapped file, and prints the throughput of each. returns the number of sources whose tree differs from the
+// tree parsed from the string, going by the hash of the trees so only one tree is held in memory at a time.
+int parse_benchmark(int megabytes)
+{
+    char path[] = "/tmp/coursework-parse-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0)
+    {
+        printf("can't create a temporary file\n");
+        return 1;
+    }
+    unlink(path); // the file is removed once it is closed, the mapped reader opens it by the name of its descriptor.
+    char fd_path[64];
+    snprintf(fd_path, sizeof(fd_path), "/proc/self/fd/%d", fd);
+
+    FILE* file = fdopen(fd, "w+");
+    parse_benchmark_generate(file, (long long)megabytes << 20);
+    long size = ftell(file);
+
+    // the string parser needs the whole text in memory, the others read it a chunk at a time.
+    char* text = (char*)malloc(size + 1);
+    rewind(file);
+    size = (long)fread(text, 1, size, file);
+    text[size] = '\0';
+
+    static const char* names[] = { "string", "FILE*", "fd", "mmap" };
+    tree_node* reference = NULL; // the tree of the string, which the tree of each other source must equal.
+    int failures = 0;
+    printf("%-8s%12s%12s%12s\n", "source", "MB/s", "nodes", "AST MB");
+    for (int source = 0; source < 4; ++source)
+    {
+        rewind(file);
+        lseek(fd, 0, SEEK_SET);
+
+        double start = parse_benchmark_seconds();
+        tree_node* root = (source == 0) ? parse_expression(text) :
+                          (source == 1) ? parse_expression_file(file) :
+                          (source == 2) ? parse_expression_fd(fd) : parse_expression_mapped(fd_path);
+        double seconds = parse_benchmark_seconds() - start;
+
+        long long nodes = parse_benchmark_count(root);
+        printf("%-8s%12.1f%12lld%12.1f\n", names[source], size / seconds / 1e6, nodes, nodes * sizeof(tree_node) / 1e6);
+
+        if (source == 0)
+        {
+            reference = root;
+            failures += (root != NULL) ? 0 : 1;
+            continue;
+        }
+        failures += (root != NULL && reference != NULL && tree_equal(root, reference)) ? 0 : 1;
+        tree_free(root);
+    }
+
+    printf("%.1f MB of text\n", size / 1e6);
+    tree_free(reference);
+    free(text);
+    fclose(file);
+    return failures;
+}
+
+// parses a generated expression of about the given number of megabytes from a string, first with parse_expression
+// and then in parallel with 1, 2, 4 and so on up to most_threads workers, and prints the throughput and speedup of
+// each. returns the number of parallel parses whose tree isn't equal to the sequential one, node by node.
+// the sequential tree is kept to compare against, and every other tree is freed before the next parse so each timed
+// parse reuses the same memory.
+int parallel_parse_benchmark(int megabytes, int most_threads)
+{
+    char* text = NULL;
+    size_t size = 0;
+    FILE* file = open_memstream(&text, &size);
+    parse_benchmark_generate(file, (long long)megabytes << 20);
+    fclose(file);
+    tree_node* reference = parse_expression(text);
+    tree_free(parse_expression(text)); // this parse takes its memory from the system, the timed ones reuse it.
+
+    double start = parse_benchmark_seconds();
+    tree_node* root = parse_expression(text);
+    double sequential_seconds = parse_benchmark_seconds() - start;
+    long long nodes = parse_benchmark_count(root);
+    int failures = (root != NULL && reference != NULL && tree_equal(root, reference)) ? 0 : 1;
+    tree_free(root);
+
+    printf("%-12s%12s%12s\n", "threads", "MB/s", "speedup");
+    printf("%-12s%12.1f%12.2f\n", "sequential", size / sequential_seconds / 1e6, 1.0);
+    for (int threads = 1; threads <= most_threads; threads *= 2)
+    {
+        thread_pool* pool = thread_pool_create(threads);
+        start = parse_benchmark_seconds();
+        root = parse_expression_parallel(pool, text);
+        double seconds = parse_benchmark_seconds() - start;
+        thread_pool_free(pool);
+
+        printf("%-12d%12.1f%12.2f\n", threads, size / seconds / 1e6, sequential_seconds / seconds);
+        failures += (root != NULL && reference != NULL && tree_equal(root, reference)) ? 0 : 1;
+        tree_free(root);
+    }
+
+    printf("%.1f MB of text, %lld nodes, %d processors\n", size / 1e6, nodes, processor_count());
+    tree_free(reference);
+    free(text);
+    return failures;
+}
+
+#endif //COURSEWORK_PARSE_BENCHMARK_H
@@ -1,180 +1,414 @@
 #ifndef COURSEWORK_PARSER_H
 #define COURSEWORK_PARSER_H
 
+#include <stdio.h>
 #include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "tree.h"
-#include "queue.h"
-#include "stack.h"
 #include "tokenizer.h"
 
-bool is_operator_symbol(char c)
+#define TEXT_READER_CHUNK 65536 // bytes read from a file at once.
+
+// source of expression text for the parser, either a string in memory or a file read in chunks.
+// the tokenizer reads from a window of the text that always ends with a zero, and each token lies wholly inside it,
+// so only the window is held in memory rather than the whole text.
+typedef struct text_reader
 {
-    return c == '+' || c == '-' || c == '*' || c == '/' || c == '~' || c == '^';
+    const char* window; // the text being tokenized, followed by a zero.
+    int offset; // index in the window of the next character to tokenize.
+    int length; // number of characters in the window.
+    bool at_end; // the window holds the rest of the input.
+    char* buffer; // the window of a chunked source, or NULL when the window is the whole string.
+    int capacity; // size of the buffer, which grows to fit a token longer than a chunk.
+    FILE* file; // chunked sources, one of which is set.
+    int fd;
+    const char* mapped;
+    size_t mapped_size;
+    size_t mapped_offset; // bytes of the mapped text already copied to the buffer.
+} text_reader;
+
+// initialise a reader with no source.
+void text_reader_init(text_reader* reader)
+{
+    reader->window = "";
+    reader->offset = 0;
+    reader->length = 0;
+    reader->at_end = true;
+    reader->buffer = NULL;
+    reader->capacity = 0;
+    reader->file = NULL;
+    reader->fd = -1;
+    reader->mapped = NULL;
+    reader->mapped_size = 0;
+    reader->mapped_offset = 0;
+}
+
+// initialise a reader of a zero terminated string, which is tokenized where it is.
+void text_reader_init_string(text_reader* reader, const char* text)
+{
+    text_reader_init(reader);
+    reader->window = text;
+    reader->length = strlen(text);
 }
 
-// rewrites the expression string to differentiate between unary and binary minus symbols.
-void preprocess_expression(char* expression)
+// initialise a reader of a chunked source, whose buffer is filled when the first token is read.
+void text_reader_init_chunked(text_reader* reader)
 {
-    int length = strlen(expression);
-    int previous_index = -1; // index of the previous non whitespace character in the expression string.
-    for (int current_index = 0; current_index < length; ++current_index)
+    text_reader_init(reader);
+    reader->at_end = false;
+    reader->capacity = TEXT_READER_CHUNK;
+    reader->buffer = (char*)malloc(reader->capacity);
+    reader->buffer[0] = '\0';
+    reader->window = reader->buffer;
+}
+
+// free memory for the reader's buffer, the source is left open.
+void text_reader_free(text_reader* reader)
+{
+    free(reader->buffer);
+    text_reader_init(reader);
+}
+
+// reads up to size bytes of the chunked source into the buffer, returns 0 at the end of the source.
+size_t text_reader_read(text_reader* reader, char* buffer, size_t size)
+{
+    if (reader->file != NULL)
     {
-        char current = expression[current_index];
-        if (is_whitespace(current) == false) // skip whitespace.
+        return fread(buffer, 1, size, reader->file);
+    }
+    else if (reader->fd >= 0)
+    {
+        ssize_t count;
+        do
         {
-            if (current == '-')
-            {
-                if (previous_index < 0 || expression[previous_index] == '(' || is_operator_symbol(expression[previous_index]))
-                {
-                    // if the minus symbol is preceded by nothing, an open parenthesis or an operator then
-                    // replace the binary minus symbol with a unary minus symbol.
-                    expression[current_index] = '~';
-                }
-            }
-            previous_index = current_index; // update the previous index.
+            count = read(reader->fd, buffer, size);
+        } while (count < 0 && errno == EINTR);
+        return (count > 0) ? (size_t)count : 0;
+    }
+    else
+    {
+        size_t count = reader->mapped_size - reader->mapped_offset;
+        count = (count < size) ? count : size;
+        memcpy(buffer, reader->mapped + reader->mapped_offset, count);
+        reader->mapped_offset += count;
+        return count;
+    }
+}
+
+// moves the unread part of the window to the front of the buffer and reads more of the source after it.
+void text_reader_fill(text_reader* reader)
+{
+    int unread = reader->length - reader->offset;
+    if (unread * 2 > reader->capacity)
+    {
+        reader->capacity *= 2; // a token is longer than half the buffer, so make room for the rest of it.
+        reader->buffer = (char*)realloc(reader->buffer, reader->capacity);
+    }
+
+    memmove(reader->buffer, reader->buffer + reader->offset, unread);
+    size_t count = text_reader_read(reader, reader->buffer + unread, reader->capacity - 1 - unread);
+    reader->at_end = (count == 0);
+    reader->offset = 0;
+    reader->length = unread + (int)count;
+    reader->buffer[reader->length] = '\0';
+    reader->window = reader->buffer;
+}
+
+// skips whitespace and makes sure the next token lies wholly inside the window, reading more of the source if needed.
+void text_reader_next_token(text_reader* reader)
+{
+    while (true)
+    {
+        while (reader->offset < reader->length && is_whitespace(reader->window[reader->offset]))
+        {
+            ++reader->offset;
+        }
+        if (reader->at_end)
+        {
+            return;
+        }
+
+        // the longest tokens are runs of letters, digits and decimal points, any other token is one character.
+        int end = reader->offset;
+        while (end < reader->length &&
+               (is_letter(reader->window[end]) || is_digit(reader->window[end]) || is_decimal_point(reader->window[end])))
+        {
+            ++end;
         }
+        if (end < reader->length)
+        {
+            return; // the token ends inside the window.
+        }
+
+        text_reader_fill(reader);
     }
 }
 
-// parses the expression string using the shunting-yard algorithm and produces an expression tree.
-// https://en.wikipedia.org/wiki/Shunting-yard_algorithm
-tree_node* parse_expression(const char* expression)
+bool is_operator_symbol(char c)
 {
-    int length = strlen(expression) + 1;
-    char* expression_copy = malloc(sizeof(char) * length);
-    strcpy(expression_copy, expression);
+    return c == '+' || c == '-' || c == '*' || c == '/' || c == '~' || c == '^';
+}
 
-    preprocess_expression(expression_copy); // differentiate between unary and binary minus symbols.
+// stack of operator tokens for the shunting-yard algorithm, its depth is the nesting depth of the expression.
+typedef struct operator_stack
+{
+    token* tokens;
+    int count;
+    int capacity;
+} operator_stack;
 
-    // create the output queue.
-    queue queue;
-    queue_init(&queue);
+// push a token to the top of the stack.
+void operator_stack_push(operator_stack* stack, token operator)
+{
+    if (stack->count == stack->capacity)
+    {
+        stack->capacity = (stack->capacity > 0) ? stack->capacity * 2 : 64;
+        stack->tokens = (token*)realloc(stack->tokens, sizeof(token) * stack->capacity);
+    }
+    stack->tokens[stack->count++] = operator;
+}
 
-    // create the operator stack.
-    stack stack;
-    stack_init(&stack);
+// return the token at the top of the stack, or NULL if the stack is empty.
+token* operator_stack_peek(operator_stack* stack)
+{
+    return (stack->count > 0) ? &stack->tokens[stack->count - 1] : NULL;
+}
 
-    int offset = 0; // the current index into the expression string where we do lexical analysis.
+// moves a token to the output of the shunting-yard algorithm. the output is in reverse polish notation, so the
+// tree is built as it goes with a stack of nodes, and the operands of an operator or function are on top of it.
+// clears valid if the token is missing an operand.
+void parse_output(node_stack* nodes, token token, bool* valid)
+{
+    if (token.type == left_parenthesis)
+    {
+        return; // a left parenthesis without a right parenthesis is discarded.
+    }
+
+    tree_node* node = tree_node_create(token);
+    if (is_operator(token))
+    {
+        // for a unary operator, we make the node on top of the stack the right child of the operator node.
+        node->right_child = (nodes->count > 0) ? node_stack_pop(nodes) : NULL;
+        if (is_binary(token))
+        {
+            // if the token is a binary operator then the next node is the left child of the operator node.
+            node->left_child = (nodes->count > 0) ? node_stack_pop(nodes) : NULL;
+            *valid = *valid && node->left_child != NULL;
+        }
+        *valid = *valid && node->right_child != NULL; // an operator is missing its operands.
+    }
+    else if (is_function(token))
+    {
+        // if the token is a function then the node on top of the stack is its left child.
+        node->left_child = (nodes->count > 0) ? node_stack_pop(nodes) : NULL;
+        *valid = *valid && node->left_child != NULL; // a function is missing its argument.
+    }
+
+    node_stack_push(nodes, node);
+}
+
+// parses the text of the reader using the shunting-yard algorithm and produces an expression tree, as if the text
+// followed a binary operator whose left operand is left. the tree of the left operand becomes part of the result, or
+// is freed with the rest if the text isn't valid, and joint is set to the node of the operator. with no left operand,
+// the text is parsed on its own.
+// the expression ends at the end of the text or at the first character that can't start a token.
+// returns NULL if the text has no expression, or its parentheses, operators and operands don't form one tree.
+// https://en.wikipedia.org/wiki/Shunting-yard_algorithm
+tree_node* parse_reader_after(text_reader* reader, tree_node* left, token_type operator, tree_node** joint)
+{
+    operator_stack operators = { NULL, 0, 0 }; // the operator stack.
+    node_stack nodes; // the output, built into trees as it is produced.
+    node_stack_init(&nodes);
+
+    bool valid = true; // cleared when the tokens can't form an expression tree.
+    char previous = '\0'; // the last character of the previous token.
+    if (left != NULL)
+    {
+        token pending;
+        token_init(&pending, operator, '\0', 0);
+        node_stack_push(&nodes, left);
+        operator_stack_push(&operators, pending);
+        *joint = NULL;
+        previous = '+'; // a minus sign at the start of the text is unary, as it is after any operator.
+    }
 
     while (true)
     {
-        token* current_token = token_alloc();
-        peek_token(expression_copy, offset, current_token); // read the current token.
+        token current_token;
+        text_reader_next_token(reader);
+        pop_token(reader->window, &reader->offset, &current_token); // read the current token.
 
-        if (current_token->type == end)
+        if (current_token.type == end)
         {
             break; // there are no more tokens to read.
         }
-        else if (is_operand(*current_token))
+
+        if (current_token.type == subtraction && (previous == '\0' || previous == '(' || is_operator_symbol(previous)))
         {
-            // if the token is a number then push it to the output queue.
-            queue_enqueue(&queue, current_token);
+            // if the minus symbol is preceded by nothing, an open parenthesis or an operator then it is unary minus.
+            current_token.type = negation;
         }
-        else if (is_function(*current_token))
+        previous = reader->window[reader->offset - 1];
+
+        if (is_operand(current_token))
+        {
+            // if the token is a number then push it to the output.
+            parse_output(&nodes, current_token, &valid);
+        }
+        else if (is_function(current_token))
         {
             // if the token is a function then push it onto the operator stack.
-            stack_push(&stack, current_token);
+            operator_stack_push(&operators, current_token);
         }
-        else if (is_operator(*current_token))
+        else if (is_operator(current_token))
         {
-            token* top = stack_peek(&stack);
-            while (top != NULL && current_token->type != left_parenthesis &&
-                (is_function(*top) || precedence(top->type) > precedence(current_token->type) ||
-                    (precedence(top->type) == precedence(current_token->type) && is_left_associative(top->type))))
+            token* top = operator_stack_peek(&operators);
+            while (top != NULL &&
+                (is_function(*top) || precedence(top->type) > precedence(current_token.type) ||
+                    (precedence(top->type) == precedence(current_token.type) && is_left_associative(top->type))))
             {
-                // pop the operator from the operator stack and enqueue it on the output queue.
-                stack_pop(&stack);
-                queue_enqueue(&queue, top);
-                top = stack_peek(&stack);
+                // pop the operator from the operator stack to the output.
+                --operators.count;
+                parse_output(&nodes, *top, &valid);
+                top = operator_stack_peek(&operators);
+                if (top == NULL && left != NULL && *joint == NULL)
+                {
+                    *joint = nodes.nodes[nodes.count - 1]; // the operator given with left was at the bottom.
+                }
             }
 
             // if the token is an operator then push it onto the operator stack.
-            stack_push(&stack, current_token);
+            operator_stack_push(&operators, current_token);
         }
-        else if (current_token->type == left_parenthesis)
+        else if (current_token.type == left_parenthesis)
         {
             // if the token is a left parenthesis then push it onto the operator stack.
-            stack_push(&stack, current_token);
+            operator_stack_push(&operators, current_token);
         }
-        else if (current_token->type == right_parenthesis)
+        else if (current_token.type == right_parenthesis)
         {
-            token* top = stack_peek(&stack);
-            while (top->type != left_parenthesis)
+            token* top = operator_stack_peek(&operators);
+            while (top != NULL && top->type != left_parenthesis)
+            {
+                // pop the operator from the operator stack to the output.
+                --operators.count;
+                parse_output(&nodes, *top, &valid);
+                top = operator_stack_peek(&operators);
+            }
+            if (top != NULL)
             {
-                // pop the operator from the operator stack and enqueue it on the output queue.
-                stack_pop(&stack);
-                queue_enqueue(&queue, top);
-                top = stack_peek(&stack);
+                --operators.count; // pop the left parenthesis from the operator stack and discard it.
             }
-            if (top->type == left_parenthesis)
+            else
             {
-                // pop the operator from the operator stack and discard it.
-                stack_pop(&stack);
-                free(top);
+                valid = false; // the right parenthesis has no matching left parenthesis.
             }
         }
-
-        pop_token(expression_copy, &offset, current_token); // move to the next token.
     }
 
-    // pop any remaining operators from the operator stack and enqueue them on the output queue.
-    token* top = stack_peek(&stack);
-    while (top != NULL)
+    // pop any remaining operators from the operator stack to the output.
+    while (operators.count > 0)
     {
-        stack_pop(&stack);
-        queue_enqueue(&queue, top);
-        top = stack_peek(&stack);
+        parse_output(&nodes, operators.tokens[--operators.count], &valid);
+        if (operators.count == 0 && left != NULL && *joint == NULL)
+        {
+            *joint = nodes.nodes[nodes.count - 1];
+        }
     }
+    free(operators.tokens);
 
-    // the output queue is in reverse polish notation, so we can build an expression tree using a stack.
-    // the stack will now store tree nodes instead of tokens.
-    token* current_token = queue_dequeue(&queue);
-    while (current_token != NULL)
+    // the root of the expression tree will be the last node in the stack, any other nodes left on the stack are
+    // operands without an operator between them.
+    tree_node* root = (nodes.count > 0) ? node_stack_pop(&nodes) : NULL;
+    valid = valid && nodes.count == 0;
+    if (valid == false)
     {
-        if (is_operand(*current_token))
+        while (nodes.count > 0)
         {
-            // if the token is an operand then push it onto the stack.
-            tree_node* node = tree_node_create(*current_token);
-            stack_push(&stack, node);
+            tree_free(node_stack_pop(&nodes));
         }
-        else if (is_operator(*current_token))
-        {
-            tree_node* node = tree_node_create(*current_token); // create a new tree node for this operator.
+        tree_free(root);
+        root = NULL;
+    }
 
-            // if the token is an operator then we need to pop at least one node from the stack.
-            // for a unary operator, we make this node the right child of the operator node.
-            node->right_child = stack_peek(&stack);
-            stack_pop(&stack);
+    node_stack_free(&nodes);
+    return root;
+}
 
-            if (is_binary(*current_token))
-            {
-                // if the token is a binary operator then pop another node from the stack.
-                // make this node the the left child of the operator node.
-                node->left_child = stack_peek(&stack);
-                stack_pop(&stack);
-            }
+// parses the text of the reader on its own, like parse_reader_after with no left operand.
+tree_node* parse_reader(text_reader* reader)
+{
+    return parse_reader_after(reader, NULL, end, NULL);
+}
 
-            stack_push(&stack, node); // push this new node onto the stack.
-        }
-        else if (is_function(*current_token))
-        {
-            // if the token is a function then pop one node from the stack and make it its left child.
-            tree_node* node = tree_node_create(*current_token);
-            node->left_child = stack_peek(&stack);
-            stack_pop(&stack);
-            stack_push(&stack, node);
-        }
+// parses the expression string and produces an expression tree, or NULL if it isn't a valid expression.
+tree_node* parse_expression(const char* expression)
+{
+    text_reader reader;
+    text_reader_init_string(&reader, expression);
+    return parse_reader(&reader);
+}
+
+// parses an expression read from the file in chunks, so the text is never held in memory as a whole.
+// the file may be read past the end of the expression.
+tree_node* parse_expression_file(FILE* file)
+{
+    text_reader reader;
+    text_reader_init_chunked(&reader);
+    reader.file = file;
+    tree_node* root = parse_reader(&reader);
+    text_reader_free(&reader);
+    return root;
+}
+
+// parses an expression read from the file descriptor in chunks, like parse_expression_file.
+tree_node* parse_expression_fd(int fd)
+{
+    text_reader reader;
+    text_reader_init_chunked(&reader);
+    reader.fd = fd;
+    tree_node* root = parse_reader(&reader);
+    text_reader_free(&reader);
+    return root;
+}
 
-        free(current_token); // free the current token.
-        current_token = queue_dequeue(&queue); // read the next token in the output queue.
+// parses an expression from a file mapped into memory, which is copied to the reader's buffer a chunk at a time, so
+// the pages of the file can be dropped from memory once they are read. returns NULL if the file can't be mapped.
+tree_node* parse_expression_mapped(const char* path)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        return NULL;
     }
 
-    tree_node* root = stack_peek(&stack); // the root of the expression tree will be the last node in the stack.
-    stack_pop(&stack);
+    struct stat status;
+    if (fstat(fd, &status) != 0 || status.st_size == 0)
+    {
+        close(fd);
+        return NULL;
+    }
+
+    void* mapped = mmap(NULL, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED)
+    {
+        return NULL;
+    }
+    madvise(mapped, status.st_size, MADV_SEQUENTIAL);
 
-    // the stack and queue must be empty at this point, so we don't need to free their nodes.
-    free(expression_copy);
+    text_reader reader;
+    text_reader_init_chunked(&reader);
+    reader.mapped = (const char*)mapped;
+    reader.mapped_size = status.st_size;
+    tree_node* root = parse_reader(&reader);
+    text_reader_free(&reader);
+    munmap(mapped, status.st_size);
     return root;
 }
 
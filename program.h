@@ -0,0 +1,362 @@
+#ifndef COURSEWORK_PROGRAM_H
+#define COURSEWORK_PROGRAM_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+
+#include "tree.h"
+#include "tree_hash.h"
+#include "list.h"
+#include "variables.h"
+
+// instruction of a compiled expression, instruction i writes its result to register i.
+typedef struct instruction
+{
+    token_type type; // operation performed by the instruction.
+    int left; // register of the left operand, unary operators and functions also store their operand here.
+    int right; // register of the right operand of a binary operator.
+    int slot; // binding slot read by a variable.
+    int partner; // register of a cosine computed together with this sine, or the other way round, or -1.
+    double value; // value of a constant.
+} instruction;
+
+// an expression tree flattened into a post-order list of instructions.
+// a program never modifies itself while running, so it can be shared between threads.
+typedef struct program
+{
+    instruction* code; // instructions in post-order, so operands are always computed first.
+    int length; // number of instructions, which is also the number of registers needed to run the program.
+    int capacity; // number of instructions allocated.
+    char* symbols; // variable symbol bound to each binding slot.
+    int slot_count; // number of binding slots.
+    int* outputs; // register holding the result of each compiled expression tree.
+    int output_count; // number of compiled expression trees.
+    int eliminated; // number of tree nodes that reused the register of an identical subexpression.
+    int* lookup; // hash table of the registers, used to find an identical instruction before emitting a new one.
+    int lookup_size; // number of buckets in the hash table, a power of two.
+} program;
+
+// allocate memory for a program on the heap.
+program* program_alloc()
+{
+    return (program*)malloc(sizeof(program));
+}
+
+// initialise an empty program.
+void program_init(program* program)
+{
+    program->code = NULL;
+    program->length = 0;
+    program->capacity = 0;
+    program->symbols = NULL;
+    program->slot_count = 0;
+    program->outputs = NULL;
+    program->output_count = 0;
+    program->eliminated = 0;
+    program->lookup = NULL;
+    program->lookup_size = 0;
+}
+
+// free memory for the program.
+void program_free(program* program)
+{
+    if (program != NULL)
+    {
+        free(program->code);
+        free(program->symbols);
+        free(program->outputs);
+        free(program->lookup);
+        free(program);
+    }
+}
+
+// returns the binding slot of a variable, or -1 if the variable is not bound.
+int program_find_slot(program* program, char symbol)
+{
+    for (int slot = 0; slot < program->slot_count; ++slot)
+    {
+        if (program->symbols[slot] == symbol)
+        {
+            return slot;
+        }
+    }
+
+    return -1;
+}
+
+// returns the operands of an instruction as value numbers, ordered for commutative operators so x * y matches y * x.
+// with no numbers, each register is its own value number.
+void instruction_operand_numbers(const instruction* instruction, const int* numbers, int* left, int* right)
+{
+    *left = (instruction->left >= 0 && numbers != NULL) ? numbers[instruction->left] : instruction->left;
+    *right = (instruction->right >= 0 && numbers != NULL) ? numbers[instruction->right] : instruction->right;
+    if ((instruction->type == addition || instruction->type == multiplication) && *left > *right)
+    {
+        int swap = *left;
+        *left = *right;
+        *right = swap;
+    }
+}
+
+// hashes an instruction by its operation and the value numbers of its operands.
+uint64_t instruction_hash(const instruction* instruction, const int* numbers)
+{
+    int left, right;
+    instruction_operand_numbers(instruction, numbers, &left, &right);
+
+    uint64_t hash = hash_combine(0, (uint64_t)instruction->type);
+    hash = hash_combine(hash, (uint64_t)(int64_t)left);
+    hash = hash_combine(hash, (uint64_t)(int64_t)right);
+    hash = hash_combine(hash, (uint64_t)(int64_t)instruction->slot);
+    if (instruction->type == constant)
+    {
+        uint64_t bits;
+        memcpy(&bits, &instruction->value, sizeof(bits));
+        hash = hash_combine(hash, bits);
+    }
+
+    return hash;
+}
+
+// do two instructions always compute the same value? constants are compared by their bits, like token_equal.
+bool instruction_same(const instruction* a, const instruction* b, const int* numbers)
+{
+    int a_left, a_right, b_left, b_right;
+    instruction_operand_numbers(a, numbers, &a_left, &a_right);
+    instruction_operand_numbers(b, numbers, &b_left, &b_right);
+
+    return a->type == b->type && a_left == b_left && a_right == b_right && a->slot == b->slot &&
+           (a->type != constant || memcmp(&a->value, &b->value, sizeof(double)) == 0);
+}
+
+// returns the bucket of the hash table holding an instruction identical to the given one, or the empty bucket
+// where it belongs.
+int program_lookup(const program* program, const instruction* instruction)
+{
+    int mask = program->lookup_size - 1;
+    int bucket = (int)(instruction_hash(instruction, NULL) & (uint64_t)mask);
+    while (program->lookup[bucket] >= 0 && instruction_same(&program->code[program->lookup[bucket]], instruction, NULL) == false)
+    {
+        bucket = (bucket + 1) & mask; // linear probing.
+    }
+
+    return bucket;
+}
+
+// appends an instruction to the program and returns the register it writes to.
+// an instruction identical to one already in the program isn't appended, the existing register is returned instead,
+// so each distinct subexpression is only computed once.
+int program_emit(program* program, instruction instruction)
+{
+    // keep the hash table at most half full, rebuilding it from the registers when it grows.
+    if (2 * (program->length + 1) > program->lookup_size)
+    {
+        program->lookup_size = (program->lookup_size == 0) ? 32 : program->lookup_size * 2;
+        while (2 * (program->length + 1) > program->lookup_size)
+        {
+            program->lookup_size *= 2;
+        }
+        program->lookup = (int*)realloc(program->lookup, sizeof(int) * program->lookup_size);
+        for (int i = 0; i < program->lookup_size; ++i)
+        {
+            program->lookup[i] = -1;
+        }
+        for (int i = 0; i < program->length; ++i)
+        {
+            program->lookup[program_lookup(program, &program->code[i])] = i;
+        }
+    }
+
+    int bucket = program_lookup(program, &instruction);
+    if (program->lookup[bucket] >= 0)
+    {
+        ++program->eliminated;
+        return program->lookup[bucket];
+    }
+
+    if (program->length == program->capacity)
+    {
+        program->capacity = (program->capacity == 0) ? 16 : program->capacity * 2;
+        program->code = (struct instruction*)realloc(program->code, sizeof(struct instruction) * program->capacity);
+    }
+
+    program->code[program->length] = instruction;
+    program->lookup[bucket] = program->length;
+    return program->length++;
+}
+
+// traverses the expression tree and emits an instruction for each node, returns the register of the root.
+int program_compile_tree(program* program, tree_node* root)
+{
+    // post-order traverse the tree, so both operands are emitted before their operator.
+    // the registers of the operands are kept on a stack, with the right operand on top.
+    node_stack order;
+    node_stack_init(&order);
+    tree_postorder(root, &order);
+
+    int* registers = (int*)malloc(sizeof(int) * (order.count + 1));
+    int count = 0;
+    for (int i = 0; i < order.count; ++i)
+    {
+        tree_node* node = order.nodes[i];
+        int right = (node->right_child != NULL) ? registers[--count] : -1;
+        int left = (node->left_child != NULL) ? registers[--count] : -1;
+
+        instruction instruction;
+        instruction.type = node->token.type;
+        instruction.left = -1;
+        instruction.right = -1;
+        instruction.slot = -1;
+        instruction.partner = -1;
+        instruction.value = node->token.value;
+
+        if (node->token.type == variable)
+        {
+            instruction.slot = program_find_slot(program, node->token.symbol);
+            if (instruction.slot < 0)
+            {
+                // an unbound variable keeps the value stored in its token, just like evaluate.
+                instruction.type = constant;
+            }
+        }
+        else if (is_unary(node->token))
+        {
+            instruction.left = right; // the operand of a unary operator.
+        }
+        else if (is_function(node->token))
+        {
+            instruction.left = left; // the argument of a function.
+        }
+        else if (is_operator(node->token))
+        {
+            instruction.left = left;
+            instruction.right = right;
+        }
+
+        registers[count++] = program_emit(program, instruction);
+    }
+
+    int result = registers[0];
+    free(registers);
+    node_stack_free(&order);
+    return result;
+}
+
+// compiles several expression trees into one program, binding a slot to each variable in the variables list.
+program* program_compile_many(tree_node** roots, int root_count, list* variables)
+{
+    program* program = program_alloc();
+    program_init(program);
+
+    // bind a slot to each variable in the same order as the variables list.
+    program->slot_count = list_length(variables);
+    program->symbols = (char*)malloc(sizeof(char) * (program->slot_count + 1));
+    int slot = 0;
+    for (list_node* item = variables->first; item != NULL; item = item->next)
+    {
+        variable_value* pair = item->payload;
+        program->symbols[slot++] = pair->symbol;
+    }
+
+    program->output_count = root_count;
+    program->outputs = (int*)malloc(sizeof(int) * (root_count + 1));
+    for (int i = 0; i < root_count; ++i)
+    {
+        program->outputs[i] = program_compile_tree(program, roots[i]);
+    }
+
+    return program;
+}
+
+// compiles an expression tree into a program, binding a slot to each variable in the variables list.
+program* program_compile(tree_node* root, list* variables)
+{
+    return program_compile_many(&root, 1, variables);
+}
+
+// computes a single instruction from the registers of its operands.
+double instruction_compute(const instruction* instruction, const double* registers, const double* slots)
+{
+    double left = (instruction->left >= 0) ? registers[instruction->left] : 0;
+    double right = (instruction->right >= 0) ? registers[instruction->right] : 0;
+
+    switch (instruction->type)
+    {
+        case addition: return left + right;
+        case subtraction: return left - right;
+        case multiplication: return left * right;
+        case division: return left / right;
+        case power: return pow(left, right);
+        case negation: return -left;
+        case squareroot: return sqrt(left);
+        case log_10: return log10(left);
+        case log_e: return log(left);
+        case sine: return sin(left);
+        case cosine: return cos(left);
+        case tangent: return tan(left);
+        case constant: return instruction->value;
+        case variable: return slots[instruction->slot];
+        default: return 0; // not a valid token type.
+    }
+}
+
+// runs the program on one set of slot values and writes the result of each compiled tree to results.
+// registers must have room for program->length values.
+void program_run(const program* program, const double* slots, double* registers, double* results)
+{
+    for (int i = 0; i < program->length; ++i)
+    {
+        const instruction* instruction = &program->code[i];
+        switch (instruction->type)
+        {
+            case addition: registers[i] = registers[instruction->left] + registers[instruction->right]; break;
+            case subtraction: registers[i] = registers[instruction->left] - registers[instruction->right]; break;
+            case multiplication: registers[i] = registers[instruction->left] * registers[instruction->right]; break;
+            case division: registers[i] = registers[instruction->left] / registers[instruction->right]; break;
+            case power: registers[i] = pow(registers[instruction->left], registers[instruction->right]); break;
+            case negation: registers[i] = -registers[instruction->left]; break;
+            case squareroot: registers[i] = sqrt(registers[instruction->left]); break;
+            case log_10: registers[i] = log10(registers[instruction->left]); break;
+            case log_e: registers[i] = log(registers[instruction->left]); break;
+            case sine:
+            case cosine:
+                if (instruction->partner < 0)
+                {
+                    registers[i] = (instruction->type == sine) ? sin(registers[instruction->left]) : cos(registers[instruction->left]);
+                }
+                else if (instruction->partner > i)
+                {
+                    // the first of a sine and cosine of the same argument computes both, with one sincos call
+                    // where the compiler and C library support it. the second has nothing left to do.
+                    double argument = registers[instruction->left];
+                    double sine_value = sin(argument);
+                    double cosine_value = cos(argument);
+                    registers[(instruction->type == sine) ? i : instruction->partner] = sine_value;
+                    registers[(instruction->type == sine) ? instruction->partner : i] = cosine_value;
+                }
+                break;
+            case tangent: registers[i] = tan(registers[instruction->left]); break;
+            case constant: registers[i] = instruction->value; break;
+            case variable: registers[i] = slots[instruction->slot]; break;
+            default: registers[i] = 0; break; // not a valid token type.
+        }
+    }
+
+    for (int i = 0; i < program->output_count; ++i)
+    {
+        results[i] = registers[program->outputs[i]];
+    }
+}
+
+// runs a program with a single compiled tree and returns its result.
+double program_evaluate(const program* program, const double* slots, double* registers)
+{
+    double result;
+    program_run(program, slots, registers, &result);
+    return result;
+}
+
+#endif //COURSEWORK_PROGRAM_H
@@ -0,0 +1,744 @@
+#ifndef COURSEWORK_PROGRAM_BENCHMARK_H
+#define COURSEWORK_PROGRAM_BENCHMARK_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "expression.h"
+#include "evaluator.h"
+#include "batch_evaluator.h"
+#include "incremental_evaluator.h"
+#include "grid_evaluator.h"
+#include "interval.h"
+#include "chebyshev.h"
+#include "float_evaluator.h"
+#include "rebalance.h"
+#include "parse_benchmark.h"
+
+// the expression the program benchmarks compile, a few terms of the kinds parse_benchmark_generate writes.
+#define PROGRAM_BENCHMARK_TEXT "sin(x * 1.25 + y) * 2.5 + (z / 3.75) ^ 2 - sqrt(x ^ 2 + y ^ 2 + z ^ 2) + cos(0.5 * x) / (1 + y ^ 2)"
+
+// fills each row of slot values with a varied point, the same for every run of a benchmark.
+void program_benchmark_rows(double* rows, int row_count, int slot_count)
+{
+    for (int row = 0; row < row_count; ++row)
+    {
+        for (int slot = 0; slot < slot_count; ++slot)
+        {
+            rows[(size_t)row * slot_count + slot] = 0.5 + 0.001 * (row % 997) + 0.25 * slot;
+        }
+    }
+}
+
+// evaluates the expression and its partial derivatives for each row, first with program_run in a loop and then with
+// batch_evaluate on 1, 2, 4 and so on up to most_threads workers, and prints the time and speedup of each.
+// returns the number of batch evaluations whose results differ from the loop.
+int batch_scaling_benchmark(int row_count, int most_threads)
+{
+    compiled_expression* expression = compiled_expression_create(PROGRAM_BENCHMARK_TEXT);
+    const program* program = expression->program;
+    double* rows = (double*)malloc(sizeof(double) * (size_t)row_count * program->slot_count);
+    double* expected = (double*)malloc(sizeof(double) * (size_t)row_count * program->output_count);
+    double* results = (double*)malloc(sizeof(double) * (size_t)row_count * program->output_count);
+    double* registers = (double*)malloc(sizeof(double) * (program->length + 1));
+    program_benchmark_rows(rows, row_count, program->slot_count);
+
+    double start = parse_benchmark_seconds();
+    for (int row = 0; row < row_count; ++row)
+    {
+        program_run(program, rows + (size_t)row * program->slot_count, registers,
+                    expected + (size_t)row * program->output_count);
+    }
+    double serial_seconds = parse_benchmark_seconds() - start;
+
+    printf("%-12s%12s%12s\n", "threads", "Mrows/s", "speedup");
+    printf("%-12s%12.2f%12.2f\n", "serial", row_count / serial_seconds / 1e6, 1.0);
+    int failures = 0;
+    for (int threads = 1; threads <= most_threads; threads *= 2)
+    {
+        thread_pool* pool = thread_pool_create(threads);
+        memset(results, 0, sizeof(double) * (size_t)row_count * program->output_count);
+        start = parse_benchmark_seconds();
+        batch_evaluate(pool, program, rows, row_count, results);
+        double seconds = parse_benchmark_seconds() - start;
+        thread_pool_free(pool);
+
+        printf("%-12d%12.2f%12.2f\n", threads, row_count / seconds / 1e6, serial_seconds / seconds);
+        failures += (memcmp(results, expected, sizeof(double) * (size_t)row_count * program->output_count) == 0) ? 0 : 1;
+    }
+
+    printf("%d rows, %d instructions, %d processors\n", row_count, program->length, processor_count());
+    free(rows);
+    free(expected);
+    free(results);
+    free(registers);
+    compiled_expression_free(expression);
+    return failures;
+}
+
+// writes a sum of a few terms in each of the given number of variables, a, b, c, d, f and so on, so a change to one
+// variable leaves most of the expression and its partial derivatives as they were.
+char* program_benchmark_separable(int variable_count)
+{
+    char* text = NULL;
+    size_t size = 0;
+    FILE* file = open_memstream(&text, &size);
+    for (int v = 0; v < variable_count; ++v)
+    {
+        char name = (char)('a' + v + (v >= 4)); // e is the constant, not a variable.
+        for (int term = 1; term <= 4; ++term)
+        {
+            fprintf(file, "%ssin(%c * %d.25) * %c ^ 2 / (1 + %c * %d)", (v == 0 && term == 1) ? "" : " + ", name, term,
+                    name, name, term);
+        }
+    }
+    fclose(file);
+    return text;
+}
+
+// changes one variable of a separable expression at a time and computes the expression and its partial derivatives
+// after each change, first with an incremental evaluator and then with program_run, and prints the time of each.
+// returns the number of updates whose results differ from program_run.
+int incremental_benchmark(int update_count, int variable_count)
+{
+    variable_count = (variable_count < 1) ? 1 : (variable_count > 25) ? 25 : variable_count;
+    char* text = program_benchmark_separable(variable_count);
+    compiled_expression* expression = compiled_expression_create(text);
+    free(text);
+    const program* program = expression->program;
+    int outputs = program->output_count;
+    double* slots = (double*)malloc(sizeof(double) * (program->slot_count + 1));
+    double* expected = (double*)malloc(sizeof(double) * (size_t)update_count * outputs);
+    double* results = (double*)malloc(sizeof(double) * (size_t)update_count * outputs);
+    double* registers = (double*)malloc(sizeof(double) * (program->length + 1));
+
+    program_benchmark_rows(slots, 1, program->slot_count);
+    incremental_evaluator* evaluator = incremental_evaluator_create(program, slots);
+    long long recomputed = 0;
+    double start = parse_benchmark_seconds();
+    for (int update = 0; update < update_count; ++update)
+    {
+        incremental_evaluator_set(evaluator, update % program->slot_count, 0.5 + 0.001 * (update % 997));
+        incremental_evaluator_update(evaluator, results + (size_t)update * outputs);
+        recomputed += evaluator->last_update_count;
+    }
+    double incremental_seconds = parse_benchmark_seconds() - start;
+    incremental_evaluator_free(evaluator);
+
+    start = parse_benchmark_seconds();
+    for (int update = 0; update < update_count; ++update)
+    {
+        slots[update % program->slot_count] = 0.5 + 0.001 * (update % 997);
+        program_run(program, slots, registers, expected + (size_t)update * outputs);
+    }
+    double run_seconds = parse_benchmark_seconds() - start;
+
+    int failures = 0;
+    for (int update = 0; update < update_count; ++update)
+    {
+        size_t offset = (size_t)update * outputs;
+        failures += (memcmp(results + offset, expected + offset, sizeof(double) * outputs) == 0) ? 0 : 1;
+    }
+
+    printf("%d updates of one of %d variables, %d instructions, %.1f recomputed on average\n", update_count,
+           program->slot_count, program->length, (double)recomputed / (update_count > 0 ? update_count : 1));
+    printf("%-14s%12s%12s\n", "evaluator", "ns/update", "speedup");
+    printf("%-14s%12.0f%12.2f\n", "program_run", run_seconds / update_count * 1e9, 1.0);
+    printf("%-14s%12.0f%12.2f\n", "incremental", incremental_seconds / update_count * 1e9,
+           run_seconds / incremental_seconds);
+    free(slots);
+    free(expected);
+    free(results);
+    free(registers);
+    compiled_expression_free(expression);
+    return failures;
+}
+
+// the expression of the two dimensional grid benchmark, in x and y.
+#define PROGRAM_BENCHMARK_PLANE "sin(x * 1.25) * cos(y) + x ^ 2 / (1 + y ^ 2) + sqrt(x ^ 2 + 1) * log(2 + y)"
+
+// evaluates an expression over a grid with grid_evaluate and then with program_run at each point in the same order,
+// and prints the time of each. returns 1 if the results differ, or if grid_evaluate rejects the axes.
+int grid_benchmark_sweep(const char* name, const char* text, const grid_axis* axes, int axis_count)
+{
+    compiled_expression* expression = compiled_expression_create(text);
+    program* program = expression->program;
+    long long point_count = 1;
+    for (int level = 0; level < axis_count; ++level)
+    {
+        point_count *= axes[level].count;
+    }
+    double* expected = (double*)malloc(sizeof(double) * (size_t)point_count * program->output_count);
+    double* results = (double*)malloc(sizeof(double) * (size_t)point_count * program->output_count);
+    double* registers = (double*)malloc(sizeof(double) * (program->length + 1));
+    double* slots = (double*)calloc(program->slot_count + 1, sizeof(double));
+    int* axis_slots = (int*)malloc(sizeof(int) * (axis_count + 1));
+    for (int level = 0; level < axis_count; ++level)
+    {
+        axis_slots[level] = program_find_slot(program, axes[level].symbol);
+    }
+
+    double start = parse_benchmark_seconds();
+    bool complete = grid_evaluate(program, axes, axis_count, results);
+    double grid_seconds = parse_benchmark_seconds() - start;
+
+    // the same points with the last axis varying fastest, setting every slot at each point.
+    start = parse_benchmark_seconds();
+    for (long long point = 0; point < point_count; ++point)
+    {
+        long long rest = point;
+        for (int level = axis_count - 1; level >= 0; --level)
+        {
+            if (axis_slots[level] >= 0)
+            {
+                slots[axis_slots[level]] = grid_axis_value(&axes[level], (int)(rest % axes[level].count));
+            }
+            rest /= axes[level].count;
+        }
+        program_run(program, slots, registers, expected + (size_t)point * program->output_count);
+    }
+    double run_seconds = parse_benchmark_seconds() - start;
+
+    bool same = complete && memcmp(results, expected, sizeof(double) * (size_t)point_count * program->output_count) == 0;
+    printf("%-8s%12lld%14d%12.1f%12.1f%10.2f%8s\n", name, point_count, program->length,
+           run_seconds / point_count * 1e9, grid_seconds / point_count * 1e9, run_seconds / grid_seconds,
+           same ? "yes" : "no");
+    free(expected);
+    free(results);
+    free(registers);
+    free(slots);
+    free(axis_slots);
+    compiled_expression_free(expression);
+    return same ? 0 : 1;
+}
+
+// sweeps a two dimensional and a three dimensional grid of about the given number of points each, comparing
+// grid_evaluate with a program_run loop. returns the number of grids whose results differ.
+int grid_benchmark(int point_count)
+{
+    int side = 1;
+    while ((long long)(side + 1) * (side + 1) <= point_count)
+    {
+        ++side;
+    }
+    grid_axis plane[2] = { { 'x', -2, 2, side }, { 'y', 0, 3, side } };
+
+    int edge = 1;
+    while ((long long)(edge + 1) * (edge + 1) * (edge + 1) <= point_count)
+    {
+        ++edge;
+    }
+    grid_axis box[3] = { { 'x', -2, 2, edge }, { 'y', 0, 3, edge }, { 'z', 0.5, 1.5, edge } };
+
+    printf("%-8s%12s%14s%12s%12s%10s%8s\n", "grid", "points", "instructions", "run ns/pt", "grid ns/pt", "speedup",
+           "same");
+    int failures = grid_benchmark_sweep("2-D", PROGRAM_BENCHMARK_PLANE, plane, 2);
+    failures += grid_benchmark_sweep("3-D", PROGRAM_BENCHMARK_TEXT, box, 3);
+    return failures;
+}
+
+// searches the box where every variable of the expression lies between lower and upper for regions where the
+// expression may be zero, and prints the boxes found, the interval evaluations they took and the points that
+// sampling the box at the same resolution would evaluate. returns the number of boxes found.
+int find_zeros_report(const char* text, double lower, double upper, double min_width)
+{
+    compiled_expression* expression = compiled_expression_create(text);
+    const program* program = expression->program;
+    interval* domain = (interval*)malloc(sizeof(interval) * (program->slot_count + 1));
+    for (int slot = 0; slot < program->slot_count; ++slot)
+    {
+        domain[slot] = interval_create(lower, upper);
+    }
+
+    double start = parse_benchmark_seconds();
+    subdivision zeros = interval_find_zeros(program, 0, domain, min_width);
+    double seconds = parse_benchmark_seconds() - start;
+
+    for (int box = 0; box < zeros.box_count && box < 8; ++box)
+    {
+        for (int slot = 0; slot < program->slot_count; ++slot)
+        {
+            const interval* side = &zeros.boxes[box * program->slot_count + slot];
+            printf("%s%c in [%.6g, %.6g]", (slot == 0) ? "" : ", ", program->symbols[slot], side->lower, side->upper);
+        }
+        printf("\n");
+    }
+    if (zeros.box_count > 8)
+    {
+        printf("... and %d more boxes\n", zeros.box_count - 8);
+    }
+    printf("%d boxes of width %g where the expression may be zero, in %.3f ms\n", zeros.box_count, min_width,
+           seconds * 1e3);
+    printf("%lld interval evaluations, against %.0f sampled points at the same resolution\n", zeros.evaluations,
+           zeros.sampled_points);
+
+    int box_count = zeros.box_count;
+    subdivision_free(&zeros);
+    free(domain);
+    compiled_expression_free(expression);
+    return box_count;
+}
+
+// fits a chebyshev surrogate of the two dimensional benchmark expression to a tolerance, then evaluates the surrogate
+// and the program of the expression alone at the same points, and prints the time of each and the largest error
+// found. returns 1 if the error at the points is above the max_error the fit reported, which is only an estimate.
+int chebyshev_benchmark(int degree, double tolerance, int point_count)
+{
+    compiled_expression* expression = compiled_expression_create(PROGRAM_BENCHMARK_PLANE);
+    program* program = program_compile(expression->root, &expression->variables); // the value, without partials.
+    double lower[2] = { -2, 0 };
+    double upper[2] = { 2, 3 };
+
+    double start = parse_benchmark_seconds();
+    chebyshev_surrogate* surrogate = chebyshev_fit(program, 0, lower, upper, degree, tolerance, 24);
+    double fit_seconds = parse_benchmark_seconds() - start;
+
+    double* points = (double*)malloc(sizeof(double) * 2 * (size_t)point_count);
+    double* expected = (double*)malloc(sizeof(double) * (size_t)point_count);
+    double* values = (double*)malloc(sizeof(double) * (size_t)point_count);
+    double* registers = (double*)malloc(sizeof(double) * (program->length + 1));
+    double* polynomials = (double*)malloc(sizeof(double) * (degree + 1));
+    double* buffer = (double*)malloc(sizeof(double) * (degree + 1));
+    for (int i = 0; i < point_count; ++i)
+    {
+        // a low discrepancy sequence, so the points cover the box evenly without lining up with the pieces.
+        points[2 * i] = lower[0] + (upper[0] - lower[0]) * fmod(0.5 + i * 0.7548776662466927, 1);
+        points[2 * i + 1] = lower[1] + (upper[1] - lower[1]) * fmod(0.5 + i * 0.5698402909980532, 1);
+    }
+
+    start = parse_benchmark_seconds();
+    for (int i = 0; i < point_count; ++i)
+    {
+        expected[i] = program_evaluate(program, points + 2 * i, registers);
+    }
+    double run_seconds = parse_benchmark_seconds() - start;
+
+    start = parse_benchmark_seconds();
+    for (int i = 0; i < point_count; ++i)
+    {
+        values[i] = chebyshev_evaluate(surrogate, points + 2 * i, polynomials, buffer);
+    }
+    double surrogate_seconds = parse_benchmark_seconds() - start;
+
+    double error = 0;
+    for (int i = 0; i < point_count; ++i)
+    {
+        error = fmax(error, fabs(values[i] - expected[i]));
+    }
+
+    printf("degree %d, tolerance %g: %d leaves fitted in %.1f ms, max_error %.3g, largest error at %d points %.3g\n",
+           degree, tolerance, surrogate->leaf_count, fit_seconds * 1e3, surrogate->max_error, point_count, error);
+    printf("%-12s%12s%12s\n", "evaluator", "ns/point", "speedup");
+    printf("%-12s%12.1f%12.2f\n", "program", run_seconds / point_count * 1e9, 1.0);
+    printf("%-12s%12.1f%12.2f\n", "chebyshev", surrogate_seconds / point_count * 1e9, run_seconds / surrogate_seconds);
+
+    // the fit checks each leaf on a grid rather than everywhere, so allow a little over its estimate.
+    int failures = (error <= 2 * fmax(surrogate->max_error, tolerance)) ? 0 : 1;
+    free(points);
+    free(expected);
+    free(values);
+    free(registers);
+    free(polynomials);
+    free(buffer);
+    chebyshev_free(surrogate);
+    program_free(program);
+    compiled_expression_free(expression);
+    return failures;
+}
+
+// evaluates an expression and its partial derivatives for each row at each accuracy, and prints the rate of each and
+// its largest relative error against the exact tier. returns 1 if the exact tier differs from program_run.
+int accuracy_benchmark_expression(const char* name, const char* text, int row_count)
+{
+    static const char* names[] = { "exact", "fast" };
+    compiled_expression* expression = compiled_expression_create(text);
+    const program* program = expression->program;
+    size_t result_count = (size_t)row_count * program->output_count;
+    double* rows = (double*)malloc(sizeof(double) * (size_t)row_count * program->slot_count);
+    double* expected = (double*)malloc(sizeof(double) * result_count);
+    double* results = (double*)malloc(sizeof(double) * result_count);
+    double* registers = (double*)malloc(sizeof(double) * (program->length + 1));
+    program_benchmark_rows(rows, row_count, program->slot_count);
+    for (int row = 0; row < row_count; ++row)
+    {
+        program_run(program, rows + (size_t)row * program->slot_count, registers,
+                    expected + (size_t)row * program->output_count);
+    }
+
+    int failures = 0;
+    double exact_seconds = 0;
+    for (int tier = accuracy_exact; tier <= accuracy_fast; ++tier)
+    {
+        double start = parse_benchmark_seconds();
+        for (int row = 0; row < row_count; ++row)
+        {
+            program_run_accuracy(program, (accuracy)tier, rows + (size_t)row * program->slot_count, registers,
+                                 results + (size_t)row * program->output_count);
+        }
+        double seconds = parse_benchmark_seconds() - start;
+        exact_seconds = (tier == accuracy_exact) ? seconds : exact_seconds;
+
+        double error = 0;
+        for (size_t i = 0; i < result_count; ++i)
+        {
+            double scale = fmax(fabs(expected[i]), 1e-300);
+            error = fmax(error, fabs(results[i] - expected[i]) / scale);
+        }
+        if (tier == accuracy_exact)
+        {
+            failures += (memcmp(results, expected, sizeof(double) * result_count) == 0) ? 0 : 1;
+        }
+        printf("%-10s%-8s%12.2f%12.2f%16.3g\n", name, names[tier], row_count / seconds / 1e6, exact_seconds / seconds,
+               error);
+    }
+
+    free(rows);
+    free(expected);
+    free(results);
+    free(registers);
+    compiled_expression_free(expression);
+    return failures;
+}
+
+// measures each accuracy of the transcendental functions on whole programs, for two benchmark expressions.
+int accuracy_benchmark(int row_count)
+{
+    printf("%-10s%-8s%12s%12s%16s\n", "program", "tier", "Mrows/s", "speedup", "max relative");
+    int failures = accuracy_benchmark_expression("3-D", PROGRAM_BENCHMARK_TEXT, row_count);
+    failures += accuracy_benchmark_expression("2-D", PROGRAM_BENCHMARK_PLANE, row_count);
+    return failures;
+}
+
+// evaluates an expression and its partial derivatives for each row in double precision with batch_evaluate, then in
+// single precision and in single precision with double precision sums with batch_evaluate_float, all on the pool, and
+// prints the rate of each with its largest error against double precision and the error float_analyse estimated.
+// the single precision rows are the double precision rows rounded, and the double precision results are for the
+// rounded rows, so the errors come from evaluation alone. returns the number of rows whose batch results differ from
+// running program_run_float or program_run_mixed on the row alone.
+int float_benchmark_expression(thread_pool* pool, const char* name, const char* text, int row_count)
+{
+    compiled_expression* expression = compiled_expression_create(text);
+    const program* program = expression->program;
+    int slot_count = program->slot_count;
+    int outputs = program->output_count;
+    double* rows = (double*)malloc(sizeof(double) * (size_t)row_count * slot_count);
+    float* float_rows = (float*)malloc(sizeof(float) * (size_t)row_count * slot_count);
+    double* expected = (double*)malloc(sizeof(double) * (size_t)row_count * outputs);
+    float* results = (float*)malloc(sizeof(float) * (size_t)row_count * outputs);
+    double* registers = (double*)malloc(sizeof(double) * (program->length + 1));
+    float* float_registers = (float*)malloc(sizeof(float) * (program->length + 1));
+    float* row_results = (float*)malloc(sizeof(float) * (outputs + 1));
+    double* lower = (double*)malloc(sizeof(double) * (slot_count + 1));
+    double* upper = (double*)malloc(sizeof(double) * (slot_count + 1));
+    program_benchmark_rows(rows, row_count, slot_count);
+    for (size_t i = 0; i < (size_t)row_count * slot_count; ++i)
+    {
+        float_rows[i] = (float)rows[i];
+        rows[i] = float_rows[i];
+    }
+    for (int slot = 0; slot < slot_count; ++slot)
+    {
+        lower[slot] = 0.5 + 0.25 * slot; // the range program_benchmark_rows fills each slot from.
+        upper[slot] = lower[slot] + 0.996;
+    }
+
+    double start = parse_benchmark_seconds();
+    batch_evaluate(pool, program, rows, row_count, expected);
+    double double_seconds = parse_benchmark_seconds() - start;
+    printf("%-8s%-10s%12.2f%10.2f%14s%14s\n", name, "double", row_count / double_seconds / 1e6, 1.0, "", "");
+
+    int failures = 0;
+    for (int mixed = 0; mixed <= 1; ++mixed)
+    {
+        start = parse_benchmark_seconds();
+        batch_evaluate_float(pool, program, float_rows, row_count, results, mixed);
+        double seconds = parse_benchmark_seconds() - start;
+
+        // the pool must give each row exactly what running it alone gives.
+        for (int row = 0; row < row_count; ++row)
+        {
+            const float* slots = float_rows + (size_t)row * slot_count;
+            if (mixed)
+            {
+                program_run_mixed(program, slots, registers, row_results);
+            }
+            else
+            {
+                program_run_float(program, slots, float_registers, row_results);
+            }
+            failures += (memcmp(row_results, results + (size_t)row * outputs, sizeof(float) * outputs) == 0) ? 0 : 1;
+        }
+
+        // the error of each output relative to its largest magnitude, as float_analyse estimates it.
+        float_analysis* analysis = float_analyse(program, lower, upper, mixed);
+        double error = 0;
+        double estimate = 0;
+        for (int output = 0; output < outputs; ++output)
+        {
+            double largest = 0;
+            double difference = 0;
+            for (int row = 0; row < row_count; ++row)
+            {
+                double value = expected[(size_t)row * outputs + output];
+                largest = fmax(largest, fabs(value));
+                difference = fmax(difference, fabs(results[(size_t)row * outputs + output] - value));
+            }
+            error = fmax(error, (largest > 0) ? difference / largest : 0);
+            estimate = fmax(estimate, analysis->relative_error[output]);
+        }
+        float_analysis_free(analysis);
+        printf("%-8s%-10s%12.2f%10.2f%14.3g%14.3g\n", name, mixed ? "mixed" : "float", row_count / seconds / 1e6,
+               double_seconds / seconds, error, estimate);
+    }
+
+    free(rows);
+    free(float_rows);
+    free(expected);
+    free(results);
+    free(registers);
+    free(float_registers);
+    free(row_results);
+    free(lower);
+    free(upper);
+    compiled_expression_free(expression);
+    return failures;
+}
+
+// measures single precision evaluation against double precision on a pool of one worker per processor, for two
+// benchmark expressions. returns the number of rows the pool evaluated differently from a single row.
+int float_benchmark(int row_count)
+{
+    thread_pool* pool = thread_pool_create(0);
+    printf("%-8s%-10s%12s%10s%14s%14s\n", "program", "precision", "Mrows/s", "speedup", "max relative", "estimated");
+    int failures = float_benchmark_expression(pool, "3-D", PROGRAM_BENCHMARK_TEXT, row_count);
+    failures += float_benchmark_expression(pool, "2-D", PROGRAM_BENCHMARK_PLANE, row_count);
+    printf("%d workers\n", pool->thread_count);
+    thread_pool_free(pool);
+    return failures;
+}
+
+// evaluates an expression and its partial derivatives for each row with its sines and cosines paired, then with the
+// pairs split into separate sin and cos calls, and prints the rate of each. returns 1 if the results differ.
+int sincos_benchmark_expression(const char* name, const char* text, int row_count)
+{
+    compiled_expression* expression = compiled_expression_create(text);
+    program* program = expression->program;
+    size_t result_count = (size_t)row_count * program->output_count;
+    double* rows = (double*)malloc(sizeof(double) * (size_t)row_count * program->slot_count);
+    double* paired = (double*)malloc(sizeof(double) * result_count);
+    double* split = (double*)malloc(sizeof(double) * result_count);
+    double* registers = (double*)malloc(sizeof(double) * (program->length + 1));
+    int* partners = (int*)malloc(sizeof(int) * (program->length + 1));
+    program_benchmark_rows(rows, row_count, program->slot_count);
+
+    int pair_count = 0;
+    for (int i = 0; i < program->length; ++i)
+    {
+        partners[i] = program->code[i].partner;
+        pair_count += (partners[i] > i) ? 1 : 0;
+    }
+
+    double seconds[2];
+    for (int pass = 0; pass < 2; ++pass)
+    {
+        double* results = (pass == 0) ? paired : split;
+        double start = parse_benchmark_seconds();
+        for (int row = 0; row < row_count; ++row)
+        {
+            program_run(program, rows + (size_t)row * program->slot_count, registers,
+                        results + (size_t)row * program->output_count);
+        }
+        seconds[pass] = parse_benchmark_seconds() - start;
+
+        for (int i = 0; i < program->length; ++i)
+        {
+            program->code[i].partner = -1; // the second pass runs the program as it was before pairing.
+        }
+    }
+    for (int i = 0; i < program->length; ++i)
+    {
+        program->code[i].partner = partners[i];
+    }
+
+    bool same = memcmp(paired, split, sizeof(double) * result_count) == 0;
+    printf("%-8s%8d%12.2f%12.2f%10.2f%8s\n", name, pair_count, row_count / seconds[1] / 1e6,
+           row_count / seconds[0] / 1e6, seconds[1] / seconds[0], same ? "yes" : "no");
+    free(rows);
+    free(paired);
+    free(split);
+    free(registers);
+    free(partners);
+    compiled_expression_free(expression);
+    return same ? 0 : 1;
+}
+
+// measures computing each sine and cosine of the same argument together, for two benchmark expressions and one
+// where most of the work is sines and cosines.
+int sincos_benchmark(int row_count)
+{
+    printf("%-8s%8s%12s%12s%10s%8s\n", "program", "pairs", "split Mr/s", "paired Mr/s", "speedup", "same");
+    int failures = sincos_benchmark_expression("3-D", PROGRAM_BENCHMARK_TEXT, row_count);
+    failures += sincos_benchmark_expression("2-D", PROGRAM_BENCHMARK_PLANE, row_count);
+    failures += sincos_benchmark_expression("waves", "sin(x * y) + cos(y * z) + sin(z * x) * cos(x + y + z)", row_count);
+    return failures;
+}
+
+// evaluates an expression and its partial derivatives for each row, first by evaluating each tree and then by running
+// the program they were compiled into, where each distinct subexpression is computed once, and prints the size and
+// time of each. returns the number of rows whose results differ.
+int cse_benchmark_expression(const char* text, int row_count)
+{
+    compiled_expression* expression = compiled_expression_create(text);
+    const program* program = expression->program;
+    int outputs = program->output_count;
+    double* rows = (double*)malloc(sizeof(double) * (size_t)row_count * program->slot_count);
+    double* expected = (double*)malloc(sizeof(double) * (size_t)row_count * outputs);
+    double* results = (double*)malloc(sizeof(double) * (size_t)row_count * outputs);
+    double* registers = (double*)malloc(sizeof(double) * (program->length + 1));
+    double bindings[BINDING_TABLE_SIZE] = { 0 };
+    program_benchmark_rows(rows, row_count, program->slot_count);
+
+    long long node_count = parse_benchmark_count(expression->root);
+    for (int slot = 0; slot < expression->variable_count; ++slot)
+    {
+        node_count += parse_benchmark_count(expression->partials[slot]);
+    }
+
+    double start = parse_benchmark_seconds();
+    for (int row = 0; row < row_count; ++row)
+    {
+        for (int slot = 0; slot < program->slot_count; ++slot)
+        {
+            bindings[(unsigned char)program->symbols[slot] % BINDING_TABLE_SIZE] = rows[(size_t)row * program->slot_count + slot];
+        }
+        double* row_results = expected + (size_t)row * outputs;
+        row_results[0] = evaluate_bound(expression->root, bindings);
+        for (int slot = 0; slot < expression->variable_count; ++slot)
+        {
+            row_results[slot + 1] = evaluate_bound(expression->partials[slot], bindings);
+        }
+    }
+    double tree_seconds = parse_benchmark_seconds() - start;
+
+    start = parse_benchmark_seconds();
+    for (int row = 0; row < row_count; ++row)
+    {
+        program_run(program, rows + (size_t)row * program->slot_count, registers, results + (size_t)row * outputs);
+    }
+    double run_seconds = parse_benchmark_seconds() - start;
+
+    int failures = 0;
+    for (int row = 0; row < row_count; ++row)
+    {
+        size_t offset = (size_t)row * outputs;
+        failures += (memcmp(results + offset, expected + offset, sizeof(double) * outputs) == 0) ? 0 : 1;
+    }
+
+    printf("%s\n", text);
+    printf("    %lld nodes, %d instructions, %d nodes eliminated, %.0f ns with trees, %.0f ns with the program, %.2fx\n",
+           node_count, program->length, program->eliminated, tree_seconds / row_count * 1e9,
+           run_seconds / row_count * 1e9, tree_seconds / run_seconds);
+    free(rows);
+    free(expected);
+    free(results);
+    free(registers);
+    compiled_expression_free(expression);
+    return failures;
+}
+
+// measures evaluating the value and gradient of a few expressions with and without common subexpression elimination.
+int cse_benchmark(int row_count)
+{
+    static const char* texts[] =
+    {
+        "sin(x * y) / (1 + x ^ 2) * cos(y / z) + tan(x * z) * ln(x + y + z)",
+        "(x * y * z + sin(x) * cos(y)) ^ 3 / sqrt(x ^ 2 + y ^ 2 + z ^ 2)",
+        "((x + y) / (y + z)) ^ (x / z) * sin(x * y * z)",
+        PROGRAM_BENCHMARK_TEXT
+    };
+
+    int failures = 0;
+    for (int i = 0; i < (int)(sizeof(texts) / sizeof(texts[0])); ++i)
+    {
+        failures += cse_benchmark_expression(texts[i], row_count);
+    }
+    return failures;
+}
+
+// evaluates a tree with evaluate_bound and as a program for each row, and prints the depth of the tree and the time
+// of each. the value of the first row is written to value.
+void rebalance_benchmark_tree(const char* name, tree_node* root, list* variables, const double* rows, int row_count,
+                              double* value)
+{
+    program* program = program_compile(root, variables);
+    double* registers = (double*)malloc(sizeof(double) * (program->length + 1));
+    double bindings[BINDING_TABLE_SIZE] = { 0 };
+
+    double start = parse_benchmark_seconds();
+    for (int row = 0; row < row_count; ++row)
+    {
+        for (int slot = 0; slot < program->slot_count; ++slot)
+        {
+            bindings[(unsigned char)program->symbols[slot] % BINDING_TABLE_SIZE] = rows[(size_t)row * program->slot_count + slot];
+        }
+        evaluate_bound(root, bindings);
+    }
+    double tree_seconds = parse_benchmark_seconds() - start;
+
+    start = parse_benchmark_seconds();
+    for (int row = 0; row < row_count; ++row)
+    {
+        program_evaluate(program, rows + (size_t)row * program->slot_count, registers);
+    }
+    double run_seconds = parse_benchmark_seconds() - start;
+
+    *value = program_evaluate(program, rows, registers);
+    printf("%-12s%10d%14.1f%14.1f\n", name, tree_depth(root), tree_seconds / row_count * 1e6,
+           run_seconds / row_count * 1e6);
+    free(registers);
+    program_free(program);
+}
+
+// builds a sum of the given number of products of a variable and a constant, one long left-leaning chain as the
+// parser gives it, and prints its depth and evaluation time before and after rebalancing, with the difference the
+// regrouping makes to the value.
+void rebalance_benchmark(int term_count)
+{
+    term_count = (term_count > 1) ? term_count : 2;
+    char* text = NULL;
+    size_t size = 0;
+    FILE* file = open_memstream(&text, &size);
+    for (int term = 0; term < term_count; ++term)
+    {
+        // each constant is different, so common subexpression elimination can't share parts of the balanced tree.
+        fprintf(file, "%s%c * %.9g", (term == 0) ? "" : " + ", "xyz"[term % 3], 1 + term * 1e-6);
+    }
+    fclose(file);
+    tree_node* root = parse_expression(text);
+    free(text);
+
+    list variables;
+    list_init(&variables);
+    find_variables(root, &variables);
+    int row_count = 2000;
+    double* rows = (double*)malloc(sizeof(double) * row_count * (list_length(&variables) + 1));
+    program_benchmark_rows(rows, row_count, list_length(&variables));
+
+    printf("%-12s%10s%14s%14s\n", "tree", "depth", "tree us/row", "run us/row");
+    double chained = 0;
+    double balanced = 0;
+    rebalance_benchmark_tree("chain", root, &variables, rows, row_count, &chained);
+    double start = parse_benchmark_seconds();
+    rebalance(root);
+    double seconds = parse_benchmark_seconds() - start;
+    rebalance_benchmark_tree("balanced", root, &variables, rows, row_count, &balanced);
+    printf("%d terms rebalanced in %.2f ms, the value of the first row changed by %.3g\n", term_count, seconds * 1e3,
+           fabs(balanced - chained));
+
+    free(rows);
+    free_variables(&variables);
+    tree_free(root);
+}
+
+#endif //COURSEWORK_PROGRAM_BENCHMARK_H
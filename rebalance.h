@@ -0,0 +1,121 @@
+#ifndef COURSEWORK_REBALANCE_H
+#define COURSEWORK_REBALANCE_H
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include "tree.h"
+
+// is the operator associative, so its chains can be regrouped?
+bool is_associative(token_type type)
+{
+    return type == addition || type == multiplication;
+}
+
+// links the operator nodes of a chain into a balanced tree over the operands from first to last, and returns its root.
+// the operator nodes are reused in the order they were found, so the root of the chain stays its root.
+tree_node* rebalance_build(node_stack* operands, int first, int last, node_stack* operators, int* next)
+{
+    if (last - first == 1)
+    {
+        return operands->nodes[first];
+    }
+
+    tree_node* node = operators->nodes[(*next)++];
+    int middle = first + (last - first) / 2;
+    node->left_child = rebalance_build(operands, first, middle, operators, next);
+    node->right_child = rebalance_build(operands, middle, last, operators, next);
+    return node;
+}
+
+// regroups each chain of the same associative operator into a balanced tree, e.g. ((a + b) + c) + d becomes
+// (a + b) + (c + d), so a chain of n operands is log2(n) deep instead of n deep.
+// the operands keep their order, and the tree is rebuilt from its own nodes, so the root node stays the root.
+// a balanced sum is pairwise summation, whose rounding error grows with log2(n) rather than n. the results may
+// still differ from the original grouping in the last bits, which is why this pass is optional.
+void rebalance(tree_node* root)
+{
+    // visit the tree from the root down, rebuilding each chain before visiting the operands below it.
+    node_stack pending;
+    node_stack operators;
+    node_stack operands;
+    node_stack chain;
+    node_stack_init(&pending);
+    node_stack_init(&operators);
+    node_stack_init(&operands);
+    node_stack_init(&chain);
+    if (root != NULL)
+    {
+        node_stack_push(&pending, root);
+    }
+
+    while (pending.count > 0)
+    {
+        tree_node* node = node_stack_pop(&pending);
+        if (is_associative(node->token.type) == false)
+        {
+            if (node->left_child != NULL) { node_stack_push(&pending, node->left_child); }
+            if (node->right_child != NULL) { node_stack_push(&pending, node->right_child); }
+            continue;
+        }
+
+        // collect the operators of the chain and its operands from left to right.
+        operators.count = 0;
+        operands.count = 0;
+        node_stack_push(&chain, node);
+        while (chain.count > 0)
+        {
+            tree_node* link = node_stack_pop(&chain);
+            if (link->token.type == node->token.type)
+            {
+                node_stack_push(&operators, link);
+                node_stack_push(&chain, link->right_child); // pushed first so the left operand is visited first.
+                node_stack_push(&chain, link->left_child);
+            }
+            else
+            {
+                node_stack_push(&operands, link);
+            }
+        }
+
+        int next = 0;
+        rebalance_build(&operands, 0, operands.count, &operators, &next);
+
+        // operands are chains of other operators, or hold chains further down.
+        for (int i = 0; i < operands.count; ++i)
+        {
+            node_stack_push(&pending, operands.nodes[i]);
+        }
+    }
+
+    node_stack_free(&pending);
+    node_stack_free(&operators);
+    node_stack_free(&operands);
+    node_stack_free(&chain);
+}
+
+// returns the number of nodes on the longest path from the root to a leaf, without recursion.
+int tree_depth(tree_node* root)
+{
+    node_stack order;
+    node_stack_init(&order);
+    tree_postorder(root, &order);
+
+    // the depths of the subtrees in post-order are kept on a stack, with the right subtree on top.
+    int* depths = (int*)malloc(sizeof(int) * (order.count + 1));
+    int count = 0;
+    for (int i = 0; i < order.count; ++i)
+    {
+        tree_node* node = order.nodes[i];
+        int right = (node->right_child != NULL) ? depths[--count] : 0;
+        int left = (node->left_child != NULL) ? depths[--count] : 0;
+        depths[count++] = 1 + ((left > right) ? left : right);
+    }
+
+    int depth = (count > 0) ? depths[0] : 0;
+    free(depths);
+    node_stack_free(&order);
+    return depth;
+}
+
+#endif //COURSEWORK_REBALANCE_H
@@ -0,0 +1,207 @@
+#ifndef COURSEWORK_RESULT_BENCHMARK_H
+#define COURSEWORK_RESULT_BENCHMARK_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "result_cache.h"
+#include "image_benchmark.h"
+
+#define RESULT_TRACE_EXPRESSIONS 200 // distinct expressions in a generated trace.
+#define RESULT_TRACE_HISTORY 64 // binding vectors of each expression a request may repeat.
+#define RESULT_TRACE_REPEATS 0.6 // share of requests that repeat a recent binding vector of their expression.
+
+// a generated trace of evaluate requests, like the requests of a pricing service: a few expressions are far more
+// popular than the rest, and many requests repeat a binding vector their expression was evaluated with shortly before.
+typedef struct result_trace
+{
+    compiled_expression* expressions[RESULT_TRACE_EXPRESSIONS];
+    int request_count;
+    int* requested; // the expression of each request.
+    double* slots; // the binding vector of each request, with room for the most slots of any expression.
+    int slot_stride;
+} result_trace;
+
+// returns a uniform random number in [0, 1) from the state of a linear congruential generator.
+double result_trace_random(unsigned long long* state)
+{
+    *state = *state * 6364136223846793005ULL + 1442695040888963407ULL;
+    return (*state >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// generates a trace of request_count requests. the popularity of the expressions follows Zipf's law, a repeated
+// binding vector is more likely to be a recent one, and a new binding vector has values with two decimal places.
+void result_trace_create(result_trace* trace, int request_count)
+{
+    trace->slot_stride = 1;
+    for (int i = 0; i < RESULT_TRACE_EXPRESSIONS; ++i)
+    {
+        char text[512];
+        image_benchmark_formula(text, sizeof(text), i);
+        trace->expressions[i] = compiled_expression_create(text);
+        int slot_count = trace->expressions[i]->program->slot_count;
+        trace->slot_stride = (slot_count > trace->slot_stride) ? slot_count : trace->slot_stride;
+    }
+
+    double popularity[RESULT_TRACE_EXPRESSIONS];
+    double total = 0;
+    for (int i = 0; i < RESULT_TRACE_EXPRESSIONS; ++i)
+    {
+        total += 1.0 / (i + 1);
+        popularity[i] = total;
+    }
+
+    // the history of each expression is a ring of its last binding vectors.
+    double* history = (double*)malloc(sizeof(double) * RESULT_TRACE_EXPRESSIONS * RESULT_TRACE_HISTORY * trace->slot_stride);
+    int history_count[RESULT_TRACE_EXPRESSIONS] = { 0 };
+
+    trace->request_count = request_count;
+    trace->requested = (int*)malloc(sizeof(int) * request_count);
+    trace->slots = (double*)malloc(sizeof(double) * (size_t)request_count * trace->slot_stride);
+    unsigned long long state = 42;
+    for (int request = 0; request < request_count; ++request)
+    {
+        double pick = result_trace_random(&state) * total;
+        int expression = 0;
+        while (popularity[expression] < pick)
+        {
+            ++expression;
+        }
+        trace->requested[request] = expression;
+
+        double* slots = trace->slots + (size_t)request * trace->slot_stride;
+        int known = (history_count[expression] < RESULT_TRACE_HISTORY) ? history_count[expression] : RESULT_TRACE_HISTORY;
+        double* ring = history + (size_t)expression * RESULT_TRACE_HISTORY * trace->slot_stride;
+        if (known > 0 && result_trace_random(&state) < RESULT_TRACE_REPEATS)
+        {
+            double age = result_trace_random(&state);
+            int back = 1 + (int)(age * age * age * known); // recent binding vectors are repeated more often.
+            back = (back < known) ? back : known;
+            int index = (history_count[expression] - back) % RESULT_TRACE_HISTORY;
+            memcpy(slots, ring + (size_t)index * trace->slot_stride, sizeof(double) * trace->slot_stride);
+        }
+        else
+        {
+            for (int slot = 0; slot < trace->slot_stride; ++slot)
+            {
+                slots[slot] = floor(50 + result_trace_random(&state) * 200) / 100;
+            }
+            int index = history_count[expression]++ % RESULT_TRACE_HISTORY;
+            memcpy(ring + (size_t)index * trace->slot_stride, slots, sizeof(double) * trace->slot_stride);
+        }
+    }
+    free(history);
+}
+
+// free memory for the trace.
+void result_trace_free(result_trace* trace)
+{
+    for (int i = 0; i < RESULT_TRACE_EXPRESSIONS; ++i)
+    {
+        compiled_expression_free(trace->expressions[i]);
+    }
+    free(trace->requested);
+    free(trace->slots);
+}
+
+// replays the trace with a result cache of the given capacity for each expression, or none for a capacity of 0.
+// returns the sum of every result, and adds up the lookups and hits of the caches.
+double result_trace_replay(const result_trace* trace, int capacity, result_policy policy, long long* lookups,
+                           long long* hits)
+{
+    result_cache* caches[RESULT_TRACE_EXPRESSIONS];
+    int length = 0;
+    int output_count = 0;
+    for (int i = 0; i < RESULT_TRACE_EXPRESSIONS; ++i)
+    {
+        const program* program = trace->expressions[i]->program;
+        caches[i] = (capacity > 0) ? result_cache_create(program, capacity, policy) : NULL;
+        length = (program->length > length) ? program->length : length;
+        output_count = (program->output_count > output_count) ? program->output_count : output_count;
+    }
+
+    double* registers = (double*)malloc(sizeof(double) * (length + 1));
+    double* results = (double*)malloc(sizeof(double) * output_count);
+    double sum = 0;
+    for (int request = 0; request < trace->request_count; ++request)
+    {
+        int expression = trace->requested[request];
+        const program* program = trace->expressions[expression]->program;
+        const double* slots = trace->slots + (size_t)request * trace->slot_stride;
+        if (caches[expression] != NULL)
+        {
+            result_cache_run(caches[expression], program, slots, registers, results);
+        }
+        else
+        {
+            program_run(program, slots, registers, results);
+        }
+        for (int output = 0; output < program->output_count; ++output)
+        {
+            sum += results[output];
+        }
+    }
+
+    *lookups = 0;
+    *hits = 0;
+    for (int i = 0; i < RESULT_TRACE_EXPRESSIONS; ++i)
+    {
+        if (caches[i] != NULL)
+        {
+            *lookups += caches[i]->lookups;
+            *hits += caches[i]->hits;
+        }
+        result_cache_free(caches[i]);
+    }
+    free(registers);
+    free(results);
+    return sum;
+}
+
+// replays a generated trace of request_count requests without result caches and then with LRU and CLOCK caches of
+// several capacities, and prints the hit ratio and time per request of each. returns the number of replays whose
+// results differ from those without a cache.
+int result_benchmark(int request_count)
+{
+    result_trace trace;
+    result_trace_create(&trace, request_count);
+
+    static const int capacities[] = { 0, 16, 64, 256 };
+    int failures = 0;
+    double reference = 0;
+    double reference_seconds = 0;
+    printf("%-8s%10s%12s%14s%10s\n", "policy", "capacity", "hit ratio", "ns/request", "speedup");
+    for (int i = 0; i < (int)(sizeof(capacities) / sizeof(capacities[0])); ++i)
+    {
+        for (int policy = result_lru; policy <= result_clock; ++policy)
+        {
+            if (capacities[i] == 0 && policy == result_clock)
+            {
+                continue;
+            }
+
+            long long lookups;
+            long long hits;
+            double start = parse_benchmark_seconds();
+            double sum = result_trace_replay(&trace, capacities[i], (result_policy)policy, &lookups, &hits);
+            double seconds = parse_benchmark_seconds() - start;
+            if (capacities[i] == 0)
+            {
+                reference = sum;
+                reference_seconds = seconds;
+            }
+            failures += (sum == reference) ? 0 : 1;
+
+            printf("%-8s%10d%11.1f%%%14.1f%9.2fx\n", (capacities[i] == 0) ? "none" : (policy == result_lru) ? "lru" : "clock",
+                   capacities[i], (lookups > 0) ? 100.0 * hits / lookups : 0.0, seconds * 1e9 / request_count,
+                   reference_seconds / seconds);
+        }
+    }
+
+    printf("%d requests over %d expressions\n", request_count, RESULT_TRACE_EXPRESSIONS);
+    result_trace_free(&trace);
+    return failures;
+}
+
+#endif //COURSEWORK_RESULT_BENCHMARK_H
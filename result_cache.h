@@ -0,0 +1,262 @@
+#ifndef COURSEWORK_RESULT_CACHE_H
+#define COURSEWORK_RESULT_CACHE_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "program.h"
+#include "tree_hash.h"
+
+// how a full result cache picks the results to evict.
+typedef enum result_policy
+{
+    result_lru, // the least recently used results.
+    result_clock // the first results the clock hand finds that weren't used since it last passed them.
+} result_policy;
+
+// the results of one program for the binding vectors it was last run with, keyed by the bit pattern of the slots, so
+// -0 and 0 are different keys and a NaN is found again. results are the value followed by each partial derivative.
+// a result cache isn't thread-safe, each thread needs its own or a lock around it.
+typedef struct result_cache
+{
+    int slot_count;
+    int output_count;
+    int capacity; // most binding vectors held.
+    int count;
+    result_policy policy;
+    double* slots; // slot_count values for each binding vector.
+    double* results; // output_count values for each binding vector.
+    uint64_t* hashes; // hash of each binding vector.
+    int* buckets; // chained hash table of the binding vectors, -1 for an empty bucket.
+    int bucket_count; // always a power of two, at least twice the capacity.
+    int* next; // next binding vector in the same bucket, or -1.
+    int* newer; // neighbours in the order of use, for LRU eviction.
+    int* older;
+    int newest;
+    int oldest;
+    unsigned char* used; // use bit of each binding vector, for CLOCK eviction.
+    int hand; // the next binding vector the clock hand looks at.
+    long long lookups;
+    long long hits;
+    long long evictions;
+} result_cache;
+
+// create an empty cache of at most capacity results of a program.
+result_cache* result_cache_create(const program* program, int capacity, result_policy policy)
+{
+    result_cache* cache = (result_cache*)malloc(sizeof(result_cache));
+    cache->slot_count = program->slot_count;
+    cache->output_count = program->output_count;
+    cache->capacity = (capacity > 0) ? capacity : 1;
+    cache->count = 0;
+    cache->policy = policy;
+    cache->slots = (double*)malloc(sizeof(double) * cache->capacity * (cache->slot_count + 1));
+    cache->results = (double*)malloc(sizeof(double) * cache->capacity * cache->output_count);
+    cache->hashes = (uint64_t*)malloc(sizeof(uint64_t) * cache->capacity);
+    cache->bucket_count = 16;
+    while (cache->bucket_count < cache->capacity * 2)
+    {
+        cache->bucket_count *= 2;
+    }
+    cache->buckets = (int*)malloc(sizeof(int) * cache->bucket_count);
+    memset(cache->buckets, -1, sizeof(int) * cache->bucket_count);
+    cache->next = (int*)malloc(sizeof(int) * cache->capacity);
+    cache->newer = (int*)malloc(sizeof(int) * cache->capacity);
+    cache->older = (int*)malloc(sizeof(int) * cache->capacity);
+    cache->newest = -1;
+    cache->oldest = -1;
+    cache->used = (unsigned char*)calloc(cache->capacity, 1);
+    cache->hand = 0;
+    cache->lookups = 0;
+    cache->hits = 0;
+    cache->evictions = 0;
+    return cache;
+}
+
+// free memory for the cache.
+void result_cache_free(result_cache* cache)
+{
+    if (cache != NULL)
+    {
+        free(cache->slots);
+        free(cache->results);
+        free(cache->hashes);
+        free(cache->buckets);
+        free(cache->next);
+        free(cache->newer);
+        free(cache->older);
+        free(cache->used);
+        free(cache);
+    }
+}
+
+// returns the hash of the bit pattern of a binding vector.
+uint64_t result_cache_hash(const result_cache* cache, const double* slots)
+{
+    uint64_t hash = 0;
+    for (int slot = 0; slot < cache->slot_count; ++slot)
+    {
+        uint64_t bits;
+        memcpy(&bits, &slots[slot], sizeof(bits));
+        hash = hash_combine(hash, bits);
+    }
+    return hash;
+}
+
+// removes a binding vector from the order of use.
+void result_cache_unlink(result_cache* cache, int index)
+{
+    if (cache->newer[index] >= 0)
+    {
+        cache->older[cache->newer[index]] = cache->older[index];
+    }
+    else
+    {
+        cache->newest = cache->older[index];
+    }
+
+    if (cache->older[index] >= 0)
+    {
+        cache->newer[cache->older[index]] = cache->newer[index];
+    }
+    else
+    {
+        cache->oldest = cache->newer[index];
+    }
+}
+
+// makes a binding vector the most recently used.
+void result_cache_touch(result_cache* cache, int index)
+{
+    cache->newer[index] = -1;
+    cache->older[index] = cache->newest;
+    if (cache->newest >= 0)
+    {
+        cache->newer[cache->newest] = index;
+    }
+    else
+    {
+        cache->oldest = index;
+    }
+    cache->newest = index;
+}
+
+// returns the index of a binding vector with the given hash, or -1 if it isn't cached.
+int result_cache_index(const result_cache* cache, const double* slots, uint64_t hash)
+{
+    int index = cache->buckets[hash & (uint64_t)(cache->bucket_count - 1)];
+    while (index >= 0 && (cache->hashes[index] != hash ||
+                          memcmp(cache->slots + (size_t)index * cache->slot_count, slots, sizeof(double) * cache->slot_count) != 0))
+    {
+        index = cache->next[index];
+    }
+    return index;
+}
+
+// copies the results of a binding vector with the given hash if they are cached, returns whether they were.
+bool result_cache_find_hashed(result_cache* cache, const double* slots, uint64_t hash, double* results)
+{
+    ++cache->lookups;
+    int index = result_cache_index(cache, slots, hash);
+    if (index < 0)
+    {
+        return false;
+    }
+
+    ++cache->hits;
+    if (cache->policy == result_lru)
+    {
+        result_cache_unlink(cache, index);
+        result_cache_touch(cache, index);
+    }
+    else
+    {
+        cache->used[index] = 1;
+    }
+    memcpy(results, cache->results + (size_t)index * cache->output_count, sizeof(double) * cache->output_count);
+    return true;
+}
+
+// copies the results of a binding vector if they are cached, returns whether they were.
+bool result_cache_find(result_cache* cache, const double* slots, double* results)
+{
+    return result_cache_find_hashed(cache, slots, result_cache_hash(cache, slots), results);
+}
+
+// returns the binding vector to overwrite with new results, evicting one if the cache is full.
+int result_cache_victim(result_cache* cache)
+{
+    if (cache->count < cache->capacity)
+    {
+        return cache->count++;
+    }
+
+    int index;
+    if (cache->policy == result_lru)
+    {
+        index = cache->oldest;
+        result_cache_unlink(cache, index);
+    }
+    else
+    {
+        // the hand clears the use bit of each binding vector it passes, and stops at one whose bit is already clear.
+        while (cache->used[cache->hand])
+        {
+            cache->used[cache->hand] = 0;
+            cache->hand = (cache->hand + 1) % cache->capacity;
+        }
+        index = cache->hand;
+        cache->hand = (cache->hand + 1) % cache->capacity;
+    }
+
+    int* link = &cache->buckets[cache->hashes[index] & (uint64_t)(cache->bucket_count - 1)];
+    while (*link != index)
+    {
+        link = &cache->next[*link];
+    }
+    *link = cache->next[index];
+    ++cache->evictions;
+    return index;
+}
+
+// stores the results of a binding vector with the given hash, which must not be cached already.
+void result_cache_store_hashed(result_cache* cache, const double* slots, uint64_t hash, const double* results)
+{
+    int index = result_cache_victim(cache);
+    memcpy(cache->slots + (size_t)index * cache->slot_count, slots, sizeof(double) * cache->slot_count);
+    memcpy(cache->results + (size_t)index * cache->output_count, results, sizeof(double) * cache->output_count);
+    cache->hashes[index] = hash;
+    int* bucket = &cache->buckets[hash & (uint64_t)(cache->bucket_count - 1)];
+    cache->next[index] = *bucket;
+    *bucket = index;
+    if (cache->policy == result_lru)
+    {
+        result_cache_touch(cache, index);
+    }
+    else
+    {
+        cache->used[index] = 1;
+    }
+}
+
+// stores the results of a binding vector, which must not be cached already.
+void result_cache_store(result_cache* cache, const double* slots, const double* results)
+{
+    result_cache_store_hashed(cache, slots, result_cache_hash(cache, slots), results);
+}
+
+// copies the cached results of the binding vector, or runs the program and caches its results.
+void result_cache_run(result_cache* cache, const program* program, const double* slots, double* registers,
+                      double* results)
+{
+    uint64_t hash = result_cache_hash(cache, slots);
+    if (result_cache_find_hashed(cache, slots, hash, results) == false)
+    {
+        program_run(program, slots, registers, results);
+        result_cache_store_hashed(cache, slots, hash, results);
+    }
+}
+
+#endif //COURSEWORK_RESULT_CACHE_H
@@ -0,0 +1,54 @@
+#ifndef COURSEWORK_SHARED_TRANSCENDENTALS_H
+#define COURSEWORK_SHARED_TRANSCENDENTALS_H
+
+#include <stdlib.h>
+
+#include "program.h"
+
+// computes each sine and cosine of the same argument with one call, through the partner of the earlier of the two.
+// the sine and cosine rules always produce such pairs, e.g. sin(u) in the expression and cos(u) in its derivative.
+// program_emit already gives repeated calls on the same argument a single register, so only the pairs are left.
+// the results are identical to the unpaired program. returns the number of libm calls saved.
+int program_share_transcendentals(program* program)
+{
+    int* sines = (int*)malloc(sizeof(int) * (program->length + 1));
+    int* cosines = (int*)malloc(sizeof(int) * (program->length + 1));
+    for (int i = 0; i < program->length; ++i)
+    {
+        sines[i] = -1;
+        cosines[i] = -1;
+    }
+
+    // find the sine and cosine of each argument register.
+    for (int i = 0; i < program->length; ++i)
+    {
+        const instruction* instruction = &program->code[i];
+        if (instruction->type == sine && instruction->partner < 0)
+        {
+            sines[instruction->left] = i;
+        }
+        else if (instruction->type == cosine && instruction->partner < 0)
+        {
+            cosines[instruction->left] = i;
+        }
+    }
+
+    int saved = 0;
+    for (int argument = 0; argument < program->length; ++argument)
+    {
+        int sine_register = sines[argument];
+        int cosine_register = cosines[argument];
+        if (sine_register >= 0 && cosine_register >= 0)
+        {
+            program->code[sine_register].partner = cosine_register;
+            program->code[cosine_register].partner = sine_register;
+            ++saved;
+        }
+    }
+
+    free(sines);
+    free(cosines);
+    return saved;
+}
+
+#endif //COURSEWORK_SHARED_TRANSCENDENTALS_H
@@ -16,21 +16,22 @@ bool is_constant(tree_node* node, double value)
     return false;
 }
 
-// traverses the tree and simplifies multiply-by-one expressions.
-bool simplify_multiply_by_one_recursive(tree_node* node)
+// simplifies any multiply-by-one expressions.
+bool simplify_multiply_by_one(tree_node* root)
 {
-    // post-order traverse the tree.
+    // post-order traverse the tree without recursion.
     // this will simplify children before simplifying parents.
-    if (node != NULL)
+    node_stack order;
+    node_stack_init(&order);
+    tree_postorder(root, &order);
+
+    bool simplified = false;
+    for (int i = 0; i < order.count; ++i)
     {
+        tree_node* node = order.nodes[i];
         tree_node* left = node->left_child;
         tree_node* right = node->right_child;
 
-        bool left_simplified = simplify_multiply_by_one_recursive(left); // simplify the left subtree.
-        bool right_simplified = simplify_multiply_by_one_recursive(right); // simplify the right subtree.
-
-        bool simplified = left_simplified || right_simplified;
-
         if (node->token.type == multiplication)
         {
             if (is_constant(left, 1.0))
@@ -58,34 +59,28 @@ bool simplify_multiply_by_one_recursive(tree_node* node)
                 tree_node_free(right); // free the constant one node.
             }
         }
-
-        return simplified;
     }
 
-    return false;
+    node_stack_free(&order);
+    return simplified;
 }
 
-// simplifies any multiply-by-one expressions.
-bool simplify_multiply_by_one(tree_node* root)
-{
-    return simplify_multiply_by_one_recursive(root);
-}
-
-// traverses the tree and simplifies multiply-by-zero expressions.
-bool simplify_multiply_by_zero_recursive(tree_node* node)
+// simplifies any multiply-by-zero expressions.
+bool simplify_multiply_by_zero(tree_node* root)
 {
-    // post-order traverse the tree.
+    // post-order traverse the tree without recursion.
     // this will simplify children before simplifying parents.
-    if (node != NULL)
+    node_stack order;
+    node_stack_init(&order);
+    tree_postorder(root, &order);
+
+    bool simplified = false;
+    for (int i = 0; i < order.count; ++i)
     {
+        tree_node* node = order.nodes[i];
         tree_node* left = node->left_child;
         tree_node* right = node->right_child;
 
-        bool left_simplified = simplify_multiply_by_zero_recursive(left); // simplify the left subtree.
-        bool right_simplified = simplify_multiply_by_zero_recursive(right); // simplify the right subtree.
-
-        bool simplified = left_simplified || right_simplified;
-
         if (node->token.type == multiplication)
         {
             if (is_constant(left, 0.0) || is_constant(right, 0.0))
@@ -102,34 +97,28 @@ bool simplify_multiply_by_zero_recursive(tree_node* node)
                 tree_free(right);
             }
         }
-
-        return simplified;
     }
 
-    return false;
+    node_stack_free(&order);
+    return simplified;
 }
 
-// simplifies any multiply-by-zero expressions.
-bool simplify_multiply_by_zero(tree_node* root)
-{
-    return simplify_multiply_by_zero_recursive(root);
-}
-
-// traverses the tree and simplifies addition-by-zero expressions.
-bool simplify_addition_by_zero_recursive(tree_node* node)
+// simplifies any addition-by-zero expressions.
+bool simplify_addition_by_zero(tree_node* root)
 {
-    // post-order traverse the tree.
+    // post-order traverse the tree without recursion.
     // this will simplify children before simplifying parents.
-    if (node != NULL)
+    node_stack order;
+    node_stack_init(&order);
+    tree_postorder(root, &order);
+
+    bool simplified = false;
+    for (int i = 0; i < order.count; ++i)
     {
+        tree_node* node = order.nodes[i];
         tree_node* left = node->left_child;
         tree_node* right = node->right_child;
 
-        bool left_simplified = simplify_addition_by_zero_recursive(left); // simplify the left subtree.
-        bool right_simplified = simplify_addition_by_zero_recursive(right); // simplify the right subtree.
-
-        bool simplified = left_simplified || right_simplified;
-
         if (node->token.type == addition)
         {
             if (is_constant(left, 0.0))
@@ -157,17 +146,10 @@ bool simplify_addition_by_zero_recursive(tree_node* node)
                 tree_node_free(right); // free the constant zero node.
             }
         }
-
-        return simplified;
     }
 
-    return false;
-}
-
-// simplifies any addition-by-zero expressions.
-bool simplify_addition_by_zero(tree_node* root)
-{
-    return simplify_addition_by_zero_recursive(root);
+    node_stack_free(&order);
+    return simplified;
 }
 
 // simplifies the expression tree.
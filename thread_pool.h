@@ -0,0 +1,228 @@
+#ifndef COURSEWORK_THREAD_POOL_H
+#define COURSEWORK_THREAD_POOL_H
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <unistd.h>
+
+// function run for each task, which is identified by its index.
+typedef void (*task_function)(void* context, int task);
+
+// range of task indices owned by one worker.
+// the owner takes tasks from the top, idle workers steal tasks from the bottom.
+typedef struct task_deque
+{
+    pthread_mutex_t lock;
+    int top; // index of the next task the owner takes.
+    int bottom; // one past the index of the next task a thief steals.
+} task_deque;
+
+// fixed set of worker threads that run the tasks of a job with work-stealing.
+// the thread calling thread_pool_run is worker 0, so a pool of one worker never starts a thread.
+typedef struct thread_pool
+{
+    pthread_t* threads; // worker threads 1 to thread_count - 1.
+    task_deque* deques; // one deque per worker.
+    int thread_count; // number of workers including the calling thread.
+    pthread_mutex_t lock; // protects the fields below.
+    pthread_cond_t job_started; // signalled when a new job is published or the pool is stopping.
+    pthread_cond_t job_finished; // signalled when the last worker finishes the current job.
+    int generation; // incremented for each new job.
+    int busy_workers; // number of worker threads still running the current job.
+    bool stopping; // set when the pool is being freed.
+    task_function function; // function of the current job.
+    void* context; // context of the current job.
+} thread_pool;
+
+// the number of processors available, used when a pool is created with no thread count.
+int processor_count()
+{
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return (count > 0) ? (int)count : 1;
+}
+
+// takes the next task from a worker's own deque, returns -1 if its deque is empty.
+int task_deque_take(task_deque* deque)
+{
+    int task = -1;
+    pthread_mutex_lock(&deque->lock);
+    if (deque->top < deque->bottom)
+    {
+        task = deque->top++;
+    }
+    pthread_mutex_unlock(&deque->lock);
+    return task;
+}
+
+// steals the last task from another worker's deque, returns -1 if its deque is empty.
+int task_deque_steal(task_deque* deque)
+{
+    int task = -1;
+    pthread_mutex_lock(&deque->lock);
+    if (deque->top < deque->bottom)
+    {
+        task = --deque->bottom;
+    }
+    pthread_mutex_unlock(&deque->lock);
+    return task;
+}
+
+// runs tasks until every deque in the pool is empty.
+void thread_pool_drain(thread_pool* pool, int worker)
+{
+    while (true)
+    {
+        int task = task_deque_take(&pool->deques[worker]);
+
+        // our own deque is empty, so try to steal from the other workers.
+        for (int i = 1; task < 0 && i < pool->thread_count; ++i)
+        {
+            task = task_deque_steal(&pool->deques[(worker + i) % pool->thread_count]);
+        }
+
+        if (task < 0)
+        {
+            return; // no tasks are left, and a job never adds new tasks.
+        }
+
+        pool->function(pool->context, task);
+    }
+}
+
+typedef struct thread_pool_worker
+{
+    thread_pool* pool;
+    int index;
+} thread_pool_worker;
+
+// main loop of a worker thread.
+void* thread_pool_worker_main(void* argument)
+{
+    thread_pool_worker* worker = argument;
+    thread_pool* pool = worker->pool;
+    int index = worker->index;
+    free(worker);
+
+    int generation = 0;
+    pthread_mutex_lock(&pool->lock);
+    while (true)
+    {
+        while (pool->stopping == false && pool->generation == generation)
+        {
+            pthread_cond_wait(&pool->job_started, &pool->lock); // wait for the next job.
+        }
+
+        if (pool->stopping)
+        {
+            break;
+        }
+
+        generation = pool->generation;
+        pthread_mutex_unlock(&pool->lock);
+
+        thread_pool_drain(pool, index);
+
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->busy_workers == 0)
+        {
+            pthread_cond_signal(&pool->job_finished); // we were the last worker running this job.
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    return NULL;
+}
+
+// create a pool of workers, a thread count of zero uses one worker per processor.
+thread_pool* thread_pool_create(int thread_count)
+{
+    thread_pool* pool = (thread_pool*)malloc(sizeof(thread_pool));
+    pool->thread_count = (thread_count > 0) ? thread_count : processor_count();
+    pool->threads = (pthread_t*)malloc(sizeof(pthread_t) * pool->thread_count);
+    pool->deques = (task_deque*)malloc(sizeof(task_deque) * pool->thread_count);
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->job_started, NULL);
+    pthread_cond_init(&pool->job_finished, NULL);
+    pool->generation = 0;
+    pool->busy_workers = 0;
+    pool->stopping = false;
+    pool->function = NULL;
+    pool->context = NULL;
+
+    for (int i = 0; i < pool->thread_count; ++i)
+    {
+        pthread_mutex_init(&pool->deques[i].lock, NULL);
+        pool->deques[i].top = 0;
+        pool->deques[i].bottom = 0;
+    }
+
+    for (int i = 1; i < pool->thread_count; ++i)
+    {
+        thread_pool_worker* worker = (thread_pool_worker*)malloc(sizeof(thread_pool_worker));
+        worker->pool = pool;
+        worker->index = i;
+        pthread_create(&pool->threads[i], NULL, thread_pool_worker_main, worker);
+    }
+
+    return pool;
+}
+
+// stop the worker threads and free memory for the pool.
+void thread_pool_free(thread_pool* pool)
+{
+    if (pool != NULL)
+    {
+        pthread_mutex_lock(&pool->lock);
+        pool->stopping = true;
+        pthread_cond_broadcast(&pool->job_started);
+        pthread_mutex_unlock(&pool->lock);
+
+        for (int i = 1; i < pool->thread_count; ++i)
+        {
+            pthread_join(pool->threads[i], NULL);
+        }
+
+        for (int i = 0; i < pool->thread_count; ++i)
+        {
+            pthread_mutex_destroy(&pool->deques[i].lock);
+        }
+
+        pthread_mutex_destroy(&pool->lock);
+        pthread_cond_destroy(&pool->job_started);
+        pthread_cond_destroy(&pool->job_finished);
+        free(pool->threads);
+        free(pool->deques);
+        free(pool);
+    }
+}
+
+// runs function once for each task index between zero and task_count - 1, and returns when every task is done.
+// the tasks are dealt out to the workers in contiguous ranges, and workers that run out steal from the others.
+void thread_pool_run(thread_pool* pool, task_function function, void* context, int task_count)
+{
+    for (int i = 0; i < pool->thread_count; ++i)
+    {
+        pool->deques[i].top = (int)((long long)task_count * i / pool->thread_count);
+        pool->deques[i].bottom = (int)((long long)task_count * (i + 1) / pool->thread_count);
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->function = function;
+    pool->context = context;
+    pool->busy_workers = pool->thread_count - 1;
+    ++pool->generation;
+    pthread_cond_broadcast(&pool->job_started);
+    pthread_mutex_unlock(&pool->lock);
+
+    thread_pool_drain(pool, 0); // the calling thread works on the job too.
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->busy_workers > 0)
+    {
+        pthread_cond_wait(&pool->job_finished, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+#endif //COURSEWORK_THREAD_POOL_H
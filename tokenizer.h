@@ -9,7 +9,7 @@
 
 bool is_whitespace(char c)
 {
-    return c == ' ' || c == '\t';
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r'; // line breaks too, so long expressions can be wrapped.
 }
 
 bool is_end(char c)
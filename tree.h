@@ -2,9 +2,17 @@
 #define COURSEWORK_TREE_H
 
 #include <stdlib.h>
+#include <string.h>
 
 #include "token.h"
 
+#define NODE_STACK_BUFFER 64 // nodes a stack holds before it moves to the heap, enough for most trees.
+
+// depth below which the hot passes stop recursing and continue with an explicit stack.
+// recursion is the fastest way to walk the shallow trees typed by people, and the limit keeps the native stack
+// bounded for generated trees that are millions of levels deep.
+#define TREE_RECURSION_LIMIT 256
+
 // node of a binary tree.
 typedef struct tree_node
 {
@@ -28,15 +36,149 @@ void tree_node_free(tree_node* node)
     }
 }
 
+// is the node a leaf, with no children?
+bool tree_node_is_leaf(tree_node* node)
+{
+    return node->left_child == NULL && node->right_child == NULL;
+}
+
+// stack of tree nodes for traversing a tree without recursion, so the depth of a tree is only limited by memory.
+// small stacks live in the buffer inside the struct and never allocate.
+typedef struct node_stack
+{
+    tree_node** nodes; // the buffer, or a heap array once the stack outgrows it.
+    int count;
+    int capacity;
+    tree_node* buffer[NODE_STACK_BUFFER];
+} node_stack;
+
+// initialise an empty stack.
+void node_stack_init(node_stack* stack)
+{
+    stack->nodes = stack->buffer;
+    stack->count = 0;
+    stack->capacity = NODE_STACK_BUFFER;
+}
+
+// push a node to the top of the stack.
+void node_stack_push(node_stack* stack, tree_node* node)
+{
+    if (stack->count == stack->capacity)
+    {
+        stack->capacity *= 2;
+        if (stack->nodes == stack->buffer)
+        {
+            stack->nodes = (tree_node**)malloc(sizeof(tree_node*) * stack->capacity);
+            memcpy(stack->nodes, stack->buffer, sizeof(stack->buffer));
+        }
+        else
+        {
+            stack->nodes = (tree_node**)realloc(stack->nodes, sizeof(tree_node*) * stack->capacity);
+        }
+    }
+
+    stack->nodes[stack->count++] = node;
+}
+
+// remove and return the node at the top of the stack.
+tree_node* node_stack_pop(node_stack* stack)
+{
+    return stack->nodes[--stack->count];
+}
+
+// free memory for the stack.
+void node_stack_free(node_stack* stack)
+{
+    if (stack->nodes != stack->buffer)
+    {
+        free(stack->nodes);
+    }
+    node_stack_init(stack);
+}
+
+// appends each node of the tree to the stack in post-order, so children always come before their parent.
+void tree_postorder(tree_node* root, node_stack* order)
+{
+    // visit the nodes root, right, left, which is post-order reversed, then reverse the new part of the stack.
+    int first = order->count;
+    node_stack pending;
+    node_stack_init(&pending);
+    if (root != NULL)
+    {
+        node_stack_push(&pending, root);
+    }
+
+    while (pending.count > 0)
+    {
+        tree_node* node = node_stack_pop(&pending);
+        node_stack_push(order, node);
+        if (node->left_child != NULL) { node_stack_push(&pending, node->left_child); }
+        if (node->right_child != NULL) { node_stack_push(&pending, node->right_child); }
+    }
+
+    for (int i = first, j = order->count - 1; i < j; ++i, --j)
+    {
+        tree_node* swap = order->nodes[i];
+        order->nodes[i] = order->nodes[j];
+        order->nodes[j] = swap;
+    }
+
+    node_stack_free(&pending);
+}
+
+// free memory for each node in the tree without recursion, so its depth is only limited by memory.
+void tree_free_iterative(tree_node* node)
+{
+    // a node's children are pushed before it is freed, so any order of visiting the nodes will do.
+    node_stack pending;
+    node_stack_init(&pending);
+    if (node != NULL)
+    {
+        node_stack_push(&pending, node);
+    }
+
+    while (pending.count > 0)
+    {
+        tree_node* current = node_stack_pop(&pending);
+        if (current->left_child != NULL) { node_stack_push(&pending, current->left_child); }
+        if (current->right_child != NULL) { node_stack_push(&pending, current->right_child); }
+        free(current);
+    }
+
+    node_stack_free(&pending);
+}
+
+// free memory for each node in the tree, recursing until the recursion limit.
+void tree_free_recursive(tree_node* node, int depth)
+{
+    if (depth >= TREE_RECURSION_LIMIT)
+    {
+        tree_free_iterative(node);
+        return;
+    }
+
+    // post-order tree traversal is required to delete the tree, leaves are freed without a call.
+    tree_node* left = node->left_child;
+    tree_node* right = node->right_child;
+    if (left != NULL)
+    {
+        if (tree_node_is_leaf(left)) { free(left); }
+        else { tree_free_recursive(left, depth + 1); }
+    }
+    if (right != NULL)
+    {
+        if (tree_node_is_leaf(right)) { free(right); }
+        else { tree_free_recursive(right, depth + 1); }
+    }
+    free(node);
+}
+
 // free memory for each node in the tree.
 void tree_free(tree_node* node)
 {
-    // post-order tree traversal is required to delete the tree.
     if (node != NULL)
     {
-        tree_free(node->left_child);
-        tree_free(node->right_child);
-        free(node);
+        tree_free_recursive(node, 0);
     }
 }
 
@@ -56,19 +198,70 @@ tree_node* tree_node_create(token token)
     return node;
 }
 
-// create a copy of a tree node.
-tree_node* tree_node_copy(tree_node* node)
+// create a copy of a tree node without recursion, so its depth is only limited by memory.
+tree_node* tree_node_copy_iterative(tree_node* node)
 {
-    // pre-order tree traversal is required to create a copy of the tree.
-    if (node != NULL)
+    if (node == NULL)
     {
-        tree_node* copy = tree_node_create(node->token);
-        copy->left_child = tree_node_copy(node->left_child);
-        copy->right_child = tree_node_copy(node->right_child);
-        return copy;
+        return NULL;
     }
 
-    return NULL;
+    // pre-order traverse the tree, each entry of the stack is a node followed by the copy waiting for its children.
+    tree_node* root = tree_node_create(node->token);
+    node_stack pending;
+    node_stack_init(&pending);
+    node_stack_push(&pending, node);
+    node_stack_push(&pending, root);
+
+    while (pending.count > 0)
+    {
+        tree_node* copy = node_stack_pop(&pending);
+        tree_node* original = node_stack_pop(&pending);
+        if (original->left_child != NULL)
+        {
+            copy->left_child = tree_node_create(original->left_child->token);
+            node_stack_push(&pending, original->left_child);
+            node_stack_push(&pending, copy->left_child);
+        }
+        if (original->right_child != NULL)
+        {
+            copy->right_child = tree_node_create(original->right_child->token);
+            node_stack_push(&pending, original->right_child);
+            node_stack_push(&pending, copy->right_child);
+        }
+    }
+
+    node_stack_free(&pending);
+    return root;
+}
+
+// create a copy of a tree node, recursing until the recursion limit.
+tree_node* tree_node_copy_recursive(tree_node* node, int depth)
+{
+    if (depth >= TREE_RECURSION_LIMIT)
+    {
+        return tree_node_copy_iterative(node);
+    }
+
+    // pre-order tree traversal is required to create a copy of the tree, leaves are copied without a call.
+    tree_node* copy = tree_node_create(node->token);
+    tree_node* left = node->left_child;
+    tree_node* right = node->right_child;
+    if (left != NULL)
+    {
+        copy->left_child = tree_node_is_leaf(left) ? tree_node_create(left->token) : tree_node_copy_recursive(left, depth + 1);
+    }
+    if (right != NULL)
+    {
+        copy->right_child = tree_node_is_leaf(right) ? tree_node_create(right->token) : tree_node_copy_recursive(right, depth + 1);
+    }
+    return copy;
+}
+
+// create a copy of a tree node.
+tree_node* tree_node_copy(tree_node* node)
+{
+    return (node != NULL) ? tree_node_copy_recursive(node, 0) : NULL;
 }
 
 #endif //COURSEWORK_TREE_H
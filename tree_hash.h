@@ -0,0 +1,129 @@
+#ifndef COURSEWORK_TREE_HASH_H
+#define COURSEWORK_TREE_HASH_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "tree.h"
+
+// mixes a value into a hash.
+uint64_t hash_combine(uint64_t hash, uint64_t value)
+{
+    // mix the value with the multiply-xorshift steps of splitmix64 so nearby values spread out.
+    value += 0x9E3779B97F4A7C15ULL;
+    value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    value = (value ^ (value >> 27)) * 0x94D049BB133111EBULL;
+    value ^= value >> 31;
+    return (hash ^ value) * 0x100000001B3ULL;
+}
+
+// returns the 64-bit FNV-1a hash of a string.
+uint64_t text_hash(const char* text)
+{
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    for (const unsigned char* c = (const unsigned char*)text; *c != '\0'; ++c)
+    {
+        hash = (hash ^ *c) * 0x100000001B3ULL;
+    }
+    return hash;
+}
+
+// hashes the fields of a token that matter to the value of an expression.
+uint64_t token_hash(token token)
+{
+    uint64_t hash = hash_combine(0xCBF29CE484222325ULL, (uint64_t)token.type);
+    if (token.type == variable)
+    {
+        hash = hash_combine(hash, (uint64_t)(unsigned char)token.symbol);
+    }
+    else if (token.type == constant)
+    {
+        uint64_t bits;
+        memcpy(&bits, &token.value, sizeof(bits));
+        hash = hash_combine(hash, bits);
+    }
+
+    return hash;
+}
+
+// are two tokens the same operation on the same operands?
+bool token_equal(token a, token b)
+{
+    if (a.type != b.type)
+    {
+        return false;
+    }
+    else if (a.type == variable)
+    {
+        return a.symbol == b.symbol;
+    }
+    else if (a.type == constant)
+    {
+        return memcmp(&a.value, &b.value, sizeof(a.value)) == 0; // compare bit patterns, so 0 and -0 are different.
+    }
+
+    return true;
+}
+
+// computes a hash of the structure of the expression tree, so identical expressions have identical hashes.
+uint64_t tree_hash(tree_node* node)
+{
+    // post-order traverse the tree, keeping the hashes of the subtrees on a stack with the right subtree on top.
+    node_stack order;
+    node_stack_init(&order);
+    tree_postorder(node, &order);
+
+    uint64_t* hashes = (uint64_t*)malloc(sizeof(uint64_t) * (order.count + 1));
+    int count = 0;
+    for (int i = 0; i < order.count; ++i)
+    {
+        tree_node* current = order.nodes[i];
+        uint64_t right = (current->right_child != NULL) ? hashes[--count] : 0;
+        uint64_t left = (current->left_child != NULL) ? hashes[--count] : 0;
+        hashes[count++] = hash_combine(hash_combine(token_hash(current->token), left), right);
+    }
+
+    uint64_t hash = (count > 0) ? hashes[0] : 0;
+    free(hashes);
+    node_stack_free(&order);
+    return hash;
+}
+
+// are two expression trees structurally identical?
+bool tree_equal(tree_node* a, tree_node* b)
+{
+    // compare the trees node by node, the stack holds pairs of nodes at the same position in each tree.
+    node_stack pending;
+    node_stack_init(&pending);
+    node_stack_push(&pending, a);
+    node_stack_push(&pending, b);
+
+    bool equal = true;
+    while (equal && pending.count > 0)
+    {
+        tree_node* second = node_stack_pop(&pending);
+        tree_node* first = node_stack_pop(&pending);
+        if (first == second)
+        {
+            continue; // the same subtree, or both are null.
+        }
+        else if (first == NULL || second == NULL || token_equal(first->token, second->token) == false)
+        {
+            equal = false;
+        }
+        else
+        {
+            node_stack_push(&pending, first->right_child);
+            node_stack_push(&pending, second->right_child);
+            node_stack_push(&pending, first->left_child);
+            node_stack_push(&pending, second->left_child);
+        }
+    }
+
+    node_stack_free(&pending);
+    return equal;
+}
+
+#endif //COURSEWORK_TREE_HASH_H
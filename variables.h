@@ -47,19 +47,27 @@ void free_variables(list* variables)
     list_free_nodes(variables); // free the list of variables.
 }
 
-// traverses the expression tree to find variables and adds them to the variables list.
-void find_variables_recursive(tree_node* node, list* variables)
+// finds all variables in the expression tree and adds them to the list of variables.
+void find_variables(tree_node* node, list* variables)
 {
-    // pre-order traverse the tree.
+    // pre-order traverse the tree, pushing the right subtree first so the left subtree is visited first.
+    node_stack pending;
+    node_stack_init(&pending);
     if (node != NULL)
     {
-        if (node->token.type == variable)
+        node_stack_push(&pending, node);
+    }
+
+    while (pending.count > 0)
+    {
+        tree_node* current = node_stack_pop(&pending);
+        if (current->token.type == variable)
         {
             bool found = false;
             for (list_node* item = variables->first; item != NULL; item = item->next)
             {
                 variable_value* pair = item->payload;
-                if (pair->symbol == node->token.symbol)
+                if (pair->symbol == current->token.symbol)
                 {
                     found = true; // we have found this variable before because it is already in the list.
                     break;
@@ -68,50 +76,50 @@ void find_variables_recursive(tree_node* node, list* variables)
 
             if (found == false) // only add a variable to the list if we haven't found it before.
             {
-                variable_value* pair = variable_value_create(node->token.symbol, node->token.value);
+                variable_value* pair = variable_value_create(current->token.symbol, current->token.value);
                 list_push_back(variables, pair); // add this variable to the variables list
             }
         }
 
-        find_variables_recursive(node->left_child, variables); // traverse the left subtree.
-        find_variables_recursive(node->right_child, variables); // traverse the right subtree.
+        if (current->right_child != NULL) { node_stack_push(&pending, current->right_child); }
+        if (current->left_child != NULL) { node_stack_push(&pending, current->left_child); }
     }
-}
 
-// finds all variables in the expression tree and adds them to the list of variables.
-void find_variables(tree_node* node, list* variables)
-{
-    find_variables_recursive(node, variables);
+    node_stack_free(&pending);
 }
 
-// traverses the expression tree and gives a value to each variable.
-void set_variables_recursive(tree_node* node, list* variables)
+// sets values for each variable in the expression tree to be the same as that in the variables list.
+void set_variables(tree_node* node, list* variables)
 {
-    // pre-order traverse the tree.
+    // the order doesn't matter here, so each node's children are simply pushed after it is visited.
+    node_stack pending;
+    node_stack_init(&pending);
     if (node != NULL)
     {
-        if (node->token.type == variable)
+        node_stack_push(&pending, node);
+    }
+
+    while (pending.count > 0)
+    {
+        tree_node* current = node_stack_pop(&pending);
+        if (current->token.type == variable)
         {
             for (list_node* item = variables->first; item != NULL; item = item->next)
             {
                 variable_value* pair = item->payload;
-                if (pair->symbol == node->token.symbol)
+                if (pair->symbol == current->token.symbol)
                 {
                     // set the value of variable node to the same as that in the variables list.
-                    node->token.value = pair->value;
+                    current->token.value = pair->value;
                 }
             }
         }
 
-        set_variables_recursive(node->left_child, variables); // traverse the left subtree.
-        set_variables_recursive(node->right_child, variables); // traverse the right subtree.
+        if (current->left_child != NULL) { node_stack_push(&pending, current->left_child); }
+        if (current->right_child != NULL) { node_stack_push(&pending, current->right_child); }
     }
-}
 
-// sets values for each variable in the expression tree to be the same as that in the variables list.
-void set_variables(tree_node* node, list* variables)
-{
-    set_variables_recursive(node, variables);
+    node_stack_free(&pending);
 }
 
 // asks the user to set a value for each variable in the variables list.